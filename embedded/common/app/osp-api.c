@@ -23,6 +23,7 @@
 #include <string.h>
 #include "osp_embeddedalgcalls.h"
 #include "osp-version.h"
+#include "osp-sensordataqueue.h"
 
 
 /*-------------------------------------------------------------------------------------------------*\
@@ -35,8 +36,6 @@
 #define RESULT_FLAG_PAUSED              (1 << 0)
 #define MAX_SENSOR_DESCRIPTORS          8
 #define MAX_RESULT_DESCRIPTORS          5
-#define SENSOR_FG_DATA_Q_SIZE           8
-#define SENSOR_BG_DATA_Q_SIZE           8
 #define MAX_SENSORS_PER_RESULT          5
 
 //Sensor flags for internal use
@@ -72,11 +71,6 @@ typedef struct {
     uint16_t Flags;                 // Paused, etc
 } _ResDesc_t;
 
-typedef struct {
-    InputSensorHandle_t Handle;     // handle for this sensor
-    TriAxisSensorRawData_t Data;    // raw data & time stamp from sensor
-} _SensorDataBuffer_t;
-
 typedef struct {
     SensorType_t ResultType;        // result type
     uint16_t SensorCount;           // number of sensors required
@@ -119,19 +113,6 @@ static  _SenDesc_t _SensorTable[MAX_SENSOR_DESCRIPTORS];
 // pointers to result data structures, and local flags
 static _ResDesc_t _ResultTable[MAX_RESULT_DESCRIPTORS];
 
-// Raw sensor data queue for foreground processing
-static _SensorDataBuffer_t _SensorFgDataQueue[SENSOR_FG_DATA_Q_SIZE];
-static int16_t _SensorFgDataQCnt;          // number of data packets in the queue
-static uint16_t _SensorFgDataNqPtr = SENSOR_FG_DATA_Q_SIZE - 1; // where the last data packet was put into the queue
-static uint16_t _SensorFgDataDqPtr;         // where to remove next data packet from the queue
-
-
-// Raw sensor data queue for background processing
-static _SensorDataBuffer_t _SensorBgDataQueue[SENSOR_BG_DATA_Q_SIZE];
-static int16_t _SensorBgDataQCnt;          // number of data packets in the queue
-static uint16_t _SensorBgDataNqPtr = SENSOR_BG_DATA_Q_SIZE - 1; // where the last data packet was put into the queue
-static uint16_t _SensorBgDataDqPtr;         // where to remove next data packet from the queue
-
 static uint32_t _sensorLastForegroundTimeStamp = 0;             // keep the last time stamp here, we will use it to check for rollover
 static uint32_t _sensorLastForegroundTimeStampExtension = 0;    // we will re-create a larger raw time stamp here
 
@@ -470,28 +451,6 @@ static int16_t ValidateResultDescriptor(SensorDescriptor_t *pResultDescriptor)
 }
 
 
-/****************************************************************************************************
- * @fn      InvalidateQueuedDataByHandle
- *          Invalidates the handles for the sensor data in the queue so that the data is discarded
- *
- ***************************************************************************************************/
-void InvalidateQueuedDataByHandle(InputSensorHandle_t Handle)
-{
-    uint16_t i;
-
-    EnterCritical();
-    for(i = 0; i < SENSOR_FG_DATA_Q_SIZE; i++ ) {
-        if(_SensorFgDataQueue[i].Handle == Handle)
-            _SensorFgDataQueue[i].Handle = NULL;
-    }
-    for(i = 0; i < SENSOR_BG_DATA_Q_SIZE; i++ ) {
-        if(_SensorBgDataQueue[i].Handle == Handle)
-            _SensorBgDataQueue[i].Handle = NULL;
-    }
-    ExitCritical();
-}
-
-
 /****************************************************************************************************
  * @fn      TurnOnSensors
  *          Turns on sensors indicated by sensorsMask (bit mask based on SensorType_t bit position
@@ -780,13 +739,13 @@ static int32_t ScaleSensorData(
 /****************************************************************************************************
  * @fn      ConvertSensorData
  *          Given a pointer to a raw sensor data packet from the input queue of type
- *          _SensorDataBuffer_t and a pointer to a sensor output data packet of type
+ *          SensorDataBuffer_t and a pointer to a sensor output data packet of type
  *          TriAxisSensorCookedData_t, apply translations and conversions into a format per Android
  *          conventions. Accuracy must be either QFIXEDPOINTPRECISE or QFIXEDPOINTEXTENDED
  *
  ***************************************************************************************************/
 static int16_t ConvertSensorData(
-    _SensorDataBuffer_t *pRawData,
+    SensorDataBuffer_t *pRawData,
     Common_3AxisResult_t *pCookedData,
     uint8_t accuracy,
     uint32_t *sensorTimeStamp,
@@ -1033,8 +992,7 @@ osp_status_t OSP_UnregisterInputSensor(InputSensorHandle_t sensorHandle)
  ***************************************************************************************************/
 osp_status_t OSP_SetData(InputSensorHandle_t sensorHandle, TriAxisSensorRawData_t *data)
 {
-    register osp_status_t FgStatus = 0;
-    register osp_status_t BgStatus = 0;
+    osp_status_t status = OSP_STATUS_OK;
 
 
     if (data == NULL)                                           // just in case
@@ -1046,37 +1004,56 @@ osp_status_t OSP_SetData(InputSensorHandle_t sensorHandle, TriAxisSensorRawData_
 
     if( ((_SenDesc_t *)sensorHandle)->Flags & SENSOR_FLAG_IN_USE ) { // if this sensor is not used by a result, ignore data
 
-        // put sensor data into the foreground queue
-        FgStatus = OSP_STATUS_QUEUE_FULL;                       // assume queue full
-        EnterCritical();                                        // no interrupts while we diddle the queues
-        if(_SensorFgDataQCnt < SENSOR_FG_DATA_Q_SIZE) {         // check for room in the foreground queue
-            _SensorFgDataQCnt++;                                //  if so, show one more in the queue
-            if(++_SensorFgDataNqPtr == SENSOR_FG_DATA_Q_SIZE) { //  bump the enqueue pointer and check for pointer wrap, rewind if so
-                _SensorFgDataNqPtr = 0;
-            }
-            FgStatus = OSP_STATUS_OK;                           // FG queue isn't full
-        }
-        _SensorFgDataQueue[_SensorFgDataNqPtr].Handle = sensorHandle;
-        memcpy(&_SensorFgDataQueue[_SensorFgDataNqPtr].Data, data, sizeof(TriAxisSensorRawData_t)); // put data in queue (room or not)
-
-        // put sensor data into the background queue
-        BgStatus = OSP_STATUS_QUEUE_FULL;                       //    assume queue full
-        if(_SensorBgDataQCnt < SENSOR_BG_DATA_Q_SIZE) {         // check for room in the background queue
-            _SensorBgDataQCnt++;                                //  if so, show one more in the queue
-            if(++_SensorBgDataNqPtr == SENSOR_BG_DATA_Q_SIZE) { //  bump the enqueue pointer and check for pointer wrap, rewind if so
-                _SensorBgDataNqPtr = 0;
-            }
-            BgStatus = OSP_STATUS_OK;                           //    FG queue isn't full
-        }
-        _SensorBgDataQueue[_SensorBgDataNqPtr].Handle = sensorHandle;
-        memcpy(&_SensorBgDataQueue[_SensorBgDataNqPtr].Data, data, sizeof(TriAxisSensorRawData_t)); // put data in queue (room or not)
+        EnterCritical();                                        // no interrupts while we diddle the queue
+        status = EnqueueSensorData(sensorHandle, data);
         ExitCritical();
     }
 
-    if((FgStatus == OSP_STATUS_QUEUE_FULL) || (BgStatus == OSP_STATUS_QUEUE_FULL))
-        return OSP_STATUS_QUEUE_FULL;
-    else
-        return OSP_STATUS_OK;
+    return status;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSP_SetDataBatch
+ *          Queues a batch of samples from one sensor, e.g. read out of its hardware FIFO, as if
+ *          OSP_SetData() was called for each. The handle is checked and interrupts disabled once
+ *          for the whole batch, so a batch may hold at most SENSOR_DATA_Q_SIZE samples: a larger
+ *          one would only push out its own samples and keep interrupts off for longer
+ *
+ * @param   sensorHandle INPUT requires a valid handle as returned by OSP_RegisterInputSensor()
+ * @param   data INPUT array of raw sensor data, oldest first
+ * @param   count INPUT number of samples in data, at most SENSOR_DATA_Q_SIZE
+ * @param   timeStampDelta INPUT 0 if every sample carries its own time stamp, else the time between
+ *          samples: data[0].TimeStamp is the first sample's and the others are derived from it
+ *
+ * @return  status as specified in OSP_Types.h. OSP_STATUS_QUEUE_FULL if the batch pushed out data
+ *          a consumer had not processed yet, OSP_STATUS_INVALID_PARAMETER if count is larger than
+ *          the queue; nothing is queued then
+ *
+ ***************************************************************************************************/
+osp_status_t OSP_SetDataBatch(InputSensorHandle_t sensorHandle, TriAxisSensorRawData_t *data,
+    uint16_t count, uint32_t timeStampDelta)
+{
+    osp_status_t status = OSP_STATUS_OK;
+
+
+    if (data == NULL)                                           // just in case
+        return OSP_STATUS_NULL_POINTER;
+    if(sensorHandle == NULL)                                    // just in case
+        return OSP_STATUS_INVALID_HANDLE;
+    if(count > SENSOR_DATA_Q_SIZE)                              // split bigger FIFO reads up
+        return OSP_STATUS_INVALID_PARAMETER;
+    if(FindSensorTableIndexByHandle(sensorHandle) == ERROR)
+        return OSP_STATUS_INVALID_HANDLE;
+
+    if( ((_SenDesc_t *)sensorHandle)->Flags & SENSOR_FLAG_IN_USE ) { // if this sensor is not used by a result, ignore data
+
+        EnterCritical();                                        // no interrupts while we diddle the queue
+        status = EnqueueSensorDataBatch(sensorHandle, data, count, timeStampDelta);
+        ExitCritical();
+    }
+
+    return status;
 }
 
 
@@ -1091,37 +1068,15 @@ osp_status_t OSP_SetData(InputSensorHandle_t sensorHandle, TriAxisSensorRawData_
  ***************************************************************************************************/
 osp_status_t OSP_DoForegroundProcessing(void)
 {
-    _SensorDataBuffer_t data;
+    SensorDataBuffer_t data;
     Common_3AxisResult_t AndoidProcessedData;
     AndroidUnCalResult_t AndoidUncalProcessedData;
     int16_t index;
     Common_3AxisResult_t algConvention;
 
     // Get next sensor data packet from the queue. If nothing in the queue, return OSP_STATUS_IDLE.
-    // If we get a data packet that has a sensor handle of NULL, we should drop it and get the next one,
-    // a NULL handle is an indicator that the data is from a sensor that has been replaced or that the data is stale.
-
-    EnterCritical();                                        // no interrupts while we diddle the queue
-
-    // ignore any data marked as stale.
-    while( (_SensorFgDataQueue[_SensorFgDataDqPtr].Handle == NULL) && (_SensorFgDataQCnt != 0) ) {
-        _SensorFgDataQCnt--;                                // stale data, show one less in the queue
-        if(++_SensorFgDataDqPtr == SENSOR_FG_DATA_Q_SIZE)   //  and check for pointer wrap, rewind if so
-            _SensorFgDataDqPtr = 0;
-    }
-
-    // now see if there is any data to process.
-    if(_SensorFgDataQCnt == 0) {                            // check for queue empty
-        ExitCritical();
+    if(DequeueSensorData(SENSOR_DATA_FOREGROUND, &data) == FALSE)
         return OSP_STATUS_IDLE;                 // nothing left in the queue, let the caller know that
-    }
-
-    // There is at least 1 data packet in the queue, get it.
-    memcpy(&data, &_SensorFgDataQueue[_SensorFgDataDqPtr], sizeof(_SensorDataBuffer_t)); // remove data from queue
-    _SensorFgDataQCnt--;                                // show one less in the queue
-    if(++_SensorFgDataDqPtr == SENSOR_FG_DATA_Q_SIZE)   //  and check for pointer wrap, rewind if so
-        _SensorFgDataDqPtr = 0;
-    ExitCritical();
 
     // now send the processed data to the appropriate entry points in the alg code.
     switch( ((_SenDesc_t*)data.Handle)->pSenDesc->SensorType ) {
@@ -1275,7 +1230,7 @@ osp_status_t OSP_DoForegroundProcessing(void)
 
     // all done for now, return OSP_STATUS_IDLE if no more data in the queue, else return OSP_STATUS_OK
 
-    if(_SensorFgDataQCnt == 0)
+    if(SensorDataQueueEmpty(SENSOR_DATA_FOREGROUND))
         return OSP_STATUS_IDLE;                 // nothing left in the queue, let the caller know that
     else
         return OSP_STATUS_OK;                   // more to process
@@ -1293,36 +1248,13 @@ osp_status_t OSP_DoForegroundProcessing(void)
  ***************************************************************************************************/
 osp_status_t OSP_DoBackgroundProcessing(void)
 {
-    _SensorDataBuffer_t data;
+    SensorDataBuffer_t data;
     Common_3AxisResult_t AndoidProcessedData;
     //Common_3AxisResult_t algConvention;
 
     // Get next sensor data packet from the queue. If nothing in the queue, return OSP_STATUS_IDLE.
-    // If we get a data packet that has a sensor handle of NULL, we should drop it and get the next one,
-    // a NULL handle is an indicator that the data is from a sensor that has been replaced and that the data is stale.
-
-    EnterCritical();                                        // no interrupts while we diddle the queue
-
-    // ignore any data marked as stale.
-    while( (_SensorBgDataQueue[_SensorBgDataDqPtr].Handle == NULL) && (_SensorBgDataQCnt != 0) ) {
-        _SensorBgDataQCnt--;                                // stale data, show one less in the queue
-        if(++_SensorBgDataDqPtr == SENSOR_BG_DATA_Q_SIZE)   //  and check for pointer wrap, rewind if so
-            _SensorBgDataDqPtr = 0;
-    }
-
-    // now see if there is any data to process.
-    if(_SensorBgDataQCnt == 0) {                // check for queue empty
-        ExitCritical();
+    if(DequeueSensorData(SENSOR_DATA_BACKGROUND, &data) == FALSE)
         return OSP_STATUS_IDLE;                 // nothing left in the queue, let the caller know that
-    }
-
-    // There is at least 1 data packet in the queue, get it.
-    memcpy(&data, &_SensorBgDataQueue[_SensorBgDataDqPtr], sizeof(_SensorDataBuffer_t)); // remove data from queue
-    _SensorBgDataQCnt--;                                // show one less in the queue
-    if(++_SensorBgDataDqPtr == SENSOR_BG_DATA_Q_SIZE)   //  and check for pointer wrap, rewind if so
-        _SensorBgDataDqPtr = 0;
-
-    ExitCritical();
 
     // now send the processed data to the appropriate entry points in the alg calibration code.
     switch( ((_SenDesc_t*)data.Handle)->pSenDesc->SensorType ) {
@@ -1395,7 +1327,7 @@ osp_status_t OSP_DoBackgroundProcessing(void)
     }
 
     // all done for now, return OSP_STATUS_IDLE if no more data in the queue, else return OSP_STATUS_OK
-    if(_SensorBgDataQCnt == 0)
+    if(SensorDataQueueEmpty(SENSOR_DATA_BACKGROUND))
         return OSP_STATUS_IDLE;                 // nothing left in the queue, let the caller know that
     else
         return OSP_STATUS_OK;                   // more to process
@@ -0,0 +1,186 @@
+/* Open Sensor Platform Project
+ * https://github.com/sensorplatforms/open-sensor-platform
+ *
+ * Copyright (C) 2013 Sensor Platforms Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*-------------------------------------------------------------------------------------------------*\
+ |    I N C L U D E   F I L E S
+\*-------------------------------------------------------------------------------------------------*/
+#include "osp-sensordataqueue.h"
+#include <string.h>
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   T Y P E   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+typedef struct {
+    uint32_t DqCnt;                 // number of data packets this consumer took from the queue
+    uint32_t Overruns;              // data packets it lost by falling a full queue behind
+} _SensorDataReader_t;
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    S T A T I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+// Raw sensor data queue, read by both foreground and background processing. A data packet is put
+// in once; each of the two has its own read position and falls behind on its own.
+static SensorDataBuffer_t _SensorDataQueue[SENSOR_DATA_Q_SIZE];
+static uint32_t _SensorDataNqCnt;           // number of data packets put into the queue
+static _SensorDataReader_t _SensorDataReaders[NUM_SENSOR_DATA_CONSUMERS];
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      EnqueueSensorData
+ *          Puts a data packet into the queue. A consumer a full queue behind loses its oldest data
+ *          packet to this one. Call with interrupts disabled (EnterCritical)
+ *
+ ***************************************************************************************************/
+osp_status_t EnqueueSensorData(InputSensorHandle_t sensorHandle, const TriAxisSensorRawData_t *data)
+{
+    osp_status_t status = OSP_STATUS_OK;
+    SensorDataBuffer_t *pSlot;
+    uint16_t i;
+
+    for(i = 0; i < NUM_SENSOR_DATA_CONSUMERS; i++) {
+        if(_SensorDataNqCnt - _SensorDataReaders[i].DqCnt == SENSOR_DATA_Q_SIZE) {
+            _SensorDataReaders[i].DqCnt++;
+            _SensorDataReaders[i].Overruns++;
+            status = OSP_STATUS_QUEUE_FULL;
+        }
+    }
+
+    pSlot = &_SensorDataQueue[_SensorDataNqCnt % SENSOR_DATA_Q_SIZE];
+    pSlot->Handle = sensorHandle;
+    memcpy(&pSlot->Data, data, sizeof(TriAxisSensorRawData_t)); // the one copy both consumers read
+    _SensorDataNqCnt++;
+
+    return status;
+}
+
+
+/****************************************************************************************************
+ * @fn      EnqueueSensorDataBatch
+ *          Puts count data packets from one sensor into the queue, oldest first. With a non-zero
+ *          timeStampDelta, data[0].TimeStamp is the first packet's and each later one is delta
+ *          after the one before. Call with interrupts disabled (EnterCritical); count is at most
+ *          SENSOR_DATA_Q_SIZE, which bounds how long that is
+ *
+ ***************************************************************************************************/
+osp_status_t EnqueueSensorDataBatch(InputSensorHandle_t sensorHandle, const TriAxisSensorRawData_t *data,
+    uint16_t count, uint32_t timeStampDelta)
+{
+    osp_status_t status = OSP_STATUS_OK;
+    TriAxisSensorRawData_t sample;
+    uint16_t i;
+
+    if(timeStampDelta == 0) {
+        for(i = 0; i < count; i++) {
+            if(EnqueueSensorData(sensorHandle, &data[i]) != OSP_STATUS_OK)
+                status = OSP_STATUS_QUEUE_FULL;
+        }
+    } else if(count > 0) {
+        memcpy(&sample, &data[0], sizeof(TriAxisSensorRawData_t));
+        for(i = 0; i < count; i++) {
+            memcpy(sample.Data, data[i].Data, sizeof(sample.Data));
+            if(EnqueueSensorData(sensorHandle, &sample) != OSP_STATUS_OK)
+                status = OSP_STATUS_QUEUE_FULL;
+            sample.TimeStamp += timeStampDelta;                 // raw time stamps wrap, as the sensor's do
+        }
+    }
+
+    return status;
+}
+
+
+/****************************************************************************************************
+ * @fn      DequeueSensorData
+ *          Takes the next data packet a consumer has not seen from the queue, skipping stale ones
+ *          (NULL handle: the sensor was replaced or unregistered). Returns FALSE if there is none
+ *
+ ***************************************************************************************************/
+osp_bool_t DequeueSensorData(SensorDataConsumer_t consumer, SensorDataBuffer_t *pData)
+{
+    _SensorDataReader_t *pReader = &_SensorDataReaders[consumer];
+    const SensorDataBuffer_t *pSlot;
+
+    EnterCritical();                                        // no interrupts while we diddle the queue
+    while(pReader->DqCnt != _SensorDataNqCnt) {
+        pSlot = &_SensorDataQueue[pReader->DqCnt % SENSOR_DATA_Q_SIZE];
+        pReader->DqCnt++;
+        if(pSlot->Handle != NULL) {
+            memcpy(pData, pSlot, sizeof(SensorDataBuffer_t)); // copy out, the slot is reused once both consumers are past it
+            ExitCritical();
+            return TRUE;
+        }
+    }
+    ExitCritical();
+
+    return FALSE;
+}
+
+
+/****************************************************************************************************
+ * @fn      SensorDataQueueEmpty
+ *          TRUE if a consumer has taken every data packet put into the queue so far
+ *
+ ***************************************************************************************************/
+osp_bool_t SensorDataQueueEmpty(SensorDataConsumer_t consumer)
+{
+    return (_SensorDataReaders[consumer].DqCnt == _SensorDataNqCnt) ? TRUE : FALSE;
+}
+
+
+/****************************************************************************************************
+ * @fn      InvalidateQueuedDataByHandle
+ *          Invalidates the handles for the sensor data in the queue so that the data is discarded
+ *
+ ***************************************************************************************************/
+void InvalidateQueuedDataByHandle(InputSensorHandle_t Handle)
+{
+    uint16_t i;
+
+    EnterCritical();
+    for(i = 0; i < SENSOR_DATA_Q_SIZE; i++ ) {
+        if(_SensorDataQueue[i].Handle == Handle)
+            _SensorDataQueue[i].Handle = NULL;
+    }
+    ExitCritical();
+}
+
+
+/****************************************************************************************************
+ * @fn      OSP_GetSensorDataOverruns
+ *          Number of data packets foreground and background processing lost because they fell a
+ *          full queue behind OSP_SetData()
+ *
+ ***************************************************************************************************/
+void OSP_GetSensorDataOverruns(uint32_t *pFgOverruns, uint32_t *pBgOverruns)
+{
+    EnterCritical();
+    if (pFgOverruns != NULL)
+        *pFgOverruns = _SensorDataReaders[SENSOR_DATA_FOREGROUND].Overruns;
+    if (pBgOverruns != NULL)
+        *pBgOverruns = _SensorDataReaders[SENSOR_DATA_BACKGROUND].Overruns;
+    ExitCritical();
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E N D   O F   F I L E
+\*-------------------------------------------------------------------------------------------------*/
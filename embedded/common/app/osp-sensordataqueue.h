@@ -0,0 +1,74 @@
+/* Open Sensor Platform Project
+ * https://github.com/sensorplatforms/open-sensor-platform
+ *
+ * Copyright (C) 2013 Sensor Platforms Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#if !defined (OSP_SENSORDATAQUEUE_H)
+#define   OSP_SENSORDATAQUEUE_H
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    I N C L U D E   F I L E S
+\*-------------------------------------------------------------------------------------------------*/
+#include "common.h"
+#include "osp-api.h"
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    C O N S T A N T S   &   M A C R O S
+\*-------------------------------------------------------------------------------------------------*/
+#ifndef SENSOR_DATA_Q_SIZE                  // sensors with a hardware FIFO may want room for a whole batch
+#define SENSOR_DATA_Q_SIZE              8   // power of 2, so the free running counts wrap cleanly
+#endif
+
+#if (SENSOR_DATA_Q_SIZE < 1) || ((SENSOR_DATA_Q_SIZE & (SENSOR_DATA_Q_SIZE - 1)) != 0)
+#error "SENSOR_DATA_Q_SIZE must be a power of 2"
+#endif
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    T Y P E   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+typedef struct {
+    InputSensorHandle_t Handle;     // handle for this sensor
+    TriAxisSensorRawData_t Data;    // raw data & time stamp from sensor
+} SensorDataBuffer_t;
+
+/* Consumers of the queue, each with its own read position */
+typedef enum {
+    SENSOR_DATA_FOREGROUND,
+    SENSOR_DATA_BACKGROUND,
+    NUM_SENSOR_DATA_CONSUMERS
+} SensorDataConsumer_t;
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E X T E R N A L   V A R I A B L E S   &   F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+/* Critical section callbacks, see OSP_Initialize() */
+extern OSP_CriticalSectionCallback_t EnterCritical;
+extern OSP_CriticalSectionCallback_t ExitCritical;
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   F U N C T I O N   D E C L A R A T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+osp_status_t EnqueueSensorData(InputSensorHandle_t sensorHandle, const TriAxisSensorRawData_t *data);
+osp_status_t EnqueueSensorDataBatch(InputSensorHandle_t sensorHandle, const TriAxisSensorRawData_t *data,
+    uint16_t count, uint32_t timeStampDelta);
+osp_bool_t DequeueSensorData(SensorDataConsumer_t consumer, SensorDataBuffer_t *pData);
+osp_bool_t SensorDataQueueEmpty(SensorDataConsumer_t consumer);
+void InvalidateQueuedDataByHandle(InputSensorHandle_t Handle);
+
+
+#endif /* OSP_SENSORDATAQUEUE_H */
+/*-------------------------------------------------------------------------------------------------*\
+ |    E N D   O F   F I L E
+\*-------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,203 @@
+/* Open Sensor Platform Project
+ * https://github.com/sensorplatforms/open-sensor-platform
+ *
+ * Copyright (C) 2013 Sensor Platforms Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * sensordataqueue-bench: cost per sample of queuing a sensor's FIFO read-out one sample at a time,
+ * as OSP_SetData() does, against queuing it as one batch, as OSP_SetDataBatch() does, with and
+ * without a time stamp delta. Batches are 1, 8, 32 and 128 samples, up to SENSOR_DATA_Q_SIZE,
+ * the most OSP_SetDataBatch() takes; the build makes the queue 128 deep for this. The queue is
+ * drained between batches, outside the timing.
+ *
+ * EnterCritical and ExitCritical are an uncontended pthread mutex here, so the numbers
+ * overstate what a batch saves over interrupt disabling on the target. The handle lookup both
+ * calls make is not included either.
+ */
+/*-------------------------------------------------------------------------------------------------*\
+ |    I N C L U D E   F I L E S
+\*-------------------------------------------------------------------------------------------------*/
+#include <pthread.h>
+#include <time.h>
+
+#include "osp-sensordataqueue.h"
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   C O N S T A N T S   &   M A C R O S
+\*-------------------------------------------------------------------------------------------------*/
+#define BENCH_SAMPLES                   (1 << 21)   /* per batch size and method */
+#define BENCH_TIME_STAMP_DELTA          (10)
+#define NSEC_PER_SEC                    (1000000000LL)
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    S T A T I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+static pthread_mutex_t _criticalLock = PTHREAD_MUTEX_INITIALIZER;
+static int _sensor;                 // its address is the sensor handle
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    F O R W A R D   F U N C T I O N   D E C L A R A T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+static void _enterCritical(void);
+static void _exitCritical(void);
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+OSP_CriticalSectionCallback_t EnterCritical = &_enterCritical;
+OSP_CriticalSectionCallback_t ExitCritical = &_exitCritical;
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      _enterCritical
+ *          Critical section stand-in
+ *
+ ***************************************************************************************************/
+static void _enterCritical(void)
+{
+    pthread_mutex_lock(&_criticalLock);
+}
+
+
+/****************************************************************************************************
+ * @fn      _exitCritical
+ *          Ends a critical section started by _enterCritical()
+ *
+ ***************************************************************************************************/
+static void _exitCritical(void)
+{
+    pthread_mutex_unlock(&_criticalLock);
+}
+
+
+/****************************************************************************************************
+ * @fn      _nowNs
+ *          Monotonic time in nanoseconds
+ *
+ ***************************************************************************************************/
+static int64_t _nowNs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+}
+
+
+/****************************************************************************************************
+ * @fn      _drain
+ *          Empties the queue for both consumers
+ *
+ ***************************************************************************************************/
+static void _drain(void)
+{
+    SensorDataBuffer_t data;
+
+    while (DequeueSensorData(SENSOR_DATA_FOREGROUND, &data) == TRUE) {
+    }
+    while (DequeueSensorData(SENSOR_DATA_BACKGROUND, &data) == TRUE) {
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      _benchBatchSize
+ *          Times count-sample FIFO read-outs queued each way, ns per sample
+ *
+ ***************************************************************************************************/
+static void _benchBatchSize(const TriAxisSensorRawData_t *pFifo, uint16_t count)
+{
+    const InputSensorHandle_t handle = (InputSensorHandle_t)&_sensor;
+    int64_t singleNs = 0, batchNs = 0, deltaNs = 0, startNs;
+    uint32_t batches = BENCH_SAMPLES / count;
+    uint32_t b;
+    uint16_t i;
+
+    for (b = 0; b < batches; b++) {
+        startNs = _nowNs();
+        for (i = 0; i < count; i++) {
+            EnterCritical();
+            EnqueueSensorData(handle, &pFifo[i]);
+            ExitCritical();
+        }
+        singleNs += _nowNs() - startNs;
+        _drain();
+
+        startNs = _nowNs();
+        EnterCritical();
+        EnqueueSensorDataBatch(handle, pFifo, count, 0);
+        ExitCritical();
+        batchNs += _nowNs() - startNs;
+        _drain();
+
+        startNs = _nowNs();
+        EnterCritical();
+        EnqueueSensorDataBatch(handle, pFifo, count, BENCH_TIME_STAMP_DELTA);
+        ExitCritical();
+        deltaNs += _nowNs() - startNs;
+        _drain();
+    }
+
+    printf("  %5u  %12.1f  %12.1f  %12.1f\n", count, (double)singleNs / (batches * count),
+           (double)batchNs / (batches * count), (double)deltaNs / (batches * count));
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      main
+ *          Runs the benchmark for each batch size that fits the queue
+ *
+ ***************************************************************************************************/
+int main(void)
+{
+    static const uint16_t batchSizes[] = { 1, 8, 32, 128 };
+    static TriAxisSensorRawData_t fifo[SENSOR_DATA_Q_SIZE];
+    uint32_t fgOverruns, bgOverruns;
+    uint16_t count;
+    size_t b;
+
+    for (count = 0; count < SENSOR_DATA_Q_SIZE; count++) {
+        fifo[count].TimeStamp = count * BENCH_TIME_STAMP_DELTA;
+        fifo[count].Data[0] = fifo[count].Data[1] = fifo[count].Data[2] = (int16_t)count;
+    }
+
+    printf("queue of %d, ns per sample\n", SENSOR_DATA_Q_SIZE);
+    printf("  batch  one at a time         batch  batch+delta\n");
+    for (b = 0; b < sizeof(batchSizes) / sizeof(batchSizes[0]); b++) {
+        if (batchSizes[b] <= SENSOR_DATA_Q_SIZE) {
+            _benchBatchSize(fifo, batchSizes[b]);
+        }
+    }
+
+    OSP_GetSensorDataOverruns(&fgOverruns, &bgOverruns);
+    if (fgOverruns || bgOverruns) {
+        printf("unexpected overruns: fg %u bg %u\n", fgOverruns, bgOverruns);
+        return 1;
+    }
+
+    return 0;
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E N D   O F   F I L E
+\*-------------------------------------------------------------------------------------------------*/
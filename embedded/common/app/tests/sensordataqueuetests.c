@@ -0,0 +1,458 @@
+/* Open Sensor Platform Project
+ * https://github.com/sensorplatforms/open-sensor-platform
+ *
+ * Copyright (C) 2013 Sensor Platforms Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * sensordataqueue-tests: host checks of the raw sensor data queue, run by ctest. EnterCritical and
+ * ExitCritical are a pthread mutex, so the foreground and background consumers can be threads
+ * racing the producer the way the processing tasks race OSP_SetData() on the target.
+ * "sensordataqueue-tests <name>..." runs the named tests, no name runs all.
+ */
+/*-------------------------------------------------------------------------------------------------*\
+ |    I N C L U D E   F I L E S
+\*-------------------------------------------------------------------------------------------------*/
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "osp-sensordataqueue.h"
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   C O N S T A N T S   &   M A C R O S
+\*-------------------------------------------------------------------------------------------------*/
+#define THREAD_TEST_SAMPLES             (20000)
+#define THREAD_TEST_PAUSE_EVERY         (4)         /* samples between producer pauses */
+#define THREAD_TEST_PAUSE_US            (50)
+#define THREAD_TEST_BG_SPIN             (50)        /* makes the background consumer the slow one */
+#define BATCH_TEST_DELTA                (8)
+#define BATCH_TEST_LAG                  (3)         /* samples the background consumer is behind */
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   T Y P E   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+typedef struct {
+    const char *name;
+    int (*run)(void);
+} SensorDataQueueTest_t;
+
+/* What one consumer thread saw */
+typedef struct {
+    SensorDataConsumer_t consumer;
+    uint32_t received;              // samples dequeued
+    uint32_t skipped;               // time stamps missing between (and before) those dequeued
+    int errors;                     // samples out of order or torn
+} _ConsumerResult_t;
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    S T A T I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+static pthread_mutex_t _criticalLock = PTHREAD_MUTEX_INITIALIZER;
+static int _producerDone;           // set and read in critical sections
+static int _sensor;                 // its address is the sensor handle
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    F O R W A R D   F U N C T I O N   D E C L A R A T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+static void _enterCritical(void);
+static void _exitCritical(void);
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+OSP_CriticalSectionCallback_t EnterCritical = &_enterCritical;
+OSP_CriticalSectionCallback_t ExitCritical = &_exitCritical;
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      _enterCritical
+ *          Critical section stand-in: the consumers are threads rather than lower priority tasks
+ *
+ ***************************************************************************************************/
+static void _enterCritical(void)
+{
+    pthread_mutex_lock(&_criticalLock);
+}
+
+
+/****************************************************************************************************
+ * @fn      _exitCritical
+ *          Ends a critical section started by _enterCritical()
+ *
+ ***************************************************************************************************/
+static void _exitCritical(void)
+{
+    pthread_mutex_unlock(&_criticalLock);
+}
+
+
+/****************************************************************************************************
+ * @fn      _setData
+ *          Queues one sample the way OSP_SetData() does. The time stamp numbers the sample and every
+ *          axis carries it too, so a consumer can tell a torn copy
+ *
+ ***************************************************************************************************/
+static osp_status_t _setData(uint32_t sampleNumber)
+{
+    TriAxisSensorRawData_t sample;
+    osp_status_t status;
+
+    sample.TimeStamp = sampleNumber;
+    sample.Data[0] = sample.Data[1] = sample.Data[2] = (int16_t)sampleNumber;
+
+    EnterCritical();
+    status = EnqueueSensorData((InputSensorHandle_t)&_sensor, &sample);
+    ExitCritical();
+
+    return status;
+}
+
+
+/****************************************************************************************************
+ * @fn      _drain
+ *          Empties the queue for both consumers so a test starts from a known state
+ *
+ ***************************************************************************************************/
+static void _drain(void)
+{
+    SensorDataBuffer_t data;
+
+    while (DequeueSensorData(SENSOR_DATA_FOREGROUND, &data) == TRUE) {
+    }
+    while (DequeueSensorData(SENSOR_DATA_BACKGROUND, &data) == TRUE) {
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      _checkSample
+ *          Checks a dequeued sample follows the last one and was not torn, and counts the samples
+ *          skipped since. Returns the next expected sample number
+ *
+ ***************************************************************************************************/
+static uint32_t _checkSample(const SensorDataBuffer_t *pData, uint32_t expected,
+                             _ConsumerResult_t *pResult)
+{
+    const TriAxisSensorRawData_t *pSample = &pData->Data;
+
+    if ((pData->Handle != (InputSensorHandle_t)&_sensor) || (pSample->TimeStamp < expected) ||
+        (pSample->Data[0] != (int16_t)pSample->TimeStamp) ||
+        (pSample->Data[1] != pSample->Data[0]) || (pSample->Data[2] != pSample->Data[0])) {
+        pResult->errors++;
+        return expected;
+    }
+
+    pResult->skipped += pSample->TimeStamp - expected;
+    pResult->received++;
+
+    return pSample->TimeStamp + 1;
+}
+
+
+/****************************************************************************************************
+ * @fn      _consumerThread
+ *          Dequeues for one consumer until the producer is done and the queue is empty
+ *
+ ***************************************************************************************************/
+static void *_consumerThread(void *arg)
+{
+    _ConsumerResult_t *pResult = (_ConsumerResult_t *)arg;
+    SensorDataBuffer_t data;
+    uint32_t expected = 1;
+    volatile int spin;
+    int wasDone;
+
+    for (;;) {
+        EnterCritical();            // read before dequeuing: the last samples precede done
+        wasDone = _producerDone;
+        ExitCritical();
+        if (DequeueSensorData(pResult->consumer, &data) == TRUE) {
+            expected = _checkSample(&data, expected, pResult);
+            if (pResult->consumer == SENSOR_DATA_BACKGROUND) {
+                for (spin = 0; spin < THREAD_TEST_BG_SPIN; spin++) {
+                }
+            }
+        } else if (wasDone) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+
+/****************************************************************************************************
+ * @fn      _testOverrun
+ *          A consumer a full queue behind loses exactly its oldest samples, one overrun each, while
+ *          the other consumer keeps up
+ *
+ ***************************************************************************************************/
+static int _testOverrun(void)
+{
+    const uint32_t extra = 3;
+    _ConsumerResult_t fg = { SENSOR_DATA_FOREGROUND, 0, 0, 0 };
+    _ConsumerResult_t bg = { SENSOR_DATA_BACKGROUND, 0, 0, 0 };
+    uint32_t fgBefore, bgBefore, fgOverruns, bgOverruns, expected, i;
+    SensorDataBuffer_t data;
+    int full = 0;
+
+    _drain();
+    OSP_GetSensorDataOverruns(&fgBefore, &bgBefore);
+
+    expected = 1;
+    for (i = 1; i <= SENSOR_DATA_Q_SIZE + extra; i++) {
+        if (_setData(i) == OSP_STATUS_QUEUE_FULL) {
+            full++;
+        }
+        if (DequeueSensorData(SENSOR_DATA_FOREGROUND, &data) == TRUE) {
+            expected = _checkSample(&data, expected, &fg);
+        }
+    }
+    expected = 1;
+    while (DequeueSensorData(SENSOR_DATA_BACKGROUND, &data) == TRUE) {
+        expected = _checkSample(&data, expected, &bg);
+    }
+
+    OSP_GetSensorDataOverruns(&fgOverruns, &bgOverruns);
+    fgOverruns -= fgBefore;
+    bgOverruns -= bgBefore;
+    printf("overrun: queue %d, %u samples: fg %u received %u overruns, bg %u received %u overruns\n",
+           SENSOR_DATA_Q_SIZE, SENSOR_DATA_Q_SIZE + extra, fg.received, fgOverruns, bg.received,
+           bgOverruns);
+
+    if (fg.errors || bg.errors || (fgOverruns != 0) || (fg.received != SENSOR_DATA_Q_SIZE + extra) ||
+        (bgOverruns != extra) || (bg.received != SENSOR_DATA_Q_SIZE) || (bg.skipped != extra) ||
+        (full != (int)extra)) {
+        return -1;
+    }
+    return 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      _fillBatch
+ *          A FIFO read-out of count samples numbered from first, time stamps and axes as _setData()
+ *          makes them
+ *
+ ***************************************************************************************************/
+static void _fillBatch(TriAxisSensorRawData_t *pBatch, uint16_t count, uint32_t first)
+{
+    uint16_t i;
+
+    for (i = 0; i < count; i++) {
+        pBatch[i].TimeStamp = first + i;
+        pBatch[i].Data[0] = pBatch[i].Data[1] = pBatch[i].Data[2] = (int16_t)(first + i);
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      _testBatch
+ *          A batch queues its samples in order and copies their data. With a time stamp delta the
+ *          first sample's time stamp is counted on from, through a wrap, and the others' ignored.
+ *          A batch running a lagging consumer a full queue behind costs it its oldest samples,
+ *          one overrun each, and returns OSP_STATUS_QUEUE_FULL
+ *
+ ***************************************************************************************************/
+static int _testBatch(void)
+{
+    const uint32_t wrapStart = 0xFFFFFFFFu - BATCH_TEST_DELTA;
+    _ConsumerResult_t fg = { SENSOR_DATA_FOREGROUND, 0, 0, 0 };
+    _ConsumerResult_t bg = { SENSOR_DATA_BACKGROUND, 0, 0, 0 };
+    TriAxisSensorRawData_t batch[SENSOR_DATA_Q_SIZE];
+    uint32_t fgBefore, bgBefore, fgOverruns, bgOverruns, expected, i;
+    SensorDataBuffer_t data;
+    osp_status_t status;
+    int failures = 0;
+
+    _drain();
+    OSP_GetSensorDataOverruns(&fgBefore, &bgBefore);
+
+    /* Delta: time stamps from the first one on, data as read out */
+    _fillBatch(batch, SENSOR_DATA_Q_SIZE, 1);
+    batch[0].TimeStamp = wrapStart;
+    EnterCritical();
+    status = EnqueueSensorDataBatch((InputSensorHandle_t)&_sensor, batch, SENSOR_DATA_Q_SIZE,
+                                    BATCH_TEST_DELTA);
+    ExitCritical();
+    if (status != OSP_STATUS_OK) {
+        failures++;
+    }
+    for (i = 0; DequeueSensorData(SENSOR_DATA_FOREGROUND, &data) == TRUE; i++) {
+        if ((i >= SENSOR_DATA_Q_SIZE) || (data.Handle != (InputSensorHandle_t)&_sensor) ||
+            (data.Data.TimeStamp != wrapStart + i * BATCH_TEST_DELTA) ||
+            memcmp(data.Data.Data, batch[i].Data, sizeof(batch[i].Data))) {
+            printf("batch: delta sample %u has time stamp %u\n", i, data.Data.TimeStamp);
+            failures++;
+            break;
+        }
+    }
+    if (i != SENSOR_DATA_Q_SIZE) {
+        failures++;
+    }
+    _drain();
+
+    /* No delta, background BATCH_TEST_LAG samples behind a full queue's worth */
+    for (i = 1; i <= BATCH_TEST_LAG; i++) {
+        _setData(i);
+    }
+    expected = 1;
+    while (DequeueSensorData(SENSOR_DATA_FOREGROUND, &data) == TRUE) {
+        expected = _checkSample(&data, expected, &fg);
+    }
+    _fillBatch(batch, SENSOR_DATA_Q_SIZE, BATCH_TEST_LAG + 1);
+    EnterCritical();
+    status = EnqueueSensorDataBatch((InputSensorHandle_t)&_sensor, batch, SENSOR_DATA_Q_SIZE, 0);
+    ExitCritical();
+    while (DequeueSensorData(SENSOR_DATA_FOREGROUND, &data) == TRUE) {
+        expected = _checkSample(&data, expected, &fg);
+    }
+    expected = 1;
+    while (DequeueSensorData(SENSOR_DATA_BACKGROUND, &data) == TRUE) {
+        expected = _checkSample(&data, expected, &bg);
+    }
+
+    OSP_GetSensorDataOverruns(&fgOverruns, &bgOverruns);
+    fgOverruns -= fgBefore;
+    bgOverruns -= bgBefore;
+    printf("batch: queue %d, %d behind: %s, fg %u received %u overruns, bg %u received %u overruns\n",
+           SENSOR_DATA_Q_SIZE, BATCH_TEST_LAG,
+           (status == OSP_STATUS_QUEUE_FULL) ? "queue full" : "no queue full", fg.received,
+           fgOverruns, bg.received, bgOverruns);
+
+    if (failures || fg.errors || bg.errors || (status != OSP_STATUS_QUEUE_FULL) ||
+        (fgOverruns != 0) || (fg.received != SENSOR_DATA_Q_SIZE + BATCH_TEST_LAG) ||
+        (bgOverruns != BATCH_TEST_LAG) || (bg.received != SENSOR_DATA_Q_SIZE) ||
+        (bg.skipped != BATCH_TEST_LAG)) {
+        return -1;
+    }
+    return 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      _testThreads
+ *          Foreground and background consumer threads race the producer: each sees its samples in
+ *          order and untorn, and every sample is either received or counted as an overrun
+ *
+ ***************************************************************************************************/
+static int _testThreads(void)
+{
+    _ConsumerResult_t results[NUM_SENSOR_DATA_CONSUMERS];
+    uint32_t before[NUM_SENSOR_DATA_CONSUMERS], overruns[NUM_SENSOR_DATA_CONSUMERS];
+    pthread_t threads[NUM_SENSOR_DATA_CONSUMERS];
+    uint32_t i;
+    int c, failed = 0;
+
+    _drain();
+    OSP_GetSensorDataOverruns(&before[SENSOR_DATA_FOREGROUND], &before[SENSOR_DATA_BACKGROUND]);
+    _producerDone = 0;
+
+    memset(results, 0, sizeof(results));
+    for (c = 0; c < NUM_SENSOR_DATA_CONSUMERS; c++) {
+        results[c].consumer = (SensorDataConsumer_t)c;
+        if (pthread_create(&threads[c], NULL, _consumerThread, &results[c]) != 0) {
+            printf("threads: can't start consumer %d\n", c);
+            return -1;
+        }
+    }
+
+    for (i = 1; i <= THREAD_TEST_SAMPLES; i++) {
+        _setData(i);
+        if ((i % THREAD_TEST_PAUSE_EVERY) == 0) {
+            usleep(THREAD_TEST_PAUSE_US);
+        }
+    }
+    EnterCritical();
+    _producerDone = 1;
+    ExitCritical();
+
+    for (c = 0; c < NUM_SENSOR_DATA_CONSUMERS; c++) {
+        pthread_join(threads[c], NULL);
+    }
+    OSP_GetSensorDataOverruns(&overruns[SENSOR_DATA_FOREGROUND], &overruns[SENSOR_DATA_BACKGROUND]);
+
+    for (c = 0; c < NUM_SENSOR_DATA_CONSUMERS; c++) {
+        overruns[c] -= before[c];
+        printf("threads: %s %u received, %u overruns, %u skipped, %d out of order or torn\n",
+               (c == SENSOR_DATA_FOREGROUND) ? "fg" : "bg", results[c].received, overruns[c],
+               results[c].skipped, results[c].errors);
+        if (results[c].errors || (results[c].received + overruns[c] != THREAD_TEST_SAMPLES) ||
+            (results[c].skipped != overruns[c])) {
+            failed = 1;
+        }
+    }
+
+    return failed ? -1 : 0;
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      main
+ *          Runs the tests named on the command line, or all of them
+ *
+ ***************************************************************************************************/
+int main(int argc, char **argv)
+{
+    static const SensorDataQueueTest_t tests[] = {
+        { "queue-overrun", _testOverrun },
+        { "queue-threads", _testThreads },
+        { "queue-batch",   _testBatch },
+    };
+    const size_t numTests = sizeof(tests) / sizeof(tests[0]);
+    int failed = 0, selected, a;
+    size_t t;
+
+    for (a = 1; a < argc; a++) {
+        t = 0;
+        while ((t < numTests) && strcmp(argv[a], tests[t].name)) {
+            t++;
+        }
+        if (t == numTests) {
+            fprintf(stderr, "no test named %s\n", argv[a]);
+            return -1;
+        }
+    }
+
+    for (t = 0; t < numTests; t++) {
+        selected = (argc == 1);
+        for (a = 1; a < argc; a++) {
+            selected = selected || !strcmp(argv[a], tests[t].name);
+        }
+        if (!selected) {
+            continue;
+        }
+
+        printf("%s\n", tests[t].name);
+        if (tests[t].run() != 0) {
+            printf("%s FAILED\n", tests[t].name);
+            failed++;
+        }
+    }
+
+    return failed ? 1 : 0;
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E N D   O F   F I L E
+\*-------------------------------------------------------------------------------------------------*/
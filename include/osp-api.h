@@ -444,7 +444,9 @@ OSP_STATUS_t     OSP_ReplaceInputSensor(SensorDescriptor_t *pSensorDescriptor,
  *
  *  Queuing data for un-registered sensors (or as sensors that).
  *  Queue size defaults to 8, though is implementation dependent and available
- *  via SENSOR_FG_DATA_Q_SIZE.
+ *  via SENSOR_DATA_Q_SIZE. Foreground and background processing read the
+ *  queue independently; one that falls a full queue behind loses its oldest
+ *  sample and OSP_STATUS_QUEUE_FULL is returned.
  *
  *  \param sensorHandle INPUT requires a valid handle as returned by
  *      OSP_RegisterInputSensor()
@@ -455,6 +457,18 @@ OSP_STATUS_t     OSP_ReplaceInputSensor(SensorDescriptor_t *pSensorDescriptor,
 OSP_STATUS_t     OSP_SetInputData(InputSensorHandle_t SensorHandle, OSP_InputSensorData_t *data);
 
 
+//! number of samples foreground and background processing lost to a full
+//! input queue
+/*!
+ *  Counts since start up, one per sample a consumer lost by falling a
+ *  full queue (SENSOR_DATA_Q_SIZE) behind OSP_SetInputData().
+ *
+ *  \param pFgOverruns OUTPUT samples lost by foreground processing, may be NULL
+ *  \param pBgOverruns OUTPUT samples lost by background processing, may be NULL
+*/
+void             OSP_GetSensorDataOverruns(uint32_t *pFgOverruns, uint32_t *pBgOverruns);
+
+
 //! triggers computation for primary algorithms  e.g ROTATION_VECTOR
 /*!
  *  Separating OSP_DoForegroundProcessing and OSP_DoBackgroundProcessing calls
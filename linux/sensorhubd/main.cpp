@@ -25,18 +25,25 @@
 #include <csignal>
 
 #include <unistd.h>
+#include <stdint.h>
 #include <sys/time.h>
 #include <sys/stat.h>
-#include <sys/select.h>
 #include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/inotify.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <libgen.h>
 #include <time.h>
 
 #include "osp_debuglogging.h"
+#include "osp_eventloop.h"
+#include "osp_configuration.h"
 #include "virtualsensordevicemanager.h"
 #include "osp_remoteprocedurecalls.h"
+#include "osp_shmpublisher.h"
 
 /*-------------------------------------------------------------------------------------------------*\
  |    E X T E R N A L   V A R I A B L E S   &   F U N C T I O N S
@@ -45,13 +52,15 @@
 /*-------------------------------------------------------------------------------------------------*\
  |    P R I V A T E   C O N S T A N T S   &   M A C R O S
 \*-------------------------------------------------------------------------------------------------*/
-#define MAX_NUM_FDS(x,y)                ((x) > (y) ? (x) : (y))
 #define ACCEL_UINPUT_NAME               "osp-accelerometer"
 #define GYRO_UINPUT_NAME                "osp-gyroscope"
 #define MAG_UINPUT_NAME                 "osp-magnetometer"
 
 #define TWENTY_MS_IN_US                 (20000)
 #define ENABLE_PIPE_NAME_TEMPLATE       "/data/misc/osp-%s-enable"
+#define PERIODIC_WORK_MS                (10000)
+#define CONFIG_EVENT_BUF_SIZE           (4096)
+#define NSEC_PER_MSEC                   (1000000.0)
 
 /*-------------------------------------------------------------------------------------------------*\
  |    P R I V A T E   T Y P E   D E F I N I T I O N S
@@ -60,39 +69,74 @@ typedef enum {
     SENSORHUBD_ACCELEROMETER_INDEX,
     SENSORHUBD_MAGNETOMETER_INDEX,
     SENSORHUBD_GYROSCOPE_INDEX,
-    //SENSORHUBD_SIG_MOTION_INDEX,
-    //SENSORHUBD_STEP_COUNTER_INDEX,
+    SENSORHUBD_SIG_MOTION_INDEX,
+    SENSORHUBD_STEP_COUNTER_INDEX,
+    SENSORHUBD_STEP_DETECTOR_INDEX,
+    SENSORHUBD_ROTATION_VECTOR_INDEX,
+    SENSORHUBD_GAME_ROTATION_VECTOR_INDEX,
     SENSORHUBD_RESULT_INDEX_COUNT
 } SensorIndices_t;
 
+/* uinput device of a result */
+typedef struct {
+    const char* name;
+    const char* physName;
+    VsdmOverflowPolicy_t policy;
+} ResultDevice_t;
+
 /*-------------------------------------------------------------------------------------------------*\
  |    S T A T I C   V A R I A B L E S   D E F I N I T I O N S
 \*-------------------------------------------------------------------------------------------------*/
 static void _logErrorIf(bool condition, const char* msg);
 static void _fatalErrorIf(bool condition, int code, const char* msg);
-static void _handleQuitSignals(int signum);
 static void _initialize();
 static void _deinitialize();
 static void _parseAndHandleEnable(int sensorIndex, char* buffer, ssize_t numBytesInBuffer);
 static VirtualSensorDeviceManager* _pVsDevMgr;
+static EventLoop* _pEventLoop;
+static ShmSamplePublisher _shmPublisher;
 static int _evdevFds[SENSORHUBD_RESULT_INDEX_COUNT] ={-1};
+static const char* _configPath = NULL;
+static int _configWatchFd = -1;
+static bool _lazyDevices = false;
+static int64_t _startNs;
+static int64_t _configDoneNs;
 
 static int _enablePipeFds[SENSORHUBD_RESULT_INDEX_COUNT] ={-1};
 static const char* _sensorNames[SENSORHUBD_RESULT_INDEX_COUNT] = {
-    "accel", "mag", "gyro", /*"sig-motion", "step-count"*/};
+    "accel", "mag", "gyro", "sig-motion", "step-count", "step-detect", "rot-vec", "game-rot-vec"};
 
 static SensorType_t _ospResultCodes[SENSORHUBD_RESULT_INDEX_COUNT]= {
     SENSOR_ACCELEROMETER_UNCALIBRATED,
     SENSOR_MAGNETIC_FIELD_UNCALIBRATED,
     SENSOR_GYROSCOPE_UNCALIBRATED,
-    //SENSOR_CONTEXT_DEVICE_MOTION,
-    //SENSOR_STEP_COUNTER
+    SENSOR_CONTEXT_DEVICE_MOTION,
+    SENSOR_STEP_COUNTER,
+    SENSOR_STEP_DETECTOR,
+    SENSOR_ROTATION_VECTOR,
+    SENSOR_GAME_ROTATION_VECTOR
+};
+
+/* Values published per result: x/y/z, change detector type and duration, step count, step flag,
+   quaternion x/y/z/w */
+static const int _resultAxes[SENSORHUBD_RESULT_INDEX_COUNT] = {3, 3, 3, 2, 1, 1, 4, 4};
+
+static const ResultDevice_t _resultDevices[SENSORHUBD_RESULT_INDEX_COUNT] = {
+    {ACCEL_UINPUT_NAME,         "acc0",     VSDM_DROP_OLDEST},
+    {MAG_UINPUT_NAME,           "mag0",     VSDM_DROP_OLDEST},
+    {GYRO_UINPUT_NAME,          "gyr0",     VSDM_DROP_OLDEST},
+    {"osp-significant-motion",  "sigm0",    VSDM_NEVER_DROP},
+    {"osp-step-counter",        "stc0",     VSDM_NEVER_DROP},
+    {"osp-step-detector",       "std0",     VSDM_NEVER_DROP},
+    {"osp-rotation-vector",     "rv0",      VSDM_DROP_OLDEST},
+    {"osp-game-rotation-vector", "grv0",    VSDM_DROP_OLDEST},
 };
 
 /*-------------------------------------------------------------------------------------------------*\
  |    F O R W A R D   F U N C T I O N   D E C L A R A T I O N S
 \*-------------------------------------------------------------------------------------------------*/
 static void _onTriAxisSensorResultDataUpdate(SensorType_t sensorType, void* pData);
+static void _onResultBatchComplete(void);
 
 /*-------------------------------------------------------------------------------------------------*\
  |    P U B L I C   V A R I A B L E S   D E F I N I T I O N S
@@ -130,6 +174,160 @@ static void _fatalErrorIf(bool condition, int code, const char* msg)
 }
 
 
+/****************************************************************************************************
+ * @fn      _monotonicNs
+ *          Current CLOCK_MONOTONIC time in nanoseconds
+ *
+ ***************************************************************************************************/
+static int64_t _monotonicNs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+
+/****************************************************************************************************
+ * @fn      _createResultDevice
+ *          Creates the uinput device of a result unless it exists. Must happen before the result
+ *          is subscribed: the subscription publishes the fd to the result callbacks
+ *
+ ***************************************************************************************************/
+static void _createResultDevice(int index)
+{
+    const ResultDevice_t& device = _resultDevices[index];
+
+    if (_evdevFds[index] >= 0) {
+        return;
+    }
+
+    const int64_t startNs = _monotonicNs();
+    _evdevFds[index] = _pVsDevMgr->createSensor(device.name, device.physName, INT_MIN, INT_MAX,
+                                                _resultAxes[index], device.policy);
+    if (_evdevFds[index] < 0) {
+        LOG_Err("could not create uinput device %s\n", device.name);
+        return;
+    }
+    LOG_Info("uinput device %s created in %.2f ms\n", device.name,
+             (_monotonicNs() - startNs) / NSEC_PER_MSEC);
+}
+
+
+/****************************************************************************************************
+ * @fn      _usage
+ *          Prints the command line options
+ *
+ ***************************************************************************************************/
+static void _usage(const char* progName)
+{
+    fprintf(stderr,
+            "Usage: %s [-C config_file] [-r relay_path] [-w wakeup_path] [-H relay_path,wakeup_path]\n"
+            "          [-y sysfs_path] [-P] [-c capture_file] [-p replay_file] [-s speed]\n"
+            "          [-i hif_device] [-S shm_socket] [-l]\n"
+            "  -C  configuration file of \"key value...\" lines, reapplied whenever it is rewritten\n"
+            "  -r  base path of the relay buffers, <path><cpu>[.produced|.consumed]\n"
+            "  -w  read relay wakeups from this file/FIFO instead of the relay input device\n"
+            "  -H  also serve the hub at these relay buffers and wakeup file/FIFO; repeatable\n"
+            "  -y  base of the sensor enable/delay nodes, <path>/<uinput name>/<node>\n"
+            "  -P  drain each CPU's relay buffer from its own pinned thread\n"
+            "  -c  record every relay node read to a trace file\n"
+            "  -p  trace file played back by the replay backend\n"
+            "  -s  replay speed: 1 original, 2 twice as fast, ..., 0 as fast as possible\n"
+            "  -i  tty or other pollable device the hif backend reads host interface packets from\n"
+            "  -S  also serve samples through shared memory rings, requested on this socket\n"
+            "  -l  lazy start: no results are subscribed and no uinput devices exist until a\n"
+            "      client enables a sensor through its pipe\n"
+            "SIGUSR1 logs the pipeline latency histograms, SIGUSR2 logs and clears them\n",
+            progName);
+}
+
+
+/****************************************************************************************************
+ * @fn      _parseCommandLine
+ *          Command line options are applied as configuration overrides so they take precedence
+ *          over the defaults established at OSPD initialization
+ *
+ ***************************************************************************************************/
+static void _parseCommandLine(int argc, char** argv)
+{
+    int option;
+    int numHubs = 0;
+    char hubName[16];
+
+    while ((option = getopt(argc, argv, "C:r:w:H:y:Pc:p:s:i:S:lh")) != -1) {
+        switch (option) {
+        case 'C':
+            //options following -C take precedence over the file
+            _configPath = optarg;
+            if (OSPConfig::load(_configPath) == NULL) {
+                LOG_Err("could not load configuration file %s\n", _configPath);
+                _exit(-1);
+            }
+            break;
+
+        case 'r':
+            OSPConfig::overrideConfigItem(OSPConfig::PROTOCOL_RELAY_PATH, optarg);
+            break;
+
+        case 'w':
+            OSPConfig::overrideConfigItem(OSPConfig::PROTOCOL_RELAY_WAKEUP_PATH, optarg);
+            break;
+
+        case 'H': {
+            //"relay_path,wakeup_path", named after hub0, the hub of -r and -w
+            char* wakeupPath = strchr(optarg, ',');
+            if (wakeupPath == NULL) {
+                _usage(argv[0]);
+                _exit(-1);
+            }
+            *wakeupPath++ = '\0';
+            snprintf(hubName, sizeof(hubName), "hub%d", ++numHubs);
+            OSPConfig::overrideRelayHub(hubName, optarg, wakeupPath);
+            break;
+        }
+
+        case 'y':
+            OSPConfig::overrideConfigItem(OSPConfig::PROTOCOL_RELAY_SYSFS_PATH, optarg);
+            break;
+
+        case 'P':
+            OSPConfig::overrideConfigItemInt(OSPConfig::PROTOCOL_RELAY_PER_CPU_DRAIN, 1);
+            break;
+
+        case 'c':
+            OSPConfig::overrideConfigItem(OSPConfig::PROTOCOL_RELAY_CAPTURE_PATH, optarg);
+            break;
+
+        case 'p':
+            OSPConfig::overrideConfigItem(OSPConfig::PROTOCOL_REPLAY_PATH, optarg);
+            break;
+
+        case 's':
+            OSPConfig::overrideConfigItemFloat(OSPConfig::PROTOCOL_REPLAY_SPEED,
+                                               strtof(optarg, NULL));
+            break;
+
+        case 'i':
+            OSPConfig::overrideConfigItem(OSPConfig::PROTOCOL_HIF_PATH, optarg);
+            break;
+
+        case 'S':
+            OSPConfig::overrideConfigItem(OSPConfig::PROTOCOL_SHM_SOCKET_PATH, optarg);
+            break;
+
+        case 'l':
+            _lazyDevices = true;
+            break;
+
+        default:
+            _usage(argv[0]);
+            _exit(option == 'h' ? 0 : -1);
+        }
+    }
+}
+
+
 /****************************************************************************************************
  * @fn      _parseAndHandleEnable
  *          Helper routine for enabling/disabling sensors in the system
@@ -158,10 +356,24 @@ static void _parseAndHandleEnable(int sensorIndex, char* buffer, ssize_t numByte
         _logErrorIf(status != OSP_STATUS_OK, "error unsubscribing from result\n");
 
     } else if ('1' == buffer[0]) {
-        LOG_Info("Subscribe to sensor index %d\n", (int)sensorIndex);
-        osp_status_t status= OSPD_SubscribeResult(_ospResultCodes[sensorIndex], _onTriAxisSensorResultDataUpdate);
+        //"1 <period us> <max report latency us>" asks for a decimated and/or batched stream
+        char* pNext;
+        const uint32_t periodUs = strtoul(buffer + 1, &pNext, 10);
+        const uint32_t maxReportLatencyUs = strtoul(pNext, NULL, 10);
+
+        LOG_Info("Subscribe to sensor index %d, period %u us, max report latency %u us\n",
+                 (int)sensorIndex, periodUs, maxReportLatencyUs);
+        _createResultDevice(sensorIndex);
+        osp_status_t status= OSPD_SubscribeResult(_ospResultCodes[sensorIndex],
+                                                  _onTriAxisSensorResultDataUpdate, periodUs,
+                                                  maxReportLatencyUs);
         _logErrorIf(status != OSP_STATUS_OK, "error subscribing to result\n");
 
+    } else if ('f' == buffer[0]) {
+        LOG_Info("Flush sensor index %d\n", (int)sensorIndex);
+        osp_status_t status= OSPD_FlushResult(_ospResultCodes[sensorIndex]);
+        _logErrorIf(status != OSP_STATUS_OK, "error flushing result\n");
+
     } else {
         //LOG_Err("unexpected data in enable buffer: %s", buffer);
     }
@@ -191,7 +403,9 @@ static void _initializeNamedPipes()
 
         _fatalErrorIf(mkfifo(pipename, 0666) != 0, -1, "could not create named pipe");
 
-        fd = open(pipename, O_RDONLY|O_NONBLOCK);
+        //Opened read-write so the FIFO always has a writer: it never reports EOF when a client
+        //closes its end, and we never have to reopen it
+        fd = open(pipename, O_RDWR|O_NONBLOCK);
         _fatalErrorIf(fd < 0, -1, "could not open named pipe for reading");
         _enablePipeFds[i]= fd;
     }
@@ -201,71 +415,52 @@ static void _initializeNamedPipes()
 
 /****************************************************************************************************
  * @fn      _onTriAxisSensorResultDataUpdate
- *          Common callback for sensor data or results received from the hub
+ *          Common callback for sensor data or results received from the hub; the result type
+ *          selects the uinput device and ring, its axis count what is published
  *
  ***************************************************************************************************/
 static void _onTriAxisSensorResultDataUpdate(SensorType_t sensorType, void* pData)
 {
     OSPD_ThreeAxisData_t* pSensorData= (OSPD_ThreeAxisData_t*)pData;
-    int32_t uinputCompatibleDataFormat[3];
-
-
-    switch(sensorType)  {
-
-    case SENSOR_ACCELEROMETER_UNCALIBRATED:
-        uinputCompatibleDataFormat[0] = pSensorData->data[0].i;
-        uinputCompatibleDataFormat[1] = pSensorData->data[1].i;
-        uinputCompatibleDataFormat[2] = pSensorData->data[2].i;
-#if 0
-        LOGS("RA %.3f (0x%8x), %.3f (0x%8x), %.3f (0x%8x), %lld\n",
-             pSensorData->data[0].f, uinputCompatibleDataFormat[0],
-             pSensorData->data[1].f, uinputCompatibleDataFormat[1],
-             pSensorData->data[2].f, uinputCompatibleDataFormat[2],
-             pSensorData->timestamp.ll);
-#endif
-        _pVsDevMgr->publish(
-                    _evdevFds[SENSORHUBD_ACCELEROMETER_INDEX],
-                    uinputCompatibleDataFormat,
-                    pSensorData->timestamp.ll);
-        break;
-
-
-    case SENSOR_MAGNETIC_FIELD_UNCALIBRATED:
-        uinputCompatibleDataFormat[0] = pSensorData->data[0].i;
-        uinputCompatibleDataFormat[1] = pSensorData->data[1].i;
-        uinputCompatibleDataFormat[2] = pSensorData->data[2].i;
-
-        _pVsDevMgr->publish(
-                    _evdevFds[SENSORHUBD_MAGNETOMETER_INDEX],
-                    uinputCompatibleDataFormat,
-                    pSensorData->timestamp.ll);
-        break;
-
-    case SENSOR_GYROSCOPE_UNCALIBRATED:
-        uinputCompatibleDataFormat[0] = pSensorData->data[0].i;
-        uinputCompatibleDataFormat[1] = pSensorData->data[1].i;
-        uinputCompatibleDataFormat[2] = pSensorData->data[2].i;
-
-        _pVsDevMgr->publish(
-                    _evdevFds[SENSORHUBD_GYROSCOPE_INDEX],
-                    uinputCompatibleDataFormat,
-                    pSensorData->timestamp.ll);
-        break;
-#if 0
-    case SENSOR_CONTEXT_DEVICE_MOTION: 
-        //LOGS("SIGM %.3f (0x%8x), %.3f (0x%8x), %.3f (0x%8x)\n", pSensorData->data[0]);
-
-        uinputCompatibleDataFormat[0]= (int)(pSensorData->data[0]);
-        timeInNano= (int64_t)(NSEC_PER_SEC * pSensorData->timestamp);
-
-        _pVsDevMgr->publish(_evdevFds[SENSORHUBD_SIG_MOTION_INDEX], uinputCompatibleDataFormat, timeInNano, 1);
-        break;
-#endif
-    default:
+    int32_t uinputCompatibleDataFormat[VSDM_MAX_AXIS];
+    int index;
+
+    for (index = 0; index < SENSORHUBD_RESULT_INDEX_COUNT; index++) {
+        if (_ospResultCodes[index] == sensorType) {
+            break;
+        }
+    }
+    if (index == SENSORHUBD_RESULT_INDEX_COUNT) {
         LOG_Err("%s unexpected result type %d\n", __FUNCTION__, sensorType);
-        break;
+        return;
+    }
+
+    //float results go out as their bit patterns, integer results as they are
+    for (int i = 0; i < _resultAxes[index]; i++) {
+        uinputCompatibleDataFormat[i] = pSensorData->data[i].i;
     }
 
+    _pVsDevMgr->queue(
+                _evdevFds[index],
+                uinputCompatibleDataFormat,
+                pSensorData->timestamp.ll,
+                _resultAxes[index]);
+    _shmPublisher.publish(index, sensorType, uinputCompatibleDataFormat, _resultAxes[index],
+                          pSensorData->timestamp.ll);
+}
+
+
+/****************************************************************************************************
+ * @fn      _onResultBatchComplete
+ *          Called once the results of a relay wakeup are delivered; pushes the frames queued by
+ *          _onTriAxisSensorResultDataUpdate out with one write per uinput device and wakes the
+ *          shared memory readers
+ *
+ ***************************************************************************************************/
+static void _onResultBatchComplete(void)
+{
+    _pVsDevMgr->flush();
+    _shmPublisher.ringDoorbells();
 }
 
 
@@ -288,11 +483,20 @@ static void _subscribeToAllResults()
     status = OSPD_SubscribeResult(SENSOR_GYROSCOPE_UNCALIBRATED, _onTriAxisSensorResultDataUpdate);
     _logErrorIf(status != OSP_STATUS_OK, "error subscribing to SENSOR_GYROSCOPE");
 
-    //    status = OSPD_SubscribeResult(SENSOR_CONTEXT_DEVICE_MOTION, _onTriAxisSensorResultDataUpdate);
-    //    _logErrorIf(status != OSP_STATUS_OK, "error subscribing to SENSOR_CONTEXT_DEVICE_MOTION");
+    status = OSPD_SubscribeResult(SENSOR_CONTEXT_DEVICE_MOTION, _onTriAxisSensorResultDataUpdate);
+    _logErrorIf(status != OSP_STATUS_OK, "error subscribing to SENSOR_CONTEXT_DEVICE_MOTION");
 
-    //    status = OSPD_SubscribeResult(SENSOR_STEP_COUNTER, _onTriAxisSensorResultDataUpdate);
-    //    _logErrorIf(status != OSP_STATUS_OK, "error subscribing to SENSOR_STEP_COUNTER");
+    status = OSPD_SubscribeResult(SENSOR_STEP_COUNTER, _onTriAxisSensorResultDataUpdate);
+    _logErrorIf(status != OSP_STATUS_OK, "error subscribing to SENSOR_STEP_COUNTER");
+
+    status = OSPD_SubscribeResult(SENSOR_STEP_DETECTOR, _onTriAxisSensorResultDataUpdate);
+    _logErrorIf(status != OSP_STATUS_OK, "error subscribing to SENSOR_STEP_DETECTOR");
+
+    status = OSPD_SubscribeResult(SENSOR_ROTATION_VECTOR, _onTriAxisSensorResultDataUpdate);
+    _logErrorIf(status != OSP_STATUS_OK, "error subscribing to SENSOR_ROTATION_VECTOR");
+
+    status = OSPD_SubscribeResult(SENSOR_GAME_ROTATION_VECTOR, _onTriAxisSensorResultDataUpdate);
+    _logErrorIf(status != OSP_STATUS_OK, "error subscribing to SENSOR_GAME_ROTATION_VECTOR");
 
 }
 
@@ -308,16 +512,24 @@ static void _initialize()
 
     LOGT("%s:%d\r\n", __FUNCTION__, __LINE__);
 
-    //create our raw input virtual sensors
-    _evdevFds[SENSORHUBD_ACCELEROMETER_INDEX] = _pVsDevMgr->createSensor(ACCEL_UINPUT_NAME, "acc0",  INT_MIN, INT_MAX);
-    _evdevFds[SENSORHUBD_MAGNETOMETER_INDEX] = _pVsDevMgr->createSensor(MAG_UINPUT_NAME, "mag0",  INT_MIN, INT_MAX);
-    _evdevFds[SENSORHUBD_GYROSCOPE_INDEX] = _pVsDevMgr->createSensor(GYRO_UINPUT_NAME, "gyr0",  INT_MIN, INT_MAX);
-    //_evdevFds[SENSORHUBD_SIG_MOTION_INDEX]= _pVsDevMgr->createSensor("osp-significant-motion", "sigm0",  INT_MIN, INT_MAX);
-    //_evdevFds[SENSORHUBD_STEP_COUNTER_INDEX]= _pVsDevMgr->createSensor("osp-step-counter", "stc0",  INT_MIN, INT_MAX);
+    //create our raw input virtual sensors, or leave that to the first subscription of each
+    const int64_t devicesStartNs = _monotonicNs();
+    for (int i = 0; i < SENSORHUBD_RESULT_INDEX_COUNT; i++) {
+        _evdevFds[i] = -1;
+        if (!_lazyDevices) {
+            _createResultDevice(i);
+        }
+    }
+    const int64_t devicesDoneNs = _monotonicNs();
+
+    //frames queued from the result callbacks get flushed once per relay wakeup
+    status= OSPD_SetBatchCompleteCallback(_onResultBatchComplete);
+    _logErrorIf(status != OSP_STATUS_OK, "error registering batch complete callback");
 
     //Initialize OSP Daemon
     LOGT("%s:%d\r\n", __FUNCTION__, __LINE__);
     status= OSPD_Initialize();
+    const int64_t backendDoneNs = _monotonicNs();
 
     LOGT("%s:%d\r\n", __FUNCTION__, __LINE__);
     _fatalErrorIf(status!= OSP_STATUS_OK, status, "Failed on OSP Daemon Initialization!");
@@ -329,9 +541,27 @@ static void _initialize()
 
     _initializeNamedPipes();
 
+    //shared memory rings are served in addition to the uinput devices
+    const OSPConfig::Snapshot_t* pConfig = OSPConfig::snapshot();
+    if ((pConfig != NULL) && !pConfig->shmSocketPath.empty()) {
+        _logErrorIf(_shmPublisher.open(_pEventLoop, pConfig->shmSocketPath.c_str(), _sensorNames,
+                                       SENSORHUBD_RESULT_INDEX_COUNT) < 0,
+                    "could not start shared memory sample rings");
+    }
+
     //!!! Debug only
-    _subscribeToAllResults();
+    if (!_lazyDevices) {
+        _subscribeToAllResults();
+    }
 
+    const int64_t doneNs = _monotonicNs();
+    LOG_Info("Startup %.2f ms: configuration %.2f, uinput devices %.2f (%s), OSPD backend %.2f, "
+             "pipes/rings/subscriptions %.2f\n",
+             (doneNs - _startNs) / NSEC_PER_MSEC,
+             (_configDoneNs - _startNs) / NSEC_PER_MSEC,
+             (devicesDoneNs - devicesStartNs) / NSEC_PER_MSEC, _lazyDevices ? "lazy" : "eager",
+             (backendDoneNs - devicesDoneNs) / NSEC_PER_MSEC,
+             (doneNs - backendDoneNs) / NSEC_PER_MSEC);
 }
 
 
@@ -353,11 +583,20 @@ static void _stopAllResults()
     status= OSPD_UnsubscribeResult(SENSOR_GYROSCOPE_UNCALIBRATED);
     _logErrorIf(status != OSP_STATUS_OK, "error unsubscribing to SENSOR_GYROSCOPE_UNCALIBRATED");
 
-    //    status= OSPD_UnsubscribeResult(SENSOR_CONTEXT_DEVICE_MOTION);
-    //    _logErrorIf(status != OSP_STATUS_OK, "error unsubscribing to SENSOR_CONTEXT_DEVICE_MOTION");
+    status= OSPD_UnsubscribeResult(SENSOR_CONTEXT_DEVICE_MOTION);
+    _logErrorIf(status != OSP_STATUS_OK, "error unsubscribing to SENSOR_CONTEXT_DEVICE_MOTION");
 
     status= OSPD_UnsubscribeResult(SENSOR_STEP_COUNTER);
     _logErrorIf(status != OSP_STATUS_OK, "error unsubscribing to SENSOR_STEP_COUNTER");
+
+    status= OSPD_UnsubscribeResult(SENSOR_STEP_DETECTOR);
+    _logErrorIf(status != OSP_STATUS_OK, "error unsubscribing to SENSOR_STEP_DETECTOR");
+
+    status= OSPD_UnsubscribeResult(SENSOR_ROTATION_VECTOR);
+    _logErrorIf(status != OSP_STATUS_OK, "error unsubscribing to SENSOR_ROTATION_VECTOR");
+
+    status= OSPD_UnsubscribeResult(SENSOR_GAME_ROTATION_VECTOR);
+    _logErrorIf(status != OSP_STATUS_OK, "error unsubscribing to SENSOR_GAME_ROTATION_VECTOR");
 }
 
 /****************************************************************************************************
@@ -372,20 +611,226 @@ static void _deinitialize()
     _stopAllResults();
 
     OSPD_Deinitialize();
+
+    //after OSPD_Deinitialize, no more results are published into the rings
+    _shmPublisher.close();
+
+    if (_configWatchFd >= 0) {
+        close(_configWatchFd);
+        _configWatchFd = -1;
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      _watchConfigFile
+ *          Watches the directory of the configuration file so that both in-place rewrites and
+ *          editors that rename a new file over it are seen
+ *
+ ***************************************************************************************************/
+static int _watchConfigFile(const char* path)
+{
+    char directory[PATH_MAX];
+
+    strncpy(directory, path, sizeof(directory) - 1);
+    directory[sizeof(directory) - 1] = '\0';
+
+    _configWatchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (_configWatchFd < 0) {
+        return -1;
+    }
+    if (inotify_add_watch(_configWatchFd, dirname(directory), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        close(_configWatchFd);
+        _configWatchFd = -1;
+        return -1;
+    }
+    return _configWatchFd;
+}
+
+
+/****************************************************************************************************
+ * @fn      _onConfigFileChanged
+ *          Event loop handler for the configuration file watch. The file is parsed and validated
+ *          here, away from the sample path; only a file that is valid as a whole gets applied
+ *
+ ***************************************************************************************************/
+static void _onConfigFileChanged(int fd, uint32_t events, void* pContext)
+{
+    char eventBuf[CONFIG_EVENT_BUF_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+    char pathCopy[PATH_MAX];
+    const char* configName;
+    bool changed = false;
+    ssize_t bytesRead;
+
+    strncpy(pathCopy, _configPath, sizeof(pathCopy) - 1);
+    pathCopy[sizeof(pathCopy) - 1] = '\0';
+    configName = basename(pathCopy);
+
+    while ((bytesRead = read(fd, eventBuf, sizeof(eventBuf))) > 0) {
+        for (char* p = eventBuf; p < eventBuf + bytesRead;) {
+            const struct inotify_event* pEvent = (const struct inotify_event*)p;
+
+            if ((pEvent->len > 0) && (strcmp(pEvent->name, configName) == 0)) {
+                changed = true;
+            }
+            p += sizeof(struct inotify_event) + pEvent->len;
+        }
+    }
+    if (!changed) {
+        return;
+    }
+
+    if (OSPConfig::load(_configPath) == NULL) {
+        LOG_Err("configuration file %s rejected, keeping the running configuration\n",
+                _configPath);
+        return;
+    }
+    LOG_Info("configuration file %s reloaded\n", _configPath);
+    osp_status_t status = OSPD_ReloadConfiguration();
+    _logErrorIf(status != OSP_STATUS_OK, "error applying reloaded configuration");
+
+    //the snapshot is only read on this thread, and nothing here keeps a pointer to it
+    OSPConfig::quiescent();
+    OSPConfig::reclaim();
+}
+
+
+/****************************************************************************************************
+ * @fn      _onEnablePipeReadable
+ *          Event loop handler for sensor enable/disable requests on a named pipe
+ *
+ ***************************************************************************************************/
+static void _onEnablePipeReadable(int fd, uint32_t events, void* pContext)
+{
+    const int sensorIndex = (int)(intptr_t)pContext;
+    char readBuf[255];
+    ssize_t bytesRead;
+
+    _logErrorIf(events & EPOLLERR, "error on FD!\n");
+
+    while ((bytesRead = read(fd, readBuf, sizeof(readBuf) - 1)) > 0) {
+        readBuf[bytesRead] = '\0';
+        _parseAndHandleEnable(sensorIndex, readBuf, bytesRead);
+    }
+    _logErrorIf((bytesRead < 0) && (errno != EAGAIN), "failed on read of enable pipe");
+}
+
+
+/****************************************************************************************************
+ * @fn      _onRelayWakeup
+ *          Event loop handler for the sensor data wakeup of the OSPD backend
+ *
+ ***************************************************************************************************/
+static void _onRelayWakeup(int fd, uint32_t events, void* pContext)
+{
+    osp_status_t status = OSPD_ProcessWakeup();
+    _logErrorIf(status != OSP_STATUS_OK, "error processing sensor data wakeup");
+}
+
+
+/****************************************************************************************************
+ * @fn      _onUinputWritable
+ *          Event loop handler for uinput devices with queued frames that can take them now
+ *
+ ***************************************************************************************************/
+static void _onUinputWritable(int fd, uint32_t events, void* pContext)
+{
+    _pVsDevMgr->retryWrites();
 }
 
 
 /****************************************************************************************************
- * @fn      _handleQuitSignals
- *          Handler for linux exit/terminate signal for the application
+ * @fn      _onPeriodicTimer
+ *          Periodic housekeeping; reports event loop wakeups and CPU time used since last period
  *
  ***************************************************************************************************/
-static void _handleQuitSignals(int signum)
+static void _onPeriodicTimer(int fd, uint32_t events, void* pContext)
 {
+    static uint64_t lastWakeups = 0;
+    static uint64_t lastCpuUs = 0;
+    uint64_t expirations;
+    uint64_t cpuUs;
+    struct rusage usage;
+
+    if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        return;
+    }
+
+    getrusage(RUSAGE_SELF, &usage);
+    cpuUs = (uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 +
+            usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+
+    const EventLoopStats_t& stats = _pEventLoop->getStats();
+    LOG_Info("event loop: %.1f wakeups/s, cpu %.2f%%\n",
+             (stats.wakeups - lastWakeups) * 1000.0 / (PERIODIC_WORK_MS * expirations),
+             (cpuUs - lastCpuUs) / (10.0 * PERIODIC_WORK_MS * expirations));
+
+    OSPD_RelayStats_t relayStats;
+    if (OSPD_GetRelayStats(&relayStats) == OSP_STATUS_OK) {
+        LOG_Info("relay ring: %u/%u (high %u), %llu overruns, %llu drained, %llu published\n",
+                 relayStats.ringOccupancy, relayStats.ringCapacity, relayStats.ringHighWater,
+                 (unsigned long long)relayStats.ringOverruns,
+                 (unsigned long long)relayStats.samplesDrained,
+                 (unsigned long long)relayStats.samplesPublished);
+        if (relayStats.nodesDecoded) {
+            LOG_Info("relay decode: %llu nodes, %.1f ns/node\n",
+                     (unsigned long long)relayStats.nodesDecoded,
+                     (double)relayStats.decodeNs / relayStats.nodesDecoded);
+            LOG_Info("hub clock: %+.2f ppm vs. host, %llu outliers\n",
+                     relayStats.hubClockSkewPpm,
+                     (unsigned long long)relayStats.hubClockOutliers);
+        }
+        for (uint32_t i = 0; (relayStats.numHubs > 1) && (i < relayStats.numHubs); i++) {
+            LOG_Info("relay hub %u: %llu drained\n", i,
+                     (unsigned long long)relayStats.hubSamplesDrained[i]);
+        }
+    }
+
+    for (int i = 0; i < SENSORHUBD_RESULT_INDEX_COUNT; i++) {
+        const uint64_t dropped = _pVsDevMgr->getDropped(_evdevFds[i]);
+        if (dropped) {
+            LOG_Info("uinput %s: %llu frames dropped\n", _sensorNames[i],
+                     (unsigned long long)dropped);
+        }
+    }
+
+    lastWakeups = stats.wakeups;
+    lastCpuUs = cpuUs;
+}
+
+
+/****************************************************************************************************
+ * @fn      _onQuitSignal
+ *          Handler for linux exit/terminate signals, delivered through the event loop
+ *
+ ***************************************************************************************************/
+static void _onQuitSignal(int fd, uint32_t events, void* pContext)
+{
+    struct signalfd_siginfo sigInfo;
+
     LOGT("%s\r\n", __FUNCTION__);
 
-    _deinitialize();
-    exit(0);
+    if (read(fd, &sigInfo, sizeof(sigInfo)) == sizeof(sigInfo)) {
+        LOG_Info("Exiting on signal %d\n", (int)sigInfo.ssi_signo);
+    }
+    _pEventLoop->stop();
+}
+
+
+/****************************************************************************************************
+ * @fn      _onLatencyDumpSignal
+ *          SIGUSR1 dumps the pipeline latency histograms, SIGUSR2 dumps and clears them
+ *
+ ***************************************************************************************************/
+static void _onLatencyDumpSignal(int fd, uint32_t events, void* pContext)
+{
+    struct signalfd_siginfo sigInfo;
+
+    if (read(fd, &sigInfo, sizeof(sigInfo)) != sizeof(sigInfo)) {
+        return;
+    }
+    osp_status_t status = OSPD_DumpLatency(sigInfo.ssi_signo == SIGUSR2);
+    _logErrorIf(status != OSP_STATUS_OK, "error dumping latency histograms");
 }
 
 
@@ -400,71 +845,69 @@ static void _handleQuitSignals(int signum)
  ***************************************************************************************************/
 int main(int argc, char** argv)
 {
-#define MS_TO_US 1000
+    static const int quitSignals[] = {SIGINT, SIGTERM};
+    static const int latencyDumpSignals[] = {SIGUSR1, SIGUSR2};
     int result =0;
-    fd_set readFdSet;
-    fd_set errFdSet;
-    int32_t maxNumFds = 0;
-    int selectResult;
+    int wakeupFd;
+
+    _startNs = _monotonicNs();
+    _parseCommandLine(argc, argv);
+    _configDoneNs = _monotonicNs();
+
+    //create these on the stack so we know they always get cleaned up properly
+    EventLoop eventLoop;
+    _pEventLoop = &eventLoop;
 
-    //
-    signal(SIGINT, _handleQuitSignals);
+    //Block the quit signals before any thread is created so only the signalfd sees them
+    _fatalErrorIf(eventLoop.addSignals(quitSignals, sizeof(quitSignals)/sizeof(quitSignals[0]),
+                                       _onQuitSignal, NULL) < 0,
+                  -1, "could not set up quit signals");
+    _logErrorIf(eventLoop.addSignals(latencyDumpSignals,
+                                     sizeof(latencyDumpSignals)/sizeof(latencyDumpSignals[0]),
+                                     _onLatencyDumpSignal, NULL) < 0,
+                "could not set up latency dump signals");
 
-    //create this on the stack so we know it always gets cleaned up properly
     VirtualSensorDeviceManager vsDevMgr;
     _pVsDevMgr= &vsDevMgr;
 
     //After initialize, all the magic happens in the callbacks such as _onAccelerometerResultDataUpdate
     _initialize();
+    //frees the snapshots of the command line and defaults that initialization replaced
+    OSPConfig::quiescent();
+    OSPConfig::reclaim();
 
-    /* This loop handles sensor enable/disable requests */
-    // FROM WHERE??
-    while (1) {
+    /* Sensor enable/disable requests arrive on the named pipes */
+    for (int i=0; i < SENSORHUBD_RESULT_INDEX_COUNT; ++i) {
+        _fatalErrorIf(eventLoop.addFd(_enablePipeFds[i], EPOLLIN, _onEnablePipeReadable,
+                                      (void*)(intptr_t)i) < 0,
+                      -1, "could not watch enable pipe");
+    }
 
-        // setup the select to read on all pipes
-        FD_ZERO(&readFdSet);
-        FD_ZERO(&errFdSet);
+    /* Sensor data arrives on the backend's wakeup device */
+    wakeupFd = OSPD_GetWakeupFd();
+    if (wakeupFd >= 0) {
+        _fatalErrorIf(eventLoop.addFd(wakeupFd, EPOLLIN, _onRelayWakeup, NULL) < 0,
+                      -1, "could not watch relay wakeup device");
+    }
 
-        for (int i=0; i < SENSORHUBD_RESULT_INDEX_COUNT; ++i) {
-            FD_SET( _enablePipeFds[i], &readFdSet);
-            FD_SET( _enablePipeFds[i], &errFdSet);
-            maxNumFds = MAX_NUM_FDS( maxNumFds, _enablePipeFds[i]);
-        }
-        //Wait for data on one of the pipes
-        selectResult = select(maxNumFds+1, &readFdSet, NULL, &errFdSet, NULL);
-        _logErrorIf(selectResult<0, "error on select() of named pipes");
-
-        if ( selectResult > 0 ) {
-
-            for (int sensorIndex=0; sensorIndex < SENSORHUBD_RESULT_INDEX_COUNT; ++sensorIndex) {
-                _logErrorIf(FD_ISSET(_enablePipeFds[sensorIndex], &errFdSet), "error on FD!\n");
-                if (FD_ISSET(_enablePipeFds[sensorIndex], &readFdSet) ) {
-                    char readBuf[255];
-                    ssize_t bytesRead = read(_enablePipeFds[sensorIndex], readBuf, 255);
-                    _logErrorIf(bytesRead < 0, "failed on read of enable pipe for");
-
-                    FD_CLR(_enablePipeFds[sensorIndex], &readFdSet );
-                    if (0 == bytesRead) {
-                        char pipename[255];
-
-                        //close and reopen the pipe or we'll spike CPU usage b/c select will always
-                        //return available and we'll always get 0 bytes from read
-                        close(_enablePipeFds[sensorIndex]);
-                        snprintf(pipename, 255, ENABLE_PIPE_NAME_TEMPLATE, _sensorNames[sensorIndex]);
-                        int fd = open(pipename, O_RDONLY|O_NONBLOCK);
-                        _fatalErrorIf(fd < 0, -1, "could not open named pipe for reading");
-                        _enablePipeFds[sensorIndex]= fd;
-
-                        continue;
-                    }
-                    _parseAndHandleEnable(sensorIndex, readBuf, bytesRead);
-                }
-            }
-
-        }
+    /* Frames a slow uinput reader did not take are retried once its device is writable */
+    _logErrorIf(eventLoop.addFd(vsDevMgr.getWritableFd(), EPOLLIN, _onUinputWritable, NULL) < 0,
+                "could not watch uinput backlogs");
 
+    /* Rewrites of the configuration file are applied without restarting the pipeline */
+    if (_configPath != NULL) {
+        _logErrorIf((_watchConfigFile(_configPath) < 0) ||
+                    (eventLoop.addFd(_configWatchFd, EPOLLIN, _onConfigFileChanged, NULL) < 0),
+                    "could not watch configuration file");
     }
 
+    _logErrorIf(eventLoop.addTimer(PERIODIC_WORK_MS, _onPeriodicTimer, NULL) < 0,
+                "could not start periodic timer");
+
+    result = eventLoop.run();
+
+    _deinitialize();
+
     return result;
 }
 
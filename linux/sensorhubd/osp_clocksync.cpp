@@ -0,0 +1,237 @@
+/* Open Sensor Platform Project
+ * https://github.com/sensorplatforms/open-sensor-platform
+ *
+ * Copyright (C) 2013 Sensor Platforms Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*-------------------------------------------------------------------------------------------------*\
+ |    I N C L U D E   F I L E S
+\*-------------------------------------------------------------------------------------------------*/
+#include <cmath>
+#include "osp_debuglogging.h"
+#include "osp_clocksync.h"
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E X T E R N A L   V A R I A B L E S   &   F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   C O N S T A N T S   &   M A C R O S
+\*-------------------------------------------------------------------------------------------------*/
+/* Prior of a fresh fit, relative to the receive jitter the covariance is scaled by: the offset
+   is unknown, the rate within 1000 ppm of nominal */
+#define HUB_CLOCK_JITTER_NS             300000.0
+#define HUB_CLOCK_PRIOR_OFFSET_NS       1e9
+#define HUB_CLOCK_PRIOR_SKEW            1e-3
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   T Y P E   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    S T A T I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    F O R W A R D   F U N C T I O N   D E C L A R A T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      start
+ *          Starts a fresh fit at one observation, nominal rate
+ *
+ ***************************************************************************************************/
+void HubClockSync::start(int64_t hubNs, int64_t hostNs)
+{
+    const double offsetStd = HUB_CLOCK_PRIOR_OFFSET_NS / HUB_CLOCK_JITTER_NS;
+    const double skewStd = HUB_CLOCK_PRIOR_SKEW / HUB_CLOCK_JITTER_NS;
+
+    _hubRefNs = hubNs;
+    _hostRefNs = hostNs;
+    _offset = 0.0;
+    _rate = 1.0;
+    _p[0][0] = offsetStd * offsetStd;
+    _p[0][1] = 0.0;
+    _p[1][0] = 0.0;
+    _p[1][1] = skewStd * skewStd;
+    _consecutiveOutliers = 0;
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      HubClockSync
+ *          Constructor, no observations yet
+ *
+ ***************************************************************************************************/
+HubClockSync::HubClockSync()
+{
+    pthread_mutex_init(&_lock, NULL);
+    _observations = 0;
+    _outliers = 0;
+    start(0, 0);
+}
+
+
+/****************************************************************************************************
+ * @fn      ~HubClockSync
+ *          Destructor
+ *
+ ***************************************************************************************************/
+HubClockSync::~HubClockSync()
+{
+    pthread_mutex_destroy(&_lock);
+}
+
+
+/****************************************************************************************************
+ * @fn      observe
+ *          One recursive least squares step. The fit is first re-expressed around this
+ *          observation's hub time, which makes the regressor (1, 0) and the update a few
+ *          multiply-adds
+ *
+ ***************************************************************************************************/
+void HubClockSync::observe(int64_t hubNs, int64_t hostNs)
+{
+    pthread_mutex_lock(&_lock);
+
+    if (_observations == 0) {
+        start(hubNs, hostNs);
+        _observations = 1;
+        pthread_mutex_unlock(&_lock);
+        return;
+    }
+
+    //Move the reference: offset' = offset + rate * dx, P' = T P T' with T = [1 dx; 0 1]
+    const double dx = (double)(hubNs - _hubRefNs);
+    _offset += _rate * dx;
+    _p[0][0] += dx * (_p[0][1] + _p[1][0]) + dx * dx * _p[1][1];
+    _p[0][1] += dx * _p[1][1];
+    _p[1][0] = _p[0][1];
+    _hubRefNs = hubNs;
+
+    const double error = (double)(hostNs - _hostRefNs) - _offset;
+    if ((_observations > HUB_CLOCK_SETTLE_OBSERVATIONS) && (fabs(error) > HUB_CLOCK_OUTLIER_NS)) {
+        _outliers++;
+        if (++_consecutiveOutliers >= HUB_CLOCK_MAX_OUTLIERS) {
+            LOG_Err("hub clock moved by %.3f ms, restarting the fit", error / 1e6);
+            start(hubNs, hostNs);
+            _observations = 1;
+        }
+        pthread_mutex_unlock(&_lock);
+        return;
+    }
+    _consecutiveOutliers = 0;
+
+    const double denominator = HUB_CLOCK_FORGETTING + _p[0][0];
+    const double gainOffset = _p[0][0] / denominator;
+    const double gainRate = _p[1][0] / denominator;
+
+    _offset += gainOffset * error;
+    _rate += gainRate * error;
+
+    _p[1][1] = (_p[1][1] - gainRate * _p[0][1]) / HUB_CLOCK_FORGETTING;
+    _p[0][1] = (_p[0][1] - gainOffset * _p[0][1]) / HUB_CLOCK_FORGETTING;
+    _p[0][0] = (_p[0][0] - gainOffset * _p[0][0]) / HUB_CLOCK_FORGETTING;
+    _p[1][0] = _p[0][1];
+
+    //keep the fractional part only so the offset does not lose precision as time goes by
+    const double whole = floor(_offset);
+    _hostRefNs += (int64_t)whole;
+    _offset -= whole;
+
+    _observations++;
+    pthread_mutex_unlock(&_lock);
+}
+
+
+/****************************************************************************************************
+ * @fn      mapping
+ *          Current hub to host mapping, to be applied with toHostNs()
+ *
+ ***************************************************************************************************/
+HubClockMap_t HubClockSync::mapping() const
+{
+    HubClockMap_t map;
+
+    pthread_mutex_lock(&_lock);
+    map.valid = (_observations > 0);
+    map.hubRefNs = _hubRefNs;
+    map.hostRefNs = _hostRefNs + (int64_t)llround(_offset);
+    map.rate = _rate;
+    pthread_mutex_unlock(&_lock);
+
+    return map;
+}
+
+
+/****************************************************************************************************
+ * @fn      reset
+ *          Forgets all observations
+ *
+ ***************************************************************************************************/
+void HubClockSync::reset()
+{
+    pthread_mutex_lock(&_lock);
+    _observations = 0;
+    _outliers = 0;
+    start(0, 0);
+    pthread_mutex_unlock(&_lock);
+}
+
+
+/****************************************************************************************************
+ * @fn      observations
+ *          Number of observations in the current fit
+ *
+ ***************************************************************************************************/
+uint64_t HubClockSync::observations() const
+{
+    pthread_mutex_lock(&_lock);
+    const uint64_t observations = _observations;
+    pthread_mutex_unlock(&_lock);
+
+    return observations;
+}
+
+
+/****************************************************************************************************
+ * @fn      outliers
+ *          Number of observations rejected as transport hiccups
+ *
+ ***************************************************************************************************/
+uint64_t HubClockSync::outliers() const
+{
+    pthread_mutex_lock(&_lock);
+    const uint64_t outliers = _outliers;
+    pthread_mutex_unlock(&_lock);
+
+    return outliers;
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E N D   O F   F I L E
+\*-------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,110 @@
+/* Open Sensor Platform Project
+ * https://github.com/sensorplatforms/open-sensor-platform
+ *
+ * Copyright (C) 2013 Sensor Platforms Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef OSP_CLOCKSYNC_H
+#define OSP_CLOCKSYNC_H
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    I N C L U D E   F I L E S
+\*-------------------------------------------------------------------------------------------------*/
+#include <stdint.h>
+#include <pthread.h>
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    C O N S T A N T S   &   M A C R O S
+\*-------------------------------------------------------------------------------------------------*/
+/* Weight of an observation relative to the next one; 1 / (1 - forgetting) observations, ~20 s
+   of drains at 50 Hz, make up the fit */
+#define HUB_CLOCK_FORGETTING            0.999
+/* Once settled, observations this far off the fit are transport hiccups and not fitted; this
+   many of them in a row mean the hub clock itself jumped and the fit starts over */
+#define HUB_CLOCK_SETTLE_OBSERVATIONS   50
+#define HUB_CLOCK_OUTLIER_NS            5000000
+#define HUB_CLOCK_MAX_OUTLIERS          16
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    T Y P E / C L A S S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+/* Hub to host time at one point: host = hostRefNs + rate * (hub - hubRefNs) */
+typedef struct {
+    bool valid;             //!< false until the first observation
+    int64_t hubRefNs;       //!< hub time, nominal ns (ticks * tick length)
+    int64_t hostRefNs;      //!< host time at hubRefNs
+    double rate;            //!< host ns per nominal hub ns, 1 + skew
+} HubClockMap_t;
+
+//! streaming fit of host time against hub time. observe() feeds (hub time of the newest sample,
+//! host time it was received) pairs; the offset and rate are tracked by recursive least squares
+//! with exponential forgetting, so slow drift of the hub oscillator is followed. Receive times
+//! include the transport delay, so the offset carries its mean
+class HubClockSync
+{
+public:
+    HubClockSync();
+    ~HubClockSync();
+
+    void observe(int64_t hubNs, int64_t hostNs);
+    HubClockMap_t mapping() const;
+    void reset();
+
+    uint64_t observations() const;
+    uint64_t outliers() const;
+
+    //! maps a hub time with a mapping taken earlier; O(1) and lock-free
+    static int64_t toHostNs(const HubClockMap_t& map, int64_t hubNs)
+    {
+        if (!map.valid) {
+            return hubNs;
+        }
+        return map.hostRefNs + (int64_t)(map.rate * (double)(hubNs - map.hubRefNs));
+    }
+
+private:
+    HubClockSync(const HubClockSync&);
+    HubClockSync& operator=(const HubClockSync&);
+
+    void start(int64_t hubNs, int64_t hostNs);
+
+    mutable pthread_mutex_t _lock;
+    uint64_t _observations;
+    uint64_t _outliers;
+    int _consecutiveOutliers;
+    //! the fit is host = _hostRefNs + _offset + _rate * (hub - _hubRefNs); the reference is moved
+    //! to every observation so the regressor stays near zero and the update well conditioned
+    int64_t _hubRefNs;
+    int64_t _hostRefNs;
+    double _offset;
+    double _rate;
+    double _p[2][2];        //!< covariance of (offset, rate), in units of the receive jitter
+};
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E X T E R N A L   V A R I A B L E S   &   F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   F U N C T I O N   D E C L A R A T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+#endif // OSP_CLOCKSYNC_H
+/*-------------------------------------------------------------------------------------------------*\
+ |    E N D   O F   F I L E
+\*-------------------------------------------------------------------------------------------------*/
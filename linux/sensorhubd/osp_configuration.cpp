@@ -28,6 +28,9 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <cmath>
 #include <algorithm>
 
 /*-------------------------------------------------------------------------------------------------*\
@@ -42,6 +45,8 @@
 #define DEFAULT_GYROSCOPE_NOISE     1.0f
 #define DEFAULT_ACCELEROMETER_NOISE 1.0f
 
+#define CONFIG_LINE_MAX             1024
+
 /*-------------------------------------------------------------------------------------------------*\
  |    P R I V A T E   T Y P E/C L A S S   D E F I N I T I O N S
 \*-------------------------------------------------------------------------------------------------*/
@@ -72,6 +77,14 @@ public:
         return left < right;
     }
 };
+
+/* One item of a configuration file, parsed but not yet applied */
+typedef struct {
+    std::string key;
+    std::string text;           //!< string items
+    std::vector<float> floats;  //!< float array items
+    std::vector<int> ints;      //!< int array items
+} ParsedItem_t;
 }
 
 
@@ -92,6 +105,153 @@ public:
  |    P R I V A T E     F U N C T I O N S
 \*-------------------------------------------------------------------------------------------------*/
 
+/****************************************************************************************************
+ * @fn      _freezeAxes
+ *          Expands a 1 or 3 element float item into three axis values
+ *
+ ***************************************************************************************************/
+static void _freezeAxes( const float* const value, const unsigned int size,
+                         const float defaultValue, float axes[3]){
+    for (unsigned int j = 0; j < 3; ++j){
+        if (value && size == 3){
+            axes[j] = value[j];
+        } else if (value && size == 1){
+            axes[j] = value[0];
+        } else {
+            axes[j] = defaultValue;
+        }
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      _endsWith
+ *          Whether a config key names the given property
+ *
+ ***************************************************************************************************/
+static bool _endsWith( const std::string& key, const char* const property){
+    const std::string suffix = std::string(".") + property;
+    return key.size() > suffix.size() &&
+            key.compare(key.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      _parseConfigLine
+ *          Parses one "key = value" line. Values are a quoted string, comma separated numbers
+ *          that are floats if any of them looks like one, or a bare word starting with a letter,
+ *          as dump() writes "sensor=acc1". Returns -1 on a syntax error, 0 for an item and 1 for
+ *          a blank or comment line
+ *
+ ***************************************************************************************************/
+static int _parseConfigLine( char* line, ParsedItem_t* pItem){
+    char* end = line + strlen(line);
+
+    while (end > line && isspace((unsigned char)end[-1])) *--end = '\0';
+    while (isspace((unsigned char)*line)) ++line;
+    if (*line == '\0' || *line == '#' || *line == '?'){
+        return 1;
+    }
+
+    char* equals = strchr(line, '=');
+    if (!equals){
+        return -1;
+    }
+    char* keyEnd = equals;
+    while (keyEnd > line && isspace((unsigned char)keyEnd[-1])) --keyEnd;
+    pItem->key.assign(line, keyEnd - line);
+    char* value = equals + 1;
+    while (isspace((unsigned char)*value)) ++value;
+    if (pItem->key.empty() || *value == '\0'){
+        return -1;
+    }
+
+    if (*value == '"'){
+        char* close = strrchr(value + 1, '"');
+        if (!close){
+            return -1;
+        }
+        pItem->text.assign(value + 1, close - value - 1);
+        return 0;
+    }
+
+    const bool floats = strpbrk(value, ".eEnN") != NULL;
+    for (char* token = value; ; ){
+        char* tokenEnd;
+        if (floats){
+            pItem->floats.push_back(strtof(token, &tokenEnd));
+        } else {
+            pItem->ints.push_back(strtol(token, &tokenEnd, 0));
+        }
+        if (tokenEnd == token){
+            break;
+        }
+        while (isspace((unsigned char)*tokenEnd)) ++tokenEnd;
+        if (*tokenEnd == '\0'){
+            return 0;
+        }
+        if (*tokenEnd != ','){
+            break;
+        }
+        token = tokenEnd + 1;
+    }
+
+    //not a number list: a bare word if it starts with a letter
+    if (!isalpha((unsigned char)*value)){
+        return -1;
+    }
+    pItem->floats.clear();
+    pItem->ints.clear();
+    pItem->text = value;
+    return 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      _checkConfigItem
+ *          Range checks of the items the decode path relies on. Returns an error text or NULL
+ *
+ ***************************************************************************************************/
+static const char* _checkConfigItem( const ParsedItem_t& item){
+    if (_endsWith(item.key, OSP::OspConfiguration::SENSOR_SWAP)){
+        bool seen[3] = {false, false, false};
+        if (item.ints.size() != 3){
+            return "swap needs 3 axis indices";
+        }
+        for (unsigned int j = 0; j < 3; ++j){
+            if (item.ints[j] < 0 || item.ints[j] > 2 || seen[item.ints[j]]){
+                return "swap is not a permutation of 0,1,2";
+            }
+            seen[item.ints[j]] = true;
+        }
+    } else if (_endsWith(item.key, OSP::OspConfiguration::SENSOR_CONVERSION)){
+        if (item.floats.size() != 1 && item.floats.size() != 3){
+            return "conversion needs 1 or 3 factors";
+        }
+        for (unsigned int j = 0; j < item.floats.size(); ++j){
+            if (!std::isfinite(item.floats[j])){
+                return "conversion factor is not finite";
+            }
+        }
+    } else if (_endsWith(item.key, OSP::OspConfiguration::SENSOR_RATE)){
+        if (item.floats.size() != 1 || !(item.floats[0] > 0.0f)){
+            return "defaultrate needs one positive period";
+        }
+    }
+    return NULL;
+}
+
+
+/****************************************************************************************************
+ * @fn      _freezeString
+ *          String item as a std::string, empty if not set
+ *
+ ***************************************************************************************************/
+static std::string _freezeString( const char* const value){
+    return value ? std::string(value) : std::string();
+}
+
+
 /*-------------------------------------------------------------------------------------------------*\
  |    P U B L I C     F U N C T I O N S
 \*-------------------------------------------------------------------------------------------------*/
@@ -367,7 +527,8 @@ OSP::OspConfiguration::setConfigItemFloat(
         for (unsigned int i =0; i < size; ++i ){
             const_cast< float* >( pair.first )[i] = value[i];
         }
-        configItemsFloat.insert(std::pair<std::string, std::pair<const float*,unsigned int> >(name, pair) );
+        //assigned, not inserted: an override must replace the array deleted above
+        configItemsFloat[name] = pair;
         status = 0;
     }
     return status;
@@ -405,6 +566,204 @@ OSP::OspConfiguration::clear(const bool final){
     configItemsInt.clear();
     configItemsFloat.clear();
     configItemsString.clear();
+
+    if (final){
+        delete _pSnapshot.exchange(NULL, std::memory_order_acq_rel);
+        for (auto it = _retiredSnapshots.begin(); it != _retiredSnapshots.end(); ++it){
+            delete it->pSnapshot;
+        }
+        _retiredSnapshots.clear();
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      freeze
+ *          Compiles the configuration items into a typed snapshot and publishes it
+ *
+ ***************************************************************************************************/
+const OSP::OspConfiguration::Snapshot_t*
+OSP::OspConfiguration::freeze(){
+    Snapshot_t* pSnapshot = new Snapshot_t;
+    unsigned int size;
+    const float* floats;
+    const int* ints;
+
+    auto sensorlist = getConfigItemsMultiple("sensor");
+    for (auto it = sensorlist.begin(); it != sensorlist.end(); ++it){
+        const char* const name = *it;
+        SensorRecord_t record;
+
+        record.name = name;
+        record.type = getTypeFromName(name);
+        record.driverName = _freezeString(getConfigItem(keyFrom(name, SENSOR_DRIVER_NAME).c_str()));
+
+        ints = getNamedConfigItemInt(name, SENSOR_SWAP, &size);
+        for (unsigned int j = 0; j < 3; ++j){
+            record.swap[j] = (ints && size == 3) ? ints[j] : j;
+        }
+        if (ints && size != 3){
+            LOG_Err("Invalid swap indices length of %d for %s, using identity", size, name);
+        }
+
+        floats = getNamedConfigItemFloat(name, SENSOR_CONVERSION, &size);
+        if (floats && size != 1 && size != 3){
+            LOG_Err("Invalid conversion value array length of %d for %s", size, name);
+        }
+        _freezeAxes(floats, size, 1.0f, record.conversion);
+
+        floats = getNamedConfigItemFloat(name, SENSOR_NOISE, &size);
+        _freezeAxes(floats, size, 0.0f, record.noise);
+
+        record.period = getNamedConfigItemFloatV(name, SENSOR_RATE, 0.0f);
+        record.useMedianFilter = getNamedConfigItemIntV(name, SENSOR_USE_MEDIAN_FILTER, 0) > 0;
+
+        record.enablePath = _freezeString(getConfigItem(keyFrom(name, SENSOR_ENABLE_PATH).c_str()));
+        record.enableValue = getNamedConfigItemIntV(name, SENSOR_ENABLE_VALUE, 1);
+        record.disableValue = getNamedConfigItemIntV(name, SENSOR_DISABLE_VALUE, 0);
+        record.delayPath = _freezeString(getConfigItem(keyFrom(name, SENSOR_DELAY_PATH).c_str()));
+
+        pSnapshot->sensors.push_back(record);
+    }
+
+    pSnapshot->relayDriver = _freezeString(getConfigItem(PROTOCOL_RELAY_DRIVER));
+    pSnapshot->relayTickUsec = getConfigItemIntV(PROTOCOL_RELAY_TICK_USEC, 1, NULL);
+    pSnapshot->relayPerCpuDrain = getConfigItemBool(PROTOCOL_RELAY_PER_CPU_DRAIN);
+    pSnapshot->relayPath = _freezeString(getConfigItem(PROTOCOL_RELAY_PATH));
+    pSnapshot->relayWakeupPath = _freezeString(getConfigItem(PROTOCOL_RELAY_WAKEUP_PATH));
+    pSnapshot->relaySysfsPath = _freezeString(getConfigItem(PROTOCOL_RELAY_SYSFS_PATH));
+    pSnapshot->relayCapturePath = _freezeString(getConfigItem(PROTOCOL_RELAY_CAPTURE_PATH));
+    auto hublist = getConfigItemsMultiple("hub");
+    for (auto it = hublist.begin(); it != hublist.end(); ++it){
+        RelayHubRecord_t hub;
+
+        hub.name = *it;
+        hub.relayPath = _freezeString(getConfigItem(keyFrom(*it, HUB_RELAY_PATH).c_str()));
+        hub.wakeupPath = _freezeString(getConfigItem(keyFrom(*it, HUB_WAKEUP_PATH).c_str()));
+        pSnapshot->relayHubs.push_back(hub);
+    }
+    pSnapshot->replayPath = _freezeString(getConfigItem(PROTOCOL_REPLAY_PATH));
+    pSnapshot->replaySpeed = getConfigItemFloatV(PROTOCOL_REPLAY_SPEED, 1.0f);
+    pSnapshot->hifPath = _freezeString(getConfigItem(PROTOCOL_HIF_PATH));
+    pSnapshot->serialBaudRate = getConfigItemIntV(PROTOCOL_SERIAL_BAUD_RATE, 115200, NULL);
+    pSnapshot->shmSocketPath = _freezeString(getConfigItem(PROTOCOL_SHM_SOCKET_PATH));
+
+    //the replaced snapshot may still be in use until the next quiescent()
+    const Snapshot_t* pReplaced = _pSnapshot.exchange(pSnapshot, std::memory_order_acq_rel);
+    if (pReplaced != NULL){
+        RetiredSnapshot_t retired;
+        retired.pSnapshot = pReplaced;
+        retired.quiescentCount = _quiescentCount.load(std::memory_order_seq_cst);
+        _retiredSnapshots.push_back(retired);
+    }
+    reclaim();
+
+    LOG_Info("Configuration frozen, %u sensors", (unsigned int)pSnapshot->sensors.size());
+    return pSnapshot;
+}
+
+
+/****************************************************************************************************
+ * @fn      reclaim
+ *          Frees the replaced snapshots that the reading thread has moved past
+ *
+ ***************************************************************************************************/
+void
+OSP::OspConfiguration::reclaim(){
+    const uint64_t quiescentCount = _quiescentCount.load(std::memory_order_seq_cst);
+
+    for (auto it = _retiredSnapshots.begin(); it != _retiredSnapshots.end(); ){
+        if (quiescentCount > it->quiescentCount){
+            delete it->pSnapshot;
+            it = _retiredSnapshots.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      load
+ *          Applies a configuration file over the current items and freezes the result
+ *
+ ***************************************************************************************************/
+const OSP::OspConfiguration::Snapshot_t*
+OSP::OspConfiguration::load( const char* const filename ){
+    std::vector<ParsedItem_t> items;
+    char line[CONFIG_LINE_MAX];
+    int lineNumber = 0;
+    bool valid = true;
+
+    FILE* f = ::fopen( filename, "r");
+    if (!f){
+        LOG_Err("Unable to open file '%s'",filename);
+        return NULL;
+    }
+
+    //everything is parsed and checked before the first item is applied
+    while (valid && fgets(line, sizeof(line), f)){
+        ParsedItem_t item;
+        const char* error = NULL;
+
+        ++lineNumber;
+        const int parsed = _parseConfigLine(line, &item);
+        if (parsed < 0){
+            error = "syntax error";
+        } else if (parsed == 0){
+            //"1" for an item that holds floats, such as a conversion factor, is a float
+            if (!item.ints.empty() &&
+                (configItemsFloat.count(item.key) > 0 ||
+                 _endsWith(item.key, SENSOR_CONVERSION) || _endsWith(item.key, SENSOR_NOISE) ||
+                 _endsWith(item.key, SENSOR_RATE))){
+                item.floats.assign(item.ints.begin(), item.ints.end());
+                item.ints.clear();
+            }
+            error = _checkConfigItem(item);
+            items.push_back(item);
+        }
+        if (error){
+            LOG_Err("%s:%d: %s", filename, lineNumber, error);
+            valid = false;
+        }
+    }
+    fclose(f);
+    if (!valid){
+        return NULL;
+    }
+
+    for (auto it = items.begin(); it != items.end(); ++it){
+        if (!it->floats.empty()){
+            setConfigItemFloat(it->key.c_str(), &it->floats[0], it->floats.size(), true);
+        } else if (!it->ints.empty()){
+            setConfigItemInt(it->key.c_str(), &it->ints[0], it->ints.size(), true);
+        } else {
+            setConfigItem(it->key.c_str(), it->text.c_str(),
+                          it->key == "sensor" || it->key == "hub", true);
+        }
+    }
+    LOG_Info("Loaded %u configuration items from %s", (unsigned int)items.size(), filename);
+
+    return freeze();
+}
+
+
+/****************************************************************************************************
+ * @fn      findSensor
+ *          Index of a sensor's record in a snapshot
+ *
+ ***************************************************************************************************/
+int
+OSP::OspConfiguration::findSensor( const Snapshot_t* const pSnapshot, const char* const name ){
+    if (pSnapshot == NULL || name == NULL){
+        return -1;
+    }
+    for (size_t i = 0; i < pSnapshot->sensors.size(); ++i){
+        if (pSnapshot->sensors[i].name == name){
+            return i;
+        }
+    }
+    return -1;
 }
 
 
@@ -434,7 +793,7 @@ OSP::OspConfiguration::setConfigItemInt(
         for (unsigned int i =0; i < size; ++i ){
             const_cast< int* >( pair.first )[i] = value[i];
         }
-        configItemsInt.insert(std::pair<std::string, std::pair<const int*, unsigned int> >(name, pair) );
+        configItemsInt[name] = pair;
         status = 0;
     }
     return status;
@@ -578,6 +937,8 @@ OSP::OspConfiguration::establishDefaultConfig(const char* const protocol){
                     true);
         OSPConfig::setConfigItemInt( "gyr1.swap",swap,3);
     }
+
+    freeze();
 }
 
 
@@ -652,10 +1013,11 @@ OSP::OspConfiguration::dump( const char* const filename ){
                     configItemsFloat[key];
             fprintf( f, "%s = ", key.c_str());
             for(unsigned int i = 0; i < floatarray.second; ++i){
+                //all significant digits and a decimal point, so load() reads back the same float
                 if (i==0)
-                    fprintf( f, "%f", floatarray.first[i]);
+                    fprintf( f, "%#.9g", floatarray.first[i]);
                 else
-                    fprintf( f, ",%f", floatarray.first[i]);
+                    fprintf( f, ",%#.9g", floatarray.first[i]);
             }
             fprintf(f, "\n");
         } else if (configItemsInt.find(key) != configItemsInt.end()){
@@ -684,6 +1046,9 @@ std::map<std::string, std::vector<const char*> > OSP::OspConfiguration::configIt
 std::map<std::string, std::pair< const float*, unsigned int>  > OSP::OspConfiguration::configItemsFloat;
 std::map<std::string, std::pair< const int *,  unsigned int>  > OSP::OspConfiguration::configItemsInt;
 OSP::OspConfiguration::Init OSP::OspConfiguration::initializer;
+std::atomic<const OSP::OspConfiguration::Snapshot_t*> OSP::OspConfiguration::_pSnapshot(NULL);
+std::atomic<uint64_t> OSP::OspConfiguration::_quiescentCount(0);
+std::vector<OSP::OspConfiguration::RetiredSnapshot_t> OSP::OspConfiguration::_retiredSnapshots;
 }
 
 /*-------------------------------------------------------------------------------------------------*\
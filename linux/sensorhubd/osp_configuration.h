@@ -24,6 +24,8 @@
 #include <string>
 #include <map>
 #include <vector>
+#include <atomic>
+#include <stdint.h>
 
 /*-------------------------------------------------------------------------------------------------*\
  |    C O N S T A N T S   &   M A C R O S
@@ -65,6 +67,48 @@ class OspConfiguration{
 public:
     typedef const char*  cstring;
 
+    /* Typed per-sensor record of a configuration snapshot */
+    typedef struct {
+        std::string name;               //!< config name, e.g. "acc1"
+        ESensorType type;
+        std::string driverName;         //!< SENSOR_DRIVER_NAME, empty if not configured
+        int swap[3];
+        float conversion[3];
+        float period;                   //!< SENSOR_RATE, seconds
+        float noise[3];
+        bool useMedianFilter;
+        std::string enablePath;         //!< SENSOR_ENABLE_PATH, empty if not configured
+        int enableValue;
+        int disableValue;
+        std::string delayPath;          //!< SENSOR_DELAY_PATH, empty if not configured
+    } SensorRecord_t;
+
+    /* Per-hub record of a configuration snapshot, one for each entry of the "hub" list */
+    typedef struct {
+        std::string name;               //!< config name, e.g. "hub1"
+        std::string relayPath;          //!< HUB_RELAY_PATH
+        std::string wakeupPath;         //!< HUB_WAKEUP_PATH, empty for the relay input device
+    } RelayHubRecord_t;
+
+    /* Immutable, typed view of the whole configuration made by freeze(). Sensors are indexed
+       by their position in the "sensor" list, see findSensor() */
+    typedef struct {
+        std::vector<SensorRecord_t> sensors;
+        std::string relayDriver;
+        int relayTickUsec;
+        bool relayPerCpuDrain;
+        std::string relayPath;
+        std::string relayWakeupPath;
+        std::string relaySysfsPath;     //!< base of the per-sensor enable and delay nodes
+        std::string relayCapturePath;
+        std::vector<RelayHubRecord_t> relayHubs;   //!< hubs served next to the one at relayPath
+        std::string replayPath;
+        float replaySpeed;
+        std::string hifPath;
+        int serialBaudRate;
+        std::string shmSocketPath;
+    } Snapshot_t;
+
     /* A list of common names to use.  Use these in lieu of direct
            strings to prevent possible misspellings that won't be caught
            by compiler*/
@@ -77,6 +121,18 @@ public:
 
     static constexpr cstring PROTOCOL_RELAY_DRIVER = "protocol.relay_driver";
     static constexpr cstring PROTOCOL_RELAY_TICK_USEC = "protocol.relay_tick_usec";
+    static constexpr cstring PROTOCOL_RELAY_PER_CPU_DRAIN = "protocol.relay_per_cpu_drain";
+    static constexpr cstring PROTOCOL_RELAY_PATH = "protocol.relay_path";
+    static constexpr cstring PROTOCOL_RELAY_WAKEUP_PATH = "protocol.relay_wakeup_path";
+    static constexpr cstring PROTOCOL_RELAY_SYSFS_PATH = "protocol.relay_sysfs_path";
+    static constexpr cstring PROTOCOL_RELAY_CAPTURE_PATH = "protocol.relay_capture_path";
+    static constexpr cstring PROTOCOL_REPLAY_PATH = "protocol.replay_path";
+    static constexpr cstring PROTOCOL_REPLAY_SPEED = "protocol.replay_speed";
+    static constexpr cstring PROTOCOL_HIF_PATH = "protocol.hif_path";
+    static constexpr cstring PROTOCOL_SHM_SOCKET_PATH = "protocol.shm_socket_path";
+
+    static constexpr cstring HUB_RELAY_PATH = "relay-path";
+    static constexpr cstring HUB_WAKEUP_PATH = "wakeup-path";
 
 
     static constexpr cstring SENSOR_INPUT_NAME = "input-name";
@@ -107,6 +163,27 @@ public:
     //to give access to setters:
     //...
 
+    /* Command line overrides. Applied before the defaults are established, which never replace
+       an item that is already set */
+    static int overrideConfigItem( const char* const name, const char* const value ){
+        return setConfigItem( name, value, false, true );
+    }
+    static int overrideConfigItemInt( const char* const name, const int value ){
+        return setConfigItemInt( name, &value, 1, true );
+    }
+    static int overrideConfigItemFloat( const char* const name, const float value ){
+        return setConfigItemFloat( name, &value, 1, true );
+    }
+    static int overrideRelayHub( const char* const name, const char* const relayPath,
+                                 const char* const wakeupPath ){
+        if (setConfigItem( "hub", name, true ) < 0 ||
+            setConfigItem( keyFrom(name, HUB_RELAY_PATH).c_str(), relayPath, false, true ) < 0){
+            return -1;
+        }
+        return wakeupPath ?
+            setConfigItem( keyFrom(name, HUB_WAKEUP_PATH).c_str(), wakeupPath, false, true ) : 0;
+    }
+
     /* Get a key from an item and property pair.  This is useful
            when getting a property for a dynamically named item such as
            a sensor */
@@ -212,6 +289,27 @@ public:
 
     static void clear( const bool final = false);
 
+    /* Compiles the current items into a new snapshot and makes it the current one. Runtime
+       lookups read the snapshot instead of the string keyed items. The replaced snapshot stays
+       valid until quiescent() has been reported after the replacement */
+    static const Snapshot_t* freeze();
+
+    /* Snapshots are read on the thread that freezes them, which reports with quiescent() that it
+       holds no snapshot pointer any more. reclaim() frees the snapshots replaced before that;
+       freeze() does so too. clear(true) frees them all */
+    static void quiescent(){
+        _quiescentCount.fetch_add(1, std::memory_order_seq_cst);
+    }
+    static void reclaim();
+
+    /* The current snapshot, NULL before the first freeze() */
+    static const Snapshot_t* snapshot(){
+        return _pSnapshot.load(std::memory_order_acquire);
+    }
+
+    /* Index of a named sensor in pSnapshot->sensors, -1 if not configured */
+    static int findSensor( const Snapshot_t* const pSnapshot, const char* const name );
+
 
     static void establishCartesianSensor( const char* const name,
                                           const char* const protocol,
@@ -224,6 +322,12 @@ public:
 
     static int dump( const char* const filename );
 
+    /* Reads items in the "key = value" format written by dump() over the current ones, then
+       freezes. The whole file is parsed and checked first; on any error nothing changes and
+       NULL is returned. Items are only added or replaced: one the file no longer sets keeps the
+       value it had, and a sensor or hub it no longer lists stays configured */
+    static const Snapshot_t* load( const char* const filename );
+
     static void establishDefaultConfig( const char* const protocol = "domain_socket");
     static const unsigned short getSizeFromName( const char* const shortName);
     static const ESensorType getTypeFromName( const char* const shortName );
@@ -280,6 +384,15 @@ private:
     static std::map< std::string, int> _typeToDimension;
     static std::map< std::string, unsigned short> _typeToSize;
 
+    typedef struct {
+        const Snapshot_t* pSnapshot;
+        uint64_t quiescentCount;        //!< count when it was replaced
+    } RetiredSnapshot_t;
+
+    static std::atomic<const Snapshot_t*> _pSnapshot;
+    static std::atomic<uint64_t> _quiescentCount;
+    static std::vector<RetiredSnapshot_t> _retiredSnapshots;
+
 };
 
 }
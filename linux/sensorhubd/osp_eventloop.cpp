@@ -0,0 +1,314 @@
+/* Open Sensor Platform Project
+ * https://github.com/sensorplatforms/open-sensor-platform
+ *
+ * Copyright (C) 2013 Sensor Platforms Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*-------------------------------------------------------------------------------------------------*\
+ |    I N C L U D E   F I L E S
+\*-------------------------------------------------------------------------------------------------*/
+#include <cstdio>
+#include <cstring>
+#include <csignal>
+
+#include <unistd.h>
+#include <errno.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+
+#include "osp_debuglogging.h"
+#include "osp_eventloop.h"
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E X T E R N A L   V A R I A B L E S   &   F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   C O N S T A N T S   &   M A C R O S
+\*-------------------------------------------------------------------------------------------------*/
+#define MS_PER_SEC                      1000
+#define NSEC_PER_MS                     1000000
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   T Y P E   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    S T A T I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    F O R W A R D   F U N C T I O N   D E C L A R A T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      add
+ *          Common registration of a file descriptor with the epoll set
+ *
+ ***************************************************************************************************/
+int EventLoop::add(int fd, uint32_t events, EventHandler_t handler, void* pContext, bool ownsFd)
+{
+    struct epoll_event epollEvent;
+    Registration_t* pRegistration;
+
+    if ((fd < 0) || (handler == NULL)) {
+        return -1;
+    }
+
+    if (_registrations.find(fd) != _registrations.end()) {
+        LOG_Err("%s: fd %d already registered\n", __FUNCTION__, fd);
+        return -1;
+    }
+
+    pRegistration = new Registration_t;
+    pRegistration->fd = fd;
+    pRegistration->ownsFd = ownsFd;
+    pRegistration->handler = handler;
+    pRegistration->pContext = pContext;
+
+    memset(&epollEvent, 0, sizeof(epollEvent));
+    epollEvent.events = events;
+    epollEvent.data.ptr = pRegistration;
+
+    if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &epollEvent) < 0) {
+        LOG_Err("%s: epoll_ctl(ADD, %d) failed: %s\n", __FUNCTION__, fd, strerror(errno));
+        delete pRegistration;
+        return -1;
+    }
+
+    _registrations[fd] = pRegistration;
+    return 0;
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      EventLoop
+ *          Class Constructor
+ *
+ ***************************************************************************************************/
+EventLoop::EventLoop():
+    _running(false)
+{
+    memset(&_stats, 0, sizeof(_stats));
+
+    _epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (_epollFd < 0) {
+        LOG_Err("%s: epoll_create1 failed: %s\n", __FUNCTION__, strerror(errno));
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      ~EventLoop
+ *          Class Destructor
+ *
+ ***************************************************************************************************/
+EventLoop::~EventLoop()
+{
+    for (std::map<int, Registration_t*>::iterator it = _registrations.begin();
+         it != _registrations.end(); ++it) {
+        if (it->second->ownsFd) {
+            close(it->first);
+        }
+        delete it->second;
+    }
+    for (size_t i = 0; i < _retired.size(); i++) {
+        delete _retired[i];
+    }
+
+    if (_epollFd >= 0) {
+        close(_epollFd);
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      addFd
+ *          Registers a caller owned file descriptor
+ *
+ ***************************************************************************************************/
+int EventLoop::addFd(int fd, uint32_t events, EventHandler_t handler, void* pContext)
+{
+    return add(fd, events, handler, pContext, false);
+}
+
+
+/****************************************************************************************************
+ * @fn      removeFd
+ *          Unregisters a file descriptor. Safe to call from within a handler
+ *
+ ***************************************************************************************************/
+int EventLoop::removeFd(int fd)
+{
+    std::map<int, Registration_t*>::iterator it = _registrations.find(fd);
+
+    if (it == _registrations.end()) {
+        return -1;
+    }
+
+    epoll_ctl(_epollFd, EPOLL_CTL_DEL, fd, NULL);
+    if (it->second->ownsFd) {
+        close(fd);
+    }
+
+    //events for this fd may still be pending in the current epoll_wait() batch
+    it->second->handler = NULL;
+    _retired.push_back(it->second);
+    _registrations.erase(it);
+
+    return 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      addTimer
+ *          Creates a periodic timerfd owned by the loop
+ *
+ ***************************************************************************************************/
+int EventLoop::addTimer(uint32_t periodMs, EventHandler_t handler, void* pContext)
+{
+    struct itimerspec timerSpec;
+    int fd;
+
+    fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+        LOG_Err("%s: timerfd_create failed: %s\n", __FUNCTION__, strerror(errno));
+        return -1;
+    }
+
+    timerSpec.it_interval.tv_sec = periodMs / MS_PER_SEC;
+    timerSpec.it_interval.tv_nsec = (periodMs % MS_PER_SEC) * NSEC_PER_MS;
+    timerSpec.it_value = timerSpec.it_interval;
+
+    if ((timerfd_settime(fd, 0, &timerSpec, NULL) < 0) ||
+        (add(fd, EPOLLIN, handler, pContext, true) < 0)) {
+        LOG_Err("%s: unable to arm timer\n", __FUNCTION__);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+
+/****************************************************************************************************
+ * @fn      addSignals
+ *          Blocks the given signals and routes them through a signalfd owned by the loop
+ *
+ ***************************************************************************************************/
+int EventLoop::addSignals(const int signals[], int numSignals, EventHandler_t handler,
+                          void* pContext)
+{
+    sigset_t mask;
+    int fd;
+
+    sigemptyset(&mask);
+    for (int i = 0; i < numSignals; i++) {
+        sigaddset(&mask, signals[i]);
+    }
+
+    //Must be blocked for signalfd to see them. Threads created later inherit the mask
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0) {
+        LOG_Err("%s: sigprocmask failed: %s\n", __FUNCTION__, strerror(errno));
+        return -1;
+    }
+
+    fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd < 0) {
+        LOG_Err("%s: signalfd failed: %s\n", __FUNCTION__, strerror(errno));
+        return -1;
+    }
+
+    if (add(fd, EPOLLIN, handler, pContext, true) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+
+/****************************************************************************************************
+ * @fn      run
+ *          Dispatch loop
+ *
+ ***************************************************************************************************/
+int EventLoop::run()
+{
+    struct epoll_event events[EVENTLOOP_MAX_EVENTS];
+    int numEvents;
+
+    if (_epollFd < 0) {
+        return -1;
+    }
+
+    _running = true;
+    while (_running) {
+        numEvents = epoll_wait(_epollFd, events, EVENTLOOP_MAX_EVENTS, -1);
+        if (numEvents < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_Err("%s: epoll_wait failed: %s\n", __FUNCTION__, strerror(errno));
+            return -1;
+        }
+
+        _stats.wakeups++;
+
+        for (int i = 0; i < numEvents; i++) {
+            Registration_t* pRegistration = (Registration_t*)events[i].data.ptr;
+
+            if (pRegistration->handler != NULL) {
+                _stats.dispatches++;
+                pRegistration->handler(pRegistration->fd, events[i].events,
+                                       pRegistration->pContext);
+            }
+        }
+
+        for (size_t i = 0; i < _retired.size(); i++) {
+            delete _retired[i];
+        }
+        _retired.clear();
+    }
+
+    return 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      stop
+ *          Makes run() return after the current dispatch round
+ *
+ ***************************************************************************************************/
+void EventLoop::stop()
+{
+    _running = false;
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E N D   O F   F I L E
+\*-------------------------------------------------------------------------------------------------*/
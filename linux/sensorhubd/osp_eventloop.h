@@ -0,0 +1,98 @@
+/* Open Sensor Platform Project
+ * https://github.com/sensorplatforms/open-sensor-platform
+ *
+ * Copyright (C) 2013 Sensor Platforms Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef OSP_EVENTLOOP_H
+#define OSP_EVENTLOOP_H
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    I N C L U D E   F I L E S
+\*-------------------------------------------------------------------------------------------------*/
+#include <stdint.h>
+#include <map>
+#include <vector>
+#include <sys/epoll.h>
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    C O N S T A N T S   &   M A C R O S
+\*-------------------------------------------------------------------------------------------------*/
+#define EVENTLOOP_MAX_EVENTS            16  /* epoll events returned per wakeup */
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    T Y P E / C L A S S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+//! called with the ready fd, the epoll event mask and the context given at registration
+typedef void (*EventHandler_t)(int fd, uint32_t events, void* pContext);
+
+typedef struct {
+    uint64_t wakeups;       //!< returns from epoll_wait() with at least one event
+    uint64_t dispatches;    //!< handler invocations
+} EventLoopStats_t;
+
+//! single threaded epoll reactor for the daemon's file descriptors, timers and signals
+class EventLoop
+{
+public:
+    EventLoop();
+    ~EventLoop();
+
+    int addFd(int fd, uint32_t events, EventHandler_t handler, void* pContext);
+    int removeFd(int fd);
+
+    //! periodic timerfd; the handler must read() the expiration count. Returns the timerfd
+    int addTimer(uint32_t periodMs, EventHandler_t handler, void* pContext);
+    //! blocks the given signals and delivers them through a signalfd. Returns the signalfd
+    int addSignals(const int signals[], int numSignals, EventHandler_t handler, void* pContext);
+
+    //! dispatches events until stop() is called; returns 0 or -1 on epoll failure
+    int run();
+    void stop();
+
+    const EventLoopStats_t& getStats() const { return _stats; }
+
+private:
+    typedef struct {
+        int fd;
+        bool ownsFd;
+        EventHandler_t handler;
+        void* pContext;
+    } Registration_t;
+
+    int add(int fd, uint32_t events, EventHandler_t handler, void* pContext, bool ownsFd);
+
+    int _epollFd;
+    volatile bool _running;
+    std::map<int, Registration_t*> _registrations;
+    std::vector<Registration_t*> _retired;  //freed once the current dispatch round is over
+    EventLoopStats_t _stats;
+};
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E X T E R N A L   V A R I A B L E S   &   F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   F U N C T I O N   D E C L A R A T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+#endif // OSP_EVENTLOOP_H
+/*-------------------------------------------------------------------------------------------------*\
+ |    E N D   O F   F I L E
+\*-------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,335 @@
+/* Open Sensor Platform Project
+ * https://github.com/sensorplatforms/open-sensor-platform
+ *
+ * Copyright (C) 2013 Sensor Platforms Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*-------------------------------------------------------------------------------------------------*\
+ |    I N C L U D E   F I L E S
+\*-------------------------------------------------------------------------------------------------*/
+#include <cstring>
+#include <cstdlib>
+
+#include "osp_hifparser.h"
+#include "SensorPackets.h"
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E X T E R N A L   V A R I A B L E S   &   F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   C O N S T A N T S   &   M A C R O S
+\*-------------------------------------------------------------------------------------------------*/
+#define HIF_QUALIFIER_BYTES             sizeof(HifSnsrPktQualifier_t)
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   T Y P E   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    S T A T I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    F O R W A R D   F U N C T I O N   D E C L A R A T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      _bigEndian16/32/64
+ *          Fields of HIF packets are big endian and not aligned
+ *
+ ***************************************************************************************************/
+static inline int16_t _bigEndian16(const uint8_t* p)
+{
+    return (int16_t)(((uint16_t)p[0] << 8) | p[1]);
+}
+
+static inline uint32_t _bigEndian32(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline uint64_t _bigEndian64(const uint8_t* p)
+{
+    return ((uint64_t)_bigEndian32(p) << 32) | _bigEndian32(p + 4);
+}
+
+
+/****************************************************************************************************
+ * @fn      _packetLayout
+ *          Length, format and value count of the sensor data packet starting with a qualifier;
+ *          the same packets, sizes and format checks as the hub's ParseSensorDataPkt()
+ *
+ ***************************************************************************************************/
+static int _packetLayout(const uint8_t* pQualifier, HifPacketFormat_t* pFormat, uint8_t* pNumValues)
+{
+    const uint8_t control = pQualifier[0];
+    const uint8_t sensorType = M_SensorType(pQualifier[1]);
+    const uint8_t attribute = pQualifier[2];
+    const uint8_t dataSize = attribute & DATA_SIZE_MASK;
+    const bool rawData = (control & DATA_FORMAT_MASK) == DATA_FORMAT_RAW;
+    const bool fixpointTime = ((control & TIME_FORMAT_MASK) == TIME_FORMAT_FIXPOINT) &&
+                              ((attribute & TIME_STAMP_SIZE_MASK) == TIME_STAMP_64_BIT);
+    const bool fixpoint32 = fixpointTime && !rawData && (dataSize == DATA_SIZE_32_BIT);
+
+    //control packets are not queued to the host, and no hub firmware sends checksums
+    if ((control & (PKID_MASK_VER0 | CRC_ENABLE)) != PKID_SENSOR_DATA) {
+        return -1;
+    }
+
+    if (control & SENSOR_ANDROID_TYPE_MASK) {
+        switch (sensorType) {
+        case PSENSOR_ACCELEROMETER_RAW:
+        case PSENSOR_MAGNETIC_FIELD_RAW:
+        case PSENSOR_GYROSCOPE_RAW:
+            if ((M_ParseSensorSubType(attribute) != SENSOR_SUBTYPE_UNUSED) || !rawData ||
+                (dataSize != DATA_SIZE_16_BIT) ||
+                ((control & TIME_FORMAT_MASK) != TIME_FORMAT_RAW) ||
+                ((attribute & TIME_STAMP_SIZE_MASK) != TIME_STAMP_32_BIT)) {
+                return -1;
+            }
+            *pFormat = HIF_PACKET_RAW;
+            *pNumValues = 3;
+            return SENSOR_RAW_DATA_PKT_SZ;
+
+        case PSENSOR_ACCELEROMETER_UNCALIBRATED:
+            break;
+
+        default:
+            return -1;
+        }
+    } else if (sensorType >= NUM_ANDROID_SENSOR_TYPE) {
+        return -1;
+    }
+
+    switch (sensorType) {
+    case SENSOR_ACCELEROMETER:
+    case SENSOR_MAGNETIC_FIELD:
+    case SENSOR_GYROSCOPE:
+    case SENSOR_ORIENTATION:
+    case SENSOR_LINEAR_ACCELERATION:
+    case SENSOR_GRAVITY:
+    case SENSOR_ROTATION_VECTOR:
+    case SENSOR_GEOMAGNETIC_ROTATION_VECTOR:
+    case SENSOR_GAME_ROTATION_VECTOR:
+    case SENSOR_MAGNETIC_FIELD_UNCALIBRATED:
+    case SENSOR_GYROSCOPE_UNCALIBRATED:
+    case PSENSOR_ACCELEROMETER_UNCALIBRATED:
+        if (!fixpoint32) {
+            return -1;
+        }
+        *pFormat = HIF_PACKET_FIXPOINT;
+        *pNumValues = 3;
+        if ((sensorType == SENSOR_ROTATION_VECTOR) ||
+            (sensorType == SENSOR_GEOMAGNETIC_ROTATION_VECTOR) ||
+            (sensorType == SENSOR_GAME_ROTATION_VECTOR)) {
+            *pNumValues = 4;
+            return QUATERNION_FIXP_DATA_PKT_SZ;
+        }
+        if ((sensorType == SENSOR_MAGNETIC_FIELD_UNCALIBRATED) ||
+            (sensorType == SENSOR_GYROSCOPE_UNCALIBRATED) ||
+            (sensorType == PSENSOR_ACCELEROMETER_UNCALIBRATED)) {
+            //the offsets follow only when the meta data says so; they are not decoded
+            return M_ParseSensorMetaData(pQualifier[1]) ?
+                    UNCALIB_FIXP_DATA_OFFSET_PKT_SZ : UNCALIB_FIXP_DATA_PKT_SZ;
+        }
+        return CALIBRATED_FIXP_DATA_PKT_SZ;
+
+    case SENSOR_SIGNIFICANT_MOTION:
+    case SENSOR_STEP_DETECTOR:
+        if (!fixpointTime || !rawData || (dataSize != DATA_SIZE_8_BIT)) {
+            return -1;
+        }
+        *pFormat = HIF_PACKET_EVENT;
+        *pNumValues = 1;
+        return STEPDETECTOR_DATA_PKT_SZ;
+
+    case SENSOR_STEP_COUNTER:
+        if (!fixpointTime || !rawData || (dataSize != DATA_SIZE_64_BIT)) {
+            return -1;
+        }
+        *pFormat = HIF_PACKET_EVENT;
+        *pNumValues = 1;
+        return STEPCOUNTER_DATA_PKT_SZ;
+
+    default:
+        return -1;
+    }
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      HifStreamParser
+ *          Constructor
+ *
+ ***************************************************************************************************/
+HifStreamParser::HifStreamParser(size_t capacity)
+    : _pBuffer(NULL)
+    , _capacity(capacity < 2 * HIF_PACKET_MAX_BYTES ? 2 * HIF_PACKET_MAX_BYTES : capacity)
+    , _head(0)
+    , _tail(0)
+    , _packets(0)
+    , _skippedBytes(0)
+{
+    _pBuffer = (uint8_t*)malloc(_capacity);
+}
+
+
+/****************************************************************************************************
+ * @fn      ~HifStreamParser
+ *          Destructor
+ *
+ ***************************************************************************************************/
+HifStreamParser::~HifStreamParser()
+{
+    free(_pBuffer);
+}
+
+
+/****************************************************************************************************
+ * @fn      packetLength
+ *          Length of the sensor data packet starting with the given 3 qualifier bytes, -1 if they
+ *          do not start one
+ *
+ ***************************************************************************************************/
+int HifStreamParser::packetLength(const uint8_t* pQualifier)
+{
+    HifPacketFormat_t format;
+    uint8_t numValues;
+
+    return _packetLayout(pQualifier, &format, &numValues);
+}
+
+
+/****************************************************************************************************
+ * @fn      writePointer
+ *          Room for the next read. A partial packet is moved to the start of the buffer only when
+ *          less than a packet's worth of room is left behind it
+ *
+ ***************************************************************************************************/
+uint8_t* HifStreamParser::writePointer(size_t* pRoom)
+{
+    if (_head == _tail) {
+        _head = 0;
+        _tail = 0;
+    } else if (_capacity - _tail < HIF_PACKET_MAX_BYTES) {
+        memmove(_pBuffer, _pBuffer + _head, _tail - _head);
+        _tail -= _head;
+        _head = 0;
+    }
+
+    *pRoom = _capacity - _tail;
+    return _pBuffer + _tail;
+}
+
+
+/****************************************************************************************************
+ * @fn      commit
+ *          Accounts for bytes read to writePointer()
+ *
+ ***************************************************************************************************/
+void HifStreamParser::commit(size_t length)
+{
+    _tail += length;
+    if (_tail > _capacity) {
+        _tail = _capacity;
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      next
+ *          Decodes the next complete packet in the buffer, skipping bytes that do not start one
+ *
+ ***************************************************************************************************/
+bool HifStreamParser::next(HifPacket_t* pPacket)
+{
+    while (_tail - _head >= HIF_QUALIFIER_BYTES) {
+        const uint8_t* pBytes = _pBuffer + _head;
+        HifPacketFormat_t format;
+        uint8_t numValues;
+        const int length = _packetLayout(pBytes, &format, &numValues);
+
+        if (length < 0) {
+            _head++;
+            _skippedBytes++;
+            continue;
+        }
+        if ((size_t)length > _tail - _head) {
+            return false;
+        }
+
+        pPacket->sensorType = M_SensorType(pBytes[1]);
+        pPacket->isPrivate = (pBytes[0] & SENSOR_ANDROID_TYPE_MASK) != 0;
+        pPacket->format = format;
+        pPacket->numValues = numValues;
+        pPacket->length = length;
+
+        const uint8_t* pData = pBytes + HIF_QUALIFIER_BYTES;
+        if (format == HIF_PACKET_RAW) {
+            pPacket->timeStamp = _bigEndian32(pData);
+            pData += sizeof(uint32_t);
+            for (uint8_t k = 0; k < numValues; k++) {
+                pPacket->value[k] = _bigEndian16(pData + k * sizeof(int16_t));
+            }
+        } else {
+            pPacket->timeStamp = (int64_t)_bigEndian64(pData);
+            pData += sizeof(uint64_t);
+            if (format == HIF_PACKET_FIXPOINT) {
+                for (uint8_t k = 0; k < numValues; k++) {
+                    pPacket->value[k] = (int32_t)_bigEndian32(pData + k * sizeof(int32_t));
+                }
+            } else if (pPacket->sensorType == SENSOR_STEP_COUNTER) {
+                pPacket->value[0] = (int64_t)_bigEndian64(pData);
+            } else {
+                pPacket->value[0] = pData[0];
+            }
+        }
+
+        _head += length;
+        _packets++;
+        return true;
+    }
+
+    return false;
+}
+
+
+/****************************************************************************************************
+ * @fn      reset
+ *          Drops the buffered bytes
+ *
+ ***************************************************************************************************/
+void HifStreamParser::reset()
+{
+    _head = 0;
+    _tail = 0;
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E N D   O F   F I L E
+\*-------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,111 @@
+/* Open Sensor Platform Project
+ * https://github.com/sensorplatforms/open-sensor-platform
+ *
+ * Copyright (C) 2013 Sensor Platforms Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef OSP_HIFPARSER_H
+#define OSP_HIFPARSER_H
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    I N C L U D E   F I L E S
+\*-------------------------------------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stddef.h>
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    C O N S T A N T S   &   M A C R O S
+\*-------------------------------------------------------------------------------------------------*/
+#define HIF_STREAM_DEFAULT_BYTES        (64 * 1024)  /* stream buffer, also the largest read */
+#define HIF_PACKET_MAX_BYTES            64           /* larger than any sensor data packet */
+#define HIF_PACKET_MAX_VALUES           4
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    T Y P E / C L A S S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+/* Layout of a decoded packet; which one is given by the packet's formats, see SensorPackets.h */
+typedef enum {
+    HIF_PACKET_RAW,             //!< 16-bit counts, 32-bit time stamp in hub timer ticks
+    HIF_PACKET_FIXPOINT,        //!< 32-bit fixed point values, Q24 seconds time stamp
+    HIF_PACKET_EVENT,           //!< 8-bit event flag or 64-bit count, Q24 seconds time stamp
+} HifPacketFormat_t;
+
+/* One sensor data packet, decoded from big endian but otherwise as sent */
+typedef struct {
+    uint8_t sensorType;         //!< M_SensorType() of the sensor id byte
+    bool isPrivate;             //!< sensorType is a PSENSOR_ rather than an Android type
+    HifPacketFormat_t format;
+    uint8_t numValues;
+    uint16_t length;            //!< bytes the packet took in the stream
+    int64_t timeStamp;
+    int64_t value[HIF_PACKET_MAX_VALUES];
+} HifPacket_t;
+
+/*
+ * Splits a byte stream of back-to-back host interface packets, as the hub queues them for the
+ * host, into packets. Reads land directly in the parser's buffer (writePointer/commit) and packets
+ * are decoded where they lie, so the only copy is moving an incomplete packet back to the start
+ * of the buffer. HIF packets carry no length or sync word: the length follows from the qualifier
+ * bytes, and a qualifier that is not a known sensor data packet is skipped a byte at a time.
+ */
+class HifStreamParser
+{
+public:
+    explicit HifStreamParser(size_t capacity = HIF_STREAM_DEFAULT_BYTES);
+    ~HifStreamParser();
+
+    //! where the next read should go and how much fits there
+    uint8_t* writePointer(size_t* pRoom);
+    //! length bytes were read to writePointer()
+    void commit(size_t length);
+    //! decodes the next complete packet; false when more bytes are needed
+    bool next(HifPacket_t* pPacket);
+    //! drops everything buffered, e.g. after the device was reopened
+    void reset();
+
+    //! length of the sensor data packet starting with this qualifier, -1 if it is not one
+    static int packetLength(const uint8_t* pQualifier);
+
+    uint64_t packets() const { return _packets; }
+    uint64_t skippedBytes() const { return _skippedBytes; }
+    size_t buffered() const { return _tail - _head; }
+
+private:
+    HifStreamParser(const HifStreamParser&);
+    HifStreamParser& operator=(const HifStreamParser&);
+
+    uint8_t* _pBuffer;
+    size_t _capacity;
+    size_t _head;               //!< first byte not parsed yet
+    size_t _tail;               //!< end of the bytes read
+    uint64_t _packets;
+    uint64_t _skippedBytes;
+};
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E X T E R N A L   V A R I A B L E S   &   F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   F U N C T I O N   D E C L A R A T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+#endif // OSP_HIFPARSER_H
+/*-------------------------------------------------------------------------------------------------*\
+ |    E N D   O F   F I L E
+\*-------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,192 @@
+/* Open Sensor Platform Project
+ * https://github.com/sensorplatforms/open-sensor-platform
+ *
+ * Copyright (C) 2013 Sensor Platforms Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*-------------------------------------------------------------------------------------------------*\
+ |    I N C L U D E   F I L E S
+\*-------------------------------------------------------------------------------------------------*/
+#include <cstring>
+#include "osp_latencyhist.h"
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E X T E R N A L   V A R I A B L E S   &   F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   C O N S T A N T S   &   M A C R O S
+\*-------------------------------------------------------------------------------------------------*/
+/* Values below this are their own bucket */
+#define LATENCY_HIST_LINEAR_LIMIT       (2 * LATENCY_HIST_SUB_BUCKETS)
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   T Y P E   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    S T A T I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    F O R W A R D   F U N C T I O N   D E C L A R A T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      bucketOf
+ *          Bucket index of a value: the power of two it falls in, then the linear sub-bucket
+ *
+ ***************************************************************************************************/
+size_t LatencyHistogram::bucketOf(uint64_t ns)
+{
+    if (ns < LATENCY_HIST_LINEAR_LIMIT) {
+        return (size_t)ns;
+    }
+
+    const int exponent = 63 - __builtin_clzll(ns);
+    if (exponent > LATENCY_HIST_MAX_EXPONENT) {
+        return LATENCY_HIST_NUM_BUCKETS - 1;
+    }
+
+    const int shift = exponent - LATENCY_HIST_SUB_BITS;
+    return (size_t)(exponent - LATENCY_HIST_SUB_BITS + 1) * LATENCY_HIST_SUB_BUCKETS +
+           (size_t)((ns >> shift) - LATENCY_HIST_SUB_BUCKETS);
+}
+
+
+/****************************************************************************************************
+ * @fn      bucketUpperBound
+ *          Largest value that lands in a bucket
+ *
+ ***************************************************************************************************/
+uint64_t LatencyHistogram::bucketUpperBound(size_t bucket)
+{
+    if (bucket < LATENCY_HIST_LINEAR_LIMIT) {
+        return bucket;
+    }
+
+    const int exponent = (int)(bucket / LATENCY_HIST_SUB_BUCKETS) + LATENCY_HIST_SUB_BITS - 1;
+    const int shift = exponent - LATENCY_HIST_SUB_BITS;
+    const uint64_t sub = bucket % LATENCY_HIST_SUB_BUCKETS;
+
+    return ((LATENCY_HIST_SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      LatencyHistogram
+ *          Class Constructor
+ *
+ ***************************************************************************************************/
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+
+/****************************************************************************************************
+ * @fn      record
+ *          Adds one value. Lock-free; concurrent callers only contend on the bucket they hit
+ *
+ ***************************************************************************************************/
+void LatencyHistogram::record(uint64_t ns)
+{
+    uint64_t max = _max.load(std::memory_order_relaxed);
+
+    _buckets[bucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+    while ((ns > max) &&
+           !_max.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      summarize
+ *          Count, percentiles and maximum. Percentiles are reported as the upper bound of the
+ *          bucket they fall in, capped by the maximum seen
+ *
+ ***************************************************************************************************/
+void LatencyHistogram::summarize(LatencySummary_t* pSummary) const
+{
+    static const struct {
+        uint64_t perMille;
+        size_t offset;
+    } quantiles[] = {
+        { 500, offsetof(LatencySummary_t, p50) },
+        { 990, offsetof(LatencySummary_t, p99) },
+        { 999, offsetof(LatencySummary_t, p999) },
+    };
+    uint64_t counts[LATENCY_HIST_NUM_BUCKETS];
+    uint64_t total = 0;
+
+    memset(pSummary, 0, sizeof(*pSummary));
+    for (size_t b = 0; b < LATENCY_HIST_NUM_BUCKETS; b++) {
+        counts[b] = _buckets[b].load(std::memory_order_relaxed);
+        total += counts[b];
+    }
+    pSummary->count = total;
+    pSummary->max = _max.load(std::memory_order_relaxed);
+    if (total == 0) {
+        return;
+    }
+
+    for (size_t q = 0; q < sizeof(quantiles)/sizeof(quantiles[0]); q++) {
+        //rank of the quantile sample, rounded up so p99.9 of 10 samples is the largest one
+        const uint64_t rank = (total * quantiles[q].perMille + 999) / 1000;
+        uint64_t* pValue = (uint64_t*)((char*)pSummary + quantiles[q].offset);
+        uint64_t seen = 0;
+
+        for (size_t b = 0; b < LATENCY_HIST_NUM_BUCKETS; b++) {
+            seen += counts[b];
+            if (seen >= rank) {
+                *pValue = bucketUpperBound(b);
+                break;
+            }
+        }
+        if (*pValue > pSummary->max) {
+            *pValue = pSummary->max;
+        }
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      reset
+ *          Clears all buckets. Values recorded concurrently may or may not survive
+ *
+ ***************************************************************************************************/
+void LatencyHistogram::reset()
+{
+    for (size_t b = 0; b < LATENCY_HIST_NUM_BUCKETS; b++) {
+        _buckets[b].store(0, std::memory_order_relaxed);
+    }
+    _max.store(0, std::memory_order_relaxed);
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E N D   O F   F I L E
+\*-------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,88 @@
+/* Open Sensor Platform Project
+ * https://github.com/sensorplatforms/open-sensor-platform
+ *
+ * Copyright (C) 2013 Sensor Platforms Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef OSP_LATENCYHIST_H
+#define OSP_LATENCYHIST_H
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    I N C L U D E   F I L E S
+\*-------------------------------------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    C O N S T A N T S   &   M A C R O S
+\*-------------------------------------------------------------------------------------------------*/
+/* Each power of two is split into 2^LATENCY_HIST_SUB_BITS linear buckets, so a bucket is at most
+   1/16th (6.25%) of its value wide. Values of 2^(LATENCY_HIST_MAX_EXPONENT + 1) ns (~137 s) and up
+   land in the last bucket */
+#define LATENCY_HIST_SUB_BITS           4
+#define LATENCY_HIST_SUB_BUCKETS        (1 << LATENCY_HIST_SUB_BITS)
+#define LATENCY_HIST_MAX_EXPONENT       36
+#define LATENCY_HIST_NUM_BUCKETS \
+    ((LATENCY_HIST_MAX_EXPONENT - LATENCY_HIST_SUB_BITS + 2) * LATENCY_HIST_SUB_BUCKETS)
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    T Y P E / C L A S S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+typedef struct {
+    uint64_t count;
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t max;
+} LatencySummary_t;
+
+//! fixed memory log-linear histogram of nanosecond values. record() is lock-free and may be
+//! called from any number of threads; summarize() reads a racy but consistent-enough snapshot
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void record(uint64_t ns);
+    void summarize(LatencySummary_t* pSummary) const;
+    void reset();
+
+private:
+    LatencyHistogram(const LatencyHistogram&);
+    LatencyHistogram& operator=(const LatencyHistogram&);
+
+    static size_t bucketOf(uint64_t ns);
+    static uint64_t bucketUpperBound(size_t bucket);
+
+    std::atomic<uint64_t> _buckets[LATENCY_HIST_NUM_BUCKETS];
+    std::atomic<uint64_t> _max;
+};
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E X T E R N A L   V A R I A B L E S   &   F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   F U N C T I O N   D E C L A R A T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+#endif // OSP_LATENCYHIST_H
+/*-------------------------------------------------------------------------------------------------*\
+ |    E N D   O F   F I L E
+\*-------------------------------------------------------------------------------------------------*/
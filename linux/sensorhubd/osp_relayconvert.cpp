@@ -0,0 +1,367 @@
+/* Open Sensor Platform Project
+ * https://github.com/sensorplatforms/open-sensor-platform
+ *
+ * Copyright (C) 2013 Sensor Platforms Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*-------------------------------------------------------------------------------------------------*\
+ |    I N C L U D E   F I L E S
+\*-------------------------------------------------------------------------------------------------*/
+#include "osp_relayconvert.h"
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+# define RELAY_CONVERT_HAVE_X86
+# include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+# define RELAY_CONVERT_HAVE_NEON
+# include <arm_neon.h>
+#endif
+
+/*
+ * All implementations do the same two exact steps per axis: int16 -> float (exact) and one
+ * single precision multiply, so results are bit-identical as long as nothing fuses or flushes.
+ * ARMv7 NEON flushes denormals to zero; that only matters for scale factors below ~1e-34.
+ */
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E X T E R N A L   V A R I A B L E S   &   F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   C O N S T A N T S   &   M A C R O S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   T Y P E   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+typedef void (*RelayConvertFunc_t)(const union sensor_relay_broadcast_node* pNodes, size_t count,
+                                   const uint8_t axisSource[3], const osp_float_t scale[3],
+                                   RelayMotionBlock_t* pBlock);
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    F O R W A R D   F U N C T I O N   D E C L A R A T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+static void _convertScalar(const union sensor_relay_broadcast_node* pNodes, size_t count,
+                           const uint8_t axisSource[3], const osp_float_t scale[3],
+                           RelayMotionBlock_t* pBlock);
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    S T A T I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+static RelayConvertFunc_t _convertMotion = _convertScalar;
+
+static const char* const _implNames[RELAY_CONVERT_IMPL_COUNT] = {
+    "scalar", "sse2", "avx2", "neon"
+};
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      _convertScalarRange
+ *          Reference conversion of nodes [first, count); also finishes the tail of vector runs
+ *
+ ***************************************************************************************************/
+static void _convertScalarRange(const union sensor_relay_broadcast_node* pNodes, size_t first,
+                                size_t count, const uint8_t axisSource[3],
+                                const osp_float_t scale[3], RelayMotionBlock_t* pBlock)
+{
+    for (size_t i = first; i < count; i++) {
+        const int16_t* pRaw = pNodes[i].sensorData.Data;
+
+        pBlock->axis[0][i] = scale[0] * (osp_float_t)pRaw[axisSource[0]];
+        pBlock->axis[1][i] = scale[1] * (osp_float_t)pRaw[axisSource[1]];
+        pBlock->axis[2][i] = scale[2] * (osp_float_t)pRaw[axisSource[2]];
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      _convertScalar
+ *          Scalar implementation
+ *
+ ***************************************************************************************************/
+static void _convertScalar(const union sensor_relay_broadcast_node* pNodes, size_t count,
+                           const uint8_t axisSource[3], const osp_float_t scale[3],
+                           RelayMotionBlock_t* pBlock)
+{
+    _convertScalarRange(pNodes, 0, count, axisSource, scale, pBlock);
+}
+
+
+#ifdef RELAY_CONVERT_HAVE_X86
+/****************************************************************************************************
+ * @fn      _transposeSse2
+ *          Turns the x,y,z of 4 nodes into (x0 x1 x2 x3 y0 y1 y2 y3) and (z0 z1 z2 z3 ....)
+ *
+ ***************************************************************************************************/
+static inline void _transposeSse2(const union sensor_relay_broadcast_node* pNodes,
+                                  __m128i* pXy, __m128i* pZp)
+{
+    const __m128i n0 = _mm_loadl_epi64((const __m128i*)pNodes[0].sensorData.Data);
+    const __m128i n1 = _mm_loadl_epi64((const __m128i*)pNodes[1].sensorData.Data);
+    const __m128i n2 = _mm_loadl_epi64((const __m128i*)pNodes[2].sensorData.Data);
+    const __m128i n3 = _mm_loadl_epi64((const __m128i*)pNodes[3].sensorData.Data);
+
+    // x0 x1 y0 y1 z0 z1 .. / x2 x3 y2 y3 z2 z3 ..
+    const __m128i n01 = _mm_unpacklo_epi16(n0, n1);
+    const __m128i n23 = _mm_unpacklo_epi16(n2, n3);
+
+    *pXy = _mm_unpacklo_epi32(n01, n23);
+    *pZp = _mm_unpackhi_epi32(n01, n23);
+}
+
+
+/****************************************************************************************************
+ * @fn      _convertSse2
+ *          SSE2 implementation, 4 nodes per step. Loads x,y,z (plus 2 bytes of padding) of each
+ *          node and transposes them into one vector per device axis
+ *
+ ***************************************************************************************************/
+static void _convertSse2(const union sensor_relay_broadcast_node* pNodes, size_t count,
+                         const uint8_t axisSource[3], const osp_float_t scale[3],
+                         RelayMotionBlock_t* pBlock)
+{
+    const __m128 scale0 = _mm_set1_ps(scale[0]);
+    const __m128 scale1 = _mm_set1_ps(scale[1]);
+    const __m128 scale2 = _mm_set1_ps(scale[2]);
+    size_t i;
+
+    for (i = 0; i + 4 <= count; i += 4) {
+        __m128i xy, zp;
+
+        _transposeSse2(&pNodes[i], &xy, &zp);
+
+        // sign extend to int32 by placing each int16 in the upper half and shifting back down
+        __m128 device[3];
+        device[0] = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(xy, xy), 16));
+        device[1] = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(xy, xy), 16));
+        device[2] = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(zp, zp), 16));
+
+        _mm_storeu_ps(&pBlock->axis[0][i], _mm_mul_ps(scale0, device[axisSource[0]]));
+        _mm_storeu_ps(&pBlock->axis[1][i], _mm_mul_ps(scale1, device[axisSource[1]]));
+        _mm_storeu_ps(&pBlock->axis[2][i], _mm_mul_ps(scale2, device[axisSource[2]]));
+    }
+
+    _convertScalarRange(pNodes, i, count, axisSource, scale, pBlock);
+}
+
+
+/****************************************************************************************************
+ * @fn      _convertAvx2
+ *          AVX2 implementation, 8 nodes per step: two SSE2 transposes, one per 128-bit lane.
+ *          The per-node loads dominate, so it measures no faster than SSE2 (and a gather based
+ *          version slower); RelayConvert_Best does not pick it
+ *
+ ***************************************************************************************************/
+__attribute__((target("avx2")))
+static void _convertAvx2(const union sensor_relay_broadcast_node* pNodes, size_t count,
+                         const uint8_t axisSource[3], const osp_float_t scale[3],
+                         RelayMotionBlock_t* pBlock)
+{
+    const __m256 scale0 = _mm256_set1_ps(scale[0]);
+    const __m256 scale1 = _mm256_set1_ps(scale[1]);
+    const __m256 scale2 = _mm256_set1_ps(scale[2]);
+    size_t i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        __m128i xyLo, zpLo, xyHi, zpHi;
+
+        _transposeSse2(&pNodes[i], &xyLo, &zpLo);
+        _transposeSse2(&pNodes[i + 4], &xyHi, &zpHi);
+
+        const __m256i xy = _mm256_inserti128_si256(_mm256_castsi128_si256(xyLo), xyHi, 1);
+        const __m256i zp = _mm256_inserti128_si256(_mm256_castsi128_si256(zpLo), zpHi, 1);
+
+        // unpack works per 128-bit lane, which keeps nodes 0-3 and 4-7 in order
+        __m256 device[3];
+        device[0] = _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_unpacklo_epi16(xy, xy), 16));
+        device[1] = _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_unpackhi_epi16(xy, xy), 16));
+        device[2] = _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_unpacklo_epi16(zp, zp), 16));
+
+        _mm256_storeu_ps(&pBlock->axis[0][i], _mm256_mul_ps(scale0, device[axisSource[0]]));
+        _mm256_storeu_ps(&pBlock->axis[1][i], _mm256_mul_ps(scale1, device[axisSource[1]]));
+        _mm256_storeu_ps(&pBlock->axis[2][i], _mm256_mul_ps(scale2, device[axisSource[2]]));
+    }
+    //the compiler does not always emit it; without it the caller's SSE code pays for the dirty
+    //upper halves on every instruction
+    _mm256_zeroupper();
+
+    _convertScalarRange(pNodes, i, count, axisSource, scale, pBlock);
+}
+#endif
+
+
+#ifdef RELAY_CONVERT_HAVE_NEON
+/****************************************************************************************************
+ * @fn      _convertNeon
+ *          NEON implementation, 4 nodes per step; same transpose as the SSE2 version
+ *
+ ***************************************************************************************************/
+static void _convertNeon(const union sensor_relay_broadcast_node* pNodes, size_t count,
+                         const uint8_t axisSource[3], const osp_float_t scale[3],
+                         RelayMotionBlock_t* pBlock)
+{
+    const float32x4_t scale0 = vdupq_n_f32(scale[0]);
+    const float32x4_t scale1 = vdupq_n_f32(scale[1]);
+    const float32x4_t scale2 = vdupq_n_f32(scale[2]);
+    size_t i;
+
+    for (i = 0; i + 4 <= count; i += 4) {
+        const int16x4_t n0 = vld1_s16(pNodes[i + 0].sensorData.Data);
+        const int16x4_t n1 = vld1_s16(pNodes[i + 1].sensorData.Data);
+        const int16x4_t n2 = vld1_s16(pNodes[i + 2].sensorData.Data);
+        const int16x4_t n3 = vld1_s16(pNodes[i + 3].sensorData.Data);
+
+        // (x0 x1 y0 y1, z0 z1 ..) / (x2 x3 y2 y3, z2 z3 ..)
+        const int16x4x2_t n01 = vzip_s16(n0, n1);
+        const int16x4x2_t n23 = vzip_s16(n2, n3);
+        // (x0 x1 x2 x3, y0 y1 y2 y3) / (z0 z1 z2 z3, ..)
+        const int32x2x2_t xy = vzip_s32(vreinterpret_s32_s16(n01.val[0]),
+                                        vreinterpret_s32_s16(n23.val[0]));
+        const int32x2x2_t zp = vzip_s32(vreinterpret_s32_s16(n01.val[1]),
+                                        vreinterpret_s32_s16(n23.val[1]));
+
+        float32x4_t device[3];
+        device[0] = vcvtq_f32_s32(vmovl_s16(vreinterpret_s16_s32(xy.val[0])));
+        device[1] = vcvtq_f32_s32(vmovl_s16(vreinterpret_s16_s32(xy.val[1])));
+        device[2] = vcvtq_f32_s32(vmovl_s16(vreinterpret_s16_s32(zp.val[0])));
+
+        vst1q_f32(&pBlock->axis[0][i], vmulq_f32(scale0, device[axisSource[0]]));
+        vst1q_f32(&pBlock->axis[1][i], vmulq_f32(scale1, device[axisSource[1]]));
+        vst1q_f32(&pBlock->axis[2][i], vmulq_f32(scale2, device[axisSource[2]]));
+    }
+
+    _convertScalarRange(pNodes, i, count, axisSource, scale, pBlock);
+}
+#endif
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      RelayConvert_Motion
+ *          Converts a run of motion nodes with the selected implementation
+ *
+ ***************************************************************************************************/
+void RelayConvert_Motion(const union sensor_relay_broadcast_node* pNodes, size_t count,
+                         const uint8_t axisSource[3], const osp_float_t scale[3],
+                         RelayMotionBlock_t* pBlock)
+{
+    _convertMotion(pNodes, count, axisSource, scale, pBlock);
+}
+
+
+/****************************************************************************************************
+ * @fn      RelayConvert_IsSupported
+ *          True if the implementation is built in and the CPU can run it
+ *
+ ***************************************************************************************************/
+bool RelayConvert_IsSupported(RelayConvertImpl_t impl)
+{
+    switch (impl) {
+    case RELAY_CONVERT_SCALAR:
+        return true;
+#ifdef RELAY_CONVERT_HAVE_X86
+    case RELAY_CONVERT_SSE2:
+        return true;
+    case RELAY_CONVERT_AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+#ifdef RELAY_CONVERT_HAVE_NEON
+    case RELAY_CONVERT_NEON:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      RelayConvert_Best
+ *          Fastest implementation supported here
+ *
+ ***************************************************************************************************/
+RelayConvertImpl_t RelayConvert_Best(void)
+{
+    static const RelayConvertImpl_t preference[] = {
+        RELAY_CONVERT_SSE2, RELAY_CONVERT_NEON
+    };
+
+    for (size_t i = 0; i < sizeof(preference)/sizeof(preference[0]); i++) {
+        if (RelayConvert_IsSupported(preference[i])) {
+            return preference[i];
+        }
+    }
+    return RELAY_CONVERT_SCALAR;
+}
+
+
+/****************************************************************************************************
+ * @fn      RelayConvert_Select
+ *          Selects the implementation used by RelayConvert_Motion. Call before any drain runs
+ *
+ ***************************************************************************************************/
+RelayConvertImpl_t RelayConvert_Select(RelayConvertImpl_t impl)
+{
+    if (!RelayConvert_IsSupported(impl)) {
+        impl = RELAY_CONVERT_SCALAR;
+    }
+
+    switch (impl) {
+#ifdef RELAY_CONVERT_HAVE_X86
+    case RELAY_CONVERT_SSE2:
+        _convertMotion = _convertSse2;
+        break;
+    case RELAY_CONVERT_AVX2:
+        _convertMotion = _convertAvx2;
+        break;
+#endif
+#ifdef RELAY_CONVERT_HAVE_NEON
+    case RELAY_CONVERT_NEON:
+        _convertMotion = _convertNeon;
+        break;
+#endif
+    default:
+        _convertMotion = _convertScalar;
+        break;
+    }
+
+    return impl;
+}
+
+
+/****************************************************************************************************
+ * @fn      RelayConvert_ImplName
+ *          Printable implementation name
+ *
+ ***************************************************************************************************/
+const char* RelayConvert_ImplName(RelayConvertImpl_t impl)
+{
+    return (impl < RELAY_CONVERT_IMPL_COUNT) ? _implNames[impl] : "unknown";
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E N D   O F   F I L E
+\*-------------------------------------------------------------------------------------------------*/
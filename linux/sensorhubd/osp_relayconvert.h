@@ -0,0 +1,80 @@
+/* Open Sensor Platform Project
+ * https://github.com/sensorplatforms/open-sensor-platform
+ *
+ * Copyright (C) 2013 Sensor Platforms Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef OSP_RELAYCONVERT_H
+#define OSP_RELAYCONVERT_H
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    I N C L U D E   F I L E S
+\*-------------------------------------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stddef.h>
+#include "osp-types.h"
+#include "sensor_relay.h"
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    C O N S T A N T S   &   M A C R O S
+\*-------------------------------------------------------------------------------------------------*/
+#define RELAY_CONVERT_BLOCK_SIZE        32  /* max nodes converted per call */
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    T Y P E / C L A S S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+typedef enum {
+    RELAY_CONVERT_SCALAR,
+    RELAY_CONVERT_SSE2,
+    RELAY_CONVERT_AVX2,
+    RELAY_CONVERT_NEON,
+    RELAY_CONVERT_IMPL_COUNT
+} RelayConvertImpl_t;
+
+/* Structure-of-arrays result: axis[k][i] is output axis k of node i */
+typedef struct {
+    osp_float_t axis[3][RELAY_CONVERT_BLOCK_SIZE];
+} RelayMotionBlock_t;
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E X T E R N A L   V A R I A B L E S   &   F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   F U N C T I O N   D E C L A R A T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+/* Converts count (<= RELAY_CONVERT_BLOCK_SIZE) consecutive motion nodes:
+   pBlock->axis[k][i] = scale[k] * pNodes[i].sensorData.Data[axisSource[k]].
+   Every implementation gives bit-identical results to the scalar one */
+void RelayConvert_Motion(const union sensor_relay_broadcast_node* pNodes, size_t count,
+                         const uint8_t axisSource[3], const osp_float_t scale[3],
+                         RelayMotionBlock_t* pBlock);
+
+/* Selects the implementation used by RelayConvert_Motion (the best supported one by default).
+   An implementation this CPU/build does not support selects the scalar one. Returns the
+   implementation actually selected */
+RelayConvertImpl_t RelayConvert_Select(RelayConvertImpl_t impl);
+bool RelayConvert_IsSupported(RelayConvertImpl_t impl);
+RelayConvertImpl_t RelayConvert_Best(void);
+const char* RelayConvert_ImplName(RelayConvertImpl_t impl);
+
+
+#endif // OSP_RELAYCONVERT_H
+/*-------------------------------------------------------------------------------------------------*\
+ |    E N D   O F   F I L E
+\*-------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,511 @@
+/* Open Sensor Platform Project
+ * https://github.com/sensorplatforms/open-sensor-platform
+ *
+ * Copyright (C) 2013 Sensor Platforms Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*-------------------------------------------------------------------------------------------------*\
+ |    I N C L U D E   F I L E S
+\*-------------------------------------------------------------------------------------------------*/
+#include <cstring>
+#include <assert.h>
+#include <atomic>
+#include <vector>
+
+#include "osp_debuglogging.h"
+#include "osp_configuration.h"
+#include "osp_relaydecoder.h"
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E X T E R N A L   V A R I A B L E S   &   F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   C O N S T A N T S   &   M A C R O S
+\*-------------------------------------------------------------------------------------------------*/
+#define RELAY_NUM_SENSOR_IDS            256 /* sensorId is a uint8_t in the relay node */
+#define RELAY_SENSOR_DISABLED           (-1) /* RelayTransform_t.sensorIndex: known, not published */
+#define RELAY_SENSOR_UNKNOWN            (-2) /* RelayTransform_t.sensorIndex: not a relay sensor */
+#define RELAY_QUATERNION_ONE            (1 << QFIXEDPOINTPRECISE) /* 32Q24 quaternion components */
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   T Y P E   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+/* A replaced decode table and the readers that may still hold it */
+typedef struct {
+    const RelayTransformTable_t* pTable;
+    bool readerActive[RELAY_DECODER_MAX_READERS];
+    uint64_t quiescentCounts[RELAY_DECODER_MAX_READERS];   //!< reader counts at the swap
+} RelayRetiredTable_t;
+/* Layout of the sensor_relay_broadcast_node member a sensor id is sent with */
+typedef enum {
+    RELAY_NODE_MOTION,          /* sensorData: 3 x int16 axes, converted by the device config */
+    RELAY_NODE_QUATERNION,      /* quaternionData: w/x/y/z in 32Q24 */
+    RELAY_NODE_STEPS,           /* stepsdata: step count */
+    RELAY_NODE_CHANGE_DETECTOR, /* changeDetectorData: segment type and duration */
+    RELAY_NODE_KIND_COUNT
+} RelayNodeKind_t;
+
+/* One sensor of the relay protocol; the table below is indexed by deviceIndex */
+typedef struct {
+    uint8_t sensorId;           /* sensorId of its relay nodes */
+    RelayNodeKind_t kind;
+    SensorType_t resultType;    /* published as */
+    const char* name;           /* config name */
+} RelaySensor_t;
+
+/* Conversion of one relay sensor id, compiled from the device config at initialization.
+   Output axis k is scale[k] * Data[axisSource[k]]; the sign of an axis is folded into scale */
+typedef struct {
+    int32_t sensorIndex;    /* ACCEL_INDEX.., or RELAY_SENSOR_DISABLED/RELAY_SENSOR_UNKNOWN */
+    RelayNodeKind_t kind;
+    uint8_t axisSource[3];
+    osp_float_t scale[3];
+} RelayTransform_t;
+
+/* Everything a drain needs to decode, swapped as a whole on reconfiguration */
+struct RelayTransformTable {
+    int64_t tickNsec;
+    RelayTransform_t transforms[RELAY_NUM_SENSOR_IDS];
+};
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    S T A T I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+/* Adding a relay sensor is an entry here plus its deviceIndex */
+static const RelaySensor_t _relaySensors[MAX_NUM_SENSORS_TO_HANDLE] = {
+    /* ACCEL_INDEX */
+    { SENSOR_ACCELEROMETER,         RELAY_NODE_MOTION,          SENSOR_ACCELEROMETER_UNCALIBRATED,  "acc1" },
+    /* MAG_INDEX */
+    { SENSOR_MAGNETIC_FIELD,        RELAY_NODE_MOTION,          SENSOR_MAGNETIC_FIELD_UNCALIBRATED, "mag1" },
+    /* GYRO_INDEX */
+    { SENSOR_GYROSCOPE,             RELAY_NODE_MOTION,          SENSOR_GYROSCOPE_UNCALIBRATED,      "gyr1" },
+    /* STEP_COUNTER_INDEX */
+    { SENSOR_STEP_COUNTER,          RELAY_NODE_STEPS,           SENSOR_STEP_COUNTER,                "stc1" },
+    /* SIG_MOTION_INDEX */
+    { SENSOR_CONTEXT_DEVICE_MOTION, RELAY_NODE_CHANGE_DETECTOR, SENSOR_CONTEXT_DEVICE_MOTION,       "sigm1" },
+    /* STEP_DETECTOR_INDEX */
+    { SENSOR_STEP_DETECTOR,         RELAY_NODE_STEPS,           SENSOR_STEP_DETECTOR,               "std1" },
+    /* ROTATION_VECTOR_INDEX */
+    { SENSOR_ROTATION_VECTOR,       RELAY_NODE_QUATERNION,      SENSOR_ROTATION_VECTOR,             "rv1" },
+    /* GAME_ROTATION_VECTOR_INDEX */
+    { SENSOR_GAME_ROTATION_VECTOR,  RELAY_NODE_QUATERNION,      SENSOR_GAME_ROTATION_VECTOR,        "grv1" },
+};
+
+static std::atomic<const RelayTransformTable_t*> _pTransforms(NULL);
+
+/* Replaced tables wait for the readers that may still decode with them. Readers, retired tables
+   and the reader table itself are only changed by the compiling thread; the counts are bumped by
+   the readers */
+static std::atomic<uint64_t> _readerQuiescentCounts[RELAY_DECODER_MAX_READERS];
+static bool _readerActive[RELAY_DECODER_MAX_READERS];
+static int32_t _untrackedReaders = 0;
+static std::vector<RelayRetiredTable_t> _replacedTransforms;
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    F O R W A R D   F U N C T I O N   D E C L A R A T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+typedef void (*RelayNodeDecoder_t)(const RelayTransform_t* pTransform, int64_t tickNsec,
+                                   const union sensor_relay_broadcast_node* pNodes, size_t count,
+                                   RelaySample_t* pSamples);
+
+static void _decodeMotion(const RelayTransform_t* pTransform, int64_t tickNsec,
+                          const union sensor_relay_broadcast_node* pNodes, size_t count,
+                          RelaySample_t* pSamples);
+static void _decodeQuaternion(const RelayTransform_t* pTransform, int64_t tickNsec,
+                              const union sensor_relay_broadcast_node* pNodes, size_t count,
+                              RelaySample_t* pSamples);
+static void _decodeSteps(const RelayTransform_t* pTransform, int64_t tickNsec,
+                         const union sensor_relay_broadcast_node* pNodes, size_t count,
+                         RelaySample_t* pSamples);
+static void _decodeChangeDetector(const RelayTransform_t* pTransform, int64_t tickNsec,
+                                  const union sensor_relay_broadcast_node* pNodes, size_t count,
+                                  RelaySample_t* pSamples);
+
+/* Indexed by RelayNodeKind_t */
+static const RelayNodeDecoder_t _nodeDecoders[RELAY_NODE_KIND_COUNT] = {
+    _decodeMotion,
+    _decodeQuaternion,
+    _decodeSteps,
+    _decodeChangeDetector,
+};
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      _decodeMotion
+ *          Axis swap and unit conversion of a run of 3-axis nodes, in one batch
+ *
+ ***************************************************************************************************/
+static void _decodeMotion(const RelayTransform_t* pTransform, int64_t tickNsec,
+                          const union sensor_relay_broadcast_node* pNodes, size_t count,
+                          RelaySample_t* pSamples)
+{
+    RelayMotionBlock_t block;
+
+    RelayConvert_Motion(pNodes, count, pTransform->axisSource, pTransform->scale, &block);
+
+    for (size_t i = 0; i < count; i++) {
+        pSamples[i].data.timestamp.ll = (int64_t)(tickNsec * pNodes[i].sensorData.TimeStamp);
+        pSamples[i].data.data[0].f = block.axis[0][i];
+        pSamples[i].data.data[1].f = block.axis[1][i];
+        pSamples[i].data.data[2].f = block.axis[2][i];
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      _decodeQuaternion
+ *          Rotation vectors are published as the x/y/z of the unit quaternion, like Android's
+ *          values[0..2]; w follows from them
+ *
+ ***************************************************************************************************/
+static void _decodeQuaternion(const RelayTransform_t* pTransform, int64_t tickNsec,
+                              const union sensor_relay_broadcast_node* pNodes, size_t count,
+                              RelaySample_t* pSamples)
+{
+    for (size_t i = 0; i < count; i++) {
+        const struct sensor_relay_quaternion_sensor_broadcast_node* pNode = &pNodes[i].quaternionData;
+
+        pSamples[i].data.timestamp.ll = (int64_t)(tickNsec * pNode->TimeStamp);
+        //x, y, z, w as Android orders a rotation vector; the node carries w first
+        for (int k = 0; k < 3; k++) {
+            pSamples[i].data.data[k].f = (osp_float_t)pNode->Data[k + 1] / RELAY_QUATERNION_ONE;
+        }
+        pSamples[i].data.data[3].f = (osp_float_t)pNode->Data[0] / RELAY_QUATERNION_ONE;
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      _decodeSteps
+ *          data[0].i carries the node's step count: steps since the last node for the step
+ *          detector, the running count for the step counter
+ *
+ ***************************************************************************************************/
+static void _decodeSteps(const RelayTransform_t* pTransform, int64_t tickNsec,
+                         const union sensor_relay_broadcast_node* pNodes, size_t count,
+                         RelaySample_t* pSamples)
+{
+    for (size_t i = 0; i < count; i++) {
+        const struct sensor_relay_steps_broadcast_node* pNode = &pNodes[i].stepsdata;
+
+        pSamples[i].data.timestamp.ll = (int64_t)(tickNsec * pNode->TimeStamp);
+        pSamples[i].data.data[0].i = (uint16_t)pNode->Data[0];
+        pSamples[i].data.data[1].i = 0;
+        pSamples[i].data.data[2].i = 0;
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      _decodeChangeDetector
+ *          data[0].i is the segment type, data[1].i its duration in microseconds (saturated)
+ *
+ ***************************************************************************************************/
+static void _decodeChangeDetector(const RelayTransform_t* pTransform, int64_t tickNsec,
+                                  const union sensor_relay_broadcast_node* pNodes, size_t count,
+                                  RelaySample_t* pSamples)
+{
+    for (size_t i = 0; i < count; i++) {
+        const struct sensor_relay_motion_change_detector_broadcast_node* pNode =
+                &pNodes[i].changeDetectorData;
+        const int64_t durationUs = tickNsec * pNode->duration / 1000;
+
+        pSamples[i].data.timestamp.ll = (int64_t)(tickNsec * pNode->TimeStamp);
+        pSamples[i].data.data[0].i = pNode->type;
+        pSamples[i].data.data[1].i = (durationUs > INT32_MAX) ? INT32_MAX : (int32_t)durationUs;
+        pSamples[i].data.data[2].i = 0;
+    }
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      RelayDecoder_SensorName
+ *          Config name of a sensor index
+ *
+ ***************************************************************************************************/
+const char* RelayDecoder_SensorName(int32_t sensorIndex)
+{
+    if ((sensorIndex < 0) || (sensorIndex >= MAX_NUM_SENSORS_TO_HANDLE)) {
+        return "";
+    }
+    return _relaySensors[sensorIndex].name;
+}
+
+
+/****************************************************************************************************
+ * @fn      RelayDecoder_LoadDeviceConfig
+ *          Reads the per sensor device configuration
+ *
+ ***************************************************************************************************/
+void RelayDecoder_LoadDeviceConfig(DeviceConfig_t deviceConfig[MAX_NUM_SENSORS_TO_HANDLE])
+{
+    const OSPConfig::Snapshot_t* pSnapshot = OSPConfig::snapshot();
+
+    for (int index = 0; index < MAX_NUM_SENSORS_TO_HANDLE; ++index){
+        const char* const name = RelayDecoder_SensorName(index);
+        const int record = OSPConfig::findSensor(pSnapshot, name);
+
+        if (record < 0){
+            deviceConfig[index].uinputName = "";
+            for (unsigned int j = 0; j < 3; ++j){
+                deviceConfig[index].swap[j] = j;
+                deviceConfig[index].conversion[j] = 1.0f;
+            }
+            continue;
+        }
+
+        const OSPConfig::SensorRecord_t& sensor = pSnapshot->sensors[record];
+        deviceConfig[index].uinputName = sensor.driverName.empty() ? sensor.name : sensor.driverName;
+        for (unsigned int j = 0; j < 3; ++j){
+            deviceConfig[index].swap[j] = sensor.swap[j];
+            deviceConfig[index].conversion[j] = sensor.conversion[j];
+        }
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      RelayDecoder_Compile
+ *          Turns the relay sensor table and the axis swap and conversion config of each sensor
+ *          into the per sensor id table used when decoding, so decoding a node is one lookup and
+ *          a plain gather-scale-store
+ *
+ ***************************************************************************************************/
+void RelayDecoder_Compile(const DeviceConfig_t deviceConfig[MAX_NUM_SENSORS_TO_HANDLE],
+                          int32_t tickUsec)
+{
+    RelayTransformTable_t* pTable = new RelayTransformTable_t;
+
+    pTable->tickNsec = (int64_t)tickUsec * 1000;
+    for (int id = 0; id < RELAY_NUM_SENSOR_IDS; id++) {
+        pTable->transforms[id].sensorIndex = RELAY_SENSOR_UNKNOWN;
+        pTable->transforms[id].kind = RELAY_NODE_MOTION;
+    }
+
+    for (int32_t sensorIndex = 0; sensorIndex < MAX_NUM_SENSORS_TO_HANDLE; sensorIndex++) {
+        const RelaySensor_t* pSensor = &_relaySensors[sensorIndex];
+        const DeviceConfig_t* pConfig = &deviceConfig[sensorIndex];
+        RelayTransform_t* pTransform = &pTable->transforms[pSensor->sensorId];
+        int source[3] = {-1, -1, -1};
+
+        pTransform->kind = pSensor->kind;
+        if (pSensor->kind != RELAY_NODE_MOTION) {
+            //no device config applies; published whenever the hub sends them
+            pTransform->sensorIndex = sensorIndex;
+            continue;
+        }
+
+        //Device axis k lands on output axis swap[k]; invert that into a gather
+        for (int k = 0; k < 3; k++) {
+            if ((pConfig->swap[k] >= 0) && (pConfig->swap[k] < 3) &&
+                (source[pConfig->swap[k]] < 0)) {
+                source[pConfig->swap[k]] = k;
+            }
+        }
+        if ((source[0] < 0) || (source[1] < 0) || (source[2] < 0)) {
+            LOG_Err("swap of %s is not a permutation (%d %d %d), using identity",
+                    RelayDecoder_SensorName(sensorIndex),
+                    pConfig->swap[0], pConfig->swap[1], pConfig->swap[2]);
+            source[0] = 0;
+            source[1] = 1;
+            source[2] = 2;
+        }
+
+        pTransform->sensorIndex = pConfig->uinputName.empty() ? RELAY_SENSOR_DISABLED : sensorIndex;
+        for (int k = 0; k < 3; k++) {
+            pTransform->axisSource[k] = source[k];
+            pTransform->scale[k] = pConfig->conversion[k];
+        }
+    }
+
+    //release: a drain that sees the new pointer sees the table filled in
+    const RelayTransformTable_t* pReplaced = _pTransforms.exchange(pTable, std::memory_order_seq_cst);
+    if (pReplaced != NULL) {
+        RelayRetiredTable_t retired;
+
+        retired.pTable = pReplaced;
+        for (int32_t reader = 0; reader < RELAY_DECODER_MAX_READERS; reader++) {
+            retired.readerActive[reader] = _readerActive[reader];
+            retired.quiescentCounts[reader] =
+                _readerQuiescentCounts[reader].load(std::memory_order_seq_cst);
+        }
+        _replacedTransforms.push_back(retired);
+    }
+    RelayDecoder_Reclaim();
+}
+
+
+/****************************************************************************************************
+ * @fn      RelayDecoder_Transforms
+ *          The current decode table
+ *
+ ***************************************************************************************************/
+const RelayTransformTable_t* RelayDecoder_Transforms(void)
+{
+    return _pTransforms.load(std::memory_order_acquire);
+}
+
+
+/****************************************************************************************************
+ * @fn      RelayDecoder_AddReader
+ *          Registers a thread that decodes with RelayDecoder_Transforms()
+ *
+ ***************************************************************************************************/
+int32_t RelayDecoder_AddReader(void)
+{
+    for (int32_t reader = 0; reader < RELAY_DECODER_MAX_READERS; reader++) {
+        if (!_readerActive[reader]) {
+            _readerActive[reader] = true;
+            return reader;
+        }
+    }
+
+    LOG_Err("more than %d relay decode readers, replaced decode tables are kept",
+            RELAY_DECODER_MAX_READERS);
+    _untrackedReaders++;
+    return -1;
+}
+
+
+/****************************************************************************************************
+ * @fn      RelayDecoder_RemoveReader
+ *          Unregisters a reader whose thread has ended
+ *
+ ***************************************************************************************************/
+void RelayDecoder_RemoveReader(int32_t reader)
+{
+    if (reader < 0) {
+        _untrackedReaders--;
+    } else if (reader < RELAY_DECODER_MAX_READERS) {
+        _readerActive[reader] = false;
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      RelayDecoder_Quiescent
+ *          Reader thread: it holds no decode table
+ *
+ ***************************************************************************************************/
+void RelayDecoder_Quiescent(int32_t reader)
+{
+    if ((reader >= 0) && (reader < RELAY_DECODER_MAX_READERS)) {
+        _readerQuiescentCounts[reader].fetch_add(1, std::memory_order_seq_cst);
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      RelayDecoder_Reclaim
+ *          Frees the replaced decode tables no reader can still hold
+ *
+ ***************************************************************************************************/
+void RelayDecoder_Reclaim(void)
+{
+    if (_untrackedReaders > 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < _replacedTransforms.size(); ) {
+        const RelayRetiredTable_t& retired = _replacedTransforms[i];
+        bool held = false;
+
+        for (int32_t reader = 0; reader < RELAY_DECODER_MAX_READERS; reader++) {
+            //a removed reader has ended; one that took over its slot is waited for as well
+            held = held || (retired.readerActive[reader] && _readerActive[reader] &&
+                            (_readerQuiescentCounts[reader].load(std::memory_order_seq_cst) <=
+                             retired.quiescentCounts[reader]));
+        }
+        if (held) {
+            i++;
+        } else {
+            delete retired.pTable;
+            _replacedTransforms.erase(_replacedTransforms.begin() + i);
+        }
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      RelayDecoder_DecodeRun
+ *          Converts the leading run of nodes of one sensor in a single batch
+ *
+ ***************************************************************************************************/
+size_t RelayDecoder_DecodeRun(const RelayTransformTable_t* pTable,
+                              const union sensor_relay_broadcast_node* pNodes, size_t maxNodes,
+                              RelaySample_t pSamples[RELAY_DECODE_MAX_RUN], size_t* pNumSamples)
+{
+    size_t runLength = 1;
+
+    *pNumSamples = 0;
+    if (maxNodes == 0) {
+        return 0;
+    }
+
+    const uint8_t sensorId = pNodes[0].sensorData.sensorId;
+    const RelayTransform_t* pTransform = &pTable->transforms[sensorId];
+
+    if (maxNodes > RELAY_DECODE_MAX_RUN) {
+        maxNodes = RELAY_DECODE_MAX_RUN;
+    }
+    while ((runLength < maxNodes) && (pNodes[runLength].sensorData.sensorId == sensorId)) {
+        runLength++;
+    }
+
+    if (pTransform->sensorIndex < 0) {
+        if (pTransform->sensorIndex == RELAY_SENSOR_UNKNOWN) {
+            LOG_Err("Invalid sensor id received from relay 0x%-2.2x", sensorId);
+        }
+        return runLength;
+    }
+
+    _nodeDecoders[pTransform->kind](pTransform, pTable->tickNsec, pNodes, runLength, pSamples);
+    for (size_t i = 0; i < runLength; i++) {
+        pSamples[i].sensorIndex = pTransform->sensorIndex;
+    }
+    *pNumSamples = runLength;
+
+    return runLength;
+}
+
+
+/****************************************************************************************************
+ * @fn      RelayDecoder_ResultType
+ *          Result type published for a sensor index
+ *
+ ***************************************************************************************************/
+SensorType_t RelayDecoder_ResultType(int32_t sensorIndex)
+{
+    if ((sensorIndex < 0) || (sensorIndex >= MAX_NUM_SENSORS_TO_HANDLE)) {
+        return SENSOR_ENUM_COUNT;
+    }
+    return _relaySensors[sensorIndex].resultType;
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E N D   O F   F I L E
+\*-------------------------------------------------------------------------------------------------*/
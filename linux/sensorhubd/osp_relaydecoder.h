@@ -0,0 +1,108 @@
+/* Open Sensor Platform Project
+ * https://github.com/sensorplatforms/open-sensor-platform
+ *
+ * Copyright (C) 2013 Sensor Platforms Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef OSP_RELAYDECODER_H
+#define OSP_RELAYDECODER_H
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    I N C L U D E   F I L E S
+\*-------------------------------------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stddef.h>
+#include "osp_remoteprocedurecalls.h"
+#include "osp_relayinterface.h"
+#include "osp_relayconvert.h"
+#include "sensor_relay.h"
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    C O N S T A N T S   &   M A C R O S
+\*-------------------------------------------------------------------------------------------------*/
+#define RELAY_DECODE_MAX_RUN            RELAY_CONVERT_BLOCK_SIZE /* nodes decoded per call */
+#define RELAY_DECODER_MAX_READERS       64  /* see RelayDecoder_AddReader() */
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    T Y P E / C L A S S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+/* CLOCK_MONOTONIC times a sample passed the daemon's pipeline stages, 0 if not taken */
+typedef struct {
+    int64_t wakeupNs;       /* relay wakeup that led to the drain was read */
+    int64_t drainNs;        /* drain of the sample's relay buffer started */
+    int64_t convertedNs;    /* sample's run was converted */
+} RelaySampleStamps_t;
+
+/* Compiled decode table, see RelayDecoder_Compile() */
+typedef struct RelayTransformTable RelayTransformTable_t;
+
+/* A converted sample, ready for the result callbacks */
+typedef struct {
+    int32_t sensorIndex;
+    OSPD_ThreeAxisData_t data;
+    RelaySampleStamps_t stamps;
+} RelaySample_t;
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E X T E R N A L   V A R I A B L E S   &   F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   F U N C T I O N   D E C L A R A T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+/* Config name of the sensor at a deviceIndex ("acc1", ...) */
+const char* RelayDecoder_SensorName(int32_t sensorIndex);
+
+/* Fills the uinput name, axis swap and conversion of each sensor from the configuration */
+void RelayDecoder_LoadDeviceConfig(DeviceConfig_t deviceConfig[MAX_NUM_SENSORS_TO_HANDLE]);
+
+/* Builds a new per sensor id decode table and makes it the current one. Must be done before any
+   decode runs. Tables are replaced, never modified, so a reload can compile while drains run */
+void RelayDecoder_Compile(const DeviceConfig_t deviceConfig[MAX_NUM_SENSORS_TO_HANDLE],
+                          int32_t tickUsec);
+
+/* The current decode table. A drain takes it once and uses it for all of its nodes, so a new
+   configuration takes effect between drains */
+const RelayTransformTable_t* RelayDecoder_Transforms(void);
+
+/* Threads that decode besides the one that compiles are registered as readers, by the compiling
+   thread, before they start. A reader calls RelayDecoder_Quiescent() whenever it holds no table,
+   such as before it blocks. A replaced table is freed by RelayDecoder_Compile() or
+   RelayDecoder_Reclaim() once every reader registered at its replacement has been quiescent or
+   removed since. Returns the reader id; -1 if there are too many, and replaced tables are then
+   kept until that reader is removed */
+int32_t RelayDecoder_AddReader(void);
+void RelayDecoder_RemoveReader(int32_t reader);
+void RelayDecoder_Quiescent(int32_t reader);
+void RelayDecoder_Reclaim(void);
+
+/* Decodes the run of same-sensor nodes at the start of pNodes[0..maxNodes). Returns the number
+   of nodes consumed (at least 1 when maxNodes > 0) and stores the resulting samples in pSamples;
+   *pNumSamples is 0 for sensors that are not published */
+size_t RelayDecoder_DecodeRun(const RelayTransformTable_t* pTable,
+                              const union sensor_relay_broadcast_node* pNodes, size_t maxNodes,
+                              RelaySample_t pSamples[RELAY_DECODE_MAX_RUN], size_t* pNumSamples);
+
+/* Result type published for a deviceIndex, SENSOR_ENUM_COUNT if none */
+SensorType_t RelayDecoder_ResultType(int32_t sensorIndex);
+
+
+#endif // OSP_RELAYDECODER_H
+/*-------------------------------------------------------------------------------------------------*\
+ |    E N D   O F   F I L E
+\*-------------------------------------------------------------------------------------------------*/
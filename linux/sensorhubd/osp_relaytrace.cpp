@@ -0,0 +1,359 @@
+/* Open Sensor Platform Project
+ * https://github.com/sensorplatforms/open-sensor-platform
+ *
+ * Copyright (C) 2013 Sensor Platforms Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*-------------------------------------------------------------------------------------------------*\
+ |    I N C L U D E   F I L E S
+\*-------------------------------------------------------------------------------------------------*/
+#include <cstring>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "osp_debuglogging.h"
+#include "osp_relaytrace.h"
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E X T E R N A L   V A R I A B L E S   &   F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   C O N S T A N T S   &   M A C R O S
+\*-------------------------------------------------------------------------------------------------*/
+#define RELAY_TRACE_RECORD_SIZE \
+    (sizeof(RelayTraceRecord_t) + sizeof(union sensor_relay_broadcast_node))
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   T Y P E   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    S T A T I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    F O R W A R D   F U N C T I O N   D E C L A R A T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      grow
+ *          Extends the file and its mapping so that at least 'needed' more bytes fit
+ *
+ ***************************************************************************************************/
+int RelayTraceWriter::grow(size_t needed)
+{
+    size_t newSize = _mapSize;
+
+    while (newSize < _used + needed) {
+        newSize += RELAY_TRACE_GROW_BYTES;
+    }
+
+    if (ftruncate(_fd, newSize) < 0) {
+        LOG_Err("%s: ftruncate failed: %s\n", __FUNCTION__, strerror(errno));
+        return -1;
+    }
+
+    //the new area is zero filled, which also keeps the end-of-trace marker in place
+    void* pMap = mremap(_pMap, _mapSize, newSize, MREMAP_MAYMOVE);
+    if (pMap == MAP_FAILED) {
+        LOG_Err("%s: mremap failed: %s\n", __FUNCTION__, strerror(errno));
+        return -1;
+    }
+
+    _pMap = (uint8_t*)pMap;
+    _mapSize = newSize;
+    return 0;
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      RelayTraceWriter
+ *          Class Constructor
+ *
+ ***************************************************************************************************/
+RelayTraceWriter::RelayTraceWriter():
+    _fd(-1), _pMap(NULL), _mapSize(0), _used(0), _records(0)
+{
+    pthread_mutex_init(&_lock, NULL);
+}
+
+
+/****************************************************************************************************
+ * @fn      ~RelayTraceWriter
+ *          Class Destructor
+ *
+ ***************************************************************************************************/
+RelayTraceWriter::~RelayTraceWriter()
+{
+    close();
+    pthread_mutex_destroy(&_lock);
+}
+
+
+/****************************************************************************************************
+ * @fn      open
+ *          Creates (truncates) the trace file and writes its header
+ *
+ ***************************************************************************************************/
+int RelayTraceWriter::open(const char* path, int32_t tickUsec)
+{
+    RelayTraceHeader_t header;
+
+    close();
+
+    _fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (_fd < 0) {
+        LOG_Err("Unable to create relay trace %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    _mapSize = RELAY_TRACE_GROW_BYTES;
+    if (ftruncate(_fd, _mapSize) < 0) {
+        LOG_Err("Unable to size relay trace %s: %s\n", path, strerror(errno));
+        close();
+        return -1;
+    }
+    void* pMap = mmap(NULL, _mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (pMap == MAP_FAILED) {
+        LOG_Err("Unable to map relay trace %s: %s\n", path, strerror(errno));
+        _pMap = NULL;
+        close();
+        return -1;
+    }
+    _pMap = (uint8_t*)pMap;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RELAY_TRACE_MAGIC, sizeof(header.magic));
+    header.version = RELAY_TRACE_VERSION;
+    header.nodeSize = sizeof(union sensor_relay_broadcast_node);
+    header.tickUsec = tickUsec;
+    memcpy(_pMap, &header, sizeof(header));
+
+    _used = sizeof(header);
+    _records = 0;
+
+    LOG_Info("Capturing relay nodes to %s", path);
+    return 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      append
+ *          Appends one record per node. The length field is stored last so a concurrent reader
+ *          (or a crash) never sees a partially written record
+ *
+ ***************************************************************************************************/
+void RelayTraceWriter::append(uint32_t cpu, int64_t hostNs,
+                              const union sensor_relay_broadcast_node* pNodes, size_t count)
+{
+    const size_t needed = count * RELAY_TRACE_RECORD_SIZE + sizeof(uint32_t);
+
+    pthread_mutex_lock(&_lock);
+
+    if ((_pMap == NULL) || ((_used + needed > _mapSize) && (grow(needed) < 0))) {
+        pthread_mutex_unlock(&_lock);
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        RelayTraceRecord_t* pRecord = (RelayTraceRecord_t*)(_pMap + _used);
+
+        pRecord->cpu = cpu;
+        pRecord->hostNs = hostNs;
+        memcpy(pRecord + 1, &pNodes[i], sizeof(pNodes[i]));
+        __atomic_store_n(&pRecord->length, (uint32_t)sizeof(pNodes[i]), __ATOMIC_RELEASE);
+
+        _used += RELAY_TRACE_RECORD_SIZE;
+    }
+    _records += count;
+
+    pthread_mutex_unlock(&_lock);
+}
+
+
+/****************************************************************************************************
+ * @fn      close
+ *          Unmaps the trace and trims the file to the records written
+ *
+ ***************************************************************************************************/
+void RelayTraceWriter::close()
+{
+    pthread_mutex_lock(&_lock);
+
+    if (_pMap != NULL) {
+        munmap(_pMap, _mapSize);
+        _pMap = NULL;
+        LOG_Info("Relay trace closed, %llu records", (unsigned long long)_records);
+    }
+    if (_fd >= 0) {
+        if (_used && (ftruncate(_fd, _used) < 0)) {
+            LOG_Err("Unable to trim relay trace: %s\n", strerror(errno));
+        }
+        ::close(_fd);
+        _fd = -1;
+    }
+    _mapSize = 0;
+    _used = 0;
+
+    pthread_mutex_unlock(&_lock);
+}
+
+
+/****************************************************************************************************
+ * @fn      RelayTraceReader
+ *          Class Constructor
+ *
+ ***************************************************************************************************/
+RelayTraceReader::RelayTraceReader():
+    _pMap(NULL), _mapSize(0), _offset(0)
+{
+    memset(&_header, 0, sizeof(_header));
+}
+
+
+/****************************************************************************************************
+ * @fn      ~RelayTraceReader
+ *          Class Destructor
+ *
+ ***************************************************************************************************/
+RelayTraceReader::~RelayTraceReader()
+{
+    close();
+}
+
+
+/****************************************************************************************************
+ * @fn      open
+ *          Maps a trace file and validates its header
+ *
+ ***************************************************************************************************/
+int RelayTraceReader::open(const char* path)
+{
+    struct stat info;
+    int fd;
+
+    close();
+
+    fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        LOG_Err("Unable to open relay trace %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    if ((fstat(fd, &info) < 0) || ((size_t)info.st_size < sizeof(_header))) {
+        LOG_Err("Relay trace %s is truncated\n", path);
+        ::close(fd);
+        return -1;
+    }
+
+    void* pMap = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    ::close(fd);
+    if (pMap == MAP_FAILED) {
+        LOG_Err("Unable to map relay trace %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    _pMap = (const uint8_t*)pMap;
+    _mapSize = info.st_size;
+
+    memcpy(&_header, _pMap, sizeof(_header));
+    if ((memcmp(_header.magic, RELAY_TRACE_MAGIC, sizeof(_header.magic)) != 0) ||
+        (_header.version != RELAY_TRACE_VERSION) ||
+        (_header.nodeSize != sizeof(union sensor_relay_broadcast_node))) {
+        LOG_Err("%s is not a compatible relay trace\n", path);
+        close();
+        return -1;
+    }
+
+    _offset = sizeof(_header);
+    return 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      close
+ *          Unmaps the trace
+ *
+ ***************************************************************************************************/
+void RelayTraceReader::close()
+{
+    if (_pMap != NULL) {
+        munmap((void*)_pMap, _mapSize);
+        _pMap = NULL;
+    }
+    _mapSize = 0;
+    _offset = 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      peek
+ *          Returns the current record, NULL once the end of the trace is reached
+ *
+ ***************************************************************************************************/
+const RelayTraceRecord_t* RelayTraceReader::peek(
+        const union sensor_relay_broadcast_node** ppNode) const
+{
+    const RelayTraceRecord_t* pRecord;
+
+    if ((_pMap == NULL) || (_offset + sizeof(RelayTraceRecord_t) > _mapSize)) {
+        return NULL;
+    }
+
+    pRecord = (const RelayTraceRecord_t*)(_pMap + _offset);
+    if ((pRecord->length != sizeof(union sensor_relay_broadcast_node)) ||
+        (_offset + sizeof(RelayTraceRecord_t) + pRecord->length > _mapSize)) {
+        return NULL;
+    }
+
+    if (ppNode != NULL) {
+        *ppNode = (const union sensor_relay_broadcast_node*)(pRecord + 1);
+    }
+    return pRecord;
+}
+
+
+/****************************************************************************************************
+ * @fn      advance
+ *          Moves past the current record
+ *
+ ***************************************************************************************************/
+void RelayTraceReader::advance()
+{
+    const RelayTraceRecord_t* pRecord = peek(NULL);
+
+    if (pRecord != NULL) {
+        _offset += sizeof(RelayTraceRecord_t) + pRecord->length;
+    }
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E N D   O F   F I L E
+\*-------------------------------------------------------------------------------------------------*/
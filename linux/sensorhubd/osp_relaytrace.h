@@ -0,0 +1,128 @@
+/* Open Sensor Platform Project
+ * https://github.com/sensorplatforms/open-sensor-platform
+ *
+ * Copyright (C) 2013 Sensor Platforms Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef OSP_RELAYTRACE_H
+#define OSP_RELAYTRACE_H
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    I N C L U D E   F I L E S
+\*-------------------------------------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "sensor_relay.h"
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    C O N S T A N T S   &   M A C R O S
+\*-------------------------------------------------------------------------------------------------*/
+#define RELAY_TRACE_MAGIC               "OSPRLTRC"
+#define RELAY_TRACE_VERSION             1
+#define RELAY_TRACE_GROW_BYTES          (4 * 1024 * 1024)  /* file/mapping growth step */
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    T Y P E / C L A S S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+/*
+ * Trace file layout: a RelayTraceHeader_t followed by records, each a RelayTraceRecord_t and
+ * 'length' bytes of payload (one raw sensor_relay_broadcast_node). A zero length ends the trace,
+ * so a file left behind by a crashed writer still reads up to its last complete record.
+ */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t nodeSize;      //!< sizeof(union sensor_relay_broadcast_node) of the writer
+    int32_t tickUsec;       //!< relay time stamp tick the nodes were captured with
+    uint32_t reserved;
+} RelayTraceHeader_t;
+
+typedef struct {
+    uint32_t length;        //!< payload bytes following this record header
+    uint32_t cpu;           //!< relay buffer the node was read from
+    int64_t hostNs;         //!< CLOCK_MONOTONIC time the daemon read the node
+} RelayTraceRecord_t;
+
+//! appends relay nodes to a memory mapped trace file; safe to share between drain threads
+class RelayTraceWriter
+{
+public:
+    RelayTraceWriter();
+    ~RelayTraceWriter();
+
+    int open(const char* path, int32_t tickUsec);
+    void append(uint32_t cpu, int64_t hostNs, const union sensor_relay_broadcast_node* pNodes,
+                size_t count);
+    void close();
+
+    bool isOpen() const { return _pMap != NULL; }
+    uint64_t recordCount() const { return _records; }
+
+private:
+    RelayTraceWriter(const RelayTraceWriter&);
+    RelayTraceWriter& operator=(const RelayTraceWriter&);
+
+    int grow(size_t needed);
+
+    int _fd;
+    uint8_t* _pMap;
+    size_t _mapSize;
+    size_t _used;
+    uint64_t _records;
+    pthread_mutex_t _lock;
+};
+
+//! sequential reader of a trace file written by RelayTraceWriter
+class RelayTraceReader
+{
+public:
+    RelayTraceReader();
+    ~RelayTraceReader();
+
+    int open(const char* path);
+    void close();
+
+    int32_t tickUsec() const { return _header.tickUsec; }
+
+    //! current record and its node, NULL at the end of the trace
+    const RelayTraceRecord_t* peek(const union sensor_relay_broadcast_node** ppNode) const;
+    void advance();
+
+private:
+    RelayTraceReader(const RelayTraceReader&);
+    RelayTraceReader& operator=(const RelayTraceReader&);
+
+    const uint8_t* _pMap;
+    size_t _mapSize;
+    size_t _offset;
+    RelayTraceHeader_t _header;
+};
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E X T E R N A L   V A R I A B L E S   &   F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   F U N C T I O N   D E C L A R A T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+#endif // OSP_RELAYTRACE_H
+/*-------------------------------------------------------------------------------------------------*\
+ |    E N D   O F   F I L E
+\*-------------------------------------------------------------------------------------------------*/
@@ -27,10 +27,12 @@
 /*-------------------------------------------------------------------------------------------------*\
  |    C O N S T A N T S   &   M A C R O S
 \*-------------------------------------------------------------------------------------------------*/
+#define OSPD_RELAY_MAX_HUBS     4   /* sensor hubs one relay backend serves */
 
 /*-------------------------------------------------------------------------------------------------*\
  |    T Y P E   D E F I N I T I O N S
 \*-------------------------------------------------------------------------------------------------*/
+/* One result sample: x/y/z, or a quaternion's x/y/z/w, or fewer integer values */
 typedef struct {
     union {
         double   d;
@@ -39,11 +41,31 @@ typedef struct {
     union {
         float   f;
         int32_t i;
-    } data[3];
+    } data[4];
 } OSPD_ThreeAxisData_t;
 
 typedef void (*OSPD_ResultDataCallback_t)(SensorType_t sensorType, void* data);
 
+/* Counters of the hand-off between the backend's data drain and its publisher */
+typedef struct {
+    uint32_t ringCapacity;      //!< samples the hand-off ring can hold
+    uint32_t ringOccupancy;     //!< samples waiting to be published
+    uint32_t ringHighWater;     //!< largest occupancy seen
+    uint64_t ringOverruns;      //!< samples dropped because the ring was full
+    uint64_t samplesDrained;    //!< samples converted and queued
+    uint64_t samplesPublished;  //!< samples handed to result callbacks
+    uint64_t nodesDecoded;      //!< raw hub records consumed by the drain
+    uint64_t decodeNs;          //!< time the drain spent decoding them
+    double hubClockSkewPpm;     //!< host ns per hub ns - 1, as fitted by the clock sync; the
+                                //!< largest magnitude of all hubs
+    uint64_t hubClockOutliers;  //!< clock sync observations rejected as transport hiccups
+    uint32_t numHubs;           //!< sensor hubs drained, 0 for backends without hubs
+    uint64_t hubSamplesDrained[OSPD_RELAY_MAX_HUBS];    //!< samplesDrained of each hub
+} OSPD_RelayStats_t;
+
+/* Invoked once all results decoded from one wakeup have been delivered */
+typedef void (*OSPD_BatchCompleteCallback_t)(void);
+
 /*-------------------------------------------------------------------------------------------------*\
  |    E X T E R N A L   V A R I A B L E S   &   F U N C T I O N S
 \*-------------------------------------------------------------------------------------------------*/
@@ -57,10 +79,29 @@ typedef void (*OSPD_ResultDataCallback_t)(SensorType_t sensorType, void* data);
 \*-------------------------------------------------------------------------------------------------*/
 osp_status_t OSPD_Initialize(void);
 osp_status_t OSPD_GetVersion(char* versionString, int bufSize);
-osp_status_t OSPD_SubscribeResult(SensorType_t sensorType, OSPD_ResultDataCallback_t dataReadyCallback );
-osp_status_t OSPD_UnsubscribeResult(SensorType_t sensorType);
+/* Any number of subscribers per sensor; periodUs > 0 decimates to one sample per period for that
+ * subscriber, maxReportLatencyUs > 0 batches its samples for up to that long. Unsubscribing with
+ * a NULL callback removes every subscriber of the sensor */
+osp_status_t OSPD_SubscribeResult(SensorType_t sensorType, OSPD_ResultDataCallback_t dataReadyCallback,
+                                  uint32_t periodUs = 0, uint32_t maxReportLatencyUs = 0);
+osp_status_t OSPD_UnsubscribeResult(SensorType_t sensorType,
+                                    OSPD_ResultDataCallback_t dataReadyCallback = NULL);
+/* Delivers the samples batched for the sensor's subscribers now, followed by a batch complete */
+osp_status_t OSPD_FlushResult(SensorType_t sensorType);
+osp_status_t OSPD_SetBatchCompleteCallback(OSPD_BatchCompleteCallback_t batchCompleteCallback);
 osp_status_t OSPD_Deinitialize(void);
 
+/* Event loop integration: the backend does its work when its wakeup fd is readable */
+int OSPD_GetWakeupFd(void);
+osp_status_t OSPD_ProcessWakeup(void);
+osp_status_t OSPD_GetRelayStats(OSPD_RelayStats_t* pStats);
+
+/* Logs p50/p99/p99.9/max of each pipeline stage per sensor; clears the histograms if reset */
+osp_status_t OSPD_DumpLatency(bool reset);
+
+/* Applies the current OSPConfig snapshot to the running pipeline without restarting it */
+osp_status_t OSPD_ReloadConfiguration(void);
+
 
 #endif /* OSP_RPC_H */
 /*-------------------------------------------------------------------------------------------------*\
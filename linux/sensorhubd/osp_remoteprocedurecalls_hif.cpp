@@ -0,0 +1,675 @@
+/* Open Sensor Platform Project
+ * https://github.com/sensorplatforms/open-sensor-platform
+ *
+ * Copyright (C) 2013 Sensor Platforms Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*-------------------------------------------------------------------------------------------------*\
+ |    I N C L U D E   F I L E S
+\*-------------------------------------------------------------------------------------------------*/
+#include "osp_remoteprocedurecalls.h"
+#include <errno.h>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <termios.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include "osp_relayinterface.h"
+#include "osp_debuglogging.h"
+#include "osp_configuration.h"
+#include "osp_relaydecoder.h"
+#include "osp_hifparser.h"
+#include "osp_subscriptions.h"
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E X T E R N A L   V A R I A B L E S   &   F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   C O N S T A N T S   &   M A C R O S
+\*-------------------------------------------------------------------------------------------------*/
+#define HIF_MAX_READS_PER_WAKEUP        8   /* full stream buffers read before yielding the loop */
+#define HIF_FIXPOINT_Q24                (1.0f / (1 << 24))
+#define HIF_FIXPOINT_Q12                (1.0f / (1 << 12))
+#define NSEC_PER_SEC                    1000000000LL
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   T Y P E   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+/* A host interface sensor and the relay sensor index its packets are published as */
+typedef struct {
+    uint8_t sensorType;         //!< HifPacket_t::sensorType
+    bool isPrivate;
+    int32_t sensorIndex;        //!< deviceIndex
+    float scale;                //!< fixed point to float, 0 for raw counts and events
+} HifSensor_t;
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    S T A T I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+/* Packets of sensors not listed here (calibrated, gravity, orientation...) are counted and
+   dropped, the daemon publishes no result for them */
+static const HifSensor_t _hifSensors[] = {
+    { PSENSOR_ACCELEROMETER_RAW,            true,  ACCEL_INDEX,                0.0f },
+    { PSENSOR_MAGNETIC_FIELD_RAW,           true,  MAG_INDEX,                  0.0f },
+    { PSENSOR_GYROSCOPE_RAW,                true,  GYRO_INDEX,                 0.0f },
+    { PSENSOR_ACCELEROMETER_UNCALIBRATED,   true,  ACCEL_INDEX,                HIF_FIXPOINT_Q24 },
+    { SENSOR_MAGNETIC_FIELD_UNCALIBRATED,   false, MAG_INDEX,                  HIF_FIXPOINT_Q12 },
+    { SENSOR_GYROSCOPE_UNCALIBRATED,        false, GYRO_INDEX,                 HIF_FIXPOINT_Q24 },
+    { SENSOR_STEP_COUNTER,                  false, STEP_COUNTER_INDEX,         0.0f },
+    { SENSOR_STEP_DETECTOR,                 false, STEP_DETECTOR_INDEX,        0.0f },
+    { SENSOR_SIGNIFICANT_MOTION,            false, SIG_MOTION_INDEX,           0.0f },
+    { SENSOR_ROTATION_VECTOR,               false, ROTATION_VECTOR_INDEX,      HIF_FIXPOINT_Q24 },
+    { SENSOR_GAME_ROTATION_VECTOR,          false, GAME_ROTATION_VECTOR_INDEX, HIF_FIXPOINT_Q24 },
+};
+
+static DeviceConfig_t _deviceConfig[MAX_NUM_SENSORS_TO_HANDLE];
+static uint8_t _axisSource[MAX_NUM_SENSORS_TO_HANDLE][3];   /* raw counts: output axis <- device axis */
+static int64_t _tickNsec;
+
+static HifStreamParser _parser;
+static int _deviceFd = -1;
+static int _timerFd = -1;
+static int _epollFd = -1;
+static int64_t _lastRawTicks;           /* newest raw packet time, extended beyond its 32 bits */
+static bool _haveRawTicks = false;
+
+static ResultSubscriptions _subscriptions;
+static OSPD_BatchCompleteCallback_t _batchCompleteCallback = NULL;
+static uint64_t _bytesRead = 0;
+static uint64_t _packetsUnpublished = 0;
+static uint64_t _decodeNs = 0;
+static uint64_t _samplesPublished = 0;
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    F O R W A R D   F U N C T I O N   D E C L A R A T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      _monotonicNs
+ *          Current CLOCK_MONOTONIC time in nanoseconds
+ *
+ ***************************************************************************************************/
+static int64_t _monotonicNs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+}
+
+
+/****************************************************************************************************
+ * @fn      _fixpointSecondsToNs
+ *          Q24 seconds time stamp of a fixed point packet in nanoseconds, without overflowing for
+ *          hub up times beyond a few minutes
+ *
+ ***************************************************************************************************/
+static int64_t _fixpointSecondsToNs(int64_t timeStamp)
+{
+    return (timeStamp >> 24) * NSEC_PER_SEC + (((timeStamp & 0xFFFFFF) * NSEC_PER_SEC) >> 24);
+}
+
+
+/****************************************************************************************************
+ * @fn      _rawTicksToNs
+ *          Hub timer ticks of a raw packet in nanoseconds, extended past the 32-bit wrap. Sensors
+ *          interleave, so a packet a little older than the newest one seen is not a wrap
+ *
+ ***************************************************************************************************/
+static int64_t _rawTicksToNs(uint32_t ticks)
+{
+    if (!_haveRawTicks) {
+        _lastRawTicks = ticks;
+        _haveRawTicks = true;
+    }
+    const int32_t delta = (int32_t)(ticks - (uint32_t)_lastRawTicks);
+    const int64_t extended = _lastRawTicks + delta;
+
+    if (delta > 0) {
+        _lastRawTicks = extended;
+    }
+    return extended * _tickNsec;
+}
+
+
+/****************************************************************************************************
+ * @fn      _compileAxes
+ *          Axis swap of the raw count sensors, same convention as RelayDecoder_Compile()
+ *
+ ***************************************************************************************************/
+static void _compileAxes(void)
+{
+    for (int32_t sensorIndex = 0; sensorIndex < MAX_NUM_SENSORS_TO_HANDLE; sensorIndex++) {
+        const DeviceConfig_t* pConfig = &_deviceConfig[sensorIndex];
+        int source[3] = {-1, -1, -1};
+
+        for (int k = 0; k < 3; k++) {
+            if ((pConfig->swap[k] >= 0) && (pConfig->swap[k] < 3) &&
+                (source[pConfig->swap[k]] < 0)) {
+                source[pConfig->swap[k]] = k;
+            }
+        }
+        if ((source[0] < 0) || (source[1] < 0) || (source[2] < 0)) {
+            source[0] = 0;
+            source[1] = 1;
+            source[2] = 2;
+        }
+        for (int k = 0; k < 3; k++) {
+            _axisSource[sensorIndex][k] = source[k];
+        }
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      _findSensor
+ *          Table entry of a packet's sensor, NULL if its results are not published
+ *
+ ***************************************************************************************************/
+static const HifSensor_t* _findSensor(const HifPacket_t* pPacket)
+{
+    for (size_t i = 0; i < sizeof(_hifSensors) / sizeof(_hifSensors[0]); i++) {
+        if ((_hifSensors[i].sensorType == pPacket->sensorType) &&
+            (_hifSensors[i].isPrivate == pPacket->isPrivate)) {
+            return &_hifSensors[i];
+        }
+    }
+    return NULL;
+}
+
+
+/****************************************************************************************************
+ * @fn      _decodePacket
+ *          Packet to the sample its relay node would have decoded to; false if not published
+ *
+ ***************************************************************************************************/
+static bool _decodePacket(const HifPacket_t* pPacket, int32_t* pSensorIndex,
+                          OSPD_ThreeAxisData_t* pData)
+{
+    const HifSensor_t* pSensor = _findSensor(pPacket);
+
+    if (pSensor == NULL) {
+        return false;
+    }
+    //like the relay's motion nodes, 3-axis sensors without a device are not published
+    if ((pSensor->sensorIndex <= GYRO_INDEX) &&
+        _deviceConfig[pSensor->sensorIndex].uinputName.empty()) {
+        return false;
+    }
+    *pSensorIndex = pSensor->sensorIndex;
+
+    switch (pPacket->format) {
+    case HIF_PACKET_RAW: {
+        const DeviceConfig_t* pConfig = &_deviceConfig[pSensor->sensorIndex];
+        const uint8_t* source = _axisSource[pSensor->sensorIndex];
+
+        pData->timestamp.ll = _rawTicksToNs((uint32_t)pPacket->timeStamp);
+        for (int k = 0; k < 3; k++) {
+            pData->data[k].f = pConfig->conversion[k] * (float)pPacket->value[source[k]];
+        }
+        break;
+    }
+
+    case HIF_PACKET_FIXPOINT:
+        //quaternions publish x, y, z, w like the relay nodes; the hub sends w first
+        pData->timestamp.ll = _fixpointSecondsToNs(pPacket->timeStamp);
+        for (int k = 0; k < 3; k++) {
+            pData->data[k].f = pSensor->scale * (float)pPacket->value[k + pPacket->numValues - 3];
+        }
+        pData->data[3].f = (pPacket->numValues > 3) ? pSensor->scale * (float)pPacket->value[0] : 0.0f;
+        break;
+
+    case HIF_PACKET_EVENT:
+        pData->timestamp.ll = _fixpointSecondsToNs(pPacket->timeStamp);
+        pData->data[0].i = (int32_t)pPacket->value[0];
+        pData->data[1].i = 0;
+        pData->data[2].i = 0;
+        break;
+    }
+
+    return true;
+}
+
+
+/****************************************************************************************************
+ * @fn      _armTimer
+ *          Arms the one-shot batch delivery timer for an absolute CLOCK_MONOTONIC time
+ *
+ ***************************************************************************************************/
+static void _armTimer(int64_t dueNs)
+{
+    struct itimerspec spec;
+
+    memset(&spec, 0, sizeof(spec));
+    if (dueNs <= 0) {
+        dueNs = 1;
+    }
+    spec.it_value.tv_sec = dueNs / NSEC_PER_SEC;
+    spec.it_value.tv_nsec = dueNs % NSEC_PER_SEC;
+    if (timerfd_settime(_timerFd, TFD_TIMER_ABSTIME, &spec, NULL) < 0) {
+        LOG_Err("%s: timerfd_settime failed: %s\n", __FUNCTION__, strerror(errno));
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      _readDevice
+ *          Reads what the device has straight into the parser's buffer and publishes every
+ *          complete packet; returns the number of samples published
+ *
+ ***************************************************************************************************/
+static size_t _readDevice(int64_t nowNs)
+{
+    size_t published = 0;
+
+    for (int reads = 0; (_deviceFd >= 0) && (reads < HIF_MAX_READS_PER_WAKEUP); reads++) {
+        size_t room;
+        uint8_t* pRoom = _parser.writePointer(&room);
+        const ssize_t length = read(_deviceFd, pRoom, room);
+
+        if (length <= 0) {
+            if ((length < 0) && ((errno == EAGAIN) || (errno == EINTR))) {
+                break;
+            }
+            //a pty whose other side closed reads EIO, a socket or FIFO 0; neither comes back
+            LOG_Err("HIF device closed (%s), %llu bytes read", (length < 0) ? strerror(errno) : "EOF",
+                    (unsigned long long)_bytesRead);
+            epoll_ctl(_epollFd, EPOLL_CTL_DEL, _deviceFd, NULL);
+            close(_deviceFd);
+            _deviceFd = -1;
+            break;
+        }
+        _bytesRead += length;
+        _parser.commit(length);
+
+        const int64_t decodeStartNs = _monotonicNs();
+        HifPacket_t packet;
+        while (_parser.next(&packet)) {
+            OSPD_ThreeAxisData_t data;
+            int32_t sensorIndex;
+
+            if (!_decodePacket(&packet, &sensorIndex, &data)) {
+                _packetsUnpublished++;
+                continue;
+            }
+            _subscriptions.dispatch(RelayDecoder_ResultType(sensorIndex), &data, nowNs);
+            published++;
+        }
+        _decodeNs += _monotonicNs() - decodeStartNs;
+
+        if ((size_t)length < room) {
+            break;
+        }
+    }
+
+    _samplesPublished += published;
+    return published;
+}
+
+
+/****************************************************************************************************
+ * @fn      _setSerialSpeed
+ *          Puts a tty into raw mode at the configured speed; other devices are left alone
+ *
+ ***************************************************************************************************/
+static void _setSerialSpeed(int fd, int baudRate)
+{
+    static const struct {
+        int baud;
+        speed_t speed;
+    } speeds[] = {
+        { 9600, B9600 }, { 19200, B19200 }, { 38400, B38400 }, { 57600, B57600 },
+        { 115200, B115200 }, { 230400, B230400 }, { 460800, B460800 }, { 921600, B921600 },
+    };
+    struct termios tty;
+
+    if (tcgetattr(fd, &tty) < 0) {
+        return;
+    }
+    //HIF packets are binary: no line discipline, no echo, no flow control characters
+    cfmakeraw(&tty);
+    tty.c_cc[VMIN] = 0;
+    tty.c_cc[VTIME] = 0;
+    size_t i;
+    for (i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++) {
+        if (speeds[i].baud == baudRate) {
+            cfsetspeed(&tty, speeds[i].speed);
+            break;
+        }
+    }
+    if (i == sizeof(speeds) / sizeof(speeds[0])) {
+        LOG_Err("Unsupported %s %d, speed left unchanged",
+                OSPConfig::PROTOCOL_SERIAL_BAUD_RATE, baudRate);
+    }
+    if (tcsetattr(fd, TCSANOW, &tty) < 0) {
+        LOG_Err("Unable to configure tty: %s", strerror(errno));
+    }
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      OSPD_Initialize
+ *          Opens the device named by protocol.hif_path that streams the hub's host interface
+ *          packets
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_Initialize(void) {
+    struct epoll_event event;
+    LOGT("%s\r\n", __FUNCTION__);
+
+    /* Raw counts are converted with the configuration of the relay protocol */
+    OSPConfig::establishDefaultConfig("relay");
+    const OSPConfig::Snapshot_t* pConfig = OSPConfig::snapshot();
+
+    const char* path = pConfig->hifPath.c_str();
+    if (path[0] == '\0') {
+        LOG_Err("No HIF device given (%s)", OSPConfig::PROTOCOL_HIF_PATH);
+        return OSP_STATUS_ERROR;
+    }
+    _deviceFd = open(path, O_RDWR | O_NONBLOCK | O_NOCTTY | O_CLOEXEC);
+    if (_deviceFd < 0) {
+        LOG_Err("Unable to open HIF device %s: %s", path, strerror(errno));
+        return OSP_STATUS_ERROR;
+    }
+    if (isatty(_deviceFd)) {
+        _setSerialSpeed(_deviceFd, pConfig->serialBaudRate);
+    }
+
+    for (int i = 0; i < MAX_NUM_SENSORS_TO_HANDLE; i++) {
+        _deviceConfig[i].uinputName.assign("");
+    }
+    RelayDecoder_LoadDeviceConfig(_deviceConfig);
+    _compileAxes();
+    _tickNsec = (int64_t)pConfig->relayTickUsec * 1000;
+    _haveRawTicks = false;
+    _parser.reset();
+
+    _timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    _epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if ((_timerFd < 0) || (_epollFd < 0)) {
+        LOG_Err("Unable to create HIF wakeups: %s", strerror(errno));
+        OSPD_Deinitialize();
+        return OSP_STATUS_ERROR;
+    }
+
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = _deviceFd;
+    if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, _deviceFd, &event) < 0) {
+        //i2c-dev and spidev cannot be polled; they need the hub's interrupt line to be read
+        LOG_Err("HIF device %s cannot be polled: %s", path, strerror(errno));
+        OSPD_Deinitialize();
+        return OSP_STATUS_ERROR;
+    }
+    event.data.fd = _timerFd;
+    epoll_ctl(_epollFd, EPOLL_CTL_ADD, _timerFd, &event);
+
+    LOG_Info("Reading HIF packets from %s, raw tick %d us", path, pConfig->relayTickUsec);
+
+    return OSP_STATUS_OK;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_GetWakeupFd
+ *          Returns the epoll fd over the device and the batch timer, -1 if not open
+ *
+ ***************************************************************************************************/
+int OSPD_GetWakeupFd(void) {
+    return _epollFd;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_ProcessWakeup
+ *          Called by the event loop when the device has data or a subscriber batch is due
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_ProcessWakeup(void) {
+    struct epoll_event events[2];
+    uint64_t expirations;
+    size_t published = 0;
+
+    if (_epollFd < 0) {
+        return OSP_STATUS_UNKNOWN_INPUT;
+    }
+
+    const int numEvents = epoll_wait(_epollFd, events, 2, 0);
+    if (numEvents < 0) {
+        if (errno != EINTR) {
+            LOG_Err("HIF wakeup epoll failed: %s", strerror(errno));
+            return OSP_STATUS_ERROR;
+        }
+        return OSP_STATUS_OK;
+    }
+
+    const int64_t nowNs = _monotonicNs();
+    for (int i = 0; i < numEvents; i++) {
+        if (events[i].data.fd == _timerFd) {
+            if ((read(_timerFd, &expirations, sizeof(expirations)) < 0) && (errno != EAGAIN)) {
+                LOG_Err("%s: read failed: %s\n", __FUNCTION__, strerror(errno));
+            }
+        } else {
+            published += _readDevice(nowNs);
+        }
+    }
+
+    const size_t batched = _subscriptions.deliverBatches(nowNs);
+    //subscriptions change on this same thread, so every wakeup is a quiescent point
+    _subscriptions.quiescent();
+
+    if (((published > 0) || (batched > 0)) && (_batchCompleteCallback != NULL)) {
+        _batchCompleteCallback();
+    }
+
+    const int64_t batchDueNs = _subscriptions.nextBatchDueNs();
+    if (batchDueNs != 0) {
+        _armTimer(batchDueNs);
+    }
+
+    return OSP_STATUS_OK;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_GetVersion
+ *          Helper routine for getting daemon version information
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_GetVersion(char* versionString, int bufSize) {
+    osp_status_t result = OSP_STATUS_OK;
+
+    LOGT("%s\r\n", __FUNCTION__);
+
+    return result;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_SubscribeResult
+ *          Enables subscription for results, decimated to one sample per periodUs and batched for
+ *          up to maxReportLatencyUs if non-zero
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_SubscribeResult(SensorType_t sensorType, OSPD_ResultDataCallback_t dataReadyCallback,
+                                  uint32_t periodUs, uint32_t maxReportLatencyUs) {
+    LOGT("%s\r\n", __FUNCTION__);
+
+    if (dataReadyCallback == NULL) {
+        return OSP_STATUS_NULL_POINTER;
+    }
+    if (_subscriptions.add(sensorType, dataReadyCallback, periodUs, maxReportLatencyUs) < 0) {
+        return OSP_STATUS_UNKNOWN_INPUT;
+    }
+
+    return OSP_STATUS_OK;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_UnsubscribeResult
+ *          Unsubscribe from sensor results; all subscribers of the sensor if dataReadyCallback is
+ *          NULL
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_UnsubscribeResult(SensorType_t sensorType, OSPD_ResultDataCallback_t dataReadyCallback) {
+    LOGT("%s\r\n", __FUNCTION__);
+
+    if ((sensorType < 0) || (sensorType >= SENSOR_ENUM_COUNT)) {
+        return OSP_STATUS_UNKNOWN_INPUT;
+    }
+    _subscriptions.remove(sensorType, dataReadyCallback);
+
+    return OSP_STATUS_OK;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_FlushResult
+ *          Delivers the samples batched for a sensor. Flushes come in on the event loop thread,
+ *          which is the one reading the device, so they are served right away
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_FlushResult(SensorType_t sensorType) {
+    LOGT("%s\r\n", __FUNCTION__);
+
+    if ((sensorType < 0) || (sensorType >= SENSOR_ENUM_COUNT)) {
+        return OSP_STATUS_UNKNOWN_INPUT;
+    }
+    _subscriptions.requestFlush(sensorType);
+    if ((_subscriptions.deliverBatches(_monotonicNs()) > 0) && (_batchCompleteCallback != NULL)) {
+        _batchCompleteCallback();
+    }
+
+    return OSP_STATUS_OK;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_SetBatchCompleteCallback
+ *          Registers the callback invoked after the packets read at one wakeup are delivered
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_SetBatchCompleteCallback(OSPD_BatchCompleteCallback_t batchCompleteCallback) {
+    osp_status_t result = OSP_STATUS_OK;
+
+    LOGT("%s\r\n", __FUNCTION__);
+
+    _batchCompleteCallback = batchCompleteCallback;
+
+    return result;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_GetRelayStats
+ *          Packets are published as they are parsed; there is no hand-off ring. nodesDecoded
+ *          counts the packets parsed
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_GetRelayStats(OSPD_RelayStats_t* pStats) {
+    if (pStats == NULL) {
+        return OSP_STATUS_NULL_POINTER;
+    }
+
+    memset(pStats, 0, sizeof(*pStats));
+    pStats->samplesDrained   = _samplesPublished;
+    pStats->samplesPublished = _samplesPublished;
+    pStats->nodesDecoded     = _parser.packets();
+    pStats->decodeNs         = _decodeNs;
+
+    return OSP_STATUS_OK;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_DumpLatency
+ *          Logs the stream counters; packets are published from the event loop, so no stage
+ *          times are kept
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_DumpLatency(bool reset) {
+    LOG_Info("HIF stream: %llu bytes, %llu packets (%llu not published), %llu bytes skipped\n",
+             (unsigned long long)_bytesRead, (unsigned long long)_parser.packets(),
+             (unsigned long long)_packetsUnpublished, (unsigned long long)_parser.skippedBytes());
+
+    return OSP_STATUS_OK;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_ReloadConfiguration
+ *          Picks up the conversion and axis swap of the raw count sensors from the current
+ *          configuration snapshot
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_ReloadConfiguration(void) {
+    DeviceConfig_t reloaded[MAX_NUM_SENSORS_TO_HANDLE];
+
+    //Device names stay as initialized; only conversion and swap change
+    RelayDecoder_LoadDeviceConfig(reloaded);
+    for (int i = 0; i < MAX_NUM_SENSORS_TO_HANDLE; i++) {
+        for (unsigned int j = 0; j < 3; j++) {
+            _deviceConfig[i].swap[j] = reloaded[i].swap[j];
+            _deviceConfig[i].conversion[j] = reloaded[i].conversion[j];
+        }
+    }
+    _compileAxes();
+    LOG_Info("HIF raw count conversion reloaded\n");
+
+    return OSP_STATUS_OK;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_Deinitialize
+ *          Tear down RPC interface function
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_Deinitialize(void) {
+    osp_status_t result = OSP_STATUS_OK;
+    LOGT("%s\r\n", __FUNCTION__);
+
+    if (_epollFd >= 0) {
+        close(_epollFd);
+        _epollFd = -1;
+    }
+    if (_timerFd >= 0) {
+        close(_timerFd);
+        _timerFd = -1;
+    }
+    if (_deviceFd >= 0) {
+        close(_deviceFd);
+        _deviceFd = -1;
+    }
+
+    return result;
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E N D   O F   F I L E
+\*-------------------------------------------------------------------------------------------------*/
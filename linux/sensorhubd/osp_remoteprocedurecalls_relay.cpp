@@ -23,13 +23,28 @@
 #include <errno.h>
 #include <cstring>
 #include <cstdlib>
+#include <cmath>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
 #include <sys/mman.h>
-#include <sys/select.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/epoll.h>
+#include <poll.h>
 #include <linux/input.h>
 #include <assert.h>
+#include <atomic>
 #include "osp_relayinterface.h"
 #include "osp_debuglogging.h"
 #include "osp_configuration.h"
+#include "osp_spscring.h"
+#include "osp_relayconvert.h"
+#include "osp_relaydecoder.h"
+#include "osp_relaytrace.h"
+#include "osp_latencyhist.h"
+#include "osp_subscriptions.h"
+#include "osp_clocksync.h"
 #include "sensor_relay.h"
 
 extern "C" {
@@ -47,46 +62,128 @@ extern "C" {
 /*-------------------------------------------------------------------------------------------------*\
  |    P R I V A T E   C O N S T A N T S   &   M A C R O S
 \*-------------------------------------------------------------------------------------------------*/
-#define PROCESS_INPUT_EVT_THRES         1
-#define MAX_NUM_FDS(x,y) ((x) > (y) ? (x) : (y))
+#define PROCESS_INPUT_EVT_THRES         64  /* input events read from the relay device per read() */
+#define RELAY_MAX_DRAIN_PASSES          8   /* bound on re-drains while the hub keeps producing */
+#define RELAY_SAMPLE_RING_SIZE          1024 /* converted samples buffered for the publisher */
+#define RELAY_PUBLISH_BATCH             256 /* samples delivered per batch complete callback */
+#define NSEC_PER_SEC                    1000000000LL
+#define RELAY_DEFAULT_PATH              "/sys/kernel/debug/sensor_relay_kernel"
+#define RELAY_DEFAULT_SYSFS_PATH        "/sys/class/sensor_relay"
+#define NSEC_PER_MSEC                   1000000LL
+#define RELAY_MAX_CPUS                  16  /* relay buffers looked for per hub */
 
 /*-------------------------------------------------------------------------------------------------*\
  |    P R I V A T E   T Y P E   D E F I N I T I O N S
 \*-------------------------------------------------------------------------------------------------*/
+/* Converted samples are handed from the relay drain to the publisher thread */
+typedef SpscRing<RelaySample_t> RelaySampleRing_t;
+
+typedef struct RelayHub RelayHub_t;
+
+/* Drain thread. One per CPU buffer, pinned to it, when protocol.relay_per_cpu_drain is set, else
+   one per hub when more than one hub is served */
+typedef struct {
+    pthread_t thread;
+    RelayHub_t* pHub;
+    unsigned int firstCpu;  /* drains the hub's buffers [firstCpu, endCpu) */
+    unsigned int endCpu;
+    bool pinned;            /* runs on firstCpu */
+    RelaySampleRing_t* pRing;
+    int eventFd;            /* doorbell rung by the event loop on each relay wakeup */
+    int32_t decoderReader;  /* RelayDecoder_AddReader() id */
+} RelayDrainThread_t;
+
+/* One sensor hub: its wakeup source, relay buffers, drains and clock. Hubs are drained
+   independently of each other into rings of their own; only the publisher sees them all */
+struct RelayHub {
+    std::string name;
+    std::string relayPath;
+    std::string wakeupPath;                 /* empty for the relay input device */
+    int wakeupFd;
+    unsigned int traceCpuBase;              /* capture trace cpu of the hub's first buffer */
+    std::vector<RelayBufStatus_t> relayStatus;
+    std::vector<int> relayFile;
+    std::vector<unsigned char *> relayBuffer;
+    /* control files */
+    std::vector<int> producedFile;
+    std::vector<int> consumedFile;
+    std::vector<RelaySampleRing_t*> sampleRings;    /* one per drain thread, or one */
+    std::vector<RelayDrainThread_t> drainThreads;   /* empty when drained by the event loop */
+    std::atomic<uint64_t> samplesDrained;
+    std::atomic<int64_t> lastWakeupNs;
+    HubClockSync clock;                     /* hub ticks -> CLOCK_BOOTTIME of sample timestamps */
+};
+
+/* Pipeline stages timed per sample, see RelaySampleStamps_t */
+typedef enum {
+    RELAY_LATENCY_WAKEUP,       /* relay wakeup read -> drain of the sample's buffer */
+    RELAY_LATENCY_DECODE,       /* drain -> sample converted */
+    RELAY_LATENCY_HANDOFF,      /* converted -> result callback dispatch */
+    RELAY_LATENCY_PUBLISH,      /* dispatch -> uinput write of its batch done */
+    RELAY_LATENCY_TOTAL,        /* relay wakeup -> uinput write done */
+    RELAY_LATENCY_STAGE_COUNT
+} RelayLatencyStage_t;
+
+/* What was last written to a sensor's enable and delay nodes, see _arbitrateSensor() */
+typedef struct {
+    int64_t defaultPeriodNs;    /* SENSOR_RATE, the rate of subscribers that take every sample */
+    int enabled;                /* -1 until first written */
+    int64_t delayMs;            /* -1 until first written */
+} RelaySensorControl_t;
 
 /*-------------------------------------------------------------------------------------------------*\
  |    S T A T I C   V A R I A B L E S   D E F I N I T I O N S
 \*-------------------------------------------------------------------------------------------------*/
-static int32_t _relay_fd;
 static int32_t _relayTickUsec;
 static DeviceConfig_t _deviceConfig[MAX_NUM_SENSORS_TO_HANDLE];
+static RelaySensorControl_t _sensorControl[MAX_NUM_SENSORS_TO_HANDLE];
 static std::string _deviceRelayInputName;
-static std::vector<RelayBufStatus_t> _relayStatus;
-static std::vector<int> _relay_file;
-static std::vector<unsigned char *> __relay_buffer;
-/* control files */
-static std::vector<int> _produced_file;
-static std::vector<int> _consumed_file;
-
-static const char* const sensornames[MAX_NUM_SENSORS_TO_HANDLE] = {
-    "acc1",
-    "mag1",
-    "gyr1",
-};
-
-static pthread_t _relayThread;
-static volatile bool _relayThreadActive = false;
 
-static OSPD_ResultDataCallback_t _resultReadyCallbacks[SENSOR_ENUM_COUNT] = {0};
+/* The hub at protocol.relay_path first, then those of the "hub" list */
+static std::vector<RelayHub_t*> _hubs;
+static int _wakeupEpollFd = -1;    /* readable when any hub's wakeup is, with more than one hub */
+
+/* Optional capture of every node read, for replay through the replay backend */
+static RelayTraceWriter _captureTrace;
+
+/* Result subscribers; read lock-free by the publisher thread */
+static ResultSubscriptions _subscriptions;
+static OSPD_BatchCompleteCallback_t _batchCompleteCallback = NULL;
+
+/* Relay drain -> publisher hand-off, the rings of all hubs */
+static std::vector<RelaySampleRing_t*> _sampleRings;
+static bool _perCpuDrain = false;
+static volatile bool _drainThreadsActive = false;
+static int _publisherEventFd = -1;
+static int _batchTimerFd = -1;     /* next subscriber batch deadline */
+static pthread_t _publisherThread;
+static volatile bool _publisherThreadActive = false;
+static std::atomic<uint64_t> _samplesPublished(0);
+static std::atomic<uint64_t> _nodesDecoded(0);
+static std::atomic<uint64_t> _decodeNs(0);
+static int64_t _relayMappingNs = 0; /* startup time spent opening and mapping the relay files */
+static LatencyHistogram _stageLatency[MAX_NUM_SENSORS_TO_HANDLE][RELAY_LATENCY_STAGE_COUNT];
+static const char* const _stageNames[RELAY_LATENCY_STAGE_COUNT] = {
+    "wakeup",
+    "decode",
+    "handoff",
+    "publish",
+    "total",
+};
 
 
 /*-------------------------------------------------------------------------------------------------*\
  |    F O R W A R D   F U N C T I O N   D E C L A R A T I O N S
 \*-------------------------------------------------------------------------------------------------*/
 static int32_t InitializeRelayInput( void );
-static void *_processRelayInput(void *pData);
-static void _relayReadAndProcessSensorData(int fd, OSPD_ResultDataCallback_t dataCallbacks[]);
-static void ProcessInputEventsRelay(void);
+static void _relayReadAndProcessSensorData(RelayHub_t* pHub);
+static void _drainRelayBuffers(RelayHub_t* pHub, unsigned int firstCpu, unsigned int endCpu,
+                               RelaySampleRing_t* pRing);
+static void *_publishRelaySamples(void *pData);
+static void *_drainRelayThread(void *pData);
+static size_t ProcessInputEventsRelay(RelayHub_t* pHub, unsigned int firstCpu, unsigned int endCpu,
+                                      RelaySampleRing_t* pRing, int64_t wakeupNs,
+                                      const RelayTransformTable_t* pTransforms);
 
 /*-------------------------------------------------------------------------------------------------*\
  |    P R I V A T E     F U N C T I O N S
@@ -97,98 +194,164 @@ static void ProcessInputEventsRelay(void);
  *          Parse the sensor data and invoke result callbacks
  *
  ***************************************************************************************************/
-static void _sensorDataPublish(uint32_t sensorIndex, OSPD_ThreeAxisData_t *pSensData)
+static void _sensorDataPublish(uint32_t sensorIndex, OSPD_ThreeAxisData_t *pSensData, int64_t nowNs)
 {
-    SensorType_t sensorType = SENSOR_ENUM_COUNT;
+    const SensorType_t sensorType = RelayDecoder_ResultType(sensorIndex);
+
+    _subscriptions.dispatch(sensorType, pSensData, nowNs);
+}
 
-    switch(sensorIndex) {
-    case ACCEL_INDEX:
-        sensorType = SENSOR_ACCELEROMETER_UNCALIBRATED;
-        LOG_Info("RA %.3f, %.3f, %.3f, %lld\n",
-             pSensData->data[0].f,
-             pSensData->data[1].f,
-             pSensData->data[2].f,
-             pSensData->timestamp.ll);
-        break;
 
-    case GYRO_INDEX:
-        sensorType = SENSOR_GYROSCOPE_UNCALIBRATED;
-        //LOG_Info("RG %.3f, %.3f, %.3f, %lld\n",
-        //     pSensData->data[0].f,
-        //     pSensData->data[1].f,
-        //     pSensData->data[2].f,
-        //     pSensData->timestamp.ll);
-        break;
+/****************************************************************************************************
+ * @fn      _monotonicNs
+ *          Current CLOCK_MONOTONIC time in nanoseconds
+ *
+ ***************************************************************************************************/
+static int64_t _monotonicNs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+}
 
-    case MAG_INDEX:
-        sensorType = SENSOR_MAGNETIC_FIELD_UNCALIBRATED;
-        //LOG_Info("RM %.3f, %.3f, %.3f, %lld\n",
-        //     pSensData->data[0].f,
-        //     pSensData->data[1].f,
-        //     pSensData->data[2].f,
-        //     pSensData->timestamp.ll);
-        break;
 
-    default:
-        break;
+/****************************************************************************************************
+ * @fn      _boottimeNs
+ *          Current CLOCK_BOOTTIME time in nanoseconds, the time base of published samples
+ *
+ ***************************************************************************************************/
+static int64_t _boottimeNs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_BOOTTIME, &now);
+    return (int64_t)now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+}
+
+
+/****************************************************************************************************
+ * @fn      _recordLatency
+ *          Adds the stage deltas of a delivered sample to its sensor's histograms
+ *
+ ***************************************************************************************************/
+static void _recordLatency(const RelaySample_t& sample, int64_t dispatchNs, int64_t publishedNs)
+{
+    LatencyHistogram* pStages;
+
+    if ((sample.sensorIndex < 0) || (sample.sensorIndex >= MAX_NUM_SENSORS_TO_HANDLE)) {
+        return;
     }
+    pStages = _stageLatency[sample.sensorIndex];
 
-    if (( sensorType < SENSOR_ENUM_COUNT) && (_resultReadyCallbacks[sensorType] != NULL)) {
-        _resultReadyCallbacks[sensorType](sensorType, pSensData);
+    if (sample.stamps.wakeupNs) {
+        pStages[RELAY_LATENCY_WAKEUP].record(sample.stamps.drainNs - sample.stamps.wakeupNs);
+        pStages[RELAY_LATENCY_TOTAL].record(publishedNs - sample.stamps.wakeupNs);
     }
+    pStages[RELAY_LATENCY_DECODE].record(sample.stamps.convertedNs - sample.stamps.drainNs);
+    pStages[RELAY_LATENCY_HANDOFF].record(dispatchNs - sample.stamps.convertedNs);
+    pStages[RELAY_LATENCY_PUBLISH].record(publishedNs - dispatchNs);
 }
 
 
 /****************************************************************************************************
- * @fn      _doAxisSwap
- *          Helper function that does the axis swap as specified in configuration
+ * @fn      _writeSysfsInt
+ *          Writes a decimal value to a sysfs attribute. Returns 0 or a negative errno
  *
  ***************************************************************************************************/
-int32_t _doAxisSwap(int32_t eventCode, int32_t sensorIndex, const int swap[3])
+static int _writeSysfsInt(const std::string& path, int64_t value)
 {
-    int32_t result = 0;
-    int32_t zeroIndexedDeviceAxis = -1;
-
-    assert((sensorIndex >= ACCEL_INDEX) && (sensorIndex < MAX_NUM_SENSORS_TO_HANDLE));
-    switch(eventCode) {
-    case ABS_X:
-    case ABS_Y:
-    case ABS_Z:
-        zeroIndexedDeviceAxis = eventCode - ABS_X;
-        break;
-
-    case ABS_RX:
-    case ABS_RY:
-    case ABS_RZ:
-        zeroIndexedDeviceAxis = eventCode - ABS_RX;
-        break;
-
-    case ABS_GAS:   //used as code for light sensor
-    case ABS_DISTANCE:  //used as code for prox sensor
-    case ABS_PRESSURE:  // used for Barometer
-        zeroIndexedDeviceAxis = 0;
-        break;
-
-    default:
-        result = -1;
-        break;
-    }
-    if (result == 0) {
-        //TODO: This is based on assumption - may need fixing
-        if (sensorIndex < MAX_NUM_SENSORS_TO_HANDLE) {
-            assert( zeroIndexedDeviceAxis >= 0 );
-            assert( zeroIndexedDeviceAxis < 3 );
-            result = swap[zeroIndexedDeviceAxis];
+    char text[24];
+    const int length = snprintf(text, sizeof(text), "%lld\n", (long long)value);
+    const int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+        return -errno;
+    }
+    const ssize_t written = write(fd, text, length);
+    const int error = (written == length) ? 0 : ((written < 0) ? -errno : -EIO);
+    close(fd);
+
+    return error;
+}
+
+
+/****************************************************************************************************
+ * @fn      _applySensorControl
+ *          Sets a sensor's enable and delay nodes: on at periodNs (0 leaves the delay alone), off
+ *          if periodNs is negative. Nodes are only written on a change. Event loop thread only
+ *
+ ***************************************************************************************************/
+static void _applySensorControl(int sensorIndex, int64_t periodNs)
+{
+    DeviceConfig_t& device = _deviceConfig[sensorIndex];
+    RelaySensorControl_t& control = _sensorControl[sensorIndex];
+    const int enabled = (periodNs >= 0) ? 1 : 0;
+
+    if (device.uinputName.empty()) {
+        return;
+    }
+
+    //the delay goes first, so a sensor being switched on starts at the rate it is needed at
+    if (enabled && (periodNs > 0) && !device.sysDelayPath.empty()) {
+        int64_t delayMs = periodNs / NSEC_PER_MSEC;
+
+        if (delayMs < 1) {
+            delayMs = 1;
         }
-    } else {
-        if (result < 0) {
-            LOG_Err("Received unknown event code: %d", eventCode );
+        if (delayMs != control.delayMs) {
+            const int error = _writeSysfsInt(device.sysDelayPath, delayMs);
+            if (error < 0) {
+                LOG_Err("Unable to set %s delay: %s", device.uinputName.c_str(), strerror(-error));
+            } else {
+                LOG_Info("%s delay %lld ms", device.uinputName.c_str(), (long long)delayMs);
+                control.delayMs = delayMs;
+            }
+        }
+    }
+
+    if ((enabled != control.enabled) && !device.sysEnablePath.empty()) {
+        const int error = _writeSysfsInt(device.sysEnablePath,
+                                         enabled ? device.enableValue : device.disableValue);
+        if (error < 0) {
+            LOG_Err("Unable to %s %s: %s", enabled ? "enable" : "disable",
+                    device.uinputName.c_str(), strerror(-error));
+        } else {
+            LOG_Info("%s %s", device.uinputName.c_str(), enabled ? "enabled" : "disabled");
+            control.enabled = enabled;
+        }
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      _arbitrateSensor
+ *          Brings a sensor in line with its subscribers: on at the fastest rate any of them asks
+ *          for, off when there are none
+ *
+ ***************************************************************************************************/
+static void _arbitrateSensor(int sensorIndex)
+{
+    _applySensorControl(sensorIndex, _subscriptions.fastestPeriodNs(
+        RelayDecoder_ResultType(sensorIndex), _sensorControl[sensorIndex].defaultPeriodNs));
+}
+
+
+/****************************************************************************************************
+ * @fn      _arbitrateSensorType
+ *          Re-arbitrates every relay sensor that produces the given result type
+ *
+ ***************************************************************************************************/
+static void _arbitrateSensorType(SensorType_t sensorType)
+{
+    for (int i = 0; i < MAX_NUM_SENSORS_TO_HANDLE; i++) {
+        if (RelayDecoder_ResultType(i) == sensorType) {
+            _arbitrateSensor(i);
         }
-        result  = -1;
     }
-    return result;
 }
 
+
 /****************************************************************************************************
  * @fn      Initialize
  *          Main Initialization routine. Initializes device configuration
@@ -196,160 +359,93 @@ int32_t _doAxisSwap(int32_t eventCode, int32_t sensorIndex, const int swap[3])
  ***************************************************************************************************/
 static int32_t Initialize( void )
 {
-    int32_t result;
-    const char *temp;
-    const int *swap;
-    unsigned int swaplen;
-    unsigned int convlen;
-    const osp_float_t * conv;
-
-    for (int index = 0; index < MAX_NUM_SENSORS_TO_HANDLE; ++index){
-        const char* const drivername = OSPConfig::getNamedConfigItem(
-                    sensornames[index],
-                    OSPConfig::SENSOR_DRIVER_NAME);
-        auto sensorlist = OSPConfig::getConfigItemsMultiple("sensor");
-        if(drivername && strlen(drivername)){
-            _deviceConfig[index].uinputName =  drivername;
-        } else {
-            _deviceConfig[index].uinputName = "";
-            for (unsigned short i2 = 0; i2 < sensorlist.size(); ++i2){
-                if ( strcmp( sensorlist[i2], sensornames[index]) == 0){
-                    _deviceConfig[index].uinputName = sensornames[index];
-                }
-            }
-        }
+    int32_t result = OSP_STATUS_OK;
+    const OSPConfig::Snapshot_t* pConfig = OSPConfig::snapshot();
 
+    RelayDecoder_LoadDeviceConfig(_deviceConfig);
 
-        swap = OSPConfig::getNamedConfigItemInt(
-                    sensornames[index], OSPConfig::SENSOR_SWAP, &swaplen);
-        if (!swap){
-            for (unsigned int j = 0; j < 3; ++j){
-                _deviceConfig[index].swap[j] = j;
-            }
-        } else if (swaplen == 3){
-            for (unsigned int j = 0; j < 3; ++j){
-                _deviceConfig[index].swap[j] = swap[j];
-            }
-        } else {
-            LOG_Err("Invalid swap indices length of %d fo %s. ABORTING",
-                    swaplen, sensornames[index]);
-            assert(swaplen == 3);
-        }
+    //nothing is known about the nodes' state until they are first written
+    for (int i = 0; i < MAX_NUM_SENSORS_TO_HANDLE; i++) {
+        const int record = OSPConfig::findSensor(pConfig, RelayDecoder_SensorName(i));
 
-        conv = OSPConfig::getNamedConfigItemFloat(
-                    sensornames[index], OSPConfig::SENSOR_CONVERSION, &convlen);
-        if (!conv){
-            for (unsigned int j = 0; j < 3; ++j){
-                _deviceConfig[index].conversion[j] = 1.0f;
-            }
-        } else if (convlen == 1){
-            for (unsigned int j = 0; j < 3; ++j){
-                _deviceConfig[index].conversion[j] = conv[0];
-            }
-        } else if (convlen == 3){
-            for (unsigned int j = 0; j < convlen; ++j){
-                _deviceConfig[index].conversion[j] = conv[j];
-            }
-        } else {
-            LOG_Err("Invalid conversion value array length of %d fo %s",
-                    convlen, sensornames[index]);
-            assert(convlen == 3);
-        }
+        _sensorControl[i].defaultPeriodNs =
+            (record >= 0) ? (int64_t)(pConfig->sensors[record].period * NSEC_PER_SEC) : 0;
+        _sensorControl[i].enabled = -1;
+        _sensorControl[i].delayMs = -1;
     }
 
-    temp = OSPConfig::getConfigItem(OSPConfig::PROTOCOL_RELAY_DRIVER);
-    _deviceRelayInputName = temp? temp : "";
+    _deviceRelayInputName = pConfig->relayDriver;
 
     if (!_deviceRelayInputName.empty()) {
+        const int64_t startNs = _monotonicNs();
+
         result = InitializeRelayInput();
+        _relayMappingNs = _monotonicNs() - startNs;
         if (result != OSP_STATUS_OK) {
             LOG_Err("InitializeRelayInput failed (%d)", result);
         }
     }
 
     /* Initialize the micro-second per tick value */
-    _relayTickUsec = OSPConfig::getConfigItemIntV(
-                OSPConfig::PROTOCOL_RELAY_TICK_USEC,
-                1,
-                NULL);
+    _relayTickUsec = pConfig->relayTickUsec;
     LOG_Info("Relay Ticks per us: %d", _relayTickUsec);
 
+    RelayDecoder_Compile(_deviceConfig, _relayTickUsec);
+
+    if (!pConfig->relayCapturePath.empty() &&
+        (_captureTrace.open(pConfig->relayCapturePath.c_str(), _relayTickUsec) < 0)) {
+        LOG_Err("Relay capture disabled");
+    }
+
+    _perCpuDrain = pConfig->relayPerCpuDrain;
+    LOG_Info("Relay per-CPU drain: %s", _perCpuDrain ? "on" : "off");
+
     return result;
 }
 
 
 /****************************************************************************************************
- * @fn      InitializeRelayInput
- *          Initializes the relay-fs interface and associated data structures.
+ * @fn      _openRelayHub
+ *          Opens a hub's wakeup source and maps its per-CPU relay buffers
  *
  ***************************************************************************************************/
-static int32_t InitializeRelayInput( void )
+static int32_t _openRelayHub(RelayHub_t* pHub)
 {
     osp_char_t devname[256];
-    osp_char_t *sysfs = NULL;
     unsigned int cpu;
 
     memset(devname, 0, sizeof(devname));
 
-    _relay_fd = -1;
-
-    for ( unsigned char i = 0; i < MAX_NUM_SENSORS_TO_HANDLE;++i){
-        _deviceConfig[i].sysEnablePath.clear();
-        _deviceConfig[i].sysDelayPath.clear();
-    }
-
-    //open up the real sensor drivers
-    _relay_fd = openInputEventDeviceExt(_deviceRelayInputName.c_str(), devname);
-    if (_relay_fd < 0) {
-        LOG_Err("Unable to open relay input device with name %s",
-                _deviceRelayInputName.c_str() );
-        return OSP_STATUS_UNKNOWN_INPUT;
+    if (!pHub->wakeupPath.empty()) {
+        //Explicit wakeup node, e.g. the FIFO of the relay emulator. Opened read-write so a FIFO
+        //never reports EOF when its writer goes away
+        pHub->wakeupFd = open(pHub->wakeupPath.c_str(), O_RDWR | O_NONBLOCK);
+        if (pHub->wakeupFd < 0) {
+            LOG_Err("Unable to open relay wakeup %s: %s", pHub->wakeupPath.c_str(), strerror(errno));
+            return OSP_STATUS_UNKNOWN_INPUT;
+        }
+        LOG_Info("Open relay wakeup %s for %s", pHub->wakeupPath.c_str(), pHub->name.c_str());
+    } else {
+        //open up the real sensor drivers
+        pHub->wakeupFd = openInputEventDeviceExt(_deviceRelayInputName.c_str(), devname);
+        if (pHub->wakeupFd < 0) {
+            LOG_Err("Unable to open relay input device with name %s",
+                    _deviceRelayInputName.c_str() );
+            return OSP_STATUS_UNKNOWN_INPUT;
+        }
+        LOG_Info("Open relay input device with name %s",
+                 _deviceRelayInputName.c_str() );
     }
-    LOG_Info("Open relay input device with name %s",
-             _deviceRelayInputName.c_str() );
 
-    for (unsigned char i = 0; i < MAX_NUM_SENSORS_TO_HANDLE; ++i) {
-        if (!_deviceConfig[i].uinputName.empty()) {
-            if (OSPConfig::getNamedConfigItem(sensornames[i],
-                                             OSPConfig::SENSOR_ENABLE_PATH)) {
-                _deviceConfig[i].enableValue = OSPConfig::getNamedConfigItemIntV
-                        ( sensornames[i],
-                          OSPConfig::SENSOR_ENABLE_VALUE,
-                          1);
-                _deviceConfig[i].disableValue =  OSPConfig::getNamedConfigItemIntV( sensornames[i],
-                                                                                   OSPConfig::SENSOR_DISABLE_VALUE, 1);
-                if(asprintf(&sysfs, "/sys/class/sensor_relay/%s/%s",
-                            _deviceConfig[i].uinputName.c_str(),
-                            OSPConfig::getNamedConfigItem(sensornames[i],
-                                                         OSPConfig::SENSOR_ENABLE_PATH))< 0) {
-                    LOG_Err("asprintf call failed!");
-                } else {
-                    LOG_Info("Sysfs Enable Path: %s, %d, %d", sysfs, _deviceConfig[i].enableValue,
-                             _deviceConfig[i].disableValue);
-                    _deviceConfig[i].sysEnablePath.assign(sysfs);
-                    free(sysfs);
-                }
-            }
-            if (OSPConfig::getNamedConfigItem( sensornames[i],
-                                              OSPConfig::SENSOR_DELAY_PATH)) {
-                if(asprintf(&sysfs, "/sys/class/sensor_relay/%s/%s",
-                            _deviceConfig[i].uinputName.c_str(),
-                            OSPConfig::getNamedConfigItem( sensornames[i],
-                                                          OSPConfig::SENSOR_DELAY_PATH)) < 0) {
-                    LOG_Err("asprintf call failed!");
-                } else {
-                    LOG_Info("Sysfs Delay Path: %s", sysfs);
-                    _deviceConfig[i].sysDelayPath.assign(sysfs);
-                    free(sysfs);
-                }
-            }
-        }
+    //wakeup events are read until EAGAIN, so the device must not block
+    if (fcntl(pHub->wakeupFd, F_SETFL, fcntl(pHub->wakeupFd, F_GETFL) | O_NONBLOCK) < 0) {
+        LOG_Err("Unable to set relay input device non-blocking: %s", strerror(errno));
     }
 
-    for (cpu = 0; (cpu < 16); ) {
+    for (cpu = 0; (cpu < RELAY_MAX_CPUS); ) {
         const RelayBufStatus_t dummyBufStatus = {0, 0, 0};
 
-        sprintf(devname, "/sys/kernel/debug/sensor_relay_kernel%d", cpu);
+        snprintf(devname, sizeof(devname), "%s%d", pHub->relayPath.c_str(), cpu);
         const int fileHandle = open(devname, O_RDONLY | O_NONBLOCK);
 
         if (fileHandle < 0) {
@@ -359,7 +455,7 @@ static int32_t InitializeRelayInput( void )
             }
             break;
         }
-        LOG_Info("cpu %d file", cpu);
+        LOG_Info("%s cpu %d file", pHub->name.c_str(), cpu);
 
         unsigned char *bufferP = (unsigned char *) mmap(
                     NULL,
@@ -379,138 +475,480 @@ static int32_t InitializeRelayInput( void )
             break;
         }
 
-        LOG_Info("cpu %d mmap", cpu);
+        LOG_Info("%s cpu %d mmap", pHub->name.c_str(), cpu);
 
-        sprintf(devname, "/sys/kernel/debug/sensor_relay_kernel%d.produced", cpu);
+        snprintf(devname, sizeof(devname), "%s%d.produced", pHub->relayPath.c_str(), cpu);
         const int producerFile = open(devname, O_RDONLY);
         if (producerFile < 0) {
             LOG_Err("Couldn't open control file %s\n", devname);
             break;
         }
 
-        LOG_Info("cpu %d producer", cpu);
+        LOG_Info("%s cpu %d producer", pHub->name.c_str(), cpu);
 
-        sprintf(devname, "/sys/kernel/debug/sensor_relay_kernel%d.consumed", cpu);
+        snprintf(devname, sizeof(devname), "%s%d.consumed", pHub->relayPath.c_str(), cpu);
         const int consumedFile = open(devname, O_RDWR);
         if (consumedFile < 0) {
             LOG_Err("Couldn't open control file %s\n", devname);
             break;
         }
-        LOG_Info("cpu %d consumed", cpu);
+        LOG_Info("%s cpu %d consumed", pHub->name.c_str(), cpu);
 
-        _relay_file.push_back(fileHandle);
-        __relay_buffer.push_back(bufferP);
-        _produced_file.push_back(producerFile);
-        _consumed_file.push_back(consumedFile);
-        _relayStatus.push_back(dummyBufStatus);
-
-        _relayStatus[cpu].produced = 0;
-        _relayStatus[cpu].consumed = 0;
+        pHub->relayFile.push_back(fileHandle);
+        pHub->relayBuffer.push_back(bufferP);
+        pHub->producedFile.push_back(producerFile);
+        pHub->consumedFile.push_back(consumedFile);
+        pHub->relayStatus.push_back(dummyBufStatus);
         cpu++;
     }
 
     if (cpu == 0) {
-        LOG_Err("No CPU relay files found");
+        LOG_Err("No CPU relay files found for %s", pHub->name.c_str());
         return OSP_STATUS_UNKNOWN_INPUT;
     }
     return OSP_STATUS_OK;
 }
 
+
 /****************************************************************************************************
- * @fn      _processRelayInput
- *          Thread entry function for relay input processing
+ * @fn      _closeRelayHub
+ *          Unmaps a hub's relay buffers, closes its files and frees it. Its drains must be stopped
  *
  ***************************************************************************************************/
-static void *_processRelayInput(void *pData)
+static void _closeRelayHub(RelayHub_t* pHub)
 {
-    LOG_Info("%s", __FUNCTION__);
+    for (size_t cpu = 0; cpu < pHub->relayFile.size(); cpu++) {
+        munmap(pHub->relayBuffer[cpu],
+               sizeof(union sensor_relay_broadcast_node) * SENSOR_RELAY_NUM_RELAY_BUFFERS);
+        close(pHub->relayFile[cpu]);
+        close(pHub->producedFile[cpu]);
+        close(pHub->consumedFile[cpu]);
+    }
+    if (pHub->wakeupFd >= 0) {
+        close(pHub->wakeupFd);
+    }
+    delete pHub;
+}
+
+
+/****************************************************************************************************
+ * @fn      InitializeRelayInput
+ *          Initializes the relay-fs interface and associated data structures of every hub.
+ *
+ ***************************************************************************************************/
+static int32_t InitializeRelayInput( void )
+{
+    osp_char_t *sysfs = NULL;
+    unsigned int traceCpuBase = 0;
+
+    for ( unsigned char i = 0; i < MAX_NUM_SENSORS_TO_HANDLE;++i){
+        _deviceConfig[i].sysEnablePath.clear();
+        _deviceConfig[i].sysDelayPath.clear();
+    }
+
+    const OSPConfig::Snapshot_t* pConfig = OSPConfig::snapshot();
+    const char* relayPath = pConfig->relayPath.empty() ? RELAY_DEFAULT_PATH :
+                                                         pConfig->relayPath.c_str();
+    const char* sysfsPath = pConfig->relaySysfsPath.empty() ? RELAY_DEFAULT_SYSFS_PATH :
+                                                              pConfig->relaySysfsPath.c_str();
+
+    for (unsigned char i = 0; i < MAX_NUM_SENSORS_TO_HANDLE; ++i) {
+        const int record = OSPConfig::findSensor(pConfig, RelayDecoder_SensorName(i));
+
+        if (!_deviceConfig[i].uinputName.empty() && (record >= 0)) {
+            const OSPConfig::SensorRecord_t& sensor = pConfig->sensors[record];
+
+            if (!sensor.enablePath.empty()) {
+                _deviceConfig[i].enableValue = sensor.enableValue;
+                _deviceConfig[i].disableValue = sensor.disableValue;
+                if(asprintf(&sysfs, "%s/%s/%s", sysfsPath,
+                            _deviceConfig[i].uinputName.c_str(),
+                            sensor.enablePath.c_str())< 0) {
+                    LOG_Err("asprintf call failed!");
+                } else {
+                    LOG_Info("Sysfs Enable Path: %s, %d, %d", sysfs, _deviceConfig[i].enableValue,
+                             _deviceConfig[i].disableValue);
+                    _deviceConfig[i].sysEnablePath.assign(sysfs);
+                    free(sysfs);
+                }
+            }
+            if (!sensor.delayPath.empty()) {
+                if(asprintf(&sysfs, "%s/%s/%s", sysfsPath,
+                            _deviceConfig[i].uinputName.c_str(),
+                            sensor.delayPath.c_str()) < 0) {
+                    LOG_Err("asprintf call failed!");
+                } else {
+                    LOG_Info("Sysfs Delay Path: %s", sysfs);
+                    _deviceConfig[i].sysDelayPath.assign(sysfs);
+                    free(sysfs);
+                }
+            }
+        }
+    }
+
+    RelayHub_t* pHub = new RelayHub_t();
+    pHub->name = "hub0";
+    pHub->relayPath = relayPath;
+    pHub->wakeupPath = pConfig->relayWakeupPath;
+    _hubs.push_back(pHub);
+
+    //only the first hub can use the relay input device; it does not tell hubs apart
+    for (size_t i = 0; i < pConfig->relayHubs.size(); i++) {
+        const OSPConfig::RelayHubRecord_t& hub = pConfig->relayHubs[i];
 
-    if (_relay_fd > 0) {
-        _relayThreadActive = true;
+        if (hub.relayPath.empty() || hub.wakeupPath.empty()) {
+            LOG_Err("Relay hub %s needs a %s and a %s", hub.name.c_str(), OSPConfig::HUB_RELAY_PATH,
+                    OSPConfig::HUB_WAKEUP_PATH);
+            return OSP_STATUS_UNKNOWN_INPUT;
+        }
+        if (_hubs.size() == OSPD_RELAY_MAX_HUBS) {
+            LOG_Err("Only %d relay hubs are served, %s is not", OSPD_RELAY_MAX_HUBS,
+                    hub.name.c_str());
+            break;
+        }
+        pHub = new RelayHub_t();
+        pHub->name = hub.name;
+        pHub->relayPath = hub.relayPath;
+        pHub->wakeupPath = hub.wakeupPath;
+        _hubs.push_back(pHub);
     }
 
-    //Main processing loop
-    while (_relayThreadActive) {
-        _relayReadAndProcessSensorData(_relay_fd, _resultReadyCallbacks);
+    for (size_t i = 0; i < _hubs.size(); i++) {
+        _hubs[i]->wakeupFd = -1;
+        _hubs[i]->traceCpuBase = traceCpuBase;
+        const int32_t result = _openRelayHub(_hubs[i]);
+        if (result != OSP_STATUS_OK) {
+            return result;
+        }
+        traceCpuBase += _hubs[i]->producedFile.size();
     }
+    return OSP_STATUS_OK;
+}
 
-    LOG_Info("Relay thread exiting...");
+/****************************************************************************************************
+ * @fn      _drainRelayBuffers
+ *          Drains the given range of a hub's CPU buffers into pRing until produced/consumed
+ *          converge, then rings the publisher
+ *
+ ***************************************************************************************************/
+static void _drainRelayBuffers(RelayHub_t* pHub, unsigned int firstCpu, unsigned int endCpu,
+                               RelaySampleRing_t* pRing)
+{
+    //Keep draining until produced/consumed converge so that nodes written while we were
+    //busy do not wait for the next notification
+    const uint64_t drainedBefore = pHub->samplesDrained.load(std::memory_order_relaxed);
+    const int64_t wakeupNs = pHub->lastWakeupNs.load(std::memory_order_relaxed);
+    const int64_t startNs = _monotonicNs();
+    //one decode table for the whole drain; a configuration reload lands between drains
+    const RelayTransformTable_t* pTransforms = RelayDecoder_Transforms();
+    size_t nodes = 0;
+
+    for (int pass = 0; pass < RELAY_MAX_DRAIN_PASSES; pass++) {
+        //only the first pass is a response to the wakeup; later ones find nodes written since
+        const size_t consumed = ProcessInputEventsRelay(pHub, firstCpu, endCpu, pRing,
+                                                        pass ? 0 : wakeupNs, pTransforms);
+        if (consumed == 0) {
+            break;
+        }
+        nodes += consumed;
+    }
+
+    if (nodes) {
+        _nodesDecoded.fetch_add(nodes, std::memory_order_relaxed);
+        _decodeNs.fetch_add(_monotonicNs() - startNs, std::memory_order_relaxed);
+    }
+
+    //One doorbell per drain; the publisher takes everything that is in the rings. With per-CPU
+    //drains the hub's counter may have moved because of another thread, which only costs a
+    //spurious doorbell
+    if (pHub->samplesDrained.load(std::memory_order_relaxed) != drainedBefore) {
+        const uint64_t one = 1;
+        if (write(_publisherEventFd, &one, sizeof(one)) < 0) {
+            LOG_Err("Unable to signal publisher: %s", strerror(errno));
+        }
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      _drainRelayThread
+ *          Drain thread entry. A per-CPU drain pins itself to the CPU whose relay buffer it owns
+ *
+ ***************************************************************************************************/
+static void *_drainRelayThread(void *pData)
+{
+    RelayDrainThread_t* pDrain = (RelayDrainThread_t*)pData;
+    cpu_set_t cpuSet;
+    uint64_t doorbell;
+
+    if (pDrain->pinned) {
+        CPU_ZERO(&cpuSet);
+        CPU_SET(pDrain->firstCpu, &cpuSet);
+        if (sched_setaffinity(0, sizeof(cpuSet), &cpuSet) < 0) {
+            //CPU may be offline (hotplug); drain from wherever we get scheduled
+            LOG_Err("Unable to pin drain thread to cpu %u: %s", pDrain->firstCpu, strerror(errno));
+        }
+    }
+
+    while (_drainThreadsActive) {
+        //no decode table is held while blocked
+        RelayDecoder_Quiescent(pDrain->decoderReader);
+        if (read(pDrain->eventFd, &doorbell, sizeof(doorbell)) < 0) {
+            if (errno != EINTR) {
+                LOG_Err("Drain doorbell read failed for %s cpu %u: %s", pDrain->pHub->name.c_str(),
+                        pDrain->firstCpu, strerror(errno));
+            }
+            continue;
+        }
+        if (!_drainThreadsActive) {
+            break;
+        }
+        _drainRelayBuffers(pDrain->pHub, pDrain->firstCpu, pDrain->endCpu, pDrain->pRing);
+    }
 
     return 0;
 }
 
 
+/****************************************************************************************************
+ * @fn      _startDrainThreads
+ *          Starts a hub's drain threads: one per CPU buffer with per-CPU drains, else one for the
+ *          whole hub if threaded. The hub's rings must exist
+ *
+ ***************************************************************************************************/
+static int32_t _startDrainThreads(RelayHub_t* pHub, bool threaded)
+{
+    if (!_perCpuDrain && !threaded) {
+        return OSP_STATUS_OK;
+    }
+
+    //sized up front; the threads keep pointers into this vector
+    pHub->drainThreads.resize(pHub->sampleRings.size());
+    for (unsigned int i = 0; i < pHub->drainThreads.size(); i++) {
+        RelayDrainThread_t& drain = pHub->drainThreads[i];
+
+        drain.pHub = pHub;
+        drain.firstCpu = _perCpuDrain ? i : 0;
+        drain.endCpu = _perCpuDrain ? i + 1 : pHub->producedFile.size();
+        drain.pinned = _perCpuDrain;
+        drain.pRing = pHub->sampleRings[i];
+        drain.eventFd = eventfd(0, EFD_CLOEXEC);
+        drain.decoderReader = RelayDecoder_AddReader();
+        if ((drain.eventFd < 0) ||
+            (pthread_create(&drain.thread, NULL, _drainRelayThread, &drain) != 0)) {
+            LOG_Err("Unable to create relay drain thread for %s cpu %u\n", pHub->name.c_str(),
+                    drain.firstCpu);
+            if (drain.eventFd >= 0) {
+                close(drain.eventFd);
+            }
+            RelayDecoder_RemoveReader(drain.decoderReader);
+            pHub->drainThreads.resize(i);
+            return OSP_STATUS_ERROR;
+        }
+    }
+
+    return OSP_STATUS_OK;
+}
+
+
+/****************************************************************************************************
+ * @fn      _popOldestSample
+ *          Takes the sample with the earliest timestamp among the heads of the sample rings, so
+ *          the drains of all CPUs and hubs merge into one timestamp ordered stream
+ *
+ ***************************************************************************************************/
+static bool _popOldestSample(RelaySample_t& sample)
+{
+    RelaySampleRing_t* pOldest = NULL;
+    int64_t oldestTime = 0;
+
+    for (size_t i = 0; i < _sampleRings.size(); i++) {
+        const RelaySample_t* pHead = _sampleRings[i]->peek();
+        if ((pHead != NULL) && ((pOldest == NULL) || (pHead->data.timestamp.ll < oldestTime))) {
+            pOldest = _sampleRings[i];
+            oldestTime = pHead->data.timestamp.ll;
+        }
+    }
+
+    return (pOldest != NULL) && pOldest->pop(sample);
+}
+
+
 /****************************************************************************************************
  * @fn      _relayReadAndProcessSensorData
- *          Helper routine for reading and handling sensor data coming via RelayFS
+ *          Helper routine for reading and handling sensor data coming via RelayFS. All pending
+ *          wakeup events of a hub are read in large chunks and coalesced into a single relay drain
  *
  ***************************************************************************************************/
-static void _relayReadAndProcessSensorData(int fd, OSPD_ResultDataCallback_t dataCallbacks[])
+static void _relayReadAndProcessSensorData(RelayHub_t* pHub)
 {
-    fd_set readFdSet;
-    fd_set excFdSet;
-    int32_t bytesRead, nfds = 0;
-    int32_t selectResult;
+    const int fd = pHub->wakeupFd;
+    const int64_t wakeupNs = _monotonicNs();
+    ssize_t bytesRead;
+    size_t numWakeups = 0;
     struct input_event inputEvents[PROCESS_INPUT_EVT_THRES];
 
-    //Since select() modifies its fdset, if the call is being used in a loop, then
-    //the set must be re-initialized before each call
-    FD_ZERO(&readFdSet);
-    FD_ZERO(&excFdSet);
+    //Empty the (non-blocking) device; every ABS_VOLUME is just a "data produced" notification
+    //so they are all served by one drain below
+    do {
+        bytesRead = read(fd, inputEvents, sizeof(inputEvents));
+        if (bytesRead < 0) {
+            if ((errno != EAGAIN) && (errno != EINTR)) {
+                LOG_Err("I/O read error on relay input device %d", fd);
+            }
+            break;
+        }
 
-    FD_SET(_relay_fd, &readFdSet);
-    FD_SET(_relay_fd, &excFdSet);
-    nfds = MAX_NUM_FDS( nfds, _relay_fd);
+        if ((bytesRead % sizeof(struct input_event)) != 0) {
+            LOG_Err("partial event struct read. Would lose some samples!");
+        }
+        for (size_t i = 0; i < (bytesRead / sizeof(struct input_event)); i++) {
+            if (inputEvents[i].code == ABS_VOLUME) {
+                numWakeups++;
+            }
+        }
+    } while (bytesRead == sizeof(inputEvents));
 
-    /* Wait to recieve data on the relay pipe */
-    selectResult = select(nfds+1, &readFdSet, NULL, &excFdSet, NULL);
-    if (!_relayThreadActive){
+    if (numWakeups == 0) {
+        return;
+    }
+    pHub->lastWakeupNs.store(wakeupNs, std::memory_order_relaxed);
+
+    //Hubs with drain threads are emptied by them, so the event loop is back for the next wakeup
+    if (!pHub->drainThreads.empty()) {
+        const uint64_t one = 1;
+        for (size_t i = 0; i < pHub->drainThreads.size(); i++) {
+            if (write(pHub->drainThreads[i].eventFd, &one, sizeof(one)) < 0) {
+                LOG_Err("Unable to signal drain thread for %s cpu %u: %s", pHub->name.c_str(),
+                        pHub->drainThreads[i].firstCpu, strerror(errno));
+            }
+        }
         return;
     }
 
-    if (selectResult > 0) {
-        //read and publish the events
-        if (FD_ISSET(_relay_fd, &excFdSet) ) {
-            LOG_Err("ERROR: exception on select of socket for relay");
-        } else {
-            //make sure this FD has data before trying to read
-            if (FD_ISSET(_relay_fd, &readFdSet) ) {
-                bytesRead = read(_relay_fd, &inputEvents[0], sizeof(struct input_event));
-                if (bytesRead < 0){
-                    LOG_Err("I/O read error on relay input device %d", _relay_fd);
-                } else if (bytesRead == 0){
-                    FD_CLR( _relay_fd, &readFdSet );
-                    FD_CLR( _relay_fd, &excFdSet );
-                } else {
-                    if ((bytesRead % sizeof(struct input_event)) != 0) {
-                        LOG_Err("partial event struct read. Would lose some samples!");
-                    }
-                    for (int i = 0; i < (bytesRead / sizeof(struct input_event)); i++) {
-                        if (inputEvents[i].code == ABS_VOLUME) {
-                            ProcessInputEventsRelay();
-                        }
-                    }
-                }
+    _drainRelayBuffers(pHub, 0, pHub->producedFile.size(), pHub->sampleRings[0]);
+}
+
+
+/****************************************************************************************************
+ * @fn      _armBatchTimer
+ *          Sets the batch timer to the next subscriber batch deadline, or disarms it (dueNs 0).
+ *          The timer is only reprogrammed when the deadline moves
+ *
+ ***************************************************************************************************/
+static void _armBatchTimer(int64_t dueNs)
+{
+    static int64_t armedNs = 0;
+    struct itimerspec spec;
+
+    if (dueNs == armedNs) {
+        return;
+    }
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = dueNs / NSEC_PER_SEC;
+    spec.it_value.tv_nsec = dueNs % NSEC_PER_SEC;
+    if (timerfd_settime(_batchTimerFd, TFD_TIMER_ABSTIME, &spec, NULL) < 0) {
+        LOG_Err("%s: timerfd_settime failed: %s\n", __FUNCTION__, strerror(errno));
+        return;
+    }
+    armedNs = dueNs;
+}
+
+
+/****************************************************************************************************
+ * @fn      _publishRelaySamples
+ *          Publisher thread entry. Fans converted samples out to the result callbacks so that a
+ *          slow consumer never holds up the relay drain
+ *
+ ***************************************************************************************************/
+static void *_publishRelaySamples(void *pData)
+{
+    RelaySample_t batch[RELAY_PUBLISH_BATCH];
+    int64_t dispatchNs[RELAY_PUBLISH_BATCH];
+    uint64_t doorbell;
+
+    LOG_Info("%s", __FUNCTION__);
+
+    while (_publisherThreadActive) {
+        struct pollfd fds[2];
+
+        fds[0].fd = _publisherEventFd;
+        fds[0].events = POLLIN;
+        fds[1].fd = _batchTimerFd;
+        fds[1].events = POLLIN;
+
+        //no subscription table is referenced while blocked
+        _subscriptions.quiescent();
+        if (poll(fds, 2, -1) < 0) {
+            if (errno != EINTR) {
+                LOG_Err("Publisher poll failed: %s", strerror(errno));
             }
+            continue;
+        }
+        if ((fds[0].revents & POLLIN) &&
+            (read(_publisherEventFd, &doorbell, sizeof(doorbell)) < 0)) {
+            LOG_Err("Publisher doorbell read failed: %s", strerror(errno));
         }
+        if ((fds[1].revents & POLLIN) &&
+            (read(_batchTimerFd, &doorbell, sizeof(doorbell)) < 0) && (errno != EAGAIN)) {
+            LOG_Err("Batch timer read failed: %s", strerror(errno));
+        }
+
+        //Batches are bounded so that the uinput write, and with it the publish time of every
+        //sample of the batch, is known without an unbounded list of pending samples
+        size_t numSamples;
+        do {
+            for (numSamples = 0;
+                 (numSamples < RELAY_PUBLISH_BATCH) && _popOldestSample(batch[numSamples]);
+                 numSamples++) {
+                dispatchNs[numSamples] = _monotonicNs();
+                _sensorDataPublish(batch[numSamples].sensorIndex, &batch[numSamples].data,
+                                   dispatchNs[numSamples]);
+            }
+            _samplesPublished.fetch_add(numSamples, std::memory_order_relaxed);
+            _subscriptions.quiescent();
+
+            if (_batchCompleteCallback != NULL) {
+                _batchCompleteCallback();
+            }
+
+            const int64_t publishedNs = _monotonicNs();
+            for (size_t i = 0; i < numSamples; i++) {
+                _recordLatency(batch[i], dispatchNs[i], publishedNs);
+            }
+        } while (numSamples == RELAY_PUBLISH_BATCH);
 
+        //subscriber batches that ran out of report latency, or were flushed, go out as one burst
+        if (_subscriptions.deliverBatches(_monotonicNs()) && (_batchCompleteCallback != NULL)) {
+            _batchCompleteCallback();
+        }
+        _armBatchTimer(_subscriptions.nextBatchDueNs());
     }
+
+    LOG_Info("Publisher thread exiting...");
+
+    return 0;
 }
 
 
 /****************************************************************************************************
  * @fn      ProcessInputEventsRelay
- *          Helper routine for processing sensor data coming via RelayFS
+ *          Helper routine for processing sensor data coming via RelayFS. Converts the nodes of a
+ *          hub's CPU buffers [firstCpu, endCpu) into pRing and returns the number of sub-buffers
+ *          consumed
  *
  ***************************************************************************************************/
-static void ProcessInputEventsRelay(void)
+static size_t ProcessInputEventsRelay(RelayHub_t* pHub, unsigned int firstCpu, unsigned int endCpu,
+                                      RelaySampleRing_t* pRing, int64_t wakeupNs,
+                                      const RelayTransformTable_t* pTransforms)
 {
     size_t size;
-    int32_t sensorIndex;
+    size_t totalConsumed = 0;
+    RelaySample_t samples[RELAY_DECODE_MAX_RUN];
 
-    for (unsigned int cpu = 0; cpu < _produced_file.size(); cpu++) {
-        lseek(_produced_file[cpu], 0, SEEK_SET);
-        if (read(_produced_file[cpu], &size,
+    for (unsigned int cpu = firstCpu; cpu < endCpu; cpu++) {
+        lseek(pHub->producedFile[cpu], 0, SEEK_SET);
+        if (read(pHub->producedFile[cpu], &size,
                  sizeof(size)) < 0) {
             LOG_Info("Couldn't read from consumed file for cpu %d, exiting: errcode = %d: %s\n",
                      cpu,
@@ -518,13 +956,19 @@ static void ProcessInputEventsRelay(void)
                      strerror(errno));
             break;
         }
-        _relayStatus[cpu].produced = size;
+        pHub->relayStatus[cpu].produced = size;
+
+        const int64_t drainNs = _monotonicNs();
+        //everything in the buffer was written by now; the newest node is the closest to it
+        const int64_t receivedNs = _boottimeNs();
+        HubClockMap_t clock = pHub->clock.mapping();
+        int64_t newestHubNs = INT64_MIN;
 
 #if 0
         LOG_Info("wakeup  CPU %d produced %d consumed %d  \n",
                  cpu,
-                 _relayStatus[cpu].produced,
-                 _relayStatus[cpu].consumed);
+                 pHub->relayStatus[cpu].produced,
+                 pHub->relayStatus[cpu].consumed);
 #endif
 
         size_t bufidx, start_subbuf, subbuf_idx;
@@ -533,21 +977,23 @@ static void ProcessInputEventsRelay(void)
 
         unsigned char *subbuf_ptr;
 
-        size_t subbufs_ready = _relayStatus[cpu].produced - _relayStatus[cpu].consumed + 1;
+        size_t subbufs_ready = pHub->relayStatus[cpu].produced - pHub->relayStatus[cpu].consumed + 1;
 
-        start_subbuf = _relayStatus[cpu].consumed % SENSOR_RELAY_NUM_RELAY_BUFFERS;
+        start_subbuf = pHub->relayStatus[cpu].consumed % SENSOR_RELAY_NUM_RELAY_BUFFERS;
 
-        if ((_relayStatus[cpu].produced == 0) && (_relayStatus[cpu].consumed == 0))
+        if ((pHub->relayStatus[cpu].produced == 0) && (pHub->relayStatus[cpu].consumed == 0))
             subbufs_ready = 0;
 #if 0
         LOG_Info("produced  %d   consumed %d\n",
-                 _relayStatus[cpu].produced,
-                 _relayStatus[cpu].consumed);
+                 pHub->relayStatus[cpu].produced,
+                 pHub->relayStatus[cpu].consumed);
 #endif
 
-        for (bufidx = start_subbuf; subbufs_ready-- > 0 ; bufidx++) {
+        //Nodes are taken in runs of the same sensor that are contiguous in the buffer so each run
+        //is converted in one batch
+        for (bufidx = start_subbuf; subbufs_ready > 0; ) {
             subbuf_idx = bufidx % SENSOR_RELAY_NUM_RELAY_BUFFERS;
-            subbuf_ptr = __relay_buffer[cpu] + (subbuf_idx * sizeof(union sensor_relay_broadcast_node));
+            subbuf_ptr = pHub->relayBuffer[cpu] + (subbuf_idx * sizeof(union sensor_relay_broadcast_node));
             union  sensor_relay_broadcast_node *sensorNode = (union  sensor_relay_broadcast_node *) subbuf_ptr;
 
 #if 0
@@ -568,201 +1014,67 @@ static void ProcessInputEventsRelay(void)
                      subbuf_ptr[21], subbuf_ptr[22],  subbuf_ptr[23]);
 #endif
 
-            if (_deviceConfig[sensorNode->sensorData.sensorId].uinputName.empty()) {
-                subbufs_consumed++;
-                continue;
-            }
+            size_t maxRunLength = SENSOR_RELAY_NUM_RELAY_BUFFERS - subbuf_idx;
+            size_t numSamples;
 
-            sensorIndex = -1;
-
-            switch (sensorNode->sensorData.sensorId) {
-            case SENSOR_ACCELEROMETER:
-                sensorIndex = ACCEL_INDEX;
-                //LOG_Info("Accel Data %d", sensorNode->sensorData.sensorId);
-                //strncpy(label,"RA", sizeof(label));
-                //goto ProcessInputEventsCommon;
-                break;
-
-            case SENSOR_GYROSCOPE:
-                sensorIndex = GYRO_INDEX;
-                //strncpy(label,"RG", sizeof(label));
-                //goto ProcessInputEventsCommon;
-                break;
-
-            case SENSOR_MAGNETIC_FIELD:
-                sensorIndex = MAG_INDEX;
-                //strncpy(label,"RM", sizeof(label));
-                //goto ProcessInputEventsCommon;
-                break;
-
-            default:
-                LOG_Err("Invalid sensor id received from relay 0x%-2.2x",
-                        sensorNode->sensorData.sensorId);
-                subbufs_consumed++;
-                continue;
-                break;
+            if (maxRunLength > subbufs_ready) {
+                maxRunLength = subbufs_ready;
             }
 
-            //ProcessInputEventsCommon:
-            if (_deviceConfig[sensorIndex].uinputName.empty()) {
-                subbufs_consumed++;
-                continue;
+            /* Axis unit conversions; results are published from the publisher thread */
+            const size_t runLength = RelayDecoder_DecodeRun(pTransforms, sensorNode, maxRunLength,
+                                                            samples, &numSamples);
+            if (_captureTrace.isOpen()) {
+                _captureTrace.append(pHub->traceCpuBase + cpu, drainNs, sensorNode, runLength);
             }
 
-            /* Axis unit conversions & result callbacks */
-            OSPD_ThreeAxisData_t floatSensorData;
-            uint64_t timeTicks = sensorNode->sensorData.TimeStamp;
-            int64_t timeNsec = (int64_t)(_relayTickUsec * timeTicks * 1000);
-
-            switch(sensorIndex) {
-            case ACCEL_INDEX:
-            case MAG_INDEX:
-            case GYRO_INDEX:
-                for (int eventCode = ABS_X; eventCode <= ABS_Z; eventCode++) {
-                    int32_t axisIndex = 0;
-                    axisIndex = _doAxisSwap(
-                                eventCode,
-                                sensorIndex ,
-                                _deviceConfig[sensorIndex].swap);
-
-                    floatSensorData.data[axisIndex].f =
-                            _deviceConfig[sensorIndex].conversion[axisIndex]*
-                            sensorNode->sensorData.Data[eventCode - ABS_X];
-                    floatSensorData.timestamp.ll = timeNsec;
-                }
-                _sensorDataPublish(sensorIndex, &floatSensorData);
-                break;
+            bufidx += runLength;
+            subbufs_ready -= runLength;
+            subbufs_consumed += runLength;
 
-            default:
-                //TODO Error Handling??
-                LOG_Err("Bad Sensor Index!!");
-                return;
+            if (numSamples && !clock.valid) {
+                pHub->clock.observe(samples[numSamples - 1].data.timestamp.ll, receivedNs);
+                clock = pHub->clock.mapping();
             }
+            for (size_t i = 0; i < numSamples; i++) {
+                const int64_t hubNs = samples[i].data.timestamp.ll;
 
-#if 0
-#ifdef ANDROID
-            switch(sensorIndex) {
-            case ACCEL_INDEX:
-            case MAG_INDEX:
-            case GYRO_INDEX:
-                LOG_Info("bufidx %-3.3d Sensor %-2.2x  TimeStamp 0x%-8.8llx x 0x%-8.8x  y 0x%-8.8x  z 0x%-8.8x tv_usec %-20.6f   \n",
-                         bufidx,
-                         sensorNode->sensorData.sensorId,
-                         sensorNode->sensorData.TimeStamp,
-                         sensorNode->sensorData.Data[0],
-                         sensorNode->sensorData.Data[1],
-                         sensorNode->sensorData.Data[2],
-                         timeUsec / 1000000.0);
-
-                LOG_Info("{!%s, %20.6f , %10.6f , %10.6f , %10.6f, 0 ,!}\n",
-                         label,
-                         (float) timeUsec / (float) 1000000.0,
-                         (float)_sfloatSensorData[sensorIndex][0],
-                         (float)_sfloatSensorData[sensorIndex][1],
-                         (float)_sfloatSensorData[sensorIndex][2]);
-                break;
-
-            default:
-                LOG_Info("bufidx %-3.3d Sensor %-2.2x  TimeStamp 0x%-8.8llx value 0x%-8.8x  tv_usec %-20.6f   \n",
-                         bufidx,
-                         sensorNode->sensorData.sensorId,
-                         sensorNode->sensorData.TimeStamp,
-                         sensorNode->sensorData.Data[0],
-                         timeUsec / 1000000.0);
-
-                LOG_Info("{!%s, %20.6f , %10.6f , 0 ,!}\n",
-                         label,
-                         (float) timeUsec / (float) 1000000.0,
-                         (float)_sfloatSensorData[sensorIndex][0]);
-                break;
+                if (hubNs > newestHubNs) {
+                    newestHubNs = hubNs;
+                }
+                samples[i].data.timestamp.ll = HubClockSync::toHostNs(clock, hubNs);
             }
-#endif
-#endif
-
 
-            //            _vsDevMgr.publish(_deviceConfig[sensorIndex].repubFd,
-            //                              &sensorNode->sensorData.Data[0],
-            //                              lastSensorEvent - ABS_X + 1,
-            //                              timeTicks);
-#if 0
-            SensorIndexToInputProducerMap::iterator iIndexToProducer;
-            iIndexToProducer= _sensorIndexToInputProducerMap.find(sensorIndex);
-
-            if(iIndexToProducer != _sensorIndexToInputProducerMap.end() ) {
-                InputProducerInterface* pProducer= iIndexToProducer->second;
-
-                if (pProducer) {
-                    switch (pProducer->getType()) {
-                    case PRODUCER_IS_THREEAXIS:
-                    {
-                        dynamic_cast<ThreeAxisSensorProducer*>(pProducer)->SetDataByFloat
-                                (eventTimeDbl,
-                                 _sfloatSensorData[sensorIndex],
-                                 3);
-                    }
-                        break;
-                    case PRODUCER_IS_STEP_DATA:
-                    {
-                        NTTIME eventTime = TOFIX_TIME(eventTimeDbl);
-                        StepData_t data;
-
-                        data.startTime = eventTime;
-                        data.stopTime =  eventTime;
-                        data.stepLength = 0;
-                        data.stepFrequency = 0;
-                        data.numStepsTotal = _numStepsTotal;
-                        data.numStepsSinceWalking = 0;
-                        data.numStepsUp = 0;
-                        data.numStepsDown = 0;
-                        data.numStepsLevel = 0;
-                        dynamic_cast<StepDataProducer*>(pProducer)->SetData(data);
-                    }
-                        break;
-                    case PRODUCER_IS_QUATERNION:
-                    {
-                        NTTIME eventTime = TOFIX_TIME(eventTimeDbl);
-                        Quat quat;
-                        quat <<
-                                (float)_sfloatSensorData[sensorIndex][0],
-                                (float)_sfloatSensorData[sensorIndex][1],
-                                (float)_sfloatSensorData[sensorIndex][2],
-                                (float)_sfloatSensorData[sensorIndex][3];
-
-                        AttitudeData data(eventTime, quat, 0.0f, 0.0f);
-
-                        dynamic_cast<AttitudeProducer*>(pProducer)->SetData(data);
-                    }
-                        break;
-                    default:
-                        LOG_Err("No mapping found for producer at sensor index %d as PRODUCER_IS_THREEAXIS nor PRODUCER_IS_STEP_DATA",
-                                sensorIndex );
-                        break;
-                    }
-                } else {
-                    LOG_Err("No mapping found for producer at sensor index %d",
-                            sensorIndex );
+            const int64_t convertedNs = numSamples ? _monotonicNs() : 0;
+            for (size_t i = 0; i < numSamples; i++) {
+                samples[i].stamps.wakeupNs = wakeupNs;
+                samples[i].stamps.drainNs = drainNs;
+                samples[i].stamps.convertedNs = convertedNs;
+                if (pRing->push(samples[i])) {
+                    pHub->samplesDrained.fetch_add(1, std::memory_order_relaxed);
                 }
-            } else {
-                LOG_Err("No mapping found for producer at sensor index %d",
-                        sensorIndex );
             }
-#endif
-            subbufs_consumed++;
+        }
+
+        if (newestHubNs != INT64_MIN) {
+            pHub->clock.observe(newestHubNs, receivedNs);
         }
 
         if (subbufs_consumed) {
             if (subbufs_consumed == SENSOR_RELAY_NUM_RELAY_BUFFERS)
-                LOG_Err("cpu %d buffer full.  Consider using a larger buffer size", cpu);
-            if (subbufs_consumed > _relayStatus[cpu].max_backlog)
-                _relayStatus[cpu].max_backlog = subbufs_consumed;
+                LOG_Err("%s cpu %d buffer full.  Consider using a larger buffer size",
+                        pHub->name.c_str(), cpu);
+            if (subbufs_consumed > pHub->relayStatus[cpu].max_backlog)
+                pHub->relayStatus[cpu].max_backlog = subbufs_consumed;
 
-            _relayStatus[cpu].consumed += subbufs_consumed;
+            pHub->relayStatus[cpu].consumed += subbufs_consumed;
+            totalConsumed += subbufs_consumed;
 #if 0
 # ifdef ANDROID
             LOG_Info("cpu %d consumed %d\n", cpu, subbufs_consumed);
 # endif
 #endif
-            if (write(_consumed_file[cpu], &subbufs_consumed, sizeof(subbufs_consumed)) < 0) {
+            if (write(pHub->consumedFile[cpu], &subbufs_consumed, sizeof(subbufs_consumed)) < 0) {
                 LOG_Err("Couldn't write to consumed file for cpu %d, exiting: errcode = %d: %s",
                         cpu, errno, strerror(errno));
                 exit(1);
@@ -770,6 +1082,8 @@ static void ProcessInputEventsRelay(void)
             subbufs_consumed = 0;
         }
     }
+
+    return totalConsumed;
 }
 
 
@@ -784,6 +1098,7 @@ static void ProcessInputEventsRelay(void)
  ***************************************************************************************************/
 osp_status_t OSPD_Initialize(void) {
     osp_status_t result = OSP_STATUS_OK;
+    const int64_t startNs = _monotonicNs();
     //int tick_us = 24;
     LOGT("%s\r\n", __FUNCTION__);
 
@@ -799,18 +1114,130 @@ osp_status_t OSPD_Initialize(void) {
 
     /* Dump config for debug */
     OSPConfig::dump("/data/tmp/config-dump.txt");
+    const int64_t configDoneNs = _monotonicNs();
 
     result = Initialize();
     if (result != OSP_STATUS_OK) {
         LOG_Err("Initialize failed (%d)", result);
+        return result;
+    }
 
-    } else if ( pthread_create(&_relayThread, NULL, _processRelayInput, NULL )!= 0) {
-        LOG_Err("Unable to create relay input processing thread\n");
+    LOG_Info("Relay node conversion: %s",
+             RelayConvert_ImplName(RelayConvert_Select(RelayConvert_Best())));
+
+    //per-CPU drains each get their own ring so every ring keeps a single producer
+    for (size_t i = 0; i < _hubs.size(); i++) {
+        const size_t numRings = _perCpuDrain ? _hubs[i]->producedFile.size() : 1;
+        for (size_t j = 0; j < numRings; j++) {
+            _hubs[i]->sampleRings.push_back(new RelaySampleRing_t(RELAY_SAMPLE_RING_SIZE));
+            _sampleRings.push_back(_hubs[i]->sampleRings.back());
+        }
+    }
+    _publisherEventFd = eventfd(0, EFD_CLOEXEC);
+    if (_publisherEventFd < 0) {
+        LOG_Err("Unable to create publisher eventfd: %s", strerror(errno));
         return OSP_STATUS_ERROR;
     }
+
+    _batchTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (_batchTimerFd < 0) {
+        LOG_Err("Unable to create batch timer: %s", strerror(errno));
+        return OSP_STATUS_ERROR;
+    }
+
+    _publisherThreadActive = true;
+    if (pthread_create(&_publisherThread, NULL, _publishRelaySamples, NULL) != 0) {
+        LOG_Err("Unable to create relay publisher thread\n");
+        _publisherThreadActive = false;
+        return OSP_STATUS_ERROR;
+    }
+
+    //A single hub is drained by the event loop; several get a thread each so that a hub with
+    //a burst to drain never holds up the others
+    _drainThreadsActive = true;
+    for (size_t i = 0; i < _hubs.size(); i++) {
+        if (_startDrainThreads(_hubs[i], _hubs.size() > 1) != OSP_STATUS_OK) {
+            return OSP_STATUS_ERROR;
+        }
+    }
+
+    if (_hubs.size() > 1) {
+        _wakeupEpollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (_wakeupEpollFd < 0) {
+            LOG_Err("Unable to create relay wakeup epoll: %s", strerror(errno));
+            return OSP_STATUS_ERROR;
+        }
+        for (size_t i = 0; i < _hubs.size(); i++) {
+            struct epoll_event event;
+
+            memset(&event, 0, sizeof(event));
+            event.events = EPOLLIN;
+            event.data.ptr = _hubs[i];
+            if (epoll_ctl(_wakeupEpollFd, EPOLL_CTL_ADD, _hubs[i]->wakeupFd, &event) < 0) {
+                LOG_Err("Unable to watch %s wakeup: %s", _hubs[i]->name.c_str(), strerror(errno));
+                return OSP_STATUS_ERROR;
+            }
+        }
+        LOG_Info("Relay serving %u hubs", (unsigned int)_hubs.size());
+    }
+
+    //sensors stay off until someone subscribes
+    for (int i = 0; i < MAX_NUM_SENSORS_TO_HANDLE; i++) {
+        _arbitrateSensor(i);
+    }
+
+    const int64_t doneNs = _monotonicNs();
+    LOG_Info("Relay startup %.2f ms: configuration %.2f, relay mapping %.2f, pipeline %.2f",
+             (doneNs - startNs) / 1e6, (configDoneNs - startNs) / 1e6, _relayMappingNs / 1e6,
+             (doneNs - configDoneNs - _relayMappingNs) / 1e6);
     return result;
 }
 
+
+/****************************************************************************************************
+ * @fn      OSPD_GetWakeupFd
+ *          Returns the relay wakeup device for the caller's event loop, -1 if not open. With more
+ *          than one hub this is an epoll fd over the wakeups of all of them
+ *
+ ***************************************************************************************************/
+int OSPD_GetWakeupFd(void) {
+    if (_hubs.empty()) {
+        return -1;
+    }
+    return (_hubs.size() == 1) ? _hubs[0]->wakeupFd : _wakeupEpollFd;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_ProcessWakeup
+ *          Called by the event loop when the relay wakeup device is readable
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_ProcessWakeup(void) {
+    struct epoll_event events[OSPD_RELAY_MAX_HUBS];
+
+    if (OSPD_GetWakeupFd() < 0) {
+        return OSP_STATUS_UNKNOWN_INPUT;
+    }
+    if (_hubs.size() == 1) {
+        _relayReadAndProcessSensorData(_hubs[0]);
+        return OSP_STATUS_OK;
+    }
+
+    const int numEvents = epoll_wait(_wakeupEpollFd, events, OSPD_RELAY_MAX_HUBS, 0);
+    if (numEvents < 0) {
+        if (errno != EINTR) {
+            LOG_Err("Relay wakeup epoll failed: %s", strerror(errno));
+            return OSP_STATUS_ERROR;
+        }
+        return OSP_STATUS_OK;
+    }
+    for (int i = 0; i < numEvents; i++) {
+        _relayReadAndProcessSensorData((RelayHub_t*)events[i].data.ptr);
+    }
+    return OSP_STATUS_OK;
+}
+
 /****************************************************************************************************
  * @fn      OSPD_GetVersion
  *          Helper routine for getting daemon version information
@@ -826,47 +1253,250 @@ osp_status_t OSPD_GetVersion(char* versionString, int bufSize) {
 
 /****************************************************************************************************
  * @fn      OSPD_SubscribeResult
- *          Enables subscription for results
+ *          Enables subscription for results. A non-zero periodUs decimates the sensor's samples
+ *          for this subscriber to at most one per period, a non-zero maxReportLatencyUs holds them
+ *          back and delivers them in bursts. Subscribing an already subscribed callback changes
+ *          its period and latency
  *
  ***************************************************************************************************/
-osp_status_t OSPD_SubscribeResult(SensorType_t sensorType, OSPD_ResultDataCallback_t dataReadyCallback ) {
-    osp_status_t result = OSP_STATUS_OK;
-
+osp_status_t OSPD_SubscribeResult(SensorType_t sensorType, OSPD_ResultDataCallback_t dataReadyCallback,
+                                  uint32_t periodUs, uint32_t maxReportLatencyUs) {
     LOGT("%s\r\n", __FUNCTION__);
 
-    _resultReadyCallbacks[sensorType] = dataReadyCallback;
+    if (dataReadyCallback == NULL) {
+        return OSP_STATUS_NULL_POINTER;
+    }
+    if (_subscriptions.add(sensorType, dataReadyCallback, periodUs, maxReportLatencyUs) < 0) {
+        return OSP_STATUS_UNKNOWN_INPUT;
+    }
+    _arbitrateSensorType(sensorType);
 
-    return result;
+    return OSP_STATUS_OK;
 }
 
 /****************************************************************************************************
  * @fn      OSPD_UnsubscribeResult
- *          Unsubscribe from sensor results
+ *          Unsubscribe from sensor results; all subscribers of the sensor if dataReadyCallback is
+ *          NULL
  *
  ***************************************************************************************************/
-osp_status_t OSPD_UnsubscribeResult(SensorType_t sensorType) {
+osp_status_t OSPD_UnsubscribeResult(SensorType_t sensorType, OSPD_ResultDataCallback_t dataReadyCallback) {
+    LOGT("%s\r\n", __FUNCTION__);
+
+    if ((sensorType < 0) || (sensorType >= SENSOR_ENUM_COUNT)) {
+        return OSP_STATUS_UNKNOWN_INPUT;
+    }
+    _subscriptions.remove(sensorType, dataReadyCallback);
+    _arbitrateSensorType(sensorType);
+
+    return OSP_STATUS_OK;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_FlushResult
+ *          Has the publisher thread deliver the samples batched for a sensor
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_FlushResult(SensorType_t sensorType) {
+    const uint64_t one = 1;
+
+    LOGT("%s\r\n", __FUNCTION__);
+
+    if ((sensorType < 0) || (sensorType >= SENSOR_ENUM_COUNT)) {
+        return OSP_STATUS_UNKNOWN_INPUT;
+    }
+    _subscriptions.requestFlush(sensorType);
+    if (write(_publisherEventFd, &one, sizeof(one)) < 0) {
+        LOG_Err("Unable to signal publisher: %s", strerror(errno));
+        return OSP_STATUS_ERROR;
+    }
+
+    return OSP_STATUS_OK;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_SetBatchCompleteCallback
+ *          Registers the callback invoked after all results from one relay drain are delivered
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_SetBatchCompleteCallback(OSPD_BatchCompleteCallback_t batchCompleteCallback) {
     osp_status_t result = OSP_STATUS_OK;
 
     LOGT("%s\r\n", __FUNCTION__);
 
-    _resultReadyCallbacks[sensorType] = NULL;
+    _batchCompleteCallback = batchCompleteCallback;
 
     return result;
 }
 
 
+/****************************************************************************************************
+ * @fn      OSPD_GetRelayStats
+ *          Snapshot of the drain -> publisher hand-off counters
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_GetRelayStats(OSPD_RelayStats_t* pStats) {
+    if (pStats == NULL) {
+        return OSP_STATUS_NULL_POINTER;
+    }
+
+    memset(pStats, 0, sizeof(*pStats));
+    for (size_t i = 0; i < _sampleRings.size(); i++) {
+        pStats->ringCapacity  += _sampleRings[i]->capacity();
+        pStats->ringOccupancy += _sampleRings[i]->occupancy();
+        pStats->ringOverruns  += _sampleRings[i]->overruns();
+        if (_sampleRings[i]->highWater() > pStats->ringHighWater) {
+            pStats->ringHighWater = _sampleRings[i]->highWater();
+        }
+    }
+    pStats->samplesPublished = _samplesPublished.load(std::memory_order_relaxed);
+    pStats->nodesDecoded     = _nodesDecoded.load(std::memory_order_relaxed);
+    pStats->decodeNs         = _decodeNs.load(std::memory_order_relaxed);
+
+    pStats->numHubs = _hubs.size();
+    for (size_t i = 0; i < _hubs.size(); i++) {
+        const HubClockMap_t clock = _hubs[i]->clock.mapping();
+
+        pStats->hubSamplesDrained[i] = _hubs[i]->samplesDrained.load(std::memory_order_relaxed);
+        pStats->samplesDrained += pStats->hubSamplesDrained[i];
+        if (clock.valid && (fabs((clock.rate - 1.0) * 1e6) > fabs(pStats->hubClockSkewPpm))) {
+            pStats->hubClockSkewPpm = (clock.rate - 1.0) * 1e6;
+        }
+        pStats->hubClockOutliers += _hubs[i]->clock.outliers();
+    }
+
+    return OSP_STATUS_OK;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_DumpLatency
+ *          Logs the per stage latency percentiles of each sensor that delivered samples
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_DumpLatency(bool reset) {
+    LatencySummary_t summary;
+
+    for (int sensor = 0; sensor < MAX_NUM_SENSORS_TO_HANDLE; sensor++) {
+        for (int stage = 0; stage < RELAY_LATENCY_STAGE_COUNT; stage++) {
+            _stageLatency[sensor][stage].summarize(&summary);
+            if (reset) {
+                _stageLatency[sensor][stage].reset();
+            }
+            if (summary.count == 0) {
+                continue;
+            }
+            LOG_Info("latency %s %-7s n=%llu p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+                     RelayDecoder_SensorName(sensor), _stageNames[stage],
+                     (unsigned long long)summary.count,
+                     summary.p50 / 1000.0, summary.p99 / 1000.0,
+                     summary.p999 / 1000.0, summary.max / 1000.0);
+        }
+    }
+
+    return OSP_STATUS_OK;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_ReloadConfiguration
+ *          Recompiles the decode transforms from the current configuration snapshot; drains pick
+ *          up the new table on their next pass. A changed default rate is applied to the sensors
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_ReloadConfiguration(void) {
+    DeviceConfig_t reloaded[MAX_NUM_SENSORS_TO_HANDLE];
+
+    //Device names and sysfs paths stay as initialized; only the decode transforms change
+    RelayDecoder_LoadDeviceConfig(reloaded);
+    for (int i = 0; i < MAX_NUM_SENSORS_TO_HANDLE; i++) {
+        for (unsigned int j = 0; j < 3; j++) {
+            _deviceConfig[i].swap[j] = reloaded[i].swap[j];
+            _deviceConfig[i].conversion[j] = reloaded[i].conversion[j];
+        }
+    }
+    RelayDecoder_Compile(_deviceConfig, _relayTickUsec);
+    LOG_Info("Relay decode transforms reloaded\n");
+
+    const OSPConfig::Snapshot_t* pConfig = OSPConfig::snapshot();
+    for (int i = 0; i < MAX_NUM_SENSORS_TO_HANDLE; i++) {
+        const int record = OSPConfig::findSensor(pConfig, RelayDecoder_SensorName(i));
+
+        _sensorControl[i].defaultPeriodNs =
+            (record >= 0) ? (int64_t)(pConfig->sensors[record].period * NSEC_PER_SEC) : 0;
+        _arbitrateSensor(i);
+    }
+
+    return OSP_STATUS_OK;
+}
+
+
 /****************************************************************************************************
  * @fn      OSPD_Deinitialize
  *          Tear down RPC interface function
  *
  ***************************************************************************************************/
 osp_status_t OSPD_Deinitialize(void) {
-    int threadStatus;
     osp_status_t result = OSP_STATUS_OK;
     LOGT("%s\r\n", __FUNCTION__);
 
-    _relayThreadActive = false;
-    pthread_join(_relayThread, (void**) &threadStatus);
+    const uint64_t one = 1;
+
+    _drainThreadsActive = false;
+    for (size_t i = 0; i < _hubs.size(); i++) {
+        std::vector<RelayDrainThread_t>& drainThreads = _hubs[i]->drainThreads;
+
+        for (size_t j = 0; j < drainThreads.size(); j++) {
+            if (write(drainThreads[j].eventFd, &one, sizeof(one)) == sizeof(one)) {
+                pthread_join(drainThreads[j].thread, NULL);
+                RelayDecoder_RemoveReader(drainThreads[j].decoderReader);
+            }
+            close(drainThreads[j].eventFd);
+        }
+        drainThreads.clear();
+    }
+    RelayDecoder_Reclaim();
+
+    if (_publisherThreadActive) {
+        _publisherThreadActive = false;
+        if (write(_publisherEventFd, &one, sizeof(one)) == sizeof(one)) {
+            pthread_join(_publisherThread, NULL);
+        }
+    }
+    _subscriptions.quiescent();
+    _subscriptions.reclaim();
+
+    //nobody is left to read the hub
+    for (int i = 0; i < MAX_NUM_SENSORS_TO_HANDLE; i++) {
+        _applySensorControl(i, -1);
+    }
+
+    if (_publisherEventFd >= 0) {
+        close(_publisherEventFd);
+        _publisherEventFd = -1;
+    }
+    if (_batchTimerFd >= 0) {
+        close(_batchTimerFd);
+        _batchTimerFd = -1;
+    }
+    for (size_t i = 0; i < _sampleRings.size(); i++) {
+        delete _sampleRings[i];
+    }
+    _sampleRings.clear();
+
+    if (_wakeupEpollFd >= 0) {
+        close(_wakeupEpollFd);
+        _wakeupEpollFd = -1;
+    }
+    for (size_t i = 0; i < _hubs.size(); i++) {
+        _closeRelayHub(_hubs[i]);
+    }
+    _hubs.clear();
+
+    _captureTrace.close();
+
     return result;
 }
 
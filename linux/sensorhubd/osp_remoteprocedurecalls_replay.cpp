@@ -0,0 +1,473 @@
+/* Open Sensor Platform Project
+ * https://github.com/sensorplatforms/open-sensor-platform
+ *
+ * Copyright (C) 2013 Sensor Platforms Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*-------------------------------------------------------------------------------------------------*\
+ |    I N C L U D E   F I L E S
+\*-------------------------------------------------------------------------------------------------*/
+#include "osp_remoteprocedurecalls.h"
+#include <errno.h>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <time.h>
+#include <sys/timerfd.h>
+#include "osp_relayinterface.h"
+#include "osp_debuglogging.h"
+#include "osp_configuration.h"
+#include "osp_relayconvert.h"
+#include "osp_relaydecoder.h"
+#include "osp_relaytrace.h"
+#include "osp_subscriptions.h"
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E X T E R N A L   V A R I A B L E S   &   F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   C O N S T A N T S   &   M A C R O S
+\*-------------------------------------------------------------------------------------------------*/
+#define REPLAY_MAX_BATCH                256 /* records published per wakeup at maximum speed */
+#define NSEC_PER_SEC                    1000000000LL
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   T Y P E   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    S T A T I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+static DeviceConfig_t _deviceConfig[MAX_NUM_SENSORS_TO_HANDLE];
+static RelayTraceReader _replayTrace;
+static int _timerFd = -1;
+static float _replaySpeed = 1.0f;       /* 0 replays as fast as the daemon can publish */
+static int64_t _firstRecordNs;          /* host receive time of the first record */
+static int64_t _replayStartNs;          /* CLOCK_MONOTONIC time the replay started */
+static bool _replayDone = false;
+
+static ResultSubscriptions _subscriptions;
+static OSPD_BatchCompleteCallback_t _batchCompleteCallback = NULL;
+static uint64_t _nodesDecoded = 0;
+static uint64_t _decodeNs = 0;
+static uint64_t _samplesPublished = 0;
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    F O R W A R D   F U N C T I O N   D E C L A R A T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      _monotonicNs
+ *          Current CLOCK_MONOTONIC time in nanoseconds
+ *
+ ***************************************************************************************************/
+static int64_t _monotonicNs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+}
+
+
+/****************************************************************************************************
+ * @fn      _dueNs
+ *          Time a record is to be replayed, scaled by the replay speed
+ *
+ ***************************************************************************************************/
+static int64_t _dueNs(const RelayTraceRecord_t* pRecord)
+{
+    if (_replaySpeed <= 0.0f) {
+        return _replayStartNs;
+    }
+    return _replayStartNs + (int64_t)((pRecord->hostNs - _firstRecordNs) / _replaySpeed);
+}
+
+
+/****************************************************************************************************
+ * @fn      _armTimer
+ *          Arms the one-shot replay timer for an absolute CLOCK_MONOTONIC time
+ *
+ ***************************************************************************************************/
+static void _armTimer(int64_t dueNs)
+{
+    struct itimerspec spec;
+
+    memset(&spec, 0, sizeof(spec));
+    //an all-zero it_value would disarm the timer, so expire at least 1ns into the epoch
+    if (dueNs <= 0) {
+        dueNs = 1;
+    }
+    spec.it_value.tv_sec = dueNs / NSEC_PER_SEC;
+    spec.it_value.tv_nsec = dueNs % NSEC_PER_SEC;
+    if (timerfd_settime(_timerFd, TFD_TIMER_ABSTIME, &spec, NULL) < 0) {
+        LOG_Err("%s: timerfd_settime failed: %s\n", __FUNCTION__, strerror(errno));
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      _publishSample
+ *          Invoke the result callback of a replayed sample
+ *
+ ***************************************************************************************************/
+static void _publishSample(RelaySample_t* pSample, int64_t nowNs)
+{
+    const SensorType_t sensorType = RelayDecoder_ResultType(pSample->sensorIndex);
+
+    _subscriptions.dispatch(sensorType, &pSample->data, nowNs);
+    _samplesPublished++;
+}
+
+
+/****************************************************************************************************
+ * @fn      _replayDueRecords
+ *          Publishes every record that is due, delivers the subscriber batches that are due and
+ *          re-arms the timer for whichever comes next
+ *
+ ***************************************************************************************************/
+static void _replayDueRecords(void)
+{
+    const union sensor_relay_broadcast_node* pNode;
+    const RelayTraceRecord_t* pRecord;
+    RelaySample_t samples[RELAY_DECODE_MAX_RUN];
+    const int64_t nowNs = _monotonicNs();
+    size_t published = 0;
+
+    while ((pRecord = _replayTrace.peek(&pNode)) != NULL) {
+        size_t numSamples;
+
+        if (_dueNs(pRecord) > nowNs) {
+            break;
+        }
+        if ((_replaySpeed <= 0.0f) && (published >= REPLAY_MAX_BATCH)) {
+            break;
+        }
+
+        /* Records are not contiguous in the trace, so they are decoded one node at a time */
+        const int64_t decodeStartNs = _monotonicNs();
+        RelayDecoder_DecodeRun(RelayDecoder_Transforms(), pNode, 1, samples, &numSamples);
+        _decodeNs += _monotonicNs() - decodeStartNs;
+        _nodesDecoded++;
+
+        for (size_t i = 0; i < numSamples; i++) {
+            _publishSample(&samples[i], nowNs);
+        }
+        _replayTrace.advance();
+        published++;
+    }
+    const size_t batched = _subscriptions.deliverBatches(nowNs);
+    //subscriptions change on this same thread, so every expiry is a quiescent point
+    _subscriptions.quiescent();
+
+    if (((published > 0) || (batched > 0)) && (_batchCompleteCallback != NULL)) {
+        _batchCompleteCallback();
+    }
+
+    int64_t nextNs = 0;
+    if (pRecord != NULL) {
+        //at maximum speed the next batch is due immediately, which keeps the event loop turning
+        nextNs = (_replaySpeed <= 0.0f) ? nowNs : _dueNs(pRecord);
+    } else if (!_replayDone) {
+        LOG_Info("Replay finished, %llu nodes, %llu samples published",
+                 (unsigned long long)_nodesDecoded, (unsigned long long)_samplesPublished);
+        _replayDone = true;
+    }
+
+    const int64_t batchDueNs = _subscriptions.nextBatchDueNs();
+    if ((batchDueNs != 0) && ((nextNs == 0) || (batchDueNs < nextNs))) {
+        nextNs = batchDueNs;
+    }
+    if (nextNs != 0) {
+        _armTimer(nextNs);
+    }
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      OSPD_Initialize
+ *          Opens the trace named by protocol.replay_path and starts replaying it
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_Initialize(void) {
+    const RelayTraceRecord_t* pRecord;
+    LOGT("%s\r\n", __FUNCTION__);
+
+    /* The replayed nodes are decoded with the configuration of the relay protocol */
+    OSPConfig::establishDefaultConfig("relay");
+    const OSPConfig::Snapshot_t* pConfig = OSPConfig::snapshot();
+
+    const char* path = pConfig->replayPath.c_str();
+    if (path[0] == '\0') {
+        LOG_Err("No replay trace given (%s)", OSPConfig::PROTOCOL_REPLAY_PATH);
+        return OSP_STATUS_ERROR;
+    }
+    if (_replayTrace.open(path) < 0) {
+        return OSP_STATUS_ERROR;
+    }
+
+    _replaySpeed = pConfig->replaySpeed;
+    if (_replaySpeed < 0.0f) {
+        _replaySpeed = 0.0f;
+    }
+    LOG_Info("Replaying %s, tick %d us, speed %.2f%s", path, _replayTrace.tickUsec(),
+             _replaySpeed, (_replaySpeed <= 0.0f) ? " (maximum)" : "");
+
+    for (int i = 0; i < MAX_NUM_SENSORS_TO_HANDLE; i++) {
+        _deviceConfig[i].uinputName.assign("");
+    }
+    RelayDecoder_LoadDeviceConfig(_deviceConfig);
+    //time stamps are converted with the tick the trace was captured with
+    RelayDecoder_Compile(_deviceConfig, _replayTrace.tickUsec());
+
+    LOG_Info("Relay node conversion: %s",
+             RelayConvert_ImplName(RelayConvert_Select(RelayConvert_Best())));
+
+    _timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (_timerFd < 0) {
+        LOG_Err("Unable to create replay timer: %s", strerror(errno));
+        _replayTrace.close();
+        return OSP_STATUS_ERROR;
+    }
+
+    _replayDone = false;
+    _replayStartNs = _monotonicNs();
+    pRecord = _replayTrace.peek(NULL);
+    if (pRecord == NULL) {
+        LOG_Info("Replay trace %s holds no records", path);
+        _replayDone = true;
+        return OSP_STATUS_OK;
+    }
+    _firstRecordNs = pRecord->hostNs;
+    _armTimer(_replayStartNs);
+
+    return OSP_STATUS_OK;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_GetWakeupFd
+ *          Returns the replay timer for the caller's event loop, -1 if not open
+ *
+ ***************************************************************************************************/
+int OSPD_GetWakeupFd(void) {
+    return _timerFd;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_ProcessWakeup
+ *          Called by the event loop when the replay timer expires
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_ProcessWakeup(void) {
+    uint64_t expirations;
+
+    if (_timerFd < 0) {
+        return OSP_STATUS_UNKNOWN_INPUT;
+    }
+
+    if (read(_timerFd, &expirations, sizeof(expirations)) < 0) {
+        if (errno != EAGAIN) {
+            LOG_Err("%s: read failed: %s\n", __FUNCTION__, strerror(errno));
+        }
+        return OSP_STATUS_OK;
+    }
+
+    _replayDueRecords();
+    return OSP_STATUS_OK;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_GetVersion
+ *          Helper routine for getting daemon version information
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_GetVersion(char* versionString, int bufSize) {
+    osp_status_t result = OSP_STATUS_OK;
+
+    LOGT("%s\r\n", __FUNCTION__);
+
+    return result;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_SubscribeResult
+ *          Enables subscription for results, decimated to one sample per periodUs and batched for
+ *          up to maxReportLatencyUs if non-zero
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_SubscribeResult(SensorType_t sensorType, OSPD_ResultDataCallback_t dataReadyCallback,
+                                  uint32_t periodUs, uint32_t maxReportLatencyUs) {
+    LOGT("%s\r\n", __FUNCTION__);
+
+    if (dataReadyCallback == NULL) {
+        return OSP_STATUS_NULL_POINTER;
+    }
+    if (_subscriptions.add(sensorType, dataReadyCallback, periodUs, maxReportLatencyUs) < 0) {
+        return OSP_STATUS_UNKNOWN_INPUT;
+    }
+
+    return OSP_STATUS_OK;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_UnsubscribeResult
+ *          Unsubscribe from sensor results; all subscribers of the sensor if dataReadyCallback is
+ *          NULL
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_UnsubscribeResult(SensorType_t sensorType, OSPD_ResultDataCallback_t dataReadyCallback) {
+    LOGT("%s\r\n", __FUNCTION__);
+
+    if ((sensorType < 0) || (sensorType >= SENSOR_ENUM_COUNT)) {
+        return OSP_STATUS_UNKNOWN_INPUT;
+    }
+    _subscriptions.remove(sensorType, dataReadyCallback);
+
+    return OSP_STATUS_OK;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_FlushResult
+ *          Delivers the samples batched for a sensor. Flushes come in on the event loop thread,
+ *          which is the one replaying, so they are served right away
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_FlushResult(SensorType_t sensorType) {
+    LOGT("%s\r\n", __FUNCTION__);
+
+    if ((sensorType < 0) || (sensorType >= SENSOR_ENUM_COUNT)) {
+        return OSP_STATUS_UNKNOWN_INPUT;
+    }
+    _subscriptions.requestFlush(sensorType);
+    if ((_subscriptions.deliverBatches(_monotonicNs()) > 0) && (_batchCompleteCallback != NULL)) {
+        _batchCompleteCallback();
+    }
+
+    return OSP_STATUS_OK;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_SetBatchCompleteCallback
+ *          Registers the callback invoked after the records due at one timer expiry are delivered
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_SetBatchCompleteCallback(OSPD_BatchCompleteCallback_t batchCompleteCallback) {
+    osp_status_t result = OSP_STATUS_OK;
+
+    LOGT("%s\r\n", __FUNCTION__);
+
+    _batchCompleteCallback = batchCompleteCallback;
+
+    return result;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_GetRelayStats
+ *          Replayed samples are published directly; there is no hand-off ring
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_GetRelayStats(OSPD_RelayStats_t* pStats) {
+    if (pStats == NULL) {
+        return OSP_STATUS_NULL_POINTER;
+    }
+
+    memset(pStats, 0, sizeof(*pStats));
+    pStats->samplesDrained   = _samplesPublished;
+    pStats->samplesPublished = _samplesPublished;
+    pStats->nodesDecoded     = _nodesDecoded;
+    pStats->decodeNs         = _decodeNs;
+
+    return OSP_STATUS_OK;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_DumpLatency
+ *          Replayed samples are published from the event loop; no stage times are kept
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_DumpLatency(bool reset) {
+    LOG_Info("No pipeline latency histograms in this backend\n");
+
+    return OSP_STATUS_OK;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_ReloadConfiguration
+ *          Recompiles the decode transforms from the current configuration snapshot; records
+ *          replayed from now on use them
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_ReloadConfiguration(void) {
+    DeviceConfig_t reloaded[MAX_NUM_SENSORS_TO_HANDLE];
+
+    //Device names and sysfs paths stay as initialized; only the decode transforms change
+    RelayDecoder_LoadDeviceConfig(reloaded);
+    for (int i = 0; i < MAX_NUM_SENSORS_TO_HANDLE; i++) {
+        for (unsigned int j = 0; j < 3; j++) {
+            _deviceConfig[i].swap[j] = reloaded[i].swap[j];
+            _deviceConfig[i].conversion[j] = reloaded[i].conversion[j];
+        }
+    }
+    RelayDecoder_Compile(_deviceConfig, _replayTrace.tickUsec());
+    LOG_Info("Relay decode transforms reloaded\n");
+
+    return OSP_STATUS_OK;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_Deinitialize
+ *          Tear down RPC interface function
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_Deinitialize(void) {
+    osp_status_t result = OSP_STATUS_OK;
+    LOGT("%s\r\n", __FUNCTION__);
+
+    if (_timerFd >= 0) {
+        close(_timerFd);
+        _timerFd = -1;
+    }
+    _replayTrace.close();
+
+    return result;
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E N D   O F   F I L E
+\*-------------------------------------------------------------------------------------------------*/
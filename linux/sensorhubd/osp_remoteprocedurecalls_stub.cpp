@@ -88,7 +88,8 @@ osp_status_t OSPD_GetVersion(char* versionString, int bufSize) {
  *          Enables subscription for results
  *
  ***************************************************************************************************/
-osp_status_t OSPD_SubscribeResult(uint32_t sensorType, OSPD_ResultDataCallback_t dataReadyCallback ) {
+osp_status_t OSPD_SubscribeResult(SensorType_t sensorType, OSPD_ResultDataCallback_t dataReadyCallback,
+                                  uint32_t periodUs, uint32_t maxReportLatencyUs) {
     osp_status_t result = OSP_STATUS_OK;
 
     LOGT("%s\r\n", __FUNCTION__);
@@ -101,7 +102,7 @@ osp_status_t OSPD_SubscribeResult(uint32_t sensorType, OSPD_ResultDataCallback_t
  *          Unsubscribe from sensor results
  *
  ***************************************************************************************************/
-osp_status_t OSPD_UnsubscribeResult(uint32_t sensorType) {
+osp_status_t OSPD_UnsubscribeResult(SensorType_t sensorType, OSPD_ResultDataCallback_t dataReadyCallback) {
     osp_status_t result = OSP_STATUS_OK;
 
     LOGT("%s\r\n", __FUNCTION__);
@@ -110,6 +111,95 @@ osp_status_t OSPD_UnsubscribeResult(uint32_t sensorType) {
 }
 
 
+/****************************************************************************************************
+ * @fn      OSPD_FlushResult
+ *          Flush sensor results
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_FlushResult(SensorType_t sensorType) {
+    osp_status_t result = OSP_STATUS_OK;
+
+    LOGT("%s\r\n", __FUNCTION__);
+
+    return result;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_SetBatchCompleteCallback
+ *          Registers the callback invoked after each batch of results
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_SetBatchCompleteCallback(OSPD_BatchCompleteCallback_t batchCompleteCallback) {
+    osp_status_t result = OSP_STATUS_OK;
+
+    LOGT("%s\r\n", __FUNCTION__);
+
+    return result;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_GetWakeupFd
+ *          No wakeup source in the stub
+ *
+ ***************************************************************************************************/
+int OSPD_GetWakeupFd(void) {
+    return -1;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_ProcessWakeup
+ *          Nothing to process in the stub
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_ProcessWakeup(void) {
+    osp_status_t result = OSP_STATUS_OK;
+
+    LOGT("%s\r\n", __FUNCTION__);
+
+    return result;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_GetRelayStats
+ *          The stub moves no data; all counters are zero
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_GetRelayStats(OSPD_RelayStats_t* pStats) {
+    if (pStats == NULL) {
+        return OSP_STATUS_NULL_POINTER;
+    }
+    memset(pStats, 0, sizeof(*pStats));
+
+    return OSP_STATUS_OK;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_DumpLatency
+ *          The stub times nothing
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_DumpLatency(bool reset) {
+    LOG_Info("No pipeline latency histograms in this backend\n");
+
+    return OSP_STATUS_OK;
+}
+
+
+/****************************************************************************************************
+ * @fn      OSPD_ReloadConfiguration
+ *          The stub has no configuration to apply
+ *
+ ***************************************************************************************************/
+osp_status_t OSPD_ReloadConfiguration(void) {
+    return OSP_STATUS_OK;
+}
+
+
 /****************************************************************************************************
  * @fn      OSPD_Deinitialize
  *          Tear down RPC interface function
@@ -0,0 +1,399 @@
+/* Open Sensor Platform Project
+ * https://github.com/sensorplatforms/open-sensor-platform
+ *
+ * Copyright (C) 2013 Sensor Platforms Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*-------------------------------------------------------------------------------------------------*\
+ |    I N C L U D E   F I L E S
+\*-------------------------------------------------------------------------------------------------*/
+#include <cstring>
+#include <algorithm>
+
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+
+#include "osp_debuglogging.h"
+#include "osp_shmpublisher.h"
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E X T E R N A L   V A R I A B L E S   &   F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   C O N S T A N T S   &   M A C R O S
+\*-------------------------------------------------------------------------------------------------*/
+#define SHM_LISTEN_BACKLOG              8
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   T Y P E   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    S T A T I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    F O R W A R D   F U N C T I O N   D E C L A R A T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      onListenReadable
+ *          Event loop handler; accepts a client connection
+ *
+ ***************************************************************************************************/
+void ShmSamplePublisher::onListenReadable(int fd, uint32_t events, void* pContext)
+{
+    ShmSamplePublisher* pThis = (ShmSamplePublisher*)pContext;
+    Client_t client;
+
+    const int clientFd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (clientFd < 0) {
+        if (errno != EAGAIN) {
+            LOG_Err("%s: accept failed: %s\n", __FUNCTION__, strerror(errno));
+        }
+        return;
+    }
+
+    if (pThis->_pEventLoop->addFd(clientFd, EPOLLIN, onClientReadable, pThis) < 0) {
+        ::close(clientFd);
+        return;
+    }
+
+    client.ringIndex = -1;
+    client.doorbellFd = -1;
+    pThis->_clients[clientFd] = client;
+}
+
+
+/****************************************************************************************************
+ * @fn      onClientReadable
+ *          Event loop handler; a ring request, or the client going away
+ *
+ ***************************************************************************************************/
+void ShmSamplePublisher::onClientReadable(int fd, uint32_t events, void* pContext)
+{
+    ShmSamplePublisher* pThis = (ShmSamplePublisher*)pContext;
+    std::map<int, Client_t>::iterator it = pThis->_clients.find(fd);
+
+    if ((it == pThis->_clients.end()) || (it->second.ringIndex >= 0) ||
+        (events & (EPOLLHUP | EPOLLERR))) {
+        //a served client has nothing more to say; readable means it hung up
+        pThis->dropClient(fd);
+        return;
+    }
+
+    pThis->serveRequest(fd);
+}
+
+
+/****************************************************************************************************
+ * @fn      serveRequest
+ *          Replies to a ring request with the ring memfd and a new doorbell for the client
+ *
+ ***************************************************************************************************/
+void ShmSamplePublisher::serveRequest(int fd)
+{
+    ShmRingRequest_t request;
+    ShmRingResponse_t response;
+    char control[CMSG_SPACE(2 * sizeof(int))];
+    struct iovec iov;
+    struct msghdr message;
+    int ringIndex = -1;
+    int doorbellFd = -1;
+
+    if (recv(fd, &request, sizeof(request), 0) != sizeof(request)) {
+        dropClient(fd);
+        return;
+    }
+    request.name[sizeof(request.name) - 1] = '\0';
+
+    memset(&response, 0, sizeof(response));
+    if (request.version != SHM_RING_VERSION) {
+        response.status = -EPROTO;
+    } else {
+        for (size_t i = 0; i < _rings.size(); i++) {
+            if (_rings[i]->name == request.name) {
+                ringIndex = i;
+            }
+        }
+        if (ringIndex < 0) {
+            response.status = -ENOENT;
+        }
+    }
+    //latest-only clients poll the seqlocked slot and are never rung
+    if ((ringIndex >= 0) && !(request.flags & SHM_RING_REQUEST_LATEST_ONLY)) {
+        doorbellFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (doorbellFd < 0) {
+            response.status = -errno;
+            ringIndex = -1;
+        }
+    }
+
+    iov.iov_base = &response;
+    iov.iov_len = sizeof(response);
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    if (ringIndex >= 0) {
+        const int fds[2] = { _rings[ringIndex]->writer.fd(), doorbellFd };
+        const size_t numFds = (doorbellFd >= 0) ? 2 : 1;
+
+        response.mapSize = _rings[ringIndex]->writer.mapSize();
+        memset(control, 0, sizeof(control));
+        message.msg_control = control;
+        message.msg_controllen = CMSG_SPACE(numFds * sizeof(int));
+        struct cmsghdr* pCmsg = CMSG_FIRSTHDR(&message);
+        pCmsg->cmsg_level = SOL_SOCKET;
+        pCmsg->cmsg_type = SCM_RIGHTS;
+        pCmsg->cmsg_len = CMSG_LEN(numFds * sizeof(int));
+        memcpy(CMSG_DATA(pCmsg), fds, numFds * sizeof(int));
+    }
+
+    if (sendmsg(fd, &message, MSG_NOSIGNAL) != sizeof(response)) {
+        LOG_Err("%s: reply to shm client failed: %s\n", __FUNCTION__, strerror(errno));
+        if (doorbellFd >= 0) {
+            ::close(doorbellFd);
+        }
+        dropClient(fd);
+        return;
+    }
+    if (ringIndex < 0) {
+        dropClient(fd);
+        return;
+    }
+
+    LOG_Info("shm reader attached to %s%s\n", _rings[ringIndex]->name.c_str(),
+             (doorbellFd < 0) ? " (latest only)" : "");
+    _clients[fd].ringIndex = ringIndex;
+    _clients[fd].doorbellFd = doorbellFd;
+
+    if (doorbellFd >= 0) {
+        pthread_mutex_lock(&_lock);
+        _rings[ringIndex]->doorbells.push_back(doorbellFd);
+        pthread_mutex_unlock(&_lock);
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      dropClient
+ *          Forgets a client and closes its connection and doorbell
+ *
+ ***************************************************************************************************/
+void ShmSamplePublisher::dropClient(int fd)
+{
+    std::map<int, Client_t>::iterator it = _clients.find(fd);
+
+    _pEventLoop->removeFd(fd);
+    ::close(fd);
+    if (it == _clients.end()) {
+        return;
+    }
+
+    if (it->second.doorbellFd >= 0) {
+        std::vector<int>& doorbells = _rings[it->second.ringIndex]->doorbells;
+
+        //closed under the lock so the publishing thread never rings a recycled fd
+        pthread_mutex_lock(&_lock);
+        doorbells.erase(std::remove(doorbells.begin(), doorbells.end(), it->second.doorbellFd),
+                        doorbells.end());
+        ::close(it->second.doorbellFd);
+        pthread_mutex_unlock(&_lock);
+
+        LOG_Info("shm reader detached from %s\n", _rings[it->second.ringIndex]->name.c_str());
+    }
+    _clients.erase(it);
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      ShmSamplePublisher
+ *          Class Constructor
+ *
+ ***************************************************************************************************/
+ShmSamplePublisher::ShmSamplePublisher():
+    _pEventLoop(NULL), _listenFd(-1)
+{
+    pthread_mutex_init(&_lock, NULL);
+}
+
+
+/****************************************************************************************************
+ * @fn      ~ShmSamplePublisher
+ *          Class Destructor
+ *
+ ***************************************************************************************************/
+ShmSamplePublisher::~ShmSamplePublisher()
+{
+    close();
+    pthread_mutex_destroy(&_lock);
+}
+
+
+/****************************************************************************************************
+ * @fn      open
+ *          Creates a ring per sensor name and starts listening for clients on socketPath
+ *
+ ***************************************************************************************************/
+int ShmSamplePublisher::open(EventLoop* pEventLoop, const char* socketPath,
+                             const char* const names[], int numRings)
+{
+    struct sockaddr_un address;
+
+    close();
+    _pEventLoop = pEventLoop;
+
+    for (int i = 0; i < numRings; i++) {
+        Ring_t* pRing = new Ring_t;
+        const int status = pRing->writer.create(names[i]);
+
+        if (status < 0) {
+            LOG_Err("Unable to create shm ring for %s: %s\n", names[i], strerror(-status));
+            delete pRing;
+            close();
+            return -1;
+        }
+        pRing->name = names[i];
+        pRing->rungHead = 0;
+        _rings.push_back(pRing);
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        LOG_Err("shm socket path too long: %s\n", socketPath);
+        close();
+        return -1;
+    }
+    strcpy(address.sun_path, socketPath);
+
+    _listenFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (_listenFd < 0) {
+        LOG_Err("Unable to create shm socket: %s\n", strerror(errno));
+        close();
+        return -1;
+    }
+
+    //a socket left behind by an earlier run would make bind() fail
+    unlink(socketPath);
+    if ((bind(_listenFd, (struct sockaddr*)&address, sizeof(address)) < 0) ||
+        (listen(_listenFd, SHM_LISTEN_BACKLOG) < 0)) {
+        LOG_Err("Unable to listen on %s: %s\n", socketPath, strerror(errno));
+        close();
+        return -1;
+    }
+    _socketPath = socketPath;
+
+    if (_pEventLoop->addFd(_listenFd, EPOLLIN, onListenReadable, this) < 0) {
+        close();
+        return -1;
+    }
+
+    LOG_Info("Serving %d shm sample rings on %s\n", numRings, socketPath);
+    return 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      close
+ *          Disconnects all clients, stops listening and releases the rings
+ *
+ ***************************************************************************************************/
+void ShmSamplePublisher::close()
+{
+    while (!_clients.empty()) {
+        dropClient(_clients.begin()->first);
+    }
+
+    if (_listenFd >= 0) {
+        _pEventLoop->removeFd(_listenFd);
+        ::close(_listenFd);
+        _listenFd = -1;
+    }
+    if (!_socketPath.empty()) {
+        unlink(_socketPath.c_str());
+        _socketPath.clear();
+    }
+
+    for (size_t i = 0; i < _rings.size(); i++) {
+        delete _rings[i];
+    }
+    _rings.clear();
+}
+
+
+/****************************************************************************************************
+ * @fn      publish
+ *          Appends a sample to a sensor's ring; readers are woken by ringDoorbells()
+ *
+ ***************************************************************************************************/
+void ShmSamplePublisher::publish(int ringIndex, int32_t sensorType, const int32_t data[],
+                                 int numAxis, int64_t timestamp)
+{
+    if ((ringIndex < 0) || ((size_t)ringIndex >= _rings.size())) {
+        return;
+    }
+    _rings[ringIndex]->writer.publish(sensorType, data, numAxis, timestamp);
+}
+
+
+/****************************************************************************************************
+ * @fn      ringDoorbells
+ *          One doorbell per reader of each ring that received samples since the last call
+ *
+ ***************************************************************************************************/
+void ShmSamplePublisher::ringDoorbells()
+{
+    const uint64_t one = 1;
+
+    for (size_t i = 0; i < _rings.size(); i++) {
+        Ring_t* pRing = _rings[i];
+        const uint64_t head = pRing->writer.head();
+
+        if (head == pRing->rungHead) {
+            continue;
+        }
+        pRing->rungHead = head;
+
+        pthread_mutex_lock(&_lock);
+        for (size_t r = 0; r < pRing->doorbells.size(); r++) {
+            //EAGAIN only means the counter is saturated, the reader will wake anyway
+            if ((write(pRing->doorbells[r], &one, sizeof(one)) < 0) && (errno != EAGAIN)) {
+                LOG_Err("shm doorbell for %s failed: %s\n", pRing->name.c_str(), strerror(errno));
+            }
+        }
+        pthread_mutex_unlock(&_lock);
+    }
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E N D   O F   F I L E
+\*-------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,102 @@
+/* Open Sensor Platform Project
+ * https://github.com/sensorplatforms/open-sensor-platform
+ *
+ * Copyright (C) 2013 Sensor Platforms Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef OSP_SHMPUBLISHER_H
+#define OSP_SHMPUBLISHER_H
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    I N C L U D E   F I L E S
+\*-------------------------------------------------------------------------------------------------*/
+#include <stdint.h>
+#include <pthread.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "osp_eventloop.h"
+#include "osp_shmring.h"
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    C O N S T A N T S   &   M A C R O S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    T Y P E / C L A S S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+//! serves one shared memory sample ring per sensor to local clients. Connections are handled on
+//! the event loop thread; publish() and ringDoorbells() belong to the result publishing thread
+class ShmSamplePublisher
+{
+public:
+    ShmSamplePublisher();
+    ~ShmSamplePublisher();
+
+    int open(EventLoop* pEventLoop, const char* socketPath, const char* const names[],
+             int numRings);
+    void close();
+
+    bool isOpen() const { return _listenFd >= 0; }
+
+    void publish(int ringIndex, int32_t sensorType, const int32_t data[], int numAxis,
+                 int64_t timestamp);
+    //! wakes the readers of every ring written since the last call
+    void ringDoorbells();
+
+private:
+    ShmSamplePublisher(const ShmSamplePublisher&);
+    ShmSamplePublisher& operator=(const ShmSamplePublisher&);
+
+    typedef struct {
+        ShmRingWriter writer;
+        std::string name;
+        uint64_t rungHead;              //!< head at the last doorbell
+        std::vector<int> doorbells;     //!< one eventfd per connected reader, under _lock
+    } Ring_t;
+
+    typedef struct {
+        int ringIndex;                  //!< -1 until the client's request is served
+        int doorbellFd;
+    } Client_t;
+
+    static void onListenReadable(int fd, uint32_t events, void* pContext);
+    static void onClientReadable(int fd, uint32_t events, void* pContext);
+    void serveRequest(int fd);
+    void dropClient(int fd);
+
+    EventLoop* _pEventLoop;
+    std::string _socketPath;
+    int _listenFd;
+    std::vector<Ring_t*> _rings;
+    std::map<int, Client_t> _clients;
+    pthread_mutex_t _lock;
+};
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E X T E R N A L   V A R I A B L E S   &   F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   F U N C T I O N   D E C L A R A T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+#endif // OSP_SHMPUBLISHER_H
+/*-------------------------------------------------------------------------------------------------*\
+ |    E N D   O F   F I L E
+\*-------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,509 @@
+/* Open Sensor Platform Project
+ * https://github.com/sensorplatforms/open-sensor-platform
+ *
+ * Copyright (C) 2013 Sensor Platforms Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*-------------------------------------------------------------------------------------------------*\
+ |    I N C L U D E   F I L E S
+\*-------------------------------------------------------------------------------------------------*/
+#include <cstring>
+
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "osp_shmring.h"
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E X T E R N A L   V A R I A B L E S   &   F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   C O N S T A N T S   &   M A C R O S
+\*-------------------------------------------------------------------------------------------------*/
+#define SHM_RING_RECORDS_OFFSET         sizeof(ShmRingHeader_t)
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   T Y P E   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    S T A T I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    F O R W A R D   F U N C T I O N   D E C L A R A T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      ShmRingWriter
+ *          Class Constructor
+ *
+ ***************************************************************************************************/
+ShmRingWriter::ShmRingWriter():
+    _fd(-1), _mapSize(0), _pHeader(NULL), _pRecords(NULL), _mask(0)
+{
+}
+
+
+/****************************************************************************************************
+ * @fn      ~ShmRingWriter
+ *          Class Destructor
+ *
+ ***************************************************************************************************/
+ShmRingWriter::~ShmRingWriter()
+{
+    destroy();
+}
+
+
+/****************************************************************************************************
+ * @fn      create
+ *          Creates the ring in an anonymous memfd. Returns 0 or a negative errno
+ *
+ ***************************************************************************************************/
+int ShmRingWriter::create(const char* name, uint32_t capacity)
+{
+    uint32_t slots = 1;
+
+    destroy();
+
+    while (slots < capacity) {
+        slots <<= 1;
+    }
+
+    _fd = memfd_create(name, MFD_CLOEXEC);
+    if (_fd < 0) {
+        return -errno;
+    }
+
+    _mapSize = SHM_RING_RECORDS_OFFSET + (size_t)slots * sizeof(ShmSampleRecord_t);
+    if (ftruncate(_fd, _mapSize) < 0) {
+        const int error = errno;
+        destroy();
+        return -error;
+    }
+
+    void* pMap = mmap(NULL, _mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (pMap == MAP_FAILED) {
+        const int error = errno;
+        destroy();
+        return -error;
+    }
+
+    //the memfd starts zero filled, so head and claim are already 0
+    _pHeader = (ShmRingHeader_t*)pMap;
+    _pRecords = (ShmSampleRecord_t*)((uint8_t*)pMap + SHM_RING_RECORDS_OFFSET);
+    _mask = slots - 1;
+
+    _pHeader->magic = SHM_RING_MAGIC;
+    _pHeader->version = SHM_RING_VERSION;
+    _pHeader->recordSize = sizeof(ShmSampleRecord_t);
+    _pHeader->capacity = slots;
+    strncpy(_pHeader->name, name, sizeof(_pHeader->name) - 1);
+
+    return 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      destroy
+ *          Unmaps the ring and closes the writer's memfd. Mapped readers keep their copy alive
+ *
+ ***************************************************************************************************/
+void ShmRingWriter::destroy()
+{
+    if (_pHeader != NULL) {
+        munmap(_pHeader, _mapSize);
+        _pHeader = NULL;
+        _pRecords = NULL;
+    }
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+    _mapSize = 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      publish
+ *          Appends one record. claim is raised before the slot is touched, so a reader that
+ *          checks claim after using a record knows whether the slot was rewritten underneath it
+ *
+ ***************************************************************************************************/
+void ShmRingWriter::publish(int32_t sensorType, const int32_t data[], int numAxis,
+                            int64_t timestamp)
+{
+    if (_pHeader == NULL) {
+        return;
+    }
+
+    const uint64_t index = _pHeader->head.load(std::memory_order_relaxed);
+    ShmSampleRecord_t* pRecord = &_pRecords[index & _mask];
+
+    _pHeader->claim.store(index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    if (numAxis > SHM_RING_MAX_AXIS) {
+        numAxis = SHM_RING_MAX_AXIS;
+    }
+    pRecord->timestamp = timestamp;
+    pRecord->sensorType = sensorType;
+    pRecord->numAxis = numAxis;
+    for (int i = 0; i < numAxis; i++) {
+        pRecord->data[i] = data[i];
+    }
+
+    _pHeader->head.store(index + 1, std::memory_order_release);
+
+    //same record into the latest slot; readers that see the sequence move retry their copy
+    const uint32_t seq = _pHeader->latestSeq.load(std::memory_order_relaxed);
+    _pHeader->latestSeq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    _pHeader->latest = *pRecord;
+    _pHeader->latestSeq.store(seq + 2, std::memory_order_release);
+}
+
+
+/****************************************************************************************************
+ * @fn      ShmRingReader
+ *          Class Constructor
+ *
+ ***************************************************************************************************/
+ShmRingReader::ShmRingReader():
+    _socketFd(-1), _doorbellFd(-1), _mapSize(0), _pHeader(NULL), _pRecords(NULL), _mask(0),
+    _cursor(0), _lost(0), _latestRetries(0)
+{
+}
+
+
+/****************************************************************************************************
+ * @fn      ~ShmRingReader
+ *          Class Destructor
+ *
+ ***************************************************************************************************/
+ShmRingReader::~ShmRingReader()
+{
+    close();
+}
+
+
+/****************************************************************************************************
+ * @fn      connect
+ *          Requests a sensor's ring from the daemon and maps it. Returns 0 or a negative errno.
+ *          With SHM_RING_REQUEST_LATEST_ONLY no doorbell is set up and wait() is unavailable
+ *
+ ***************************************************************************************************/
+int ShmRingReader::connect(const char* socketPath, const char* name, uint32_t flags)
+{
+    struct sockaddr_un address;
+    ShmRingRequest_t request;
+    ShmRingResponse_t response;
+    char control[CMSG_SPACE(2 * sizeof(int))];
+    struct iovec iov;
+    struct msghdr message;
+    int fds[2] = { -1, -1 };
+
+    close();
+
+    _socketFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (_socketFd < 0) {
+        return -errno;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath, sizeof(address.sun_path) - 1);
+    if (::connect(_socketFd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        const int error = errno;
+        close();
+        return -error;
+    }
+
+    memset(&request, 0, sizeof(request));
+    request.version = SHM_RING_VERSION;
+    request.flags = flags;
+    strncpy(request.name, name, sizeof(request.name) - 1);
+    if (send(_socketFd, &request, sizeof(request), 0) != sizeof(request)) {
+        const int error = errno;
+        close();
+        return error ? -error : -EIO;
+    }
+
+    iov.iov_base = &response;
+    iov.iov_len = sizeof(response);
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    if (recvmsg(_socketFd, &message, MSG_CMSG_CLOEXEC) != sizeof(response)) {
+        close();
+        return -EPROTO;
+    }
+    if (response.status != 0) {
+        close();
+        return response.status;
+    }
+
+    const size_t numFds = (flags & SHM_RING_REQUEST_LATEST_ONLY) ? 1 : 2;
+    struct cmsghdr* pCmsg = CMSG_FIRSTHDR(&message);
+    if ((pCmsg == NULL) || (pCmsg->cmsg_type != SCM_RIGHTS) ||
+        (pCmsg->cmsg_len != CMSG_LEN(numFds * sizeof(int)))) {
+        close();
+        return -EPROTO;
+    }
+    memcpy(fds, CMSG_DATA(pCmsg), numFds * sizeof(int));
+
+    //the socket stays open; the daemon drops our doorbell when it closes
+    return attach(fds[0], response.mapSize, fds[1]);
+}
+
+
+/****************************************************************************************************
+ * @fn      attach
+ *          Maps a ring and starts reading at its current head
+ *
+ ***************************************************************************************************/
+int ShmRingReader::attach(int ringFd, size_t mapSize, int doorbellFd)
+{
+    void* pMap = mmap(NULL, mapSize, PROT_READ, MAP_SHARED, ringFd, 0);
+    ::close(ringFd);
+    _doorbellFd = doorbellFd;
+    if (pMap == MAP_FAILED) {
+        const int error = errno;
+        close();
+        return -error;
+    }
+
+    _pHeader = (const ShmRingHeader_t*)pMap;
+    _mapSize = mapSize;
+    if ((_pHeader->magic != SHM_RING_MAGIC) || (_pHeader->version != SHM_RING_VERSION) ||
+        (_pHeader->recordSize != sizeof(ShmSampleRecord_t)) ||
+        (SHM_RING_RECORDS_OFFSET + (size_t)_pHeader->capacity * sizeof(ShmSampleRecord_t) >
+         mapSize)) {
+        close();
+        return -EPROTO;
+    }
+
+    _pRecords = (const ShmSampleRecord_t*)((const uint8_t*)pMap + SHM_RING_RECORDS_OFFSET);
+    _mask = _pHeader->capacity - 1;
+    _cursor = _pHeader->head.load(std::memory_order_acquire);
+    _lost = 0;
+    _latestRetries = 0;
+
+    return 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      close
+ *          Unmaps the ring and closes the doorbell and the daemon connection
+ *
+ ***************************************************************************************************/
+void ShmRingReader::close()
+{
+    if (_pHeader != NULL) {
+        munmap((void*)_pHeader, _mapSize);
+        _pHeader = NULL;
+        _pRecords = NULL;
+    }
+    if (_doorbellFd >= 0) {
+        ::close(_doorbellFd);
+        _doorbellFd = -1;
+    }
+    if (_socketFd >= 0) {
+        ::close(_socketFd);
+        _socketFd = -1;
+    }
+    _mapSize = 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      wait
+ *          Waits for the doorbell and clears it
+ *
+ ***************************************************************************************************/
+int ShmRingReader::wait(int timeoutMs)
+{
+    struct pollfd pfd;
+    uint64_t count;
+
+    if (_doorbellFd < 0) {
+        return -EBADF;
+    }
+
+    pfd.fd = _doorbellFd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    const int ready = poll(&pfd, 1, timeoutMs);
+    if (ready <= 0) {
+        return (ready < 0) ? -errno : 0;
+    }
+
+    if ((::read(_doorbellFd, &count, sizeof(count)) < 0) && (errno != EAGAIN)) {
+        return -errno;
+    }
+    return 1;
+}
+
+
+/****************************************************************************************************
+ * @fn      acquire
+ *          Points *ppRecords at the oldest unread record and returns how many records follow it
+ *          contiguously (at most maxRecords). The span stays valid until release()
+ *
+ ***************************************************************************************************/
+size_t ShmRingReader::acquire(const ShmSampleRecord_t** ppRecords, size_t maxRecords)
+{
+    if (_pHeader == NULL) {
+        return 0;
+    }
+
+    const uint64_t head = _pHeader->head.load(std::memory_order_acquire);
+    const uint64_t capacity = _mask + 1;
+
+    //the slot of record 'head' may be in the middle of being rewritten, so a lapped reader
+    //restarts at the oldest record that is certainly intact
+    if (head - _cursor >= capacity) {
+        const uint64_t oldest = head - capacity + 1;
+        _lost += oldest - _cursor;
+        _cursor = oldest;
+    }
+
+    size_t count = head - _cursor;
+    if (count > capacity - (_cursor & _mask)) {
+        count = capacity - (_cursor & _mask);
+    }
+    if (count > maxRecords) {
+        count = maxRecords;
+    }
+
+    *ppRecords = &_pRecords[_cursor & _mask];
+    return count;
+}
+
+
+/****************************************************************************************************
+ * @fn      release
+ *          Ends the use of the first count records of the last acquire(). Records whose slot the
+ *          writer claimed in the meantime are counted lost; the return value is the number of
+ *          records at the end of the span that were intact throughout
+ *
+ ***************************************************************************************************/
+size_t ShmRingReader::release(size_t count)
+{
+    if (_pHeader == NULL) {
+        return 0;
+    }
+
+    //orders the reads of the records before the claim check
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t claim = _pHeader->claim.load(std::memory_order_relaxed);
+    const uint64_t capacity = _mask + 1;
+    size_t torn = 0;
+
+    //record n is intact while no record n + capacity has been claimed
+    if (claim > _cursor + capacity) {
+        torn = claim - capacity - _cursor;
+        if (torn > count) {
+            torn = count;
+        }
+    }
+
+    _lost += torn;
+    _cursor += count;
+    return count - torn;
+}
+
+
+/****************************************************************************************************
+ * @fn      read
+ *          Copies up to maxRecords unread records out; returns the number copied intact
+ *
+ ***************************************************************************************************/
+size_t ShmRingReader::read(ShmSampleRecord_t* pRecords, size_t maxRecords)
+{
+    const ShmSampleRecord_t* pSpan;
+    size_t total = 0;
+
+    while (total < maxRecords) {
+        const size_t count = acquire(&pSpan, maxRecords - total);
+        if (count == 0) {
+            break;
+        }
+        memcpy(&pRecords[total], pSpan, count * sizeof(*pSpan));
+
+        //drop the copies of records that were rewritten while being copied
+        const size_t intact = release(count);
+        memmove(&pRecords[total], &pRecords[total + count - intact], intact * sizeof(*pSpan));
+        total += intact;
+    }
+
+    return total;
+}
+
+
+/****************************************************************************************************
+ * @fn      readLatest
+ *          Seqlock read of the newest record: a few loads and a copy, no system call. The copy is
+ *          repeated while the writer is inside its update or finished one during the copy
+ *
+ ***************************************************************************************************/
+int ShmRingReader::readLatest(ShmSampleRecord_t* pRecord)
+{
+    if (_pHeader == NULL) {
+        return -EBADF;
+    }
+
+    for (;;) {
+        const uint32_t seq = _pHeader->latestSeq.load(std::memory_order_acquire);
+        if (seq == 0) {
+            return 0;
+        }
+        if ((seq & 1) == 0) {
+            *pRecord = _pHeader->latest;
+
+            //orders the copy before the second look at the sequence
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (_pHeader->latestSeq.load(std::memory_order_relaxed) == seq) {
+                return 1;
+            }
+        }
+        _latestRetries++;
+    }
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E N D   O F   F I L E
+\*-------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,180 @@
+/* Open Sensor Platform Project
+ * https://github.com/sensorplatforms/open-sensor-platform
+ *
+ * Copyright (C) 2013 Sensor Platforms Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef OSP_SHMRING_H
+#define OSP_SHMRING_H
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    I N C L U D E   F I L E S
+\*-------------------------------------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    C O N S T A N T S   &   M A C R O S
+\*-------------------------------------------------------------------------------------------------*/
+#define SHM_RING_MAGIC                  0x4f535052  /* "OSPR" */
+#define SHM_RING_VERSION                2
+#define SHM_RING_DEFAULT_CAPACITY       4096        /* records per sensor ring */
+#define SHM_RING_NAME_SIZE              16
+#define SHM_RING_MAX_AXIS               4
+#define SHM_RING_CACHE_LINE_SIZE        64
+
+/* ShmRingRequest_t flags */
+#define SHM_RING_REQUEST_LATEST_ONLY    0x1         /* no doorbell, the client only reads latest */
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    T Y P E / C L A S S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+/*
+ * Per-sensor sample ring shared between sensorhubd (the only writer) and any number of readers.
+ * Layout of the mapping: ShmRingHeader_t, then 'capacity' ShmSampleRecord_t slots. The writer
+ * never waits for readers; every reader keeps its own cursor and detects being lapped from claim.
+ * The header also carries a copy of the newest record under a seqlock, for clients that poll the
+ * latest value at their own rate instead of consuming the stream.
+ */
+typedef struct {
+    int64_t timestamp;                  //!< sample time, nanoseconds
+    int32_t sensorType;                 //!< SensorType_t of the result
+    int32_t numAxis;
+    int32_t data[SHM_RING_MAX_AXIS];    //!< raw bits, float results are stored as their int32 image
+} ShmSampleRecord_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recordSize;                //!< sizeof(ShmSampleRecord_t) of the writer
+    uint32_t capacity;                  //!< slots, a power of two
+    char name[SHM_RING_NAME_SIZE];      //!< sensor name the ring was requested with
+    char pad0[SHM_RING_CACHE_LINE_SIZE - 4 * sizeof(uint32_t) - SHM_RING_NAME_SIZE];
+    std::atomic<uint64_t> head;         //!< records ever written; slot of record n is n % capacity
+    std::atomic<uint64_t> claim;        //!< head + 1 while the writer fills the slot of record head
+    char pad1[SHM_RING_CACHE_LINE_SIZE - 2 * sizeof(std::atomic<uint64_t>)];
+    std::atomic<uint32_t> latestSeq;    //!< even: latest is stable, odd: being rewritten
+    uint32_t reserved;
+    ShmSampleRecord_t latest;           //!< copy of the newest record, guarded by latestSeq
+    char pad2[SHM_RING_CACHE_LINE_SIZE - 2 * sizeof(uint32_t) - sizeof(ShmSampleRecord_t)];
+} ShmRingHeader_t;
+
+/* Client request on the daemon's SOCK_SEQPACKET socket */
+typedef struct {
+    uint32_t version;
+    uint32_t flags;                     //!< SHM_RING_REQUEST_*
+    char name[SHM_RING_NAME_SIZE];
+} ShmRingRequest_t;
+
+/* Daemon reply. On success the ring memfd and the reader's eventfd doorbell come with it as
+   SCM_RIGHTS; the doorbell stays registered for as long as the connection is open. A
+   SHM_RING_REQUEST_LATEST_ONLY request gets the ring memfd alone */
+typedef struct {
+    int32_t status;                     //!< 0 or a negative errno
+    uint32_t mapSize;
+} ShmRingResponse_t;
+
+//! writer side of a ring. Owns the memfd; publish() is for a single thread
+class ShmRingWriter
+{
+public:
+    ShmRingWriter();
+    ~ShmRingWriter();
+
+    int create(const char* name, uint32_t capacity = SHM_RING_DEFAULT_CAPACITY);
+    void destroy();
+
+    void publish(int32_t sensorType, const int32_t data[], int numAxis, int64_t timestamp);
+
+    int fd() const { return _fd; }
+    size_t mapSize() const { return _mapSize; }
+    uint64_t head() const { return _pHeader ? _pHeader->head.load(std::memory_order_relaxed) : 0; }
+
+private:
+    ShmRingWriter(const ShmRingWriter&);
+    ShmRingWriter& operator=(const ShmRingWriter&);
+
+    int _fd;
+    size_t _mapSize;
+    ShmRingHeader_t* _pHeader;
+    ShmSampleRecord_t* _pRecords;
+    uint64_t _mask;
+};
+
+//! reader side of a ring, the client library. Records are used in place; acquire() hands out a
+//! contiguous span and release() tells how much of it the writer did not overwrite meanwhile
+class ShmRingReader
+{
+public:
+    ShmRingReader();
+    ~ShmRingReader();
+
+    //! asks the daemon listening on socketPath for the ring of a sensor ("accel", ...)
+    int connect(const char* socketPath, const char* name, uint32_t flags = 0);
+    //! maps a ring fd directly, with an optional doorbell; takes ownership of both fds
+    int attach(int ringFd, size_t mapSize, int doorbellFd);
+    void close();
+
+    //! blocks until the doorbell rings or timeoutMs passes (-1 waits forever). 1 rung, 0 timeout
+    int wait(int timeoutMs);
+
+    //! span of unread records, in place. Skips records already overwritten and counts them lost
+    size_t acquire(const ShmSampleRecord_t** ppRecords, size_t maxRecords);
+    //! finishes a span of acquire(); returns how many of its records were valid while in use
+    size_t release(size_t count);
+
+    //! copying convenience on top of acquire()/release()
+    size_t read(ShmSampleRecord_t* pRecords, size_t maxRecords);
+
+    //! copies the newest record without touching the cursor. 1 copied, 0 nothing published yet
+    int readLatest(ShmSampleRecord_t* pRecord);
+
+    int doorbellFd() const { return _doorbellFd; }
+    uint64_t lost() const { return _lost; }
+    //! readLatest() attempts that raced the writer and were repeated
+    uint64_t latestRetries() const { return _latestRetries; }
+    const char* name() const { return _pHeader ? _pHeader->name : ""; }
+
+private:
+    ShmRingReader(const ShmRingReader&);
+    ShmRingReader& operator=(const ShmRingReader&);
+
+    int _socketFd;
+    int _doorbellFd;
+    size_t _mapSize;
+    const ShmRingHeader_t* _pHeader;
+    const ShmSampleRecord_t* _pRecords;
+    uint64_t _mask;
+    uint64_t _cursor;
+    uint64_t _lost;
+    uint64_t _latestRetries;
+};
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E X T E R N A L   V A R I A B L E S   &   F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   F U N C T I O N   D E C L A R A T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+#endif // OSP_SHMRING_H
+/*-------------------------------------------------------------------------------------------------*\
+ |    E N D   O F   F I L E
+\*-------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,136 @@
+/* Open Sensor Platform Project
+ * https://github.com/sensorplatforms/open-sensor-platform
+ *
+ * Copyright (C) 2013 Sensor Platforms Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef OSP_SPSCRING_H
+#define OSP_SPSCRING_H
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    I N C L U D E   F I L E S
+\*-------------------------------------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    C O N S T A N T S   &   M A C R O S
+\*-------------------------------------------------------------------------------------------------*/
+#define SPSC_CACHE_LINE_SIZE            64
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    T Y P E / C L A S S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+/* Bounded lock-free ring for exactly one producer thread and one consumer thread.
+   The capacity is rounded up to a power of two. push() never blocks; when the ring is
+   full the element is dropped and counted as an overrun. */
+template <typename T>
+class SpscRing
+{
+public:
+    explicit SpscRing(size_t capacity):
+        _head(0), _tail(0), _overruns(0), _highWater(0)
+    {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        _slots.resize(size);
+        _mask = size - 1;
+    }
+
+    /* Producer side */
+    bool push(const T& item) {
+        const size_t tail = _tail.load(std::memory_order_relaxed);
+        const size_t used = tail - _head.load(std::memory_order_acquire);
+
+        if (used > _mask) {
+            _overruns.store(_overruns.load(std::memory_order_relaxed) + 1,
+                            std::memory_order_relaxed);
+            return false;
+        }
+        _slots[tail & _mask] = item;
+        _tail.store(tail + 1, std::memory_order_release);
+
+        if (used + 1 > _highWater.load(std::memory_order_relaxed)) {
+            _highWater.store(used + 1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    /* Consumer side */
+    bool pop(T& item) {
+        const size_t head = _head.load(std::memory_order_relaxed);
+
+        if (head == _tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = _slots[head & _mask];
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    //! oldest element without removing it, NULL when empty (consumer side)
+    const T* peek() const {
+        const size_t head = _head.load(std::memory_order_relaxed);
+
+        if (head == _tail.load(std::memory_order_acquire)) {
+            return NULL;
+        }
+        return &_slots[head & _mask];
+    }
+
+    /* Statistics, safe from any thread */
+    size_t occupancy() const {
+        return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire);
+    }
+    size_t capacity() const { return _mask + 1; }
+    uint64_t overruns() const { return _overruns.load(std::memory_order_relaxed); }
+    size_t highWater() const { return _highWater.load(std::memory_order_relaxed); }
+
+private:
+    SpscRing(const SpscRing&);
+    SpscRing& operator=(const SpscRing&);
+
+    std::vector<T> _slots;
+    size_t _mask;
+
+    /* head and tail are padded apart so the two threads do not false share a cache line */
+    char _pad0[SPSC_CACHE_LINE_SIZE];
+    std::atomic<size_t> _head;
+    char _pad1[SPSC_CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> _tail;
+    char _pad2[SPSC_CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+    std::atomic<uint64_t> _overruns;
+    std::atomic<size_t> _highWater;
+};
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E X T E R N A L   V A R I A B L E S   &   F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   F U N C T I O N   D E C L A R A T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+#endif // OSP_SPSCRING_H
+/*-------------------------------------------------------------------------------------------------*\
+ |    E N D   O F   F I L E
+\*-------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,508 @@
+/* Open Sensor Platform Project
+ * https://github.com/sensorplatforms/open-sensor-platform
+ *
+ * Copyright (C) 2013 Sensor Platforms Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*-------------------------------------------------------------------------------------------------*\
+ |    I N C L U D E   F I L E S
+\*-------------------------------------------------------------------------------------------------*/
+#include "osp_debuglogging.h"
+#include "osp_subscriptions.h"
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E X T E R N A L   V A R I A B L E S   &   F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   C O N S T A N T S   &   M A C R O S
+\*-------------------------------------------------------------------------------------------------*/
+#define NSEC_PER_USEC                   1000LL
+#define SUBSCRIPTION_BATCH_MAX          4096    /* samples held per subscriber, ~10 s at 400 Hz */
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   T Y P E   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    S T A T I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    F O R W A R D   F U N C T I O N   D E C L A R A T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      publish
+ *          Makes pTable the current table and retires the one it replaces. Called with _lock held
+ *
+ ***************************************************************************************************/
+void ResultSubscriptions::publish(Table_t* pTable, const std::vector<Subscriber_t*>& removed)
+{
+    Retired_t retired;
+
+    //seq_cst on both sides: a dispatcher that still sees the old table has not yet passed the
+    //quiescent point counted after this exchange
+    pTable->sequence = ++_retiredSequence;
+    retired.pTable = _pTable.exchange(pTable, std::memory_order_seq_cst);
+    retired.removed = removed;
+    retired.quiescentCount = _quiescentCount.load(std::memory_order_seq_cst);
+    retired.sequence = pTable->sequence;
+    retired.holdsBatches = false;
+    for (size_t i = 0; i < removed.size(); i++) {
+        retired.holdsBatches = retired.holdsBatches || (removed[i]->reportLatencyNs != 0);
+    }
+    _retired.push_back(retired);
+
+    if (retired.holdsBatches) {
+        _retiredBatches.store(true, std::memory_order_seq_cst);
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      free
+ *          Deletes a retired table and the subscribers that were removed with it
+ *
+ ***************************************************************************************************/
+void ResultSubscriptions::free(const Retired_t& retired)
+{
+    for (size_t i = 0; i < retired.removed.size(); i++) {
+        const Subscriber_t* pSubscriber = retired.removed[i];
+
+        LOG_Info("subscriber %p removed: %llu delivered, %llu decimated\n",
+                 (void*)pSubscriber->callback,
+                 (unsigned long long)pSubscriber->delivered,
+                 (unsigned long long)pSubscriber->decimated);
+        delete pSubscriber;
+    }
+    delete retired.pTable;
+}
+
+
+/****************************************************************************************************
+ * @fn      deliverBatch
+ *          Hands every sample held for a subscriber to its callback, oldest first
+ *
+ ***************************************************************************************************/
+size_t ResultSubscriptions::deliverBatch(SensorType_t sensorType, Subscriber_t* pSubscriber)
+{
+    const size_t count = pSubscriber->batch.size();
+
+    for (size_t i = 0; i < count; i++) {
+        pSubscriber->callback(sensorType, &pSubscriber->batch[i]);
+    }
+    pSubscriber->batch.clear();
+    pSubscriber->delivered += count;
+
+    return count;
+}
+
+
+/****************************************************************************************************
+ * @fn      deliverRetiredBatches
+ *          Delivers what the subscribers pTable and the tables before it replaced still hold.
+ *          Dispatching thread, using pTable: it can no longer reach those subscribers. Ones removed
+ *          by later tables may still be in pTable and wait for the dispatcher to move on. The
+ *          callbacks run without _lock; reclaim() keeps the subscribers until
+ *          _batchesDeliveredThrough covers their table
+ *
+ ***************************************************************************************************/
+size_t ResultSubscriptions::deliverRetiredBatches(const Table_t* pTable)
+{
+    std::vector<Subscriber_t*> holding;
+    bool laterHoldBatches = false;
+    size_t delivered = 0;
+
+    if (!_retiredBatches.exchange(false, std::memory_order_seq_cst)) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&_lock);
+    const uint64_t deliveredThrough = _batchesDeliveredThrough.load(std::memory_order_relaxed);
+    for (size_t r = 0; r < _retired.size(); r++) {
+        if (_retired[r].sequence <= deliveredThrough) {
+            continue;
+        }
+        if (_retired[r].sequence > pTable->sequence) {
+            laterHoldBatches = laterHoldBatches || _retired[r].holdsBatches;
+            continue;
+        }
+        for (size_t i = 0; i < _retired[r].removed.size(); i++) {
+            if (!_retired[r].removed[i]->batch.empty()) {
+                holding.push_back(_retired[r].removed[i]);
+            }
+        }
+    }
+    pthread_mutex_unlock(&_lock);
+
+    for (size_t i = 0; i < holding.size(); i++) {
+        delivered += deliverBatch(holding[i]->sensorType, holding[i]);
+    }
+    if (pTable->sequence > deliveredThrough) {
+        _batchesDeliveredThrough.store(pTable->sequence, std::memory_order_seq_cst);
+    }
+    if (laterHoldBatches) {
+        _retiredBatches.store(true, std::memory_order_seq_cst);
+    }
+
+    return delivered;
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      ResultSubscriptions
+ *          Class Constructor
+ *
+ ***************************************************************************************************/
+ResultSubscriptions::ResultSubscriptions():
+    _pTable(new Table_t()), _quiescentCount(0), _retiredSequence(0), _retiredBatches(false),
+    _batchesDeliveredThrough(0), _anyFlushRequested(false), _nextBatchDueNs(0), _dispatchSequence(0)
+{
+    pthread_mutex_init(&_lock, NULL);
+    for (int type = 0; type < SENSOR_ENUM_COUNT; type++) {
+        _flushRequested[type].store(false, std::memory_order_relaxed);
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      ~ResultSubscriptions
+ *          Class Destructor. The dispatching thread must be gone
+ *
+ ***************************************************************************************************/
+ResultSubscriptions::~ResultSubscriptions()
+{
+    Table_t* pTable = _pTable.load(std::memory_order_relaxed);
+
+    for (size_t i = 0; i < _retired.size(); i++) {
+        free(_retired[i]);
+    }
+    for (int type = 0; type < SENSOR_ENUM_COUNT; type++) {
+        for (size_t i = 0; i < pTable->bySensor[type].size(); i++) {
+            delete pTable->bySensor[type][i];
+        }
+    }
+    delete pTable;
+
+    pthread_mutex_destroy(&_lock);
+}
+
+
+/****************************************************************************************************
+ * @fn      add
+ *          Subscribes a callback to a sensor type at a minimum sample period and maximum report
+ *          latency
+ *
+ ***************************************************************************************************/
+int ResultSubscriptions::add(SensorType_t sensorType, OSPD_ResultDataCallback_t callback,
+                             uint32_t periodUs, uint32_t maxReportLatencyUs)
+{
+    std::vector<Subscriber_t*> removed;
+
+    if ((sensorType < 0) || (sensorType >= SENSOR_ENUM_COUNT) || (callback == NULL)) {
+        return -1;
+    }
+
+    Subscriber_t* pSubscriber = new Subscriber_t;
+    pSubscriber->callback = callback;
+    pSubscriber->sensorType = sensorType;
+    pSubscriber->periodNs = (int64_t)periodUs * NSEC_PER_USEC;
+    pSubscriber->reportLatencyNs = (int64_t)maxReportLatencyUs * NSEC_PER_USEC;
+    pSubscriber->nextDueNs = 0;
+    pSubscriber->lastSeenNs = 0;
+    pSubscriber->batchDueNs = 0;
+    if (pSubscriber->reportLatencyNs) {
+        //allocated here so that the dispatching thread never grows it
+        pSubscriber->batch.reserve(SUBSCRIPTION_BATCH_MAX);
+    }
+    pSubscriber->delivered = 0;
+    pSubscriber->decimated = 0;
+
+    pthread_mutex_lock(&_lock);
+
+    Table_t* pTable = new Table_t(*_pTable.load(std::memory_order_relaxed));
+    std::vector<Subscriber_t*>& subscribers = pTable->bySensor[sensorType];
+
+    //a new period for an existing subscriber replaces it, the table never changes in place
+    for (size_t i = 0; i < subscribers.size(); i++) {
+        if (subscribers[i]->callback == callback) {
+            removed.push_back(subscribers[i]);
+            subscribers.erase(subscribers.begin() + i);
+            break;
+        }
+    }
+    subscribers.push_back(pSubscriber);
+    publish(pTable, removed);
+
+    pthread_mutex_unlock(&_lock);
+
+    reclaim();
+    return 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      remove
+ *          Unsubscribes one callback, or every callback of the sensor type
+ *
+ ***************************************************************************************************/
+int ResultSubscriptions::remove(SensorType_t sensorType, OSPD_ResultDataCallback_t callback)
+{
+    std::vector<Subscriber_t*> removed;
+
+    if ((sensorType < 0) || (sensorType >= SENSOR_ENUM_COUNT)) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&_lock);
+
+    const Table_t* pCurrent = _pTable.load(std::memory_order_relaxed);
+    if (!pCurrent->bySensor[sensorType].empty()) {
+        Table_t* pTable = new Table_t(*pCurrent);
+        std::vector<Subscriber_t*>& subscribers = pTable->bySensor[sensorType];
+
+        for (size_t i = 0; i < subscribers.size(); ) {
+            if ((callback == NULL) || (subscribers[i]->callback == callback)) {
+                removed.push_back(subscribers[i]);
+                subscribers.erase(subscribers.begin() + i);
+            } else {
+                i++;
+            }
+        }
+        publish(pTable, removed);
+    }
+
+    pthread_mutex_unlock(&_lock);
+
+    reclaim();
+    return removed.size();
+}
+
+
+/****************************************************************************************************
+ * @fn      reclaim
+ *          Frees the retired tables the dispatching thread has moved past, once the batches their
+ *          subscribers held are delivered
+ *
+ ***************************************************************************************************/
+void ResultSubscriptions::reclaim()
+{
+    pthread_mutex_lock(&_lock);
+
+    const uint64_t quiescentCount = _quiescentCount.load(std::memory_order_seq_cst);
+    const uint64_t deliveredThrough = _batchesDeliveredThrough.load(std::memory_order_seq_cst);
+    for (size_t i = 0; i < _retired.size(); ) {
+        if ((quiescentCount > _retired[i].quiescentCount) &&
+            (!_retired[i].holdsBatches || (_retired[i].sequence <= deliveredThrough))) {
+            free(_retired[i]);
+            _retired.erase(_retired.begin() + i);
+        } else {
+            i++;
+        }
+    }
+
+    pthread_mutex_unlock(&_lock);
+}
+
+
+/****************************************************************************************************
+ * @fn      hasSubscribers
+ *          Whether anyone is subscribed to the sensor type
+ *
+ ***************************************************************************************************/
+bool ResultSubscriptions::hasSubscribers(SensorType_t sensorType) const
+{
+    bool result;
+
+    if ((sensorType < 0) || (sensorType >= SENSOR_ENUM_COUNT)) {
+        return false;
+    }
+
+    //under the lock the current table can not be retired and freed while we look at it
+    pthread_mutex_lock(&_lock);
+    result = !_pTable.load(std::memory_order_relaxed)->bySensor[sensorType].empty();
+    pthread_mutex_unlock(&_lock);
+
+    return result;
+}
+
+
+/****************************************************************************************************
+ * @fn      fastestPeriodNs
+ *          The rate the sensor has to run at to serve all of its subscribers
+ *
+ ***************************************************************************************************/
+int64_t ResultSubscriptions::fastestPeriodNs(SensorType_t sensorType,
+                                             int64_t defaultPeriodNs) const
+{
+    int64_t result = -1;
+
+    if ((sensorType < 0) || (sensorType >= SENSOR_ENUM_COUNT)) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&_lock);
+    const std::vector<Subscriber_t*>& subscribers =
+        _pTable.load(std::memory_order_relaxed)->bySensor[sensorType];
+    for (size_t i = 0; i < subscribers.size(); i++) {
+        const int64_t periodNs = (subscribers[i]->periodNs > 0) ? subscribers[i]->periodNs :
+                                                                  defaultPeriodNs;
+        if ((result < 0) || (periodNs < result)) {
+            result = periodNs;
+        }
+    }
+    pthread_mutex_unlock(&_lock);
+
+    return result;
+}
+
+
+/****************************************************************************************************
+ * @fn      requestFlush
+ *          Marks the batches of a sensor type for delivery. The caller wakes the dispatching thread
+ *
+ ***************************************************************************************************/
+void ResultSubscriptions::requestFlush(SensorType_t sensorType)
+{
+    if ((sensorType < 0) || (sensorType >= SENSOR_ENUM_COUNT)) {
+        return;
+    }
+
+    //per type first: the dispatcher clears the summary flag before looking at the types
+    _flushRequested[sensorType].store(true, std::memory_order_seq_cst);
+    _anyFlushRequested.store(true, std::memory_order_seq_cst);
+}
+
+
+/****************************************************************************************************
+ * @fn      dispatch
+ *          Hands a sample to the subscribers of its type. A subscriber with a period gets a sample
+ *          once the period since its last one has passed, with half an input interval of slack so
+ *          that timestamp jitter does not skip a whole extra sample
+ *
+ ***************************************************************************************************/
+void ResultSubscriptions::dispatch(SensorType_t sensorType, OSPD_ThreeAxisData_t* pData,
+                                   int64_t nowNs)
+{
+    const int64_t timestampNs = pData->timestamp.ll;
+    const Table_t* pTable = _pTable.load(std::memory_order_seq_cst);
+
+    if ((sensorType < 0) || (sensorType >= SENSOR_ENUM_COUNT)) {
+        return;
+    }
+
+    //samples a replaced subscriber holds go out before its replacement gets a newer one
+    if (pTable->sequence != _dispatchSequence) {
+        _dispatchSequence = pTable->sequence;
+        _retiredBatches.store(true, std::memory_order_relaxed);
+        deliverRetiredBatches(pTable);
+    }
+
+    const std::vector<Subscriber_t*>& subscribers = pTable->bySensor[sensorType];
+    for (size_t i = 0; i < subscribers.size(); i++) {
+        Subscriber_t* pSubscriber = subscribers[i];
+
+        if (pSubscriber->periodNs) {
+            const int64_t slack = pSubscriber->lastSeenNs ?
+                        (timestampNs - pSubscriber->lastSeenNs) / 2 : 0;
+
+            pSubscriber->lastSeenNs = timestampNs;
+            if (timestampNs + slack < pSubscriber->nextDueNs) {
+                pSubscriber->decimated++;
+                continue;
+            }
+            //keep the cadence, but do not try to catch up after a gap in the stream
+            pSubscriber->nextDueNs += pSubscriber->periodNs;
+            if (pSubscriber->nextDueNs <= timestampNs) {
+                pSubscriber->nextDueNs = timestampNs + pSubscriber->periodNs;
+            }
+        }
+
+        if (pSubscriber->reportLatencyNs) {
+            if (pSubscriber->batch.empty()) {
+                pSubscriber->batchDueNs = nowNs + pSubscriber->reportLatencyNs;
+                if ((_nextBatchDueNs == 0) || (pSubscriber->batchDueNs < _nextBatchDueNs)) {
+                    _nextBatchDueNs = pSubscriber->batchDueNs;
+                }
+            }
+            pSubscriber->batch.push_back(*pData);
+            //a full buffer goes out early, like a hub FIFO reaching its watermark
+            if (pSubscriber->batch.size() >= SUBSCRIPTION_BATCH_MAX) {
+                deliverBatch(sensorType, pSubscriber);
+            }
+            continue;
+        }
+
+        pSubscriber->callback(sensorType, pData);
+        pSubscriber->delivered++;
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      deliverBatches
+ *          Delivers the batches of retired subscribers, those whose report latency has run out and
+ *          those a flush was requested for, and works out when the next one falls due
+ *
+ ***************************************************************************************************/
+size_t ResultSubscriptions::deliverBatches(int64_t nowNs)
+{
+    const Table_t* pTable = _pTable.load(std::memory_order_seq_cst);
+    const bool flushRequested = _anyFlushRequested.exchange(false, std::memory_order_seq_cst);
+    size_t delivered = deliverRetiredBatches(pTable);
+
+    if (!flushRequested && ((_nextBatchDueNs == 0) || (_nextBatchDueNs > nowNs))) {
+        return delivered;
+    }
+
+    _nextBatchDueNs = 0;
+    for (int type = 0; type < SENSOR_ENUM_COUNT; type++) {
+        const std::vector<Subscriber_t*>& subscribers = pTable->bySensor[type];
+        const bool flush = flushRequested &&
+                    _flushRequested[type].exchange(false, std::memory_order_seq_cst);
+
+        for (size_t i = 0; i < subscribers.size(); i++) {
+            Subscriber_t* pSubscriber = subscribers[i];
+
+            if (pSubscriber->batch.empty()) {
+                continue;
+            }
+            if (flush || (pSubscriber->batchDueNs <= nowNs)) {
+                delivered += deliverBatch((SensorType_t)type, pSubscriber);
+            } else if ((_nextBatchDueNs == 0) || (pSubscriber->batchDueNs < _nextBatchDueNs)) {
+                _nextBatchDueNs = pSubscriber->batchDueNs;
+            }
+        }
+    }
+
+    return delivered;
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E N D   O F   F I L E
+\*-------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,153 @@
+/* Open Sensor Platform Project
+ * https://github.com/sensorplatforms/open-sensor-platform
+ *
+ * Copyright (C) 2013 Sensor Platforms Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef OSP_SUBSCRIPTIONS_H
+#define OSP_SUBSCRIPTIONS_H
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    I N C L U D E   F I L E S
+\*-------------------------------------------------------------------------------------------------*/
+#include <stdint.h>
+#include <pthread.h>
+#include <atomic>
+#include <vector>
+#include "osp_remoteprocedurecalls.h"
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    C O N S T A N T S   &   M A C R O S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    T Y P E / C L A S S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+/*
+ * Result subscribers, any number per sensor type, each with its own minimum sample period and
+ * maximum report latency.
+ *
+ * The table is immutable once published. add()/remove() build a new table under a mutex and swap
+ * the pointer; the dispatching thread reads the current table without locks. A replaced table,
+ * and the subscribers it alone referenced, are freed once the dispatching thread has reported a
+ * quiescent point (quiescent(): it holds no table reference) after the swap.
+ *
+ * A subscriber with a report latency gets its samples in bursts: they are held in its batch
+ * buffer until the oldest has waited that long, the buffer is full or a flush is requested.
+ * Re-subscribing or unsubscribing retires the subscriber; the samples it still holds go to its
+ * callback from the dispatching thread before any sample dispatched through the table that replaced
+ * it (or at its next deliverBatches(), if that comes first), and only then is it freed. A callback
+ * that re-subscribes so sees its samples in time order.
+ */
+class ResultSubscriptions
+{
+public:
+    ResultSubscriptions();
+    ~ResultSubscriptions();
+
+    /* Control side, any thread but the dispatching one */
+    //! adds a subscriber, or changes the period and report latency of an existing one. periodUs 0
+    //! takes every sample, maxReportLatencyUs 0 delivers each one as it arrives
+    int add(SensorType_t sensorType, OSPD_ResultDataCallback_t callback, uint32_t periodUs,
+            uint32_t maxReportLatencyUs);
+    //! removes one subscriber, or all subscribers of the type if callback is NULL. Returns the
+    //! number removed
+    int remove(SensorType_t sensorType, OSPD_ResultDataCallback_t callback);
+    //! frees replaced tables the dispatching thread can no longer see
+    void reclaim();
+    bool hasSubscribers(SensorType_t sensorType) const;
+    //! shortest period any subscriber of the type asks for, counting subscribers that take every
+    //! sample as defaultPeriodNs. -1 if the type has no subscribers
+    int64_t fastestPeriodNs(SensorType_t sensorType, int64_t defaultPeriodNs) const;
+    //! asks the dispatching thread to deliver the batches held for the type at its next
+    //! deliverBatches()
+    void requestFlush(SensorType_t sensorType);
+
+    /* Dispatching thread */
+    //! delivers a sample to every subscriber of its type whose period is due, or queues it in
+    //! the subscriber's batch. nowNs is CLOCK_MONOTONIC, the batch deadlines run on it
+    void dispatch(SensorType_t sensorType, OSPD_ThreeAxisData_t* pData, int64_t nowNs);
+    //! delivers the batches that are due or flushed. Returns the number of samples delivered
+    size_t deliverBatches(int64_t nowNs);
+    //! CLOCK_MONOTONIC time the next batch falls due, 0 if no samples are held
+    int64_t nextBatchDueNs() const { return _nextBatchDueNs; }
+    void quiescent() { _quiescentCount.fetch_add(1, std::memory_order_seq_cst); }
+
+private:
+    ResultSubscriptions(const ResultSubscriptions&);
+    ResultSubscriptions& operator=(const ResultSubscriptions&);
+
+    typedef struct {
+        OSPD_ResultDataCallback_t callback;
+        SensorType_t sensorType;
+        int64_t periodNs;
+        int64_t reportLatencyNs;
+        /* decimation and batch state, only touched by the dispatching thread */
+        int64_t nextDueNs;
+        int64_t lastSeenNs;
+        int64_t batchDueNs;             //!< when the oldest held sample must go out
+        std::vector<OSPD_ThreeAxisData_t> batch;
+        uint64_t delivered;
+        uint64_t decimated;
+    } Subscriber_t;
+
+    typedef struct {
+        std::vector<Subscriber_t*> bySensor[SENSOR_ENUM_COUNT];
+        uint64_t sequence;              //!< Retired_t::sequence of the table this one replaced
+    } Table_t;
+
+    typedef struct {
+        Table_t* pTable;
+        std::vector<Subscriber_t*> removed;
+        uint64_t quiescentCount;        //!< dispatcher count at the swap
+        uint64_t sequence;              //!< order of the swap, see _batchesDeliveredThrough
+        bool holdsBatches;              //!< a removed subscriber batches; wait for its delivery
+    } Retired_t;
+
+    void publish(Table_t* pTable, const std::vector<Subscriber_t*>& removed);
+    void free(const Retired_t& retired);
+    size_t deliverBatch(SensorType_t sensorType, Subscriber_t* pSubscriber);
+    size_t deliverRetiredBatches(const Table_t* pTable);
+
+    std::atomic<Table_t*> _pTable;
+    std::atomic<uint64_t> _quiescentCount;
+    std::vector<Retired_t> _retired;
+    uint64_t _retiredSequence;          //!< last Retired_t::sequence handed out, under _lock
+    std::atomic<bool> _retiredBatches;  //!< retired subscribers may hold samples
+    //! retired tables up to this sequence had their subscribers' batches delivered
+    std::atomic<uint64_t> _batchesDeliveredThrough;
+    mutable pthread_mutex_t _lock;
+
+    std::atomic<bool> _flushRequested[SENSOR_ENUM_COUNT];
+    std::atomic<bool> _anyFlushRequested;
+    int64_t _nextBatchDueNs;            //!< dispatching thread only
+    uint64_t _dispatchSequence;         //!< sequence of the table dispatch() last used, same
+};
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E X T E R N A L   V A R I A B L E S   &   F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   F U N C T I O N   D E C L A R A T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+#endif // OSP_SUBSCRIPTIONS_H
+/*-------------------------------------------------------------------------------------------------*\
+ |    E N D   O F   F I L E
+\*-------------------------------------------------------------------------------------------------*/
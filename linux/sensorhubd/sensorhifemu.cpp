@@ -0,0 +1,503 @@
+/* Open Sensor Platform Project
+ * https://github.com/sensorplatforms/open-sensor-platform
+ *
+ * Copyright (C) 2013 Sensor Platforms Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * sensorhif-emulator: stand-in for a sensor hub streaming host interface packets over a serial
+ * line.
+ *
+ * Creates a pseudo terminal and writes HIF sensor data packets to it at the requested rates,
+ * formatted by the hub's own SensorPackets.c and queued back-to-back like the hub does. Run a
+ * sensorhubd built with OSPD_BACKEND=hif against it with
+ *
+ *      sensorhubd -i <pty printed at start>
+ *
+ * With -o the generated stream is also recorded to a file, and with -f a recorded stream is played
+ * back instead of generating one. -j puts a junk byte between packets now and then, which the
+ * daemon has to skip to find the next packet.
+ */
+/*-------------------------------------------------------------------------------------------------*\
+ |    I N C L U D E   F I L E S
+\*-------------------------------------------------------------------------------------------------*/
+#include <climits>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <csignal>
+#include <cmath>
+
+#include <unistd.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <termios.h>
+
+extern "C" {
+#include "SensorPackets.h"
+}
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   C O N S T A N T S   &   M A C R O S
+\*-------------------------------------------------------------------------------------------------*/
+#define EMU_NUM_SENSORS                 6
+#define EMU_PLAYBACK_CHUNK              256     /* bytes of a recorded stream written at a time */
+
+#define NSEC_PER_SEC                    1000000000LL
+#define NSEC_PER_USEC                   1000LL
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   T Y P E   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+typedef enum {
+    EMU_PACKET_RAW,
+    EMU_PACKET_UNCALIBRATED,
+    EMU_PACKET_CALIBRATED,
+    EMU_PACKET_QUATERNION,
+    EMU_PACKET_STEPS,
+} EmuPacketKind_t;
+
+typedef struct {
+    ASensorType_t sensorType;
+    EmuPacketKind_t kind;
+    const char* name;
+    unsigned int rateHz;
+    int64_t periodNs;
+    int64_t nextDueNs;
+    uint64_t generated;
+} EmuSensor_t;
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    S T A T I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+static EmuSensor_t _sensors[EMU_NUM_SENSORS] = {
+    { AP_PSENSOR_ACCELEROMETER_RAW,      EMU_PACKET_RAW,          "accel",   200, 0, 0, 0 },
+    { SENSOR_MAGNETIC_FIELD_UNCALIBRATED, EMU_PACKET_UNCALIBRATED, "mag",     50,  0, 0, 0 },
+    { SENSOR_GYROSCOPE_UNCALIBRATED,     EMU_PACKET_UNCALIBRATED, "gyro",    200, 0, 0, 0 },
+    { SENSOR_ROTATION_VECTOR,            EMU_PACKET_QUATERNION,   "rv",      50,  0, 0, 0 },
+    { SENSOR_STEP_DETECTOR,              EMU_PACKET_STEPS,        "steps",   2,   0, 0, 0 },
+    { SENSOR_ACCELEROMETER,              EMU_PACKET_CALIBRATED,   "accel-c", 0,   0, 0, 0 },
+};
+static unsigned int _tickUsec = 24;
+static unsigned int _junkEvery = 0;
+static int _ptyFd = -1;
+static int _recordFd = -1;
+static uint64_t _bytesWritten = 0;
+static uint64_t _junkBytes = 0;
+static volatile sig_atomic_t _running = 1;
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    F O R W A R D   F U N C T I O N   D E C L A R A T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      SendSensorEnableReq/SendSensorDisableReq
+ *          Referenced by the control packet parser of SensorPackets.c; the emulator only formats
+ *          sensor data packets
+ *
+ ***************************************************************************************************/
+extern "C" void SendSensorEnableReq(ASensorType_t sensor)
+{
+}
+
+extern "C" void SendSensorDisableReq(ASensorType_t sensor)
+{
+}
+
+
+/****************************************************************************************************
+ * @fn      _nowNs
+ *          Monotonic time in nanoseconds; the hub time stamps are derived from it
+ *
+ ***************************************************************************************************/
+static int64_t _nowNs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+}
+
+
+/****************************************************************************************************
+ * @fn      _onQuitSignal
+ *          SIGINT/SIGTERM handler
+ *
+ ***************************************************************************************************/
+static void _onQuitSignal(int signum)
+{
+    _running = 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      _createPty
+ *          Opens a pseudo terminal in raw mode and returns the name of the side the daemon opens.
+ *          The emulator keeps that side open too, so the pty does not hang up before the daemon
+ *          comes and after it goes
+ *
+ ***************************************************************************************************/
+static const char* _createPty(void)
+{
+    struct termios tty;
+    const char* name;
+    int slaveFd;
+
+    _ptyFd = posix_openpt(O_RDWR | O_NOCTTY);
+    if ((_ptyFd < 0) || (grantpt(_ptyFd) < 0) || (unlockpt(_ptyFd) < 0) ||
+        ((name = ptsname(_ptyFd)) == NULL)) {
+        fprintf(stderr, "Unable to create pty: %s\n", strerror(errno));
+        return NULL;
+    }
+
+    slaveFd = open(name, O_RDWR | O_NOCTTY);
+    if ((slaveFd < 0) || (tcgetattr(slaveFd, &tty) < 0)) {
+        fprintf(stderr, "Unable to open %s: %s\n", name, strerror(errno));
+        return NULL;
+    }
+    cfmakeraw(&tty);
+    tcsetattr(slaveFd, TCSANOW, &tty);
+
+    return name;
+}
+
+
+/****************************************************************************************************
+ * @fn      _writeStream
+ *          Writes bytes to the pty, and to the recording if there is one. Blocks while the daemon
+ *          is behind: a packet written in part would be lost to the parser
+ *
+ ***************************************************************************************************/
+static bool _writeStream(const uint8_t* pBytes, size_t length)
+{
+    if ((_recordFd >= 0) && (write(_recordFd, pBytes, length) != (ssize_t)length)) {
+        fprintf(stderr, "recording write failed: %s\n", strerror(errno));
+        close(_recordFd);
+        _recordFd = -1;
+    }
+
+    while (length > 0) {
+        const ssize_t written = write(_ptyFd, pBytes, length);
+
+        if (written < 0) {
+            if (errno == EINTR) {
+                if (!_running) {
+                    return false;
+                }
+                continue;
+            }
+            fprintf(stderr, "pty write failed: %s\n", strerror(errno));
+            return false;
+        }
+        pBytes += written;
+        length -= written;
+        _bytesWritten += written;
+    }
+    return true;
+}
+
+
+/****************************************************************************************************
+ * @fn      _formatPacket
+ *          Formats the next packet of a sensor; returns its length
+ *
+ ***************************************************************************************************/
+static int16_t _formatPacket(uint8_t* pDest, const EmuSensor_t* pSensor, int64_t hubNs)
+{
+    //fixed point time stamps are seconds in Q24
+    const uint64_t fixpointTime = ((uint64_t)hubNs << 24) / NSEC_PER_SEC;
+    const int32_t count = (int32_t)(pSensor->generated & 0x7fff);
+
+    switch (pSensor->kind) {
+    case EMU_PACKET_RAW: {
+        TriAxisRawData_t raw;
+
+        raw.TStamp.TS64 = (uint64_t)hubNs / (_tickUsec * NSEC_PER_USEC);
+        raw.Axis[0] = count;
+        raw.Axis[1] = -count;
+        raw.Axis[2] = 4096;
+        return FormatSensorDataPktRaw(pDest, &raw, META_DATA_UNUSED, pSensor->sensorType,
+                                      SENSOR_SUBTYPE_UNUSED);
+    }
+
+    case EMU_PACKET_UNCALIBRATED: {
+        UncalibratedFixP_t uncalibrated;
+
+        memset(&uncalibrated, 0, sizeof(uncalibrated));
+        uncalibrated.TimeStamp.TS64 = fixpointTime;
+        uncalibrated.Axis[0] = count << 8;
+        uncalibrated.Axis[1] = -(count << 8);
+        uncalibrated.Axis[2] = 1 << 16;
+        return FormatUncalibratedPktFixP(pDest, &uncalibrated, META_DATA_UNUSED,
+                                         pSensor->sensorType);
+    }
+
+    case EMU_PACKET_CALIBRATED: {
+        CalibratedFixP_t calibrated;
+
+        calibrated.TimeStamp.TS64 = fixpointTime;
+        calibrated.Axis[0] = count << 8;
+        calibrated.Axis[1] = 0;
+        calibrated.Axis[2] = 0;
+        return FormatCalibratedPktFixP(pDest, &calibrated, pSensor->sensorType);
+    }
+
+    case EMU_PACKET_QUATERNION: {
+        //turning about z at 1 rad/s
+        const double halfAngle = 0.5 * hubNs / NSEC_PER_SEC;
+        QuaternionFixP_t quaternion;
+
+        quaternion.TimeStamp.TS64 = fixpointTime;
+        quaternion.Quat[0] = (int32_t)(cos(halfAngle) * (1 << 24));
+        quaternion.Quat[1] = 0;
+        quaternion.Quat[2] = 0;
+        quaternion.Quat[3] = (int32_t)(sin(halfAngle) * (1 << 24));
+        return FormatQuaternionPktFixP(pDest, &quaternion, pSensor->sensorType);
+    }
+
+    case EMU_PACKET_STEPS: {
+        StepDetector_t step;
+
+        step.TimeStamp.TS64 = fixpointTime;
+        step.StepDetected = 1;
+        return FormatStepDetectorPkt(pDest, &step, pSensor->sensorType);
+    }
+    }
+
+    return -1;
+}
+
+
+/****************************************************************************************************
+ * @fn      _playback
+ *          Writes a recorded stream to the pty at the given byte rate, 0 as fast as it is read
+ *
+ ***************************************************************************************************/
+static int _playback(const char* path, unsigned int bytesPerSec)
+{
+    uint8_t chunk[EMU_PLAYBACK_CHUNK];
+    const int fd = open(path, O_RDONLY);
+    ssize_t length;
+
+    if (fd < 0) {
+        fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    const int64_t startNs = _nowNs();
+    while (_running && ((length = read(fd, chunk, sizeof(chunk))) > 0)) {
+        if (!_writeStream(chunk, length)) {
+            break;
+        }
+        if (bytesPerSec) {
+            const int64_t dueNs = startNs + (int64_t)(_bytesWritten * NSEC_PER_SEC / bytesPerSec);
+            struct timespec wake;
+
+            wake.tv_sec = dueNs / NSEC_PER_SEC;
+            wake.tv_nsec = dueNs % NSEC_PER_SEC;
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+        }
+    }
+    close(fd);
+
+    printf("played %llu bytes of %s in %.2fs\n", (unsigned long long)_bytesWritten, path,
+           (double)(_nowNs() - startNs) / NSEC_PER_SEC);
+    return 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      _usage
+ *          Prints the command line options
+ *
+ ***************************************************************************************************/
+static void _usage(const char* progName)
+{
+    fprintf(stderr,
+            "Usage: %s [-a hz] [-m hz] [-g hz] [-q hz] [-s hz] [-c hz] [-k tick_us] [-j packets]\n"
+            "          [-t seconds] [-o record_file] [-w seconds]\n"
+            "       %s -f record_file [-r bytes_per_sec] [-w seconds]\n"
+            "  -a  raw accelerometer packets per second, 0 disables (200)\n"
+            "  -m/-g  uncalibrated magnetometer/gyroscope packets per second (50/200)\n"
+            "  -q  rotation vector packets per second (50)\n"
+            "  -s  step detector packets per second (2)\n"
+            "  -c  calibrated accelerometer packets per second, not published by the daemon (0)\n"
+            "  -k  raw time stamp tick in us, must match protocol.relay_tick_usec (24)\n"
+            "  -j  write a junk byte after every this many packets, 0 never (0)\n"
+            "  -t  run time in seconds, 0 runs until interrupted (10)\n"
+            "  -o  also record the stream to this file\n"
+            "  -f  play back a recorded stream instead of generating one\n"
+            "  -r  playback rate in bytes per second, 0 as fast as the daemon reads (0)\n"
+            "  -w  wait this long for the daemon to open the pty before streaming (5)\n",
+            progName, progName);
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      main
+ *          Application entry point
+ *
+ ***************************************************************************************************/
+int main(int argc, char** argv)
+{
+    const char* recordPath = NULL;
+    const char* playbackPath = NULL;
+    unsigned int playbackRate = 0;
+    unsigned int durationSec = 10;
+    unsigned int waitSec = 5;
+    int option;
+
+    while ((option = getopt(argc, argv, "a:m:g:q:s:c:k:j:t:o:f:r:w:h")) != -1) {
+        switch (option) {
+        case 'a': _sensors[0].rateHz = strtoul(optarg, NULL, 0); break;
+        case 'm': _sensors[1].rateHz = strtoul(optarg, NULL, 0); break;
+        case 'g': _sensors[2].rateHz = strtoul(optarg, NULL, 0); break;
+        case 'q': _sensors[3].rateHz = strtoul(optarg, NULL, 0); break;
+        case 's': _sensors[4].rateHz = strtoul(optarg, NULL, 0); break;
+        case 'c': _sensors[5].rateHz = strtoul(optarg, NULL, 0); break;
+        case 'k': _tickUsec = strtoul(optarg, NULL, 0); break;
+        case 'j': _junkEvery = strtoul(optarg, NULL, 0); break;
+        case 't': durationSec = strtoul(optarg, NULL, 0); break;
+        case 'o': recordPath = optarg; break;
+        case 'f': playbackPath = optarg; break;
+        case 'r': playbackRate = strtoul(optarg, NULL, 0); break;
+        case 'w': waitSec = strtoul(optarg, NULL, 0); break;
+        default:
+            _usage(argv[0]);
+            return (option == 'h') ? 0 : -1;
+        }
+    }
+
+    if (_tickUsec == 0) {
+        _usage(argv[0]);
+        return -1;
+    }
+
+    const char* ptyName = _createPty();
+    if (ptyName == NULL) {
+        return -1;
+    }
+    if ((recordPath != NULL) &&
+        ((_recordFd = open(recordPath, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)) {
+        fprintf(stderr, "Unable to create %s: %s\n", recordPath, strerror(errno));
+        return -1;
+    }
+
+    printf("HIF emulator ready, start the daemon with:\n"
+           "  sensorhubd -i %s\n", ptyName);
+    fflush(stdout);
+
+    //no SA_RESTART, so the signal also breaks a write the daemon is not reading out of
+    struct sigaction quitAction;
+    memset(&quitAction, 0, sizeof(quitAction));
+    quitAction.sa_handler = _onQuitSignal;
+    sigaction(SIGINT, &quitAction, NULL);
+    sigaction(SIGTERM, &quitAction, NULL);
+
+    //the pty buffers a few KB only; give the daemon time to open it
+    sleep(waitSec);
+
+    if (playbackPath != NULL) {
+        return _playback(playbackPath, playbackRate);
+    }
+
+    const int64_t startNs = _nowNs();
+    const int64_t endNs = durationSec ? startNs + durationSec * NSEC_PER_SEC : LLONG_MAX;
+    uint64_t packets = 0;
+
+    for (int i = 0; i < EMU_NUM_SENSORS; i++) {
+        _sensors[i].periodNs = _sensors[i].rateHz ? NSEC_PER_SEC / _sensors[i].rateHz : 0;
+        _sensors[i].nextDueNs = startNs;
+    }
+
+    while (_running) {
+        //everything due in this pass goes out in one write, as the hub empties its queue
+        uint8_t stream[EMU_NUM_SENSORS * 64 * sizeof(HostIFPackets_t)];
+        size_t streamLength = 0;
+        int64_t nowNs = _nowNs();
+        int64_t wakeNs = endNs;
+
+        if (nowNs >= endNs) {
+            break;
+        }
+
+        for (int i = 0; i < EMU_NUM_SENSORS; i++) {
+            EmuSensor_t* pSensor = &_sensors[i];
+
+            if (pSensor->periodNs == 0) {
+                continue;
+            }
+            while ((pSensor->nextDueNs <= nowNs) &&
+                   (streamLength + 2 * sizeof(HostIFPackets_t) <= sizeof(stream))) {
+                const int16_t length = _formatPacket(&stream[streamLength], pSensor,
+                                                     pSensor->nextDueNs - startNs);
+                if (length > 0) {
+                    streamLength += length;
+                    pSensor->generated++;
+                    packets++;
+                    if (_junkEvery && ((packets % _junkEvery) == 0)) {
+                        stream[streamLength++] = 0xFF;
+                        _junkBytes++;
+                    }
+                }
+                pSensor->nextDueNs += pSensor->periodNs;
+            }
+            if (pSensor->nextDueNs < wakeNs) {
+                wakeNs = pSensor->nextDueNs;
+            }
+        }
+
+        if ((streamLength > 0) && !_writeStream(stream, streamLength)) {
+            break;
+        }
+
+        struct timespec wake;
+        wake.tv_sec = wakeNs / NSEC_PER_SEC;
+        wake.tv_nsec = wakeNs % NSEC_PER_SEC;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+    }
+
+    const double elapsedSec = (double)(_nowNs() - startNs) / NSEC_PER_SEC;
+
+    printf("ran %.2fs, %llu bytes, %llu junk\n", elapsedSec, (unsigned long long)_bytesWritten,
+           (unsigned long long)_junkBytes);
+    for (int i = 0; i < EMU_NUM_SENSORS; i++) {
+        printf("  %-8s %10llu packets  %8.1f/s\n", _sensors[i].name,
+               (unsigned long long)_sensors[i].generated, _sensors[i].generated / elapsedSec);
+    }
+    if (_recordFd >= 0) {
+        close(_recordFd);
+    }
+
+    return 0;
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E N D   O F   F I L E
+\*-------------------------------------------------------------------------------------------------*/
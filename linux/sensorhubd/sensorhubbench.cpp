@@ -0,0 +1,518 @@
+/* Open Sensor Platform Project
+ * https://github.com/sensorplatforms/open-sensor-platform
+ *
+ * Copyright (C) 2013 Sensor Platforms Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * sensorhub-bench: microbenchmarks of sensorhubd's sample path, one stage at a time and without
+ * the rest of the daemon around it.
+ *
+ * -f  uinput frame publishing: one write() per event as before frames, one write() per frame,
+ *     and queue()/flush() of a burst. Reports ns and write syscalls per sample. Frames go to
+ *     /dev/null unless -u asks for real uinput devices
+ * -d  relay node decoding (RelayDecoder_DecodeRun) of a relay buffer's worth of nodes, for runs of
+ *     one sensor of several lengths and each conversion implementation the host supports.
+ *     Reports ns per node
+ * -v  relay node conversion (RelayConvert_Motion) alone, each implementation the host supports, in
+ *     the block runs a drain converts. Whether they agree is checked by sensorhub-tests
+ * -c  per-sensor configuration lookups (swap, conversion, rate, noise, median filter flag) through
+ *     the string keyed OSPConfig getters and through the frozen snapshot
+ */
+/*-------------------------------------------------------------------------------------------------*\
+ |    I N C L U D E   F I L E S
+\*-------------------------------------------------------------------------------------------------*/
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+
+#include <unistd.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <linux/input.h>
+
+#include "virtualsensordevicemanager.h"
+#include "osp_relaydecoder.h"
+#include "osp_configuration.h"
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   C O N S T A N T S   &   M A C R O S
+\*-------------------------------------------------------------------------------------------------*/
+#define BENCH_FRAME_SAMPLES             200000
+#define BENCH_FRAME_DEVICES             3
+#define BENCH_DECODE_ITERATIONS         20000
+#define BENCH_CONVERT_ITERATIONS        20000
+#define BENCH_RELAY_TICK_USEC           24
+#define BENCH_CONFIG_LOOKUPS            1000000
+
+#define NSEC_PER_SEC                    1000000000LL
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   T Y P E   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+typedef enum {
+    BENCH_PUBLISH_PER_EVENT,    //!< one write() per event, how samples went out before frames
+    BENCH_PUBLISH_FRAME,        //!< publish(): one write() per sample
+    BENCH_PUBLISH_QUEUED,       //!< queue() a burst per device, then flush()
+} BenchPublish_t;
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    S T A T I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+static unsigned int _samples = BENCH_FRAME_SAMPLES;
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    F O R W A R D   F U N C T I O N   D E C L A R A T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      _nowNs
+ *          Monotonic time in nanoseconds
+ *
+ ***************************************************************************************************/
+static int64_t _nowNs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+}
+
+
+/****************************************************************************************************
+ * @fn      _writeSyscalls
+ *          Write syscalls this process made so far (syscw of /proc/self/io), -1 if the kernel
+ *          does not account them
+ *
+ ***************************************************************************************************/
+static long long _writeSyscalls(void)
+{
+    char line[128];
+    long long count = -1;
+    FILE* pFile = fopen("/proc/self/io", "r");
+
+    if (pFile == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), pFile) != NULL) {
+        if (sscanf(line, "syscw: %lld", &count) == 1) {
+            break;
+        }
+    }
+    fclose(pFile);
+
+    return count;
+}
+
+
+/****************************************************************************************************
+ * @fn      _publishSamples
+ *          Publishes _samples 3-axis samples round robin over the devices the given way
+ *
+ ***************************************************************************************************/
+static void _publishSamples(VirtualSensorDeviceManager* pManager, const int deviceFds[],
+                            BenchPublish_t how, unsigned int burst)
+{
+    int32_t data[3] = {100, -200, 4096};
+    input_event events[VSDM_MAX_EVENTS_PER_FRAME];
+
+    for (unsigned int n = 0; n < _samples; n++) {
+        const int deviceFd = deviceFds[n % BENCH_FRAME_DEVICES];
+        const int64_t timeNs = (int64_t)n * 5000000;
+
+        data[0] = (int32_t)n;
+        switch (how) {
+        case BENCH_PUBLISH_PER_EVENT:
+            memset(events, 0, sizeof(events));
+            for (int i = 0; i < 3; i++) {
+                events[i].type = EV_ABS;
+                events[i].code = ABS_X + i;
+                events[i].value = data[i];
+            }
+            events[3].type = EV_ABS;
+            events[3].code = ABS_MISC;
+            events[3].value = (uint32_t)(timeNs & 0xFFFFFFFF);
+            events[4].type = EV_SYN;
+            events[4].value = (uint32_t)(timeNs >> 32);
+            for (int i = 0; i < 5; i++) {
+                pManager->publish(deviceFd, events[i]);
+            }
+            break;
+
+        case BENCH_PUBLISH_FRAME:
+            pManager->publish(deviceFd, data, timeNs);
+            break;
+
+        case BENCH_PUBLISH_QUEUED:
+            pManager->queue(deviceFd, data, timeNs);
+            if ((n + 1) % burst == 0) {
+                pManager->flush();
+            }
+            break;
+        }
+    }
+    pManager->flush();
+}
+
+
+/****************************************************************************************************
+ * @fn      _benchFrames
+ *          uinput frame publishing before and after frames were written whole
+ *
+ ***************************************************************************************************/
+static int _benchFrames(bool useUinput)
+{
+    static const struct {
+        BenchPublish_t how;
+        unsigned int burst;
+        const char* name;
+    } runs[] = {
+        { BENCH_PUBLISH_PER_EVENT, 1,  "write per event" },
+        { BENCH_PUBLISH_FRAME,     1,  "write per frame" },
+        { BENCH_PUBLISH_QUEUED,    3,  "queue/flush x1" },
+        { BENCH_PUBLISH_QUEUED,    24, "queue/flush x8" },
+        { BENCH_PUBLISH_QUEUED,    96, "queue/flush x32" },
+    };
+    VirtualSensorDeviceManager manager;
+    int deviceFds[BENCH_FRAME_DEVICES];
+
+    for (int i = 0; i < BENCH_FRAME_DEVICES; i++) {
+        char name[32];
+
+        snprintf(name, sizeof(name), "osp-bench%d", i);
+        deviceFds[i] = useUinput ? manager.createSensor(name, name, -2048, 2047, 3)
+                                 : manager.attachDevice(open("/dev/null", O_WRONLY | O_NONBLOCK));
+        if (deviceFds[i] < 0) {
+            fprintf(stderr, "Unable to open %s: %s\n", useUinput ? "/dev/uinput" : "/dev/null",
+                    strerror(errno));
+            return -1;
+        }
+    }
+
+    printf("uinput frames, %u 3-axis samples over %d %s devices (queue/flush xN: N samples per "
+           "device and flush)\n", _samples, BENCH_FRAME_DEVICES, useUinput ? "uinput" : "/dev/null");
+    for (size_t r = 0; r < sizeof(runs) / sizeof(runs[0]); r++) {
+        const long long startWrites = _writeSyscalls();
+        const int64_t startNs = _nowNs();
+
+        _publishSamples(&manager, deviceFds, runs[r].how, runs[r].burst);
+
+        const double nsPerSample = (double)(_nowNs() - startNs) / _samples;
+        const long long writes = _writeSyscalls() - startWrites;
+        if (startWrites < 0) {
+            printf("  %-16s %8.1f ns/sample\n", runs[r].name, nsPerSample);
+        } else {
+            printf("  %-16s %8.1f ns/sample  %6.3f writes/sample\n", runs[r].name, nsPerSample,
+                   (double)writes / _samples);
+        }
+    }
+
+    return 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      _fillRelayNodes
+ *          A relay buffer of accelerometer, magnetometer and gyroscope nodes in runs of runLength
+ *
+ ***************************************************************************************************/
+static void _fillRelayNodes(union sensor_relay_broadcast_node* pNodes, size_t numNodes,
+                            size_t runLength)
+{
+    static const uint8_t sensorIds[] = {
+        SENSOR_ACCELEROMETER, SENSOR_MAGNETIC_FIELD, SENSOR_GYROSCOPE
+    };
+
+    srand(1);
+    memset(pNodes, 0, numNodes * sizeof(pNodes[0]));
+    for (size_t i = 0; i < numNodes; i++) {
+        pNodes[i].sensorData.sensorId = sensorIds[(i / runLength) % 3];
+        pNodes[i].sensorData.TimeStamp = i * 200;
+        for (int k = 0; k < 3; k++) {
+            pNodes[i].sensorData.Data[k] = (int16_t)rand();
+        }
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      _benchDecode
+ *          Relay node decoding on its own, the way a drain walks a relay buffer
+ *
+ ***************************************************************************************************/
+static int _benchDecode(void)
+{
+    static const size_t runLengths[] = {1, 8, RELAY_DECODE_MAX_RUN};
+    static union sensor_relay_broadcast_node nodes[SENSOR_RELAY_NUM_RELAY_BUFFERS];
+    RelaySample_t samples[RELAY_DECODE_MAX_RUN];
+    DeviceConfig_t deviceConfig[MAX_NUM_SENSORS_TO_HANDLE];
+    size_t published = 0;
+
+    for (int i = 0; i < MAX_NUM_SENSORS_TO_HANDLE; i++) {
+        deviceConfig[i].uinputName = RelayDecoder_SensorName(i);
+        deviceConfig[i].swap[0] = 1;
+        deviceConfig[i].swap[1] = 0;
+        deviceConfig[i].swap[2] = 2;
+        deviceConfig[i].conversion[0] = 0.0625f;
+        deviceConfig[i].conversion[1] = -0.0625f;
+        deviceConfig[i].conversion[2] = 9.80665f / 4096;
+    }
+    RelayDecoder_Compile(deviceConfig, BENCH_RELAY_TICK_USEC);
+    const RelayTransformTable_t* pTransforms = RelayDecoder_Transforms();
+
+    printf("relay decode, %d nodes of accel/mag/gyro per buffer, ns/node by run length\n",
+           SENSOR_RELAY_NUM_RELAY_BUFFERS);
+    printf("  %-6s", "");
+    for (size_t r = 0; r < sizeof(runLengths) / sizeof(runLengths[0]); r++) {
+        printf("  run %-3u", (unsigned int)runLengths[r]);
+    }
+    printf("\n");
+
+    for (int impl = RELAY_CONVERT_SCALAR; impl < RELAY_CONVERT_IMPL_COUNT; impl++) {
+        if (!RelayConvert_IsSupported((RelayConvertImpl_t)impl)) {
+            continue;
+        }
+        RelayConvert_Select((RelayConvertImpl_t)impl);
+        printf("  %-6s", RelayConvert_ImplName((RelayConvertImpl_t)impl));
+
+        for (size_t r = 0; r < sizeof(runLengths) / sizeof(runLengths[0]); r++) {
+            _fillRelayNodes(nodes, SENSOR_RELAY_NUM_RELAY_BUFFERS, runLengths[r]);
+
+            const int64_t startNs = _nowNs();
+            for (int n = 0; n < BENCH_DECODE_ITERATIONS; n++) {
+                size_t i = 0;
+                while (i < SENSOR_RELAY_NUM_RELAY_BUFFERS) {
+                    size_t numSamples;
+
+                    i += RelayDecoder_DecodeRun(pTransforms, &nodes[i],
+                                                SENSOR_RELAY_NUM_RELAY_BUFFERS - i, samples,
+                                                &numSamples);
+                    published += numSamples;
+                }
+                __asm__ __volatile__("" : : "r"(samples) : "memory");
+            }
+            printf("  %7.2f", (double)(_nowNs() - startNs) /
+                   ((double)BENCH_DECODE_ITERATIONS * SENSOR_RELAY_NUM_RELAY_BUFFERS));
+        }
+        printf("\n");
+    }
+    RelayConvert_Select(RelayConvert_Best());
+
+    return (published > 0) ? 0 : -1;
+}
+
+
+/****************************************************************************************************
+ * @fn      _benchConvert
+ *          Relay node conversion throughput of each implementation
+ *
+ ***************************************************************************************************/
+static int _benchConvert(void)
+{
+    static const uint8_t axisSource[3] = {1, 0, 2};
+    static const osp_float_t scale[3] = {0.0625f, -0.0625f, 9.80665f / 4096};
+    static union sensor_relay_broadcast_node nodes[SENSOR_RELAY_NUM_RELAY_BUFFERS];
+    static RelayMotionBlock_t blocks[(SENSOR_RELAY_NUM_RELAY_BUFFERS + RELAY_CONVERT_BLOCK_SIZE - 1) /
+                                     RELAY_CONVERT_BLOCK_SIZE];
+
+    _fillRelayNodes(nodes, SENSOR_RELAY_NUM_RELAY_BUFFERS, SENSOR_RELAY_NUM_RELAY_BUFFERS);
+
+    printf("relay convert, %d nodes per buffer in runs of %d\n", SENSOR_RELAY_NUM_RELAY_BUFFERS,
+           RELAY_CONVERT_BLOCK_SIZE);
+    for (int impl = RELAY_CONVERT_SCALAR; impl < RELAY_CONVERT_IMPL_COUNT; impl++) {
+        const char* name = RelayConvert_ImplName((RelayConvertImpl_t)impl);
+
+        if (!RelayConvert_IsSupported((RelayConvertImpl_t)impl)) {
+            printf("  %-6s not supported\n", name);
+            continue;
+        }
+        RelayConvert_Select((RelayConvertImpl_t)impl);
+
+        const int64_t startNs = _nowNs();
+        for (int n = 0; n < BENCH_CONVERT_ITERATIONS; n++) {
+            for (size_t first = 0; first < SENSOR_RELAY_NUM_RELAY_BUFFERS;
+                 first += RELAY_CONVERT_BLOCK_SIZE) {
+                size_t count = SENSOR_RELAY_NUM_RELAY_BUFFERS - first;
+                if (count > RELAY_CONVERT_BLOCK_SIZE) {
+                    count = RELAY_CONVERT_BLOCK_SIZE;
+                }
+                RelayConvert_Motion(&nodes[first], count, axisSource, scale,
+                                    &blocks[first / RELAY_CONVERT_BLOCK_SIZE]);
+            }
+            __asm__ __volatile__("" : : "r"(blocks) : "memory");
+        }
+        const double nsPerNode = (double)(_nowNs() - startNs) /
+                ((double)BENCH_CONVERT_ITERATIONS * SENSOR_RELAY_NUM_RELAY_BUFFERS);
+        printf("  %-6s %6.2f ns/node  %8.1f Mnodes/s\n", name, nsPerNode, 1000.0 / nsPerNode);
+    }
+    RelayConvert_Select(RelayConvert_Best());
+
+    return 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      _benchConfigLookups
+ *          Times the per-sensor lookups of swap, conversion, rate, noise and median filter flag
+ *          through the string keyed getters and through the frozen snapshot
+ *
+ ***************************************************************************************************/
+static int _benchConfigLookups(void)
+{
+    static const char* const names[] = {"acc1", "mag1", "gyr1"};
+    const int numNames = sizeof(names)/sizeof(names[0]);
+    struct timespec start, end;
+    volatile float sink = 0.0f;
+    double itemsNs, snapshotNs;
+    int records[numNames];
+
+    OSPConfig::establishDefaultConfig("relay");
+    const OSPConfig::Snapshot_t* pConfig = OSPConfig::snapshot();
+    for (int i = 0; i < numNames; i++) {
+        records[i] = OSPConfig::findSensor(pConfig, names[i]);
+        if (records[i] < 0) {
+            fprintf(stderr, "sensor %s missing from the default configuration\n", names[i]);
+            return -1;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < BENCH_CONFIG_LOOKUPS; i++) {
+        const char* const name = names[i % numNames];
+        unsigned int size;
+
+        const int* swap = OSPConfig::getNamedConfigItemInt(name, OSPConfig::SENSOR_SWAP, &size);
+        const float* conversion = OSPConfig::getNamedConfigItemFloat(name,
+                                                                    OSPConfig::SENSOR_CONVERSION,
+                                                                    &size);
+        const float* noise = OSPConfig::getNamedConfigItemFloat(name, OSPConfig::SENSOR_NOISE,
+                                                               &size);
+        sink = sink + conversion[swap[0]] + noise[0] +
+                OSPConfig::getNamedConfigItemFloatV(name, OSPConfig::SENSOR_RATE, 0.0f) +
+                OSPConfig::getNamedConfigItemIntV(name, OSPConfig::SENSOR_USE_MEDIAN_FILTER, 0);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    itemsNs = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < BENCH_CONFIG_LOOKUPS; i++) {
+        const OSPConfig::SensorRecord_t& sensor =
+                OSPConfig::snapshot()->sensors[records[i % numNames]];
+
+        sink = sink + sensor.conversion[sensor.swap[0]] + sensor.noise[0] + sensor.period +
+                sensor.useMedianFilter;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    snapshotNs = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+
+    printf("config items: %.0f lookups/s (%.1f ns each)\n",
+           BENCH_CONFIG_LOOKUPS * 1e9 / itemsNs, itemsNs / BENCH_CONFIG_LOOKUPS);
+    printf("snapshot:     %.0f lookups/s (%.1f ns each), %.0fx\n",
+           BENCH_CONFIG_LOOKUPS * 1e9 / snapshotNs, snapshotNs / BENCH_CONFIG_LOOKUPS,
+           itemsNs / snapshotNs);
+    return 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      _usage
+ *          Prints the command line options
+ *
+ ***************************************************************************************************/
+static void _usage(const char* progName)
+{
+    fprintf(stderr,
+            "Usage: %s [-f] [-u] [-n samples] [-d] [-v] [-c]\n"
+            "  -f  uinput frame publishing, per event vs per frame vs queued bursts\n"
+            "  -u  publish frames to real uinput devices rather than /dev/null\n"
+            "  -n  samples per run (%u)\n"
+            "  -d  relay node decoding per run length and conversion implementation\n"
+            "  -v  relay node conversion per implementation\n"
+            "  -c  configuration lookups, string keyed items vs. snapshot\n"
+            "Without a benchmark option all of them run.\n",
+            progName, BENCH_FRAME_SAMPLES);
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      main
+ *          Application entry point
+ *
+ ***************************************************************************************************/
+int main(int argc, char** argv)
+{
+    bool runFrames = false;
+    bool runDecode = false;
+    bool runConvert = false;
+    bool runConfig = false;
+    bool useUinput = false;
+    int option;
+    int result = 0;
+
+    while ((option = getopt(argc, argv, "fun:dvch")) != -1) {
+        switch (option) {
+        case 'f': runFrames = true; break;
+        case 'u': useUinput = true; break;
+        case 'n': _samples = strtoul(optarg, NULL, 0); break;
+        case 'd': runDecode = true; break;
+        case 'v': runConvert = true; break;
+        case 'c': runConfig = true; break;
+        default:
+            _usage(argv[0]);
+            return (option == 'h') ? 0 : -1;
+        }
+    }
+
+    if (_samples == 0) {
+        _usage(argv[0]);
+        return -1;
+    }
+    if (!runFrames && !runDecode && !runConvert && !runConfig) {
+        runFrames = runDecode = runConvert = runConfig = true;
+    }
+
+    if (runFrames && (_benchFrames(useUinput) < 0)) {
+        result = -1;
+    }
+    if (runDecode && (_benchDecode() < 0)) {
+        result = -1;
+    }
+    if (runConvert && (_benchConvert() < 0)) {
+        result = -1;
+    }
+    if (runConfig && (_benchConfigLookups() < 0)) {
+        result = -1;
+    }
+
+    return result;
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E N D   O F   F I L E
+\*-------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,495 @@
+/* Open Sensor Platform Project
+ * https://github.com/sensorplatforms/open-sensor-platform
+ *
+ * Copyright (C) 2013 Sensor Platforms Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * sensorhub-shmclient: reads a sensor's shared memory sample ring from sensorhubd (started with
+ * -S <socket>) and prints the samples, using the ShmRingReader client library.
+ *
+ * With -B it instead runs a self-contained fan-out benchmark: one writer thread publishes batches
+ * into a ring while 1, 4 and 16 reader threads consume it through their own doorbells, and the
+ * per-reader throughput, losses and publish-to-read latency are reported.
+ *
+ * -l polls the ring's latest value every given number of milliseconds instead of reading the
+ * stream, and -L benchmarks that path: a 1 kHz writer against 1, 4 and 16 readers spinning on
+ * readLatest(), reporting read rate, cost, seqlock retries and torn copies (which must be 0).
+ */
+/*-------------------------------------------------------------------------------------------------*\
+ |    I N C L U D E   F I L E S
+\*-------------------------------------------------------------------------------------------------*/
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <csignal>
+#include <vector>
+
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "osp_shmring.h"
+#include "osp_latencyhist.h"
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   C O N S T A N T S   &   M A C R O S
+\*-------------------------------------------------------------------------------------------------*/
+#define CLIENT_DEFAULT_SOCKET           "/data/misc/sensorhubd-shm"
+#define CLIENT_READ_BATCH               64
+
+#define BENCH_BATCH                     32      /* records per doorbell, like a relay drain */
+#define BENCH_PERIOD_USEC               250     /* between batches: 128k records/s */
+#define BENCH_DURATION_SEC              2
+#define BENCH_LATEST_PERIOD_USEC        1000    /* latest benchmark writer: 1 kHz */
+
+#define NSEC_PER_SEC                    1000000000LL
+#define NSEC_PER_USEC                   1000LL
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   T Y P E   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+typedef struct {
+    pthread_t thread;
+    ShmRingReader reader;
+    uint64_t records;
+    LatencyHistogram latency;
+} BenchReader_t;
+
+typedef struct {
+    pthread_t thread;
+    ShmRingReader reader;
+    uint64_t reads;
+    uint64_t torn;                      //!< copies whose axes disagree; the seqlock prevents these
+} BenchLatestReader_t;
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    S T A T I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+static volatile bool _running = true;
+static volatile bool _benchWriterDone = false;
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      _monotonicNs
+ *          Current CLOCK_MONOTONIC time in nanoseconds
+ *
+ ***************************************************************************************************/
+static int64_t _monotonicNs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+}
+
+
+/****************************************************************************************************
+ * @fn      _onSignal
+ *          Stops the client loop
+ *
+ ***************************************************************************************************/
+static void _onSignal(int signum)
+{
+    _running = false;
+}
+
+
+/****************************************************************************************************
+ * @fn      _usage
+ *          Prints the command line options
+ *
+ ***************************************************************************************************/
+static void _usage(const char* progName)
+{
+    fprintf(stderr,
+            "Usage: %s [-s socket] [-n sensor] [-c count] [-l period_ms] | -B | -L\n"
+            "  -s  sensorhubd shm socket (default " CLIENT_DEFAULT_SOCKET ")\n"
+            "  -n  sensor ring to read: accel, mag, gyro, sig-motion, step-count, step-detect,\n"
+            "      rot-vec or game-rot-vec (default accel)\n"
+            "  -c  stop after this many samples\n"
+            "  -l  print the latest sample every period_ms instead of the stream\n"
+            "  -B  run the 1/4/16 reader fan-out benchmark, no daemon needed\n"
+            "  -L  run the 1 kHz writer latest-value contention benchmark, no daemon needed\n",
+            progName);
+}
+
+
+/****************************************************************************************************
+ * @fn      _printRecord
+ *          Prints one sample with as many values as it has, a quaternion's four included
+ *
+ ***************************************************************************************************/
+static void _printRecord(const char* name, const ShmSampleRecord_t* pRecord)
+{
+    const float* pValues = (const float*)pRecord->data;
+
+    printf("%s %lld", name, (long long)pRecord->timestamp);
+    for (int i = 0; (i < pRecord->numAxis) && (i < SHM_RING_MAX_AXIS); i++) {
+        printf(" %f", pValues[i]);
+    }
+    printf("\n");
+}
+
+
+/****************************************************************************************************
+ * @fn      _readSamples
+ *          Prints the samples of one ring as they arrive
+ *
+ ***************************************************************************************************/
+static int _readSamples(const char* socketPath, const char* name, uint64_t maxSamples)
+{
+    ShmRingReader reader;
+    const ShmSampleRecord_t* pRecords;
+    uint64_t samples = 0;
+
+    const int status = reader.connect(socketPath, name);
+    if (status < 0) {
+        fprintf(stderr, "Unable to get ring %s from %s: %s\n", name, socketPath,
+                strerror(-status));
+        return -1;
+    }
+
+    while (_running && ((maxSamples == 0) || (samples < maxSamples))) {
+        size_t count = reader.acquire(&pRecords, CLIENT_READ_BATCH);
+        if (count == 0) {
+            if (reader.wait(1000) < 0) {
+                break;
+            }
+            continue;
+        }
+
+        //records are printed straight from the shared mapping
+        for (size_t i = 0; i < count; i++) {
+            _printRecord(name, &pRecords[i]);
+        }
+        samples += reader.release(count);
+    }
+
+    printf("%llu samples, %llu lost\n", (unsigned long long)samples,
+           (unsigned long long)reader.lost());
+    return 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      _pollLatest
+ *          Prints a ring's latest sample at a fixed period, without a doorbell or a cursor
+ *
+ ***************************************************************************************************/
+static int _pollLatest(const char* socketPath, const char* name, uint64_t maxSamples,
+                       unsigned int periodMs)
+{
+    ShmRingReader reader;
+    ShmSampleRecord_t record;
+    uint64_t samples = 0;
+
+    const int status = reader.connect(socketPath, name, SHM_RING_REQUEST_LATEST_ONLY);
+    if (status < 0) {
+        fprintf(stderr, "Unable to get ring %s from %s: %s\n", name, socketPath,
+                strerror(-status));
+        return -1;
+    }
+
+    while (_running && ((maxSamples == 0) || (samples < maxSamples))) {
+        if (reader.readLatest(&record) > 0) {
+            _printRecord(name, &record);
+            samples++;
+        }
+        usleep(periodMs * 1000);
+    }
+
+    printf("%llu samples, %llu seqlock retries\n", (unsigned long long)samples,
+           (unsigned long long)reader.latestRetries());
+    return 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      _benchReader
+ *          Benchmark reader thread; consumes in place and records publish-to-read latency
+ *
+ ***************************************************************************************************/
+static void *_benchReader(void *pData)
+{
+    BenchReader_t* pBench = (BenchReader_t*)pData;
+    const ShmSampleRecord_t* pRecords;
+
+    for (;;) {
+        const size_t count = pBench->reader.acquire(&pRecords, CLIENT_READ_BATCH);
+        if (count == 0) {
+            if (_benchWriterDone) {
+                break;
+            }
+            pBench->reader.wait(100);
+            continue;
+        }
+
+        const int64_t nowNs = _monotonicNs();
+        for (size_t i = 0; i < count; i++) {
+            pBench->latency.record(nowNs - pRecords[i].timestamp);
+        }
+        pBench->records += pBench->reader.release(count);
+    }
+
+    return 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      _benchFanOut
+ *          One writer, numReaders readers on a private ring
+ *
+ ***************************************************************************************************/
+static int _benchFanOut(unsigned int numReaders)
+{
+    ShmRingWriter writer;
+    std::vector<BenchReader_t*> readers;
+    std::vector<int> doorbells;
+    const int32_t data[3] = {0, 0, 0};
+    const uint64_t one = 1;
+    uint64_t published = 0;
+
+    if (writer.create("bench") < 0) {
+        fprintf(stderr, "Unable to create ring: %s\n", strerror(errno));
+        return -1;
+    }
+
+    _benchWriterDone = false;
+    for (unsigned int r = 0; r < numReaders; r++) {
+        BenchReader_t* pBench = new BenchReader_t;
+        const int doorbellFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+        pBench->records = 0;
+        //the reader owns what it attaches, so it gets its own descriptors
+        if ((doorbellFd < 0) ||
+            (pBench->reader.attach(dup(writer.fd()), writer.mapSize(), dup(doorbellFd)) < 0)) {
+            fprintf(stderr, "Unable to attach reader %u\n", r);
+            return -1;
+        }
+        doorbells.push_back(doorbellFd);
+        readers.push_back(pBench);
+        pthread_create(&pBench->thread, NULL, _benchReader, pBench);
+    }
+
+    const int64_t startNs = _monotonicNs();
+    const int64_t endNs = startNs + BENCH_DURATION_SEC * NSEC_PER_SEC;
+    int64_t nextNs = startNs;
+    while (nextNs < endNs) {
+        struct timespec wake;
+
+        for (int i = 0; i < BENCH_BATCH; i++) {
+            writer.publish(0, data, 3, _monotonicNs());
+        }
+        published += BENCH_BATCH;
+        for (size_t r = 0; r < doorbells.size(); r++) {
+            if (write(doorbells[r], &one, sizeof(one)) < 0) {
+                //saturated counter, the reader is awake anyway
+            }
+        }
+
+        nextNs += BENCH_PERIOD_USEC * NSEC_PER_USEC;
+        wake.tv_sec = nextNs / NSEC_PER_SEC;
+        wake.tv_nsec = nextNs % NSEC_PER_SEC;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+    }
+    _benchWriterDone = true;
+
+    uint64_t delivered = 0;
+    uint64_t lost = 0;
+    LatencySummary_t worst;
+    memset(&worst, 0, sizeof(worst));
+    for (size_t r = 0; r < readers.size(); r++) {
+        LatencySummary_t summary;
+
+        pthread_join(readers[r]->thread, NULL);
+        readers[r]->latency.summarize(&summary);
+        delivered += readers[r]->records;
+        lost += readers[r]->reader.lost();
+        if (summary.p50 > worst.p50) worst.p50 = summary.p50;
+        if (summary.p99 > worst.p99) worst.p99 = summary.p99;
+        if (summary.max > worst.max) worst.max = summary.max;
+        close(doorbells[r]);
+        delete readers[r];
+    }
+
+    const double seconds = (_monotonicNs() - startNs) / (double)NSEC_PER_SEC;
+    printf("%2u readers: %llu published, %.0f records/s per reader, %.0f records/s total, "
+           "%llu lost, latency p50 %.1f us p99 %.1f us max %.1f us (worst reader)\n",
+           numReaders, (unsigned long long)published,
+           delivered / seconds / numReaders, delivered / seconds,
+           (unsigned long long)lost,
+           worst.p50 / 1000.0, worst.p99 / 1000.0, worst.max / 1000.0);
+    return 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      _benchLatestReader
+ *          Latest-value benchmark reader; reads back to back and checks every copy is whole
+ *
+ ***************************************************************************************************/
+static void *_benchLatestReader(void *pData)
+{
+    BenchLatestReader_t* pBench = (BenchLatestReader_t*)pData;
+    ShmSampleRecord_t record;
+
+    while (!_benchWriterDone) {
+        if (pBench->reader.readLatest(&record) <= 0) {
+            continue;
+        }
+        //the writer stores the same sequence number in every axis and in the timestamp
+        if ((record.data[0] != record.data[1]) || (record.data[1] != record.data[2]) ||
+            (record.timestamp != record.data[0])) {
+            pBench->torn++;
+        }
+        pBench->reads++;
+    }
+
+    return 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      _benchLatest
+ *          One 1 kHz writer, numReaders readers polling the latest value of a private ring
+ *
+ ***************************************************************************************************/
+static int _benchLatest(unsigned int numReaders)
+{
+    ShmRingWriter writer;
+    std::vector<BenchLatestReader_t*> readers;
+    int32_t published = 0;
+
+    if (writer.create("bench") < 0) {
+        fprintf(stderr, "Unable to create ring: %s\n", strerror(errno));
+        return -1;
+    }
+
+    _benchWriterDone = false;
+    for (unsigned int r = 0; r < numReaders; r++) {
+        BenchLatestReader_t* pBench = new BenchLatestReader_t;
+
+        pBench->reads = 0;
+        pBench->torn = 0;
+        if (pBench->reader.attach(dup(writer.fd()), writer.mapSize(), -1) < 0) {
+            fprintf(stderr, "Unable to attach reader %u\n", r);
+            return -1;
+        }
+        readers.push_back(pBench);
+        pthread_create(&pBench->thread, NULL, _benchLatestReader, pBench);
+    }
+
+    const int64_t startNs = _monotonicNs();
+    const int64_t endNs = startNs + BENCH_DURATION_SEC * NSEC_PER_SEC;
+    int64_t nextNs = startNs;
+    while (nextNs < endNs) {
+        struct timespec wake;
+
+        published++;
+        const int32_t data[3] = { published, published, published };
+        writer.publish(0, data, 3, published);
+
+        nextNs += BENCH_LATEST_PERIOD_USEC * NSEC_PER_USEC;
+        wake.tv_sec = nextNs / NSEC_PER_SEC;
+        wake.tv_nsec = nextNs % NSEC_PER_SEC;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+    }
+    _benchWriterDone = true;
+
+    uint64_t reads = 0;
+    uint64_t retries = 0;
+    uint64_t torn = 0;
+    for (size_t r = 0; r < readers.size(); r++) {
+        pthread_join(readers[r]->thread, NULL);
+        reads += readers[r]->reads;
+        retries += readers[r]->reader.latestRetries();
+        torn += readers[r]->torn;
+        delete readers[r];
+    }
+
+    const double seconds = (_monotonicNs() - startNs) / (double)NSEC_PER_SEC;
+    printf("%2u readers: %d published, %.2fM reads/s per reader, %.1f ns per read, "
+           "%llu retries (%.4f%%), %llu torn\n",
+           numReaders, published, reads / seconds / numReaders / 1e6,
+           (reads > 0) ? seconds * numReaders * 1e9 / reads : 0.0,
+           (unsigned long long)retries, (reads > 0) ? 100.0 * retries / reads : 0.0,
+           (unsigned long long)torn);
+    return 0;
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      main
+ *          Application entry point
+ *
+ ***************************************************************************************************/
+int main(int argc, char** argv)
+{
+    static const unsigned int benchReaders[] = {1, 4, 16};
+    const char* socketPath = CLIENT_DEFAULT_SOCKET;
+    const char* name = "accel";
+    uint64_t maxSamples = 0;
+    unsigned int latestPeriodMs = 0;
+    int option;
+
+    while ((option = getopt(argc, argv, "s:n:c:l:BLh")) != -1) {
+        switch (option) {
+        case 's': socketPath = optarg; break;
+        case 'n': name = optarg; break;
+        case 'c': maxSamples = strtoull(optarg, NULL, 0); break;
+        case 'B':
+            for (size_t i = 0; i < sizeof(benchReaders)/sizeof(benchReaders[0]); i++) {
+                if (_benchFanOut(benchReaders[i]) < 0) {
+                    return -1;
+                }
+            }
+            return 0;
+        case 'l': latestPeriodMs = strtoul(optarg, NULL, 0); break;
+        case 'L':
+            for (size_t i = 0; i < sizeof(benchReaders)/sizeof(benchReaders[0]); i++) {
+                if (_benchLatest(benchReaders[i]) < 0) {
+                    return -1;
+                }
+            }
+            return 0;
+        default:
+            _usage(argv[0]);
+            return (option == 'h') ? 0 : -1;
+        }
+    }
+
+    signal(SIGINT, _onSignal);
+    signal(SIGTERM, _onSignal);
+
+    if (latestPeriodMs > 0) {
+        return _pollLatest(socketPath, name, maxSamples, latestPeriodMs);
+    }
+    return _readSamples(socketPath, name, maxSamples);
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E N D   O F   F I L E
+\*-------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,1119 @@
+/* Open Sensor Platform Project
+ * https://github.com/sensorplatforms/open-sensor-platform
+ *
+ * Copyright (C) 2013 Sensor Platforms Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * sensorhub-tests: host checks of sensorhubd modules, run by ctest. Each test is a function
+ * returning 0 on success; "sensorhub-tests <name>..." runs the named ones, no name runs all. The
+ * exit status is non-zero if any test failed.
+ */
+/*-------------------------------------------------------------------------------------------------*\
+ |    I N C L U D E   F I L E S
+\*-------------------------------------------------------------------------------------------------*/
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <unistd.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include "osp_relayconvert.h"
+#include "osp_clocksync.h"
+#include "osp_latencyhist.h"
+#include "osp_configuration.h"
+#include "osp_subscriptions.h"
+#include "osp_eventloop.h"
+#include "osp_shmpublisher.h"
+#include "osp_hifparser.h"
+#include "osp_remoteprocedurecalls.h"
+
+extern "C" {
+#include "SensorPackets.h"
+}
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   C O N S T A N T S   &   M A C R O S
+\*-------------------------------------------------------------------------------------------------*/
+#define CLOCK_TEST_SECONDS              (600)
+#define CLOCK_TEST_DRAIN_NS             (20000000)  /* 50 Hz drains */
+#define CLOCK_TEST_SETTLE_NS            (10000000000LL)
+#define CLOCK_TEST_MAX_JITTER_NS        (100000)    /* p99.9 of the residual */
+#define CLOCK_TEST_MAX_RATE_PPM         (5.0)
+#define CONFIG_TEST_PATH_MAX            (64)
+#define ORDER_TEST_PERIOD_NS            (10000000)  /* 100 Hz samples */
+#define ORDER_TEST_LATENCY_US           (1000000)
+#define SHM_TEST_PATH_MAX               (64)
+#define SHM_TEST_SAMPLES                (20)
+#define SHM_TEST_PERIOD_NS              (5000000)   /* 200 Hz orientation */
+#define SHM_TEST_STOP_POLL_MS           (10)
+#define HIF_TEST_PACKETS                (1000)
+#define HIF_TEST_KINDS                  (5)
+#define HIF_TEST_JUNK_EVERY             (7)         /* packets between junk bytes */
+#define HIF_TEST_JUNK                   (0xFF)      /* never a sensor data packet's control byte */
+#define HIF_TEST_CAPACITY               (2 * HIF_PACKET_MAX_BYTES)  /* smallest, compacts most */
+#define CONTROL_TEST_PATH_MAX           (96)
+#define CONTROL_TEST_SENSOR             "acc1"      /* 50 Hz default rate */
+#define CONTROL_TEST_NODE_MAX           (32)
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   T Y P E   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+typedef struct {
+    const char* name;
+    int (*run)(void);
+} SensorhubTest_t;
+
+/* One step of the sensor-control test and the node writes it must cause */
+typedef struct {
+    bool subscribe;                     //!< else unsubscribe
+    OSPD_ResultDataCallback_t callback;
+    uint32_t periodUs;
+    const char* writes;                 //!< nodes written, in order, space separated
+    const char* enable;                 //!< node contents afterwards
+    const char* delay;
+} ControlTestStep_t;
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    S T A T I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+static std::vector<int64_t> _orderTestTimestamps;  //!< what _orderTestCallback was handed
+static std::atomic<bool> _shmTestDone;              //!< tells the shm-latest event loop to stop
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    F O R W A R D   F U N C T I O N   D E C L A R A T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      _convertBuffer
+ *          Converts a whole relay buffer in the same runs the daemon's drain uses
+ *
+ ***************************************************************************************************/
+static void _convertBuffer(const union sensor_relay_broadcast_node* pNodes, size_t numNodes,
+                           const uint8_t axisSource[3], const osp_float_t scale[3],
+                           RelayMotionBlock_t* pBlocks)
+{
+    for (size_t first = 0; first < numNodes; first += RELAY_CONVERT_BLOCK_SIZE) {
+        size_t count = numNodes - first;
+        if (count > RELAY_CONVERT_BLOCK_SIZE) {
+            count = RELAY_CONVERT_BLOCK_SIZE;
+        }
+        RelayConvert_Motion(&pNodes[first], count, axisSource, scale,
+                            &pBlocks[first / RELAY_CONVERT_BLOCK_SIZE]);
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      _testRelayConvert
+ *          Every conversion implementation the host supports is bit-identical to the scalar one,
+ *          for each axis swap, for the int16 extremes and for every run length up to a block
+ *
+ ***************************************************************************************************/
+static int _testRelayConvert(void)
+{
+    static const uint8_t axisSources[][3] = {
+        {0, 1, 2}, {1, 0, 2}, {2, 1, 0}, {1, 2, 0}
+    };
+    static const osp_float_t scale[3] = {0.0625f, -0.0625f, 9.80665f / 4096};
+    const size_t numNodes = SENSOR_RELAY_NUM_RELAY_BUFFERS;
+    const size_t numBlocks = (numNodes + RELAY_CONVERT_BLOCK_SIZE - 1) / RELAY_CONVERT_BLOCK_SIZE;
+    union sensor_relay_broadcast_node nodes[SENSOR_RELAY_NUM_RELAY_BUFFERS];
+    RelayMotionBlock_t reference[numBlocks];
+    RelayMotionBlock_t blocks[numBlocks];
+    int mismatches = 0;
+
+    srand(1);
+    memset(nodes, 0, sizeof(nodes));
+    for (size_t i = 0; i < numNodes; i++) {
+        nodes[i].sensorData.sensorId = SENSOR_ACCELEROMETER;
+        for (int k = 0; k < 3; k++) {
+            nodes[i].sensorData.Data[k] = (int16_t)rand();
+        }
+    }
+    nodes[0].sensorData.Data[0] = INT16_MIN;
+    nodes[1].sensorData.Data[1] = INT16_MAX;
+    nodes[2].sensorData.Data[2] = INT16_MIN;
+    nodes[3].sensorData.Data[0] = -1;
+
+    for (int impl = RELAY_CONVERT_SCALAR + 1; impl < RELAY_CONVERT_IMPL_COUNT; impl++) {
+        const char* name = RelayConvert_ImplName((RelayConvertImpl_t)impl);
+
+        if (!RelayConvert_IsSupported((RelayConvertImpl_t)impl)) {
+            printf("  %-6s not supported, skipped\n", name);
+            continue;
+        }
+
+        for (size_t a = 0; a < sizeof(axisSources) / sizeof(axisSources[0]); a++) {
+            RelayConvert_Select(RELAY_CONVERT_SCALAR);
+            _convertBuffer(nodes, numNodes, axisSources[a], scale, reference);
+            RelayConvert_Select((RelayConvertImpl_t)impl);
+            memset(blocks, 0, sizeof(blocks));
+            _convertBuffer(nodes, numNodes, axisSources[a], scale, blocks);
+
+            for (size_t i = 0; i < numNodes; i++) {
+                const size_t b = i / RELAY_CONVERT_BLOCK_SIZE;
+                const size_t j = i % RELAY_CONVERT_BLOCK_SIZE;
+                for (int k = 0; k < 3; k++) {
+                    if (memcmp(&blocks[b].axis[k][j], &reference[b].axis[k][j],
+                               sizeof(osp_float_t))) {
+                        printf("  %-6s swap %u node %u axis %d: %.9g != %.9g\n", name,
+                               (unsigned)a, (unsigned)i, k, blocks[b].axis[k][j],
+                               reference[b].axis[k][j]);
+                        mismatches++;
+                    }
+                }
+            }
+        }
+
+        //the short runs a drain converts between other sensors' nodes
+        for (size_t count = 1; count <= RELAY_CONVERT_BLOCK_SIZE; count++) {
+            RelayConvert_Select(RELAY_CONVERT_SCALAR);
+            RelayConvert_Motion(&nodes[5], count, axisSources[1], scale, &reference[0]);
+            RelayConvert_Select((RelayConvertImpl_t)impl);
+            RelayConvert_Motion(&nodes[5], count, axisSources[1], scale, &blocks[0]);
+            for (size_t j = 0; j < count; j++) {
+                for (int k = 0; k < 3; k++) {
+                    if (memcmp(&blocks[0].axis[k][j], &reference[0].axis[k][j],
+                               sizeof(osp_float_t))) {
+                        printf("  %-6s run of %u node %u axis %d differs\n", name,
+                               (unsigned)count, (unsigned)j, k);
+                        mismatches++;
+                    }
+                }
+            }
+        }
+        printf("  %-6s matches scalar\n", name);
+    }
+    RelayConvert_Select(RelayConvert_Best());
+
+    return mismatches ? -1 : 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      _testClockSync
+ *          Feeds the hub clock sync from a simulated hub: the oscillator runs 50 ppm fast with a
+ *          slow +-2 ppm wander, each drain is received 100 us + exponential(200 us) after the
+ *          newest sample was taken, 1% of drains an extra 2-8 ms late. Reports the error of the
+ *          mapped times against the true sample times, and that of the fixed tick mapping. Fails if
+ *          the jitter or the final rate error is out of bounds, or the fixed mapping does better
+ *
+ ***************************************************************************************************/
+static int _testClockSync(void)
+{
+    HubClockSync clockSync;
+    LatencyHistogram jitter;
+    LatencySummary_t summary;
+    double hubNs = 1e12;    //hub time, nominal ns, at host time hostNs
+    double sumError = 0.0, maxFixedError = 0.0, rateErrorPpm;
+    int64_t firstHubNs = 0, firstHostNs = 0;
+    std::vector<double> errors;
+
+    srand48(1);
+    for (int64_t hostNs = 0; hostNs < CLOCK_TEST_SECONDS * 1000000000LL;
+         hostNs += CLOCK_TEST_DRAIN_NS) {
+        const double skew = 50e-6 + 2e-6 * sin(2 * M_PI * hostNs / 300e9);
+        double delayNs = 100000.0 - 200000.0 * log(1.0 - drand48());
+
+        hubNs += CLOCK_TEST_DRAIN_NS * (1.0 + skew);
+        if (drand48() < 0.01) {
+            delayNs += 2000000.0 + 6000000.0 * drand48();
+        }
+
+        const HubClockMap_t map = clockSync.mapping();
+        if (!map.valid) {
+            firstHubNs = (int64_t)hubNs;
+            firstHostNs = hostNs + (int64_t)delayNs;
+        } else if (hostNs >= CLOCK_TEST_SETTLE_NS) {
+            errors.push_back((double)(HubClockSync::toHostNs(map, (int64_t)hubNs) - hostNs));
+            sumError += errors.back();
+            maxFixedError = fmax(maxFixedError,
+                                 fabs((double)(firstHostNs + ((int64_t)hubNs - firstHubNs) - hostNs)));
+        }
+        clockSync.observe((int64_t)hubNs, hostNs + (int64_t)delayNs);
+    }
+
+    //the mean transport delay is a constant offset; jitter is what remains around it
+    const double bias = sumError / errors.size();
+    for (size_t i = 0; i < errors.size(); i++) {
+        jitter.record((uint64_t)fabs(errors[i] - bias));
+    }
+    jitter.summarize(&summary);
+
+    printf("clock sync: %llu samples over %d s, %llu outliers rejected\n",
+           (unsigned long long)errors.size(), CLOCK_TEST_SECONDS,
+           (unsigned long long)clockSync.outliers());
+    rateErrorPpm = (clockSync.mapping().rate - 1.0 / (1.0 + 50e-6 +
+                    2e-6 * sin(2 * M_PI * CLOCK_TEST_SECONDS / 300.0))) * 1e6;
+    printf("  offset bias %.1f us (mean transport delay), rate error %.2f ppm at the end\n",
+           bias / 1000.0, rateErrorPpm);
+    printf("  residual jitter p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+           summary.p50 / 1000.0, summary.p99 / 1000.0, summary.p999 / 1000.0,
+           summary.max / 1000.0);
+    printf("  fixed tick mapping: max error %.1f ms\n", maxFixedError / 1e6);
+
+    if ((summary.p999 > CLOCK_TEST_MAX_JITTER_NS) || (fabs(rateErrorPpm) > CLOCK_TEST_MAX_RATE_PPM) ||
+        ((double)summary.max >= maxFixedError)) {
+        return -1;
+    }
+    return 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      _sameFile
+ *          Whether two files have the same contents
+ *
+ ***************************************************************************************************/
+static bool _sameFile(const char* pathA, const char* pathB)
+{
+    FILE* pA = fopen(pathA, "r");
+    FILE* pB = fopen(pathB, "r");
+    bool same = (pA != NULL) && (pB != NULL);
+
+    while (same) {
+        const int a = fgetc(pA);
+        same = (a == fgetc(pB));
+        if (a == EOF) {
+            break;
+        }
+    }
+    if (pA != NULL) {
+        fclose(pA);
+    }
+    if (pB != NULL) {
+        fclose(pB);
+    }
+    return same;
+}
+
+
+/****************************************************************************************************
+ * @fn      _sameSensorRecord
+ *          Whether two snapshot sensor records are identical, floats bit for bit
+ *
+ ***************************************************************************************************/
+static bool _sameSensorRecord(const OSPConfig::SensorRecord_t& a, const OSPConfig::SensorRecord_t& b)
+{
+    return (a.name == b.name) && (a.type == b.type) && (a.driverName == b.driverName) &&
+            !memcmp(a.swap, b.swap, sizeof(a.swap)) &&
+            !memcmp(a.conversion, b.conversion, sizeof(a.conversion)) &&
+            !memcmp(&a.period, &b.period, sizeof(a.period)) &&
+            !memcmp(a.noise, b.noise, sizeof(a.noise)) &&
+            (a.useMedianFilter == b.useMedianFilter) && (a.enablePath == b.enablePath) &&
+            (a.enableValue == b.enableValue) && (a.disableValue == b.disableValue) &&
+            (a.delayPath == b.delayPath);
+}
+
+
+/****************************************************************************************************
+ * @fn      _testConfigRoundTrip
+ *          A configuration dump()ed and load()ed into an empty configuration gives the same
+ *          snapshot and dumps to the same file. The configuration is the relay default with a
+ *          served hub and a conversion factor that needs all of a float's digits
+ *
+ ***************************************************************************************************/
+static int _testConfigRoundTrip(void)
+{
+    char dumpPath[CONFIG_TEST_PATH_MAX];
+    char reloadedPath[CONFIG_TEST_PATH_MAX];
+    int failures = 0;
+
+    snprintf(dumpPath, sizeof(dumpPath), "/tmp/sensorhub-tests-%d.conf", (int)getpid());
+    snprintf(reloadedPath, sizeof(reloadedPath), "/tmp/sensorhub-tests-%d-reloaded.conf",
+             (int)getpid());
+
+    OSPConfig::clear(true);
+    OSPConfig::overrideRelayHub("hub1", "/tmp/relay1/", "/tmp/relay1.wakeup");
+    OSPConfig::overrideConfigItemFloat(OSPConfig::keyFrom("acc1",
+                                                          OSPConfig::SENSOR_CONVERSION).c_str(),
+                                       9.80665f / 4096);
+    OSPConfig::establishDefaultConfig("relay");
+    const OSPConfig::Snapshot_t original = *OSPConfig::snapshot();
+    if (OSPConfig::dump(dumpPath) < 0) {
+        printf("  could not dump to %s\n", dumpPath);
+        return -1;
+    }
+
+    OSPConfig::clear(true);
+    const OSPConfig::Snapshot_t* pLoaded = OSPConfig::load(dumpPath);
+    if (pLoaded == NULL) {
+        printf("  load() rejects the dump() output %s\n", dumpPath);
+        return -1;
+    }
+
+    if (pLoaded->sensors.size() != original.sensors.size()) {
+        printf("  %u sensors loaded, %u dumped\n", (unsigned)pLoaded->sensors.size(),
+               (unsigned)original.sensors.size());
+        failures++;
+    }
+    for (size_t i = 0; i < original.sensors.size(); i++) {
+        const int record = OSPConfig::findSensor(pLoaded, original.sensors[i].name.c_str());
+        if ((record < 0) || !_sameSensorRecord(pLoaded->sensors[record], original.sensors[i])) {
+            printf("  sensor %s differs\n", original.sensors[i].name.c_str());
+            failures++;
+        }
+    }
+    if ((pLoaded->relayHubs.size() != 1) ||
+        (pLoaded->relayHubs[0].relayPath != original.relayHubs[0].relayPath) ||
+        (pLoaded->relayHubs[0].wakeupPath != original.relayHubs[0].wakeupPath) ||
+        (pLoaded->relayDriver != original.relayDriver) ||
+        (pLoaded->relayTickUsec != original.relayTickUsec)) {
+        printf("  relay hubs or protocol differ\n");
+        failures++;
+    }
+
+    if ((OSPConfig::dump(reloadedPath) < 0) || !_sameFile(dumpPath, reloadedPath)) {
+        printf("  dump of the loaded configuration %s differs from %s\n", reloadedPath, dumpPath);
+        failures++;
+    }
+    OSPConfig::clear(true);
+
+    if (failures == 0) {
+        unlink(dumpPath);
+        unlink(reloadedPath);
+    }
+    return failures ? -1 : 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      _orderTestCallback
+ *          Subscriber of the subscription-order test, records the timestamps it gets
+ *
+ ***************************************************************************************************/
+static void _orderTestCallback(SensorType_t sensorType, void* data)
+{
+    _orderTestTimestamps.push_back(((OSPD_ThreeAxisData_t*)data)->timestamp.ll);
+}
+
+
+/****************************************************************************************************
+ * @fn      _dispatchOrderTestSamples
+ *          Dispatches count accelerometer samples numbered from first, first * period apart
+ *
+ ***************************************************************************************************/
+static void _dispatchOrderTestSamples(ResultSubscriptions& subscriptions, int first, int count)
+{
+    OSPD_ThreeAxisData_t sample;
+
+    memset(&sample, 0, sizeof(sample));
+    for (int i = first; i < first + count; i++) {
+        sample.timestamp.ll = (int64_t)i * ORDER_TEST_PERIOD_NS;
+        subscriptions.dispatch(SENSOR_ACCELEROMETER, &sample, sample.timestamp.ll);
+        subscriptions.quiescent();
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      _testSubscriptionOrder
+ *          A batching subscriber that re-subscribes without batching, and later unsubscribes, gets
+ *          every sample once and in time order: what the old subscription held goes out before
+ *          anything newer
+ *
+ ***************************************************************************************************/
+static int _testSubscriptionOrder(void)
+{
+    ResultSubscriptions subscriptions;
+    int failures = 0;
+
+    _orderTestTimestamps.clear();
+    subscriptions.add(SENSOR_ACCELEROMETER, _orderTestCallback, 0, ORDER_TEST_LATENCY_US);
+    _dispatchOrderTestSamples(subscriptions, 1, 50);
+    subscriptions.add(SENSOR_ACCELEROMETER, _orderTestCallback, 0, 0);
+    _dispatchOrderTestSamples(subscriptions, 51, 10);
+    subscriptions.add(SENSOR_ACCELEROMETER, _orderTestCallback, 0, ORDER_TEST_LATENCY_US);
+    _dispatchOrderTestSamples(subscriptions, 61, 10);
+    subscriptions.remove(SENSOR_ACCELEROMETER, _orderTestCallback);
+    subscriptions.deliverBatches(0);
+    subscriptions.quiescent();
+    subscriptions.reclaim();
+
+    printf("subscription order: %u of 70 samples delivered\n",
+           (unsigned)_orderTestTimestamps.size());
+    if (_orderTestTimestamps.size() != 70) {
+        failures++;
+    }
+    for (size_t i = 0; i < _orderTestTimestamps.size(); i++) {
+        if (_orderTestTimestamps[i] != (int64_t)(i + 1) * ORDER_TEST_PERIOD_NS) {
+            printf("  sample %u has timestamp %lld ns\n", (unsigned)i,
+                   (long long)_orderTestTimestamps[i]);
+            failures++;
+            break;
+        }
+    }
+
+    return failures ? -1 : 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      _shmTestStopPoll
+ *          Timer of the shm-latest event loop, stops it once the test is done with it
+ *
+ ***************************************************************************************************/
+static void _shmTestStopPoll(int fd, uint32_t events, void* pContext)
+{
+    EventLoop* pEventLoop = (EventLoop*)pContext;
+    uint64_t expirations;
+
+    if (read(fd, &expirations, sizeof(expirations)) < 0) {
+        return;
+    }
+    if (_shmTestDone.load()) {
+        pEventLoop->stop();
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      _shmTestLoop
+ *          Event loop thread of the shm-latest test, serves the publisher's ring requests
+ *
+ ***************************************************************************************************/
+static void* _shmTestLoop(void* pContext)
+{
+    ((EventLoop*)pContext)->run();
+    return NULL;
+}
+
+
+/****************************************************************************************************
+ * @fn      _shmTestQuaternion
+ *          Quaternion of sample i of the shm-latest test as published: float images, x/y/z/w
+ *
+ ***************************************************************************************************/
+static void _shmTestQuaternion(int i, int32_t data[4])
+{
+    const float half = 0.01f * i;
+    const float quaternion[4] = { sinf(half), 0.0f, 0.0f, cosf(half) };
+
+    memcpy(data, quaternion, sizeof(quaternion));
+}
+
+
+/****************************************************************************************************
+ * @fn      _testShmLatest
+ *          A client asking only for the latest value of the rotation vector and game rotation
+ *          vector rings reads the newest quaternion of each, all four axes of it, while the
+ *          publisher streams both the way sensorhubd does
+ *
+ ***************************************************************************************************/
+static int _testShmLatest(void)
+{
+    static const char* const names[] = { "rot-vec", "game-rot-vec" };
+    static const int32_t types[] = { SENSOR_ROTATION_VECTOR, SENSOR_GAME_ROTATION_VECTOR };
+    char socketPath[SHM_TEST_PATH_MAX];
+    EventLoop eventLoop;
+    ShmSamplePublisher publisher;
+    pthread_t loopThread;
+    int32_t data[4];
+    int failures = 0;
+
+    snprintf(socketPath, sizeof(socketPath), "/tmp/sensorhub-tests-%d.sock", (int)getpid());
+    _shmTestDone.store(false);
+    if ((publisher.open(&eventLoop, socketPath, names, 2) < 0) ||
+        (eventLoop.addTimer(SHM_TEST_STOP_POLL_MS, _shmTestStopPoll, &eventLoop) < 0) ||
+        (pthread_create(&loopThread, NULL, _shmTestLoop, &eventLoop) != 0)) {
+        printf("  could not serve shm rings on %s\n", socketPath);
+        return -1;
+    }
+
+    ShmRingReader readers[2];
+    ShmSampleRecord_t record;
+    for (int ring = 0; ring < 2; ring++) {
+        if (readers[ring].connect(socketPath, names[ring], SHM_RING_REQUEST_LATEST_ONLY) < 0) {
+            printf("  could not get ring %s\n", names[ring]);
+            failures++;
+        } else if (readers[ring].readLatest(&record) != 0) {
+            printf("  %s has a latest value before anything was published\n", names[ring]);
+            failures++;
+        }
+    }
+
+    //interleaved, each ring with its own quaternions; neither may show the other's
+    for (int i = 1; i <= SHM_TEST_SAMPLES; i++) {
+        for (int ring = 0; ring < 2; ring++) {
+            _shmTestQuaternion(ring ? -i : i, data);
+            publisher.publish(ring, types[ring], data, 4, (int64_t)i * SHM_TEST_PERIOD_NS + ring);
+        }
+    }
+    publisher.ringDoorbells();
+
+    for (int ring = 0; ring < 2; ring++) {
+        _shmTestQuaternion(ring ? -SHM_TEST_SAMPLES : SHM_TEST_SAMPLES, data);
+        if (readers[ring].readLatest(&record) != 1) {
+            printf("  %s: no latest value\n", names[ring]);
+            failures++;
+            continue;
+        }
+
+        const float* pValues = (const float*)record.data;
+        printf("%s latest: %lld ns, %d axes, %f %f %f %f\n", names[ring],
+               (long long)record.timestamp, record.numAxis, pValues[0], pValues[1], pValues[2],
+               pValues[3]);
+        if ((record.timestamp != (int64_t)SHM_TEST_SAMPLES * SHM_TEST_PERIOD_NS + ring) ||
+            (record.sensorType != types[ring]) || (record.numAxis != 4) ||
+            memcmp(record.data, data, sizeof(data))) {
+            failures++;
+        }
+    }
+
+    _shmTestDone.store(true);
+    pthread_join(loopThread, NULL);
+    publisher.close();
+    return failures ? -1 : 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      SendSensorEnableReq/SendSensorDisableReq
+ *          Referenced by the control packet parser of SensorPackets.c; the hif-parse test only
+ *          formats sensor data packets
+ *
+ ***************************************************************************************************/
+extern "C" void SendSensorEnableReq(ASensorType_t sensor)
+{
+}
+
+extern "C" void SendSensorDisableReq(ASensorType_t sensor)
+{
+}
+
+
+/****************************************************************************************************
+ * @fn      _formatHifTestPacket
+ *          Formats packet i of the hif-parse stream with the hub's own SensorPackets.c, cycling
+ *          through raw, uncalibrated, quaternion, step detector and step counter packets, and
+ *          fills in what the parser should decode from it. Returns the packet's length
+ *
+ ***************************************************************************************************/
+static int16_t _formatHifTestPacket(int i, uint8_t* pDest, HifPacket_t* pExpected)
+{
+    int16_t length = -1;
+
+    memset(pExpected, 0, sizeof(*pExpected));
+    pExpected->timeStamp = ((int64_t)i << 20) + 1;
+
+    switch (i % HIF_TEST_KINDS) {
+    case 0: {
+        TriAxisRawData_t raw;
+
+        raw.TStamp.TS64 = pExpected->timeStamp & 0xffffffff;
+        raw.Axis[0] = i;
+        raw.Axis[1] = -i;
+        raw.Axis[2] = -32768;
+        length = FormatSensorDataPktRaw(pDest, &raw, META_DATA_UNUSED,
+                                        (ASensorType_t)AP_PSENSOR_ACCELEROMETER_RAW,
+                                        SENSOR_SUBTYPE_UNUSED);
+        pExpected->sensorType = PSENSOR_ACCELEROMETER_RAW;
+        pExpected->isPrivate = true;
+        pExpected->format = HIF_PACKET_RAW;
+        pExpected->numValues = 3;
+        pExpected->timeStamp = raw.TStamp.TS64;
+        for (int k = 0; k < 3; k++) {
+            pExpected->value[k] = raw.Axis[k];
+        }
+        break;
+    }
+
+    case 1: {
+        UncalibratedFixP_t uncalibrated;
+
+        memset(&uncalibrated, 0, sizeof(uncalibrated));
+        uncalibrated.TimeStamp.TS64 = pExpected->timeStamp;
+        uncalibrated.Axis[0] = i << 8;
+        uncalibrated.Axis[1] = -(i << 8);
+        uncalibrated.Axis[2] = INT32_MIN;
+        length = FormatUncalibratedPktFixP(pDest, &uncalibrated, META_DATA_UNUSED,
+                                           SENSOR_GYROSCOPE_UNCALIBRATED);
+        pExpected->sensorType = SENSOR_GYROSCOPE_UNCALIBRATED;
+        pExpected->format = HIF_PACKET_FIXPOINT;
+        pExpected->numValues = 3;
+        for (int k = 0; k < 3; k++) {
+            pExpected->value[k] = uncalibrated.Axis[k];
+        }
+        break;
+    }
+
+    case 2: {
+        QuaternionFixP_t quaternion;
+
+        quaternion.TimeStamp.TS64 = pExpected->timeStamp;
+        quaternion.Quat[0] = (1 << 24) - i;
+        quaternion.Quat[1] = i;
+        quaternion.Quat[2] = -i;
+        quaternion.Quat[3] = INT32_MAX - i;
+        length = FormatQuaternionPktFixP(pDest, &quaternion, SENSOR_ROTATION_VECTOR);
+        pExpected->sensorType = SENSOR_ROTATION_VECTOR;
+        pExpected->format = HIF_PACKET_FIXPOINT;
+        pExpected->numValues = 4;
+        for (int k = 0; k < 4; k++) {
+            pExpected->value[k] = quaternion.Quat[k];
+        }
+        break;
+    }
+
+    case 3: {
+        StepDetector_t step;
+
+        step.TimeStamp.TS64 = pExpected->timeStamp;
+        step.StepDetected = 1;
+        length = FormatStepDetectorPkt(pDest, &step, SENSOR_STEP_DETECTOR);
+        pExpected->sensorType = SENSOR_STEP_DETECTOR;
+        pExpected->format = HIF_PACKET_EVENT;
+        pExpected->numValues = 1;
+        pExpected->value[0] = 1;
+        break;
+    }
+
+    case 4: {
+        StepCounter_t steps;
+
+        steps.TimeStamp.TS64 = pExpected->timeStamp;
+        steps.NumStepsTotal = 0x100000000ULL + i;
+        length = FormatStepCounterPkt(pDest, &steps, SENSOR_STEP_COUNTER);
+        pExpected->sensorType = SENSOR_STEP_COUNTER;
+        pExpected->format = HIF_PACKET_EVENT;
+        pExpected->numValues = 1;
+        pExpected->value[0] = (int64_t)steps.NumStepsTotal;
+        break;
+    }
+    }
+
+    pExpected->length = (length > 0) ? length : 0;
+    return length;
+}
+
+
+/****************************************************************************************************
+ * @fn      _sameHifPacket
+ *          True if a decoded packet is the expected one
+ *
+ ***************************************************************************************************/
+static bool _sameHifPacket(const HifPacket_t* pPacket, const HifPacket_t* pExpected)
+{
+    if ((pPacket->sensorType != pExpected->sensorType) ||
+        (pPacket->isPrivate != pExpected->isPrivate) || (pPacket->format != pExpected->format) ||
+        (pPacket->numValues != pExpected->numValues) || (pPacket->length != pExpected->length) ||
+        (pPacket->timeStamp != pExpected->timeStamp)) {
+        return false;
+    }
+    for (int k = 0; k < pExpected->numValues; k++) {
+        if (pPacket->value[k] != pExpected->value[k]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/****************************************************************************************************
+ * @fn      _testHifParse
+ *          A stream of hub packets with junk bytes between some of them, written to a socket in
+ *          uneven chunks and read straight into the smallest parser buffer, decodes to every packet
+ *          in order with its values, and exactly the junk is skipped. Packets left partial in the
+ *          buffer must survive being moved to its start
+ *
+ ***************************************************************************************************/
+static int _testHifParse(void)
+{
+    static const size_t chunks[] = { 1, 2, 3, 5, 8, 13, 21, 34, 55, 89, 7, 64 };
+    std::vector<uint8_t> stream;
+    std::vector<HifPacket_t> expected(HIF_TEST_PACKETS);
+    uint8_t bytes[HIF_PACKET_MAX_BYTES];
+    HifStreamParser parser(HIF_TEST_CAPACITY);
+    HifPacket_t packet;
+    uint64_t junk = 0;
+    size_t received = 0, splitCompactions = 0;
+    int fds[2];
+    int failures = 0;
+
+    for (int i = 0; i < HIF_TEST_PACKETS; i++) {
+        const int16_t length = _formatHifTestPacket(i, bytes, &expected[i]);
+        if (length <= 0) {
+            printf("  SensorPackets.c could not format packet %d\n", i);
+            return -1;
+        }
+        stream.insert(stream.end(), bytes, bytes + length);
+        if ((i % HIF_TEST_JUNK_EVERY) == 0) {
+            stream.push_back(HIF_TEST_JUNK);
+            junk++;
+        }
+    }
+
+    if ((socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) ||
+        (fcntl(fds[1], F_SETFL, O_NONBLOCK) < 0)) {
+        printf("  no socket pair\n");
+        return -1;
+    }
+
+    const uint8_t* pWriteEnd = NULL;
+    size_t offset = 0;
+    for (size_t c = 0; offset < stream.size(); c++) {
+        size_t chunk = chunks[c % (sizeof(chunks) / sizeof(chunks[0]))];
+        if (chunk > stream.size() - offset) {
+            chunk = stream.size() - offset;
+        }
+        if (write(fds[0], &stream[offset], chunk) != (ssize_t)chunk) {
+            printf("  short write to the socket\n");
+            failures++;
+            break;
+        }
+        offset += chunk;
+
+        //read as the hif backend does: whatever is there, to the parser's write pointer
+        for (;;) {
+            size_t room;
+            uint8_t* pWrite = parser.writePointer(&room);
+            if ((pWriteEnd != NULL) && (pWrite != pWriteEnd) && (parser.buffered() > 0)) {
+                splitCompactions++;
+            }
+            const ssize_t got = read(fds[1], pWrite, room);
+            if (got <= 0) {
+                pWriteEnd = pWrite;
+                break;
+            }
+            parser.commit(got);
+            pWriteEnd = pWrite + got;
+
+            while (parser.next(&packet)) {
+                if ((received >= expected.size()) || !_sameHifPacket(&packet, &expected[received])) {
+                    printf("  packet %u: type %u, %u values, %lld time stamp, %lld first value\n",
+                           (unsigned)received, packet.sensorType, packet.numValues,
+                           (long long)packet.timeStamp, (long long)packet.value[0]);
+                    failures++;
+                }
+                received++;
+            }
+        }
+    }
+    close(fds[0]);
+    close(fds[1]);
+
+    printf("hif parse: %u bytes, %u of %d packets, %llu of %llu junk bytes skipped, "
+           "%u partial packets moved, %u bytes left\n", (unsigned)stream.size(),
+           (unsigned)received, HIF_TEST_PACKETS, (unsigned long long)parser.skippedBytes(),
+           (unsigned long long)junk, (unsigned)splitCompactions, (unsigned)parser.buffered());
+    if ((received != HIF_TEST_PACKETS) || (parser.packets() != HIF_TEST_PACKETS) ||
+        (parser.skippedBytes() != junk) || (splitCompactions == 0) || (parser.buffered() != 0)) {
+        failures++;
+    }
+
+    return failures ? -1 : 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      _controlTestSubscriberA/B/C/D
+ *          Subscribers of the sensor-control test; only their rates matter
+ *
+ ***************************************************************************************************/
+static void _controlTestSubscriberA(SensorType_t sensorType, void* data)
+{
+}
+
+static void _controlTestSubscriberB(SensorType_t sensorType, void* data)
+{
+}
+
+static void _controlTestSubscriberC(SensorType_t sensorType, void* data)
+{
+}
+
+static void _controlTestSubscriberD(SensorType_t sensorType, void* data)
+{
+}
+
+
+/****************************************************************************************************
+ * @fn      _createControlTestFile
+ *          Creates an empty file (relay buffer, control file or sysfs node) of the given size
+ *
+ ***************************************************************************************************/
+static int _createControlTestFile(const char* dir, const char* name, off_t size)
+{
+    char path[CONTROL_TEST_PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    const int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    const int result = ftruncate(fd, size);
+    close(fd);
+    return result;
+}
+
+
+/****************************************************************************************************
+ * @fn      _readControlTestNode
+ *          Contents of a sensor node without the trailing newline
+ *
+ ***************************************************************************************************/
+static std::string _readControlTestNode(const char* nodeDir, const char* name)
+{
+    char path[CONTROL_TEST_PATH_MAX];
+    char text[CONTROL_TEST_NODE_MAX];
+    ssize_t length = -1;
+
+    snprintf(path, sizeof(path), "%s/%s", nodeDir, name);
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        length = read(fd, text, sizeof(text) - 1);
+        close(fd);
+    }
+    if (length < 0) {
+        return "?";
+    }
+    while ((length > 0) && (text[length - 1] == '\n')) {
+        length--;
+    }
+    return std::string(text, length);
+}
+
+
+/****************************************************************************************************
+ * @fn      _controlTestWrites
+ *          The nodes written since the last call, in order, from the inotify watch on their
+ *          directory
+ *
+ ***************************************************************************************************/
+static std::string _controlTestWrites(int inotifyFd)
+{
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    std::string writes;
+    ssize_t length;
+
+    while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t offset = 0; offset < length; ) {
+            const struct inotify_event* pEvent = (const struct inotify_event*)&buffer[offset];
+
+            if (pEvent->len > 0) {
+                writes += writes.empty() ? "" : " ";
+                writes += pEvent->name;
+            }
+            offset += sizeof(struct inotify_event) + pEvent->len;
+        }
+    }
+    return writes;
+}
+
+
+/****************************************************************************************************
+ * @fn      _testSensorControl
+ *          The relay backend runs a sensor at the fastest rate its subscribers ask for: the delay
+ *          node is written before the enable node, in whole milliseconds and at least 1, each node
+ *          only when its value changes, and the sensor is disabled with the last unsubscribe.
+ *          protocol.relay_sysfs_path points at a temporary directory standing in for sysfs, next
+ *          to empty relay buffers and a wakeup FIFO so that the backend starts
+ *
+ ***************************************************************************************************/
+static int _testSensorControl(void)
+{
+    static const ControlTestStep_t steps[] = {
+        //the default rate, 20 ms
+        { true,  _controlTestSubscriberA, 0,     "delay enable", "1", "20" },
+        { true,  _controlTestSubscriberB, 5000,  "delay",        "1", "5" },
+        { true,  _controlTestSubscriberC, 10000, "",             "1", "5" },
+        { false, _controlTestSubscriberB, 0,     "delay",        "1", "10" },
+        //rounded down to whole milliseconds, and never below 1
+        { true,  _controlTestSubscriberD, 1500,  "delay",        "1", "1" },
+        { true,  _controlTestSubscriberD, 300,   "",             "1", "1" },
+        { false, _controlTestSubscriberD, 0,     "delay",        "1", "10" },
+        { false, _controlTestSubscriberC, 0,     "delay",        "1", "20" },
+        { false, _controlTestSubscriberA, 0,     "enable",       "0", "20" },
+        { true,  _controlTestSubscriberA, 2500,  "delay enable", "1", "2" },
+    };
+    const SensorType_t resultType = SENSOR_ACCELEROMETER_UNCALIBRATED;
+    char dir[] = "/tmp/sensorhub-tests-XXXXXX";
+    char path[CONTROL_TEST_PATH_MAX];
+    char nodeDir[CONTROL_TEST_PATH_MAX];
+    std::string writes;
+    int failures = 0;
+
+    if (mkdtemp(dir) == NULL) {
+        printf("  no temporary directory\n");
+        return -1;
+    }
+    snprintf(path, sizeof(path), "%s/sysfs", dir);
+    snprintf(nodeDir, sizeof(nodeDir), "%s/sysfs/%s", dir, CONTROL_TEST_SENSOR);
+    const off_t relaySize = sizeof(union sensor_relay_broadcast_node) *
+                            SENSOR_RELAY_NUM_RELAY_BUFFERS;
+    if ((mkdir(path, 0755) < 0) || (mkdir(nodeDir, 0755) < 0) ||
+        (_createControlTestFile(nodeDir, "enable", 0) < 0) ||
+        (_createControlTestFile(nodeDir, "delay", 0) < 0) ||
+        (_createControlTestFile(dir, "relay0", relaySize) < 0) ||
+        (_createControlTestFile(dir, "relay0.produced", 0) < 0) ||
+        (_createControlTestFile(dir, "relay0.consumed", 0) < 0)) {
+        printf("  could not create the nodes in %s\n", dir);
+        return -1;
+    }
+    snprintf(path, sizeof(path), "%s/wakeup", dir);
+    const int inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if ((mkfifo(path, 0600) < 0) || (inotifyFd < 0) ||
+        (inotify_add_watch(inotifyFd, nodeDir, IN_CLOSE_WRITE) < 0)) {
+        printf("  could not watch %s\n", nodeDir);
+        return -1;
+    }
+
+    OSPConfig::clear(true);
+    OSPConfig::overrideConfigItem(OSPConfig::PROTOCOL_RELAY_WAKEUP_PATH, path);
+    snprintf(path, sizeof(path), "%s/relay", dir);
+    OSPConfig::overrideConfigItem(OSPConfig::PROTOCOL_RELAY_PATH, path);
+    snprintf(path, sizeof(path), "%s/sysfs", dir);
+    OSPConfig::overrideConfigItem(OSPConfig::PROTOCOL_RELAY_SYSFS_PATH, path);
+    OSPConfig::overrideConfigItem(OSPConfig::keyFrom(CONTROL_TEST_SENSOR,
+                                                     OSPConfig::SENSOR_ENABLE_PATH).c_str(),
+                                  "enable");
+    OSPConfig::overrideConfigItem(OSPConfig::keyFrom(CONTROL_TEST_SENSOR,
+                                                     OSPConfig::SENSOR_DELAY_PATH).c_str(),
+                                  "delay");
+    if (OSPD_Initialize() != OSP_STATUS_OK) {
+        printf("  relay backend did not start on %s\n", dir);
+        return -1;
+    }
+
+    //off until someone subscribes; nothing is known about the rate yet
+    writes = _controlTestWrites(inotifyFd);
+    printf("sensor control: start: wrote [%s], enable %s, delay %s\n", writes.c_str(),
+           _readControlTestNode(nodeDir, "enable").c_str(),
+           _readControlTestNode(nodeDir, "delay").c_str());
+    if ((writes != "enable") || (_readControlTestNode(nodeDir, "enable") != "0") ||
+        (_readControlTestNode(nodeDir, "delay") != "")) {
+        failures++;
+    }
+
+    for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+        const ControlTestStep_t& step = steps[i];
+
+        if (step.subscribe) {
+            OSPD_SubscribeResult(resultType, step.callback, step.periodUs, 0);
+        } else {
+            OSPD_UnsubscribeResult(resultType, step.callback);
+        }
+        writes = _controlTestWrites(inotifyFd);
+        const std::string enable = _readControlTestNode(nodeDir, "enable");
+        const std::string delay = _readControlTestNode(nodeDir, "delay");
+
+        printf("sensor control: step %u %s %u us: wrote [%s], enable %s, delay %s\n",
+               (unsigned)i, step.subscribe ? "subscribe" : "unsubscribe", step.periodUs,
+               writes.c_str(), enable.c_str(), delay.c_str());
+        if ((writes != step.writes) || (enable != step.enable) || (delay != step.delay)) {
+            failures++;
+        }
+    }
+
+    //the daemon going away switches the sensor off
+    OSPD_Deinitialize();
+    writes = _controlTestWrites(inotifyFd);
+    printf("sensor control: stop: wrote [%s], enable %s\n", writes.c_str(),
+           _readControlTestNode(nodeDir, "enable").c_str());
+    if ((writes != "enable") || (_readControlTestNode(nodeDir, "enable") != "0")) {
+        failures++;
+    }
+
+    close(inotifyFd);
+    if (!failures) {
+        static const char* const files[] = {
+            "sysfs/" CONTROL_TEST_SENSOR "/enable", "sysfs/" CONTROL_TEST_SENSOR "/delay",
+            "sysfs/" CONTROL_TEST_SENSOR, "sysfs", "relay0", "relay0.produced",
+            "relay0.consumed", "wakeup"
+        };
+        for (size_t f = 0; f < sizeof(files) / sizeof(files[0]); f++) {
+            snprintf(path, sizeof(path), "%s/%s", dir, files[f]);
+            remove(path);
+        }
+        rmdir(dir);
+    }
+    return failures ? -1 : 0;
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      main
+ *          Application entry point
+ *
+ ***************************************************************************************************/
+int main(int argc, char** argv)
+{
+    static const SensorhubTest_t tests[] = {
+        { "relay-convert",     _testRelayConvert },
+        { "clock-sync",        _testClockSync },
+        { "config-round-trip", _testConfigRoundTrip },
+        { "subscription-order", _testSubscriptionOrder },
+        { "shm-latest",        _testShmLatest },
+        { "hif-parse",         _testHifParse },
+        { "sensor-control",    _testSensorControl },
+    };
+    const size_t numTests = sizeof(tests) / sizeof(tests[0]);
+    int failed = 0;
+
+    for (int a = 1; a < argc; a++) {
+        size_t t = 0;
+        while ((t < numTests) && strcmp(argv[a], tests[t].name)) {
+            t++;
+        }
+        if (t == numTests) {
+            fprintf(stderr, "no test named %s\n", argv[a]);
+            return -1;
+        }
+    }
+
+    for (size_t t = 0; t < numTests; t++) {
+        bool selected = (argc == 1);
+        for (int a = 1; a < argc; a++) {
+            selected = selected || !strcmp(argv[a], tests[t].name);
+        }
+        if (!selected) {
+            continue;
+        }
+
+        printf("%s\n", tests[t].name);
+        if (tests[t].run() != 0) {
+            printf("%s FAILED\n", tests[t].name);
+            failed++;
+        }
+    }
+
+    return failed ? 1 : 0;
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E N D   O F   F I L E
+\*-------------------------------------------------------------------------------------------------*/
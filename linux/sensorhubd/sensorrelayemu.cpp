@@ -0,0 +1,669 @@
+/* Open Sensor Platform Project
+ * https://github.com/sensorplatforms/open-sensor-platform
+ *
+ * Copyright (C) 2013 Sensor Platforms Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * sensorrelay-emulator: userspace stand-in for the sensor relay kernel module.
+ *
+ * Creates the relay buffers and their .produced/.consumed companions as plain files (put them on
+ * a tmpfs) plus a wakeup FIFO, then writes sensor_relay_broadcast_node records at the requested
+ * rates. Run sensorhubd against it with
+ *
+ *      sensorhubd -r <dir>/sensor_relay_kernel -w <dir>/sensor_relay_wakeup
+ *
+ * With -l the emulator also reads the daemon's accelerometer uinput device and reports the
+ * end-to-end latency from node write to uinput frame, together with the achieved throughput.
+ *
+ * With -p the emulator reports the daemon's wakeups (voluntary context switches of all its
+ * threads) and CPU time over the run. -W makes that a benchmark: an idle phase with no sensor data
+ * followed by a phase of accelerometer nodes at 1 kHz, -t seconds each. Instead of -p the daemon
+ * command line can follow "--"; the emulator then starts the daemon itself once the relay files
+ * exist and stops it at the end:
+ *
+ *      sensorrelay-emulator -d <dir> -W -- sensorhubd -r <dir>/sensor_relay_kernel \
+ *              -w <dir>/sensor_relay_wakeup
+ */
+/*-------------------------------------------------------------------------------------------------*\
+ |    I N C L U D E   F I L E S
+\*-------------------------------------------------------------------------------------------------*/
+#include <climits>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <csignal>
+
+#include <unistd.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <linux/input.h>
+
+#include "sensor_relay.h"
+
+extern "C" {
+#include "uinpututils.h"
+}
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   C O N S T A N T S   &   M A C R O S
+\*-------------------------------------------------------------------------------------------------*/
+#define EMU_DEFAULT_DIR                 "/tmp/sensor_relay"
+#define EMU_BUFFER_NAME                 "sensor_relay_kernel"
+#define EMU_WAKEUP_NAME                 "sensor_relay_wakeup"
+#define EMU_MAX_CPUS                    16
+#define EMU_NUM_SENSORS                 3
+#define EMU_LATENCY_DEVICE              "osp-accelerometer"
+
+#define EMU_LOADED_RATE_HZ              1000
+#define EMU_DAEMON_SETTLE_SEC           2   /* startup of a daemon we launched, not measured */
+
+#define NSEC_PER_SEC                    1000000000LL
+#define NSEC_PER_USEC                   1000LL
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E   T Y P E   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+typedef struct {
+    union sensor_relay_broadcast_node *pNodes;
+    int bufferFd;
+    int producedFd;
+    int consumedFd;
+    uint64_t written;       //!< nodes written since start
+    uint64_t consumed;      //!< sum of the counts the daemon appended to .consumed
+    uint64_t overruns;      //!< nodes dropped because the daemon fell a full buffer behind
+} EmuCpuBuffer_t;
+
+typedef struct {
+    uint8_t sensorId;
+    const char* name;
+    unsigned int rateHz;
+    int64_t periodNs;
+    int64_t nextDueNs;
+    uint64_t generated;
+} EmuSensor_t;
+
+typedef struct {
+    uint64_t frames;
+    int64_t sumNs;
+    int64_t maxNs;
+} EmuLatency_t;
+
+typedef struct {
+    uint64_t wakeups;       //!< voluntary context switches, each one a sleep the daemon woke from
+    uint64_t cpuTicks;      //!< user + system time in clock ticks
+} EmuDaemonLoad_t;
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    S T A T I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+static EmuCpuBuffer_t _cpuBuffers[EMU_MAX_CPUS];
+static unsigned int _numCpus = 1;
+static EmuSensor_t _sensors[EMU_NUM_SENSORS] = {
+    { SENSOR_ACCELEROMETER,  "accel", 200, 0, 0, 0 },
+    { SENSOR_MAGNETIC_FIELD, "mag",   50,  0, 0, 0 },
+    { SENSOR_GYROSCOPE,      "gyro",  200, 0, 0, 0 },
+};
+static unsigned int _tickUsec = 24;
+static unsigned int _batch = 1;
+static int _wakeupFd = -1;
+static volatile sig_atomic_t _running = 1;
+
+static int _latencyFd = -1;
+static EmuLatency_t _latency;
+
+static pid_t _daemonPid;
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    F O R W A R D   F U N C T I O N   D E C L A R A T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C   V A R I A B L E S   D E F I N I T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P R I V A T E     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      _nowNs
+ *          Monotonic time in nanoseconds; the same clock the node time stamps are derived from
+ *
+ ***************************************************************************************************/
+static int64_t _nowNs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+}
+
+
+/****************************************************************************************************
+ * @fn      _onQuitSignal
+ *          SIGINT/SIGTERM handler
+ *
+ ***************************************************************************************************/
+static void _onQuitSignal(int signum)
+{
+    _running = 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      _createCpuBuffer
+ *          Creates the relay buffer of one CPU and its produced/consumed control files
+ *
+ ***************************************************************************************************/
+static int _createCpuBuffer(const char* dir, unsigned int cpu)
+{
+    const size_t bufferSize =
+            sizeof(union sensor_relay_broadcast_node) * SENSOR_RELAY_NUM_RELAY_BUFFERS;
+    EmuCpuBuffer_t* pBuffer = &_cpuBuffers[cpu];
+    char path[256];
+    size_t zero = 0;
+
+    memset(pBuffer, 0, sizeof(*pBuffer));
+
+    snprintf(path, sizeof(path), "%s/" EMU_BUFFER_NAME "%u", dir, cpu);
+    pBuffer->bufferFd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if ((pBuffer->bufferFd < 0) || (ftruncate(pBuffer->bufferFd, bufferSize) < 0)) {
+        fprintf(stderr, "Unable to create %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    pBuffer->pNodes = (union sensor_relay_broadcast_node*)mmap(
+                NULL, bufferSize, PROT_READ | PROT_WRITE, MAP_SHARED, pBuffer->bufferFd, 0);
+    if (pBuffer->pNodes == MAP_FAILED) {
+        fprintf(stderr, "Unable to mmap %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    snprintf(path, sizeof(path), "%s/" EMU_BUFFER_NAME "%u.produced", dir, cpu);
+    pBuffer->producedFd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if ((pBuffer->producedFd < 0) ||
+        (pwrite(pBuffer->producedFd, &zero, sizeof(zero), 0) != sizeof(zero))) {
+        fprintf(stderr, "Unable to create %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    //the daemon appends one size_t per drain; we read them back from our own file offset
+    snprintf(path, sizeof(path), "%s/" EMU_BUFFER_NAME "%u.consumed", dir, cpu);
+    pBuffer->consumedFd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (pBuffer->consumedFd < 0) {
+        fprintf(stderr, "Unable to create %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      _updateConsumed
+ *          Picks up the consumed counts the daemon wrote since the last call
+ *
+ ***************************************************************************************************/
+static void _updateConsumed(EmuCpuBuffer_t* pBuffer)
+{
+    size_t counts[64];
+    ssize_t bytesRead;
+
+    while ((bytesRead = read(pBuffer->consumedFd, counts, sizeof(counts))) > 0) {
+        for (size_t i = 0; i < (size_t)bytesRead / sizeof(size_t); i++) {
+            pBuffer->consumed += counts[i];
+        }
+        //never split a count across two reads
+        if (bytesRead % sizeof(size_t)) {
+            lseek(pBuffer->consumedFd, -(bytesRead % sizeof(size_t)), SEEK_CUR);
+            break;
+        }
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      _writeNode
+ *          Appends one motion sensor node to a CPU buffer. Like relay-fs in no-overwrite mode the
+ *          node is dropped when the reader is a full buffer behind. Returns true if written
+ *
+ ***************************************************************************************************/
+static bool _writeNode(EmuCpuBuffer_t* pBuffer, const EmuSensor_t* pSensor, int64_t nowNs)
+{
+    union sensor_relay_broadcast_node* pNode;
+    size_t produced;
+
+    if (pBuffer->written - pBuffer->consumed >= SENSOR_RELAY_NUM_RELAY_BUFFERS) {
+        _updateConsumed(pBuffer);
+        if (pBuffer->written - pBuffer->consumed >= SENSOR_RELAY_NUM_RELAY_BUFFERS) {
+            pBuffer->overruns++;
+            return false;
+        }
+    }
+
+    pNode = &pBuffer->pNodes[pBuffer->written % SENSOR_RELAY_NUM_RELAY_BUFFERS];
+    memset(pNode, 0, sizeof(*pNode));
+    pNode->sensorData.sensorId = pSensor->sensorId;
+    pNode->sensorData.TimeStamp = (uint64_t)nowNs / (_tickUsec * NSEC_PER_USEC);
+    pNode->sensorData.Data[0] = (int16_t)(pSensor->generated & 0x7fff);
+    pNode->sensorData.Data[1] = (int16_t)-(int16_t)(pSensor->generated & 0x7fff);
+    pNode->sensorData.Data[2] = (int16_t)pSensor->sensorId;
+    pBuffer->written++;
+
+    //the kernel reports the index of the last sub-buffer produced, not a count
+    produced = pBuffer->written - 1;
+    pwrite(pBuffer->producedFd, &produced, sizeof(produced), 0);
+
+    return true;
+}
+
+
+/****************************************************************************************************
+ * @fn      _signalWakeup
+ *          Emits the ABS_VOLUME event the relay driver raises when data was produced
+ *
+ ***************************************************************************************************/
+static void _signalWakeup(void)
+{
+    struct input_event event;
+
+    memset(&event, 0, sizeof(event));
+    event.type = EV_ABS;
+    event.code = ABS_VOLUME;
+    event.value = 1;
+
+    //a full FIFO means the daemon has not caught up yet and a wakeup is already pending
+    if ((write(_wakeupFd, &event, sizeof(event)) < 0) && (errno != EAGAIN)) {
+        fprintf(stderr, "wakeup write failed: %s\n", strerror(errno));
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      _measureLatency
+ *          Latency thread entry. Decodes the sample time stamp the daemon puts in ABS_MISC (low 32
+ *          bits) and compares it with the arrival time of the uinput frame
+ *
+ ***************************************************************************************************/
+static void *_measureLatency(void *pData)
+{
+    struct input_event events[64];
+    ssize_t bytesRead;
+
+    while (_running) {
+        bytesRead = read(_latencyFd, events, sizeof(events));
+        if (bytesRead <= 0) {
+            if ((bytesRead < 0) && (errno == EINTR)) {
+                continue;
+            }
+            break;
+        }
+
+        const uint32_t nowLow = (uint32_t)_nowNs();
+        for (size_t i = 0; i < (size_t)bytesRead / sizeof(struct input_event); i++) {
+            if ((events[i].type != EV_ABS) || (events[i].code != ABS_MISC)) {
+                continue;
+            }
+            //modulo 2^32 ns, so good for latencies up to ~2s. Includes up to one relay tick of
+            //time stamp truncation
+            const int64_t latencyNs = (int32_t)(nowLow - (uint32_t)events[i].value);
+
+            _latency.frames++;
+            _latency.sumNs += latencyNs;
+            if (latencyNs > _latency.maxNs) {
+                _latency.maxNs = latencyNs;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      _readDaemonLoad
+ *          Sums wakeups and CPU time over all threads of the daemon. Returns -1 if it is gone
+ *
+ ***************************************************************************************************/
+static int _readDaemonLoad(EmuDaemonLoad_t* pLoad)
+{
+    char path[300];
+    char line[512];
+    struct dirent* pEntry;
+    DIR* pTasks;
+
+    memset(pLoad, 0, sizeof(*pLoad));
+    snprintf(path, sizeof(path), "/proc/%d/task", (int)_daemonPid);
+    if ((pTasks = opendir(path)) == NULL) {
+        return -1;
+    }
+
+    while ((pEntry = readdir(pTasks)) != NULL) {
+        unsigned long long utime, stime, switches;
+        FILE* pFile;
+
+        if (pEntry->d_name[0] == '.') {
+            continue;
+        }
+
+        snprintf(path, sizeof(path), "/proc/%d/task/%s/stat", (int)_daemonPid, pEntry->d_name);
+        if ((pFile = fopen(path, "r")) != NULL) {
+            //fields 14 and 15; skip past the command name, which may contain spaces
+            const char* pFields = NULL;
+            if (fgets(line, sizeof(line), pFile) != NULL) {
+                pFields = strrchr(line, ')');
+            }
+            if ((pFields != NULL) &&
+                (sscanf(pFields + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+                        &utime, &stime) == 2)) {
+                pLoad->cpuTicks += utime + stime;
+            }
+            fclose(pFile);
+        }
+
+        snprintf(path, sizeof(path), "/proc/%d/task/%s/status", (int)_daemonPid, pEntry->d_name);
+        if ((pFile = fopen(path, "r")) != NULL) {
+            while (fgets(line, sizeof(line), pFile) != NULL) {
+                if (sscanf(line, "voluntary_ctxt_switches: %llu", &switches) == 1) {
+                    pLoad->wakeups += switches;
+                }
+            }
+            fclose(pFile);
+        }
+    }
+    closedir(pTasks);
+
+    return 0;
+}
+
+
+/****************************************************************************************************
+ * @fn      _reportDaemonLoad
+ *          Prints the daemon's wakeups and CPU time per second between two readings
+ *
+ ***************************************************************************************************/
+static void _reportDaemonLoad(const char* phase, const EmuDaemonLoad_t* pStart,
+                              const EmuDaemonLoad_t* pEnd, double elapsedSec)
+{
+    const double cpuSec = (double)(pEnd->cpuTicks - pStart->cpuTicks) / sysconf(_SC_CLK_TCK);
+
+    printf("  daemon %-8s %8.1f wakeups/s  %7.2f ms CPU/s (%.2f%%)\n", phase,
+           (pEnd->wakeups - pStart->wakeups) / elapsedSec, cpuSec * 1000.0 / elapsedSec,
+           cpuSec * 100.0 / elapsedSec);
+}
+
+
+/****************************************************************************************************
+ * @fn      _emulate
+ *          Writes nodes at the configured rates for durationSec seconds (0: until interrupted) and
+ *          returns the time it ran
+ *
+ ***************************************************************************************************/
+static double _emulate(unsigned int durationSec)
+{
+    const int64_t startNs = _nowNs();
+    const int64_t endNs = durationSec ? startNs + durationSec * NSEC_PER_SEC : LLONG_MAX;
+    unsigned int pendingNodes = 0;
+    unsigned int nextCpu = 0;
+
+    for (int i = 0; i < EMU_NUM_SENSORS; i++) {
+        _sensors[i].periodNs = _sensors[i].rateHz ? NSEC_PER_SEC / _sensors[i].rateHz : 0;
+        _sensors[i].nextDueNs = startNs;
+    }
+
+    while (_running) {
+        int64_t nowNs = _nowNs();
+        int64_t wakeNs = endNs;
+
+        if (nowNs >= endNs) {
+            break;
+        }
+
+        for (int i = 0; i < EMU_NUM_SENSORS; i++) {
+            EmuSensor_t* pSensor = &_sensors[i];
+
+            if (pSensor->periodNs == 0) {
+                continue;
+            }
+            while (pSensor->nextDueNs <= nowNs) {
+                //spread the nodes over the CPU buffers like interrupts landing on different CPUs
+                if (_writeNode(&_cpuBuffers[nextCpu], pSensor, nowNs)) {
+                    pSensor->generated++;
+                    pendingNodes++;
+                }
+                nextCpu = (nextCpu + 1) % _numCpus;
+                pSensor->nextDueNs += pSensor->periodNs;
+            }
+            if (pSensor->nextDueNs < wakeNs) {
+                wakeNs = pSensor->nextDueNs;
+            }
+        }
+
+        if (pendingNodes >= _batch) {
+            _signalWakeup();
+            pendingNodes = 0;
+        }
+
+        struct timespec wake;
+        wake.tv_sec = wakeNs / NSEC_PER_SEC;
+        wake.tv_nsec = wakeNs % NSEC_PER_SEC;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+    }
+
+    return (double)(_nowNs() - startNs) / NSEC_PER_SEC;
+}
+
+
+/****************************************************************************************************
+ * @fn      _usage
+ *          Prints the command line options
+ *
+ ***************************************************************************************************/
+static void _usage(const char* progName)
+{
+    fprintf(stderr,
+            "Usage: %s [-d dir] [-n cpus] [-a hz] [-m hz] [-g hz] [-k tick_us] [-b batch]\n"
+            "          [-t seconds] [-l] [-p daemon_pid | -W] [-- daemon command]\n"
+            "  -d  directory for the relay files, preferably on tmpfs (" EMU_DEFAULT_DIR ")\n"
+            "  -n  number of per-CPU relay buffers (1)\n"
+            "  -a/-m/-g  accelerometer/magnetometer/gyroscope rate in Hz, 0 disables (200/50/200)\n"
+            "  -k  relay time stamp tick in us, must match protocol.relay_tick_us (24)\n"
+            "  -b  nodes written per wakeup event (1)\n"
+            "  -t  run time in seconds, 0 runs until interrupted (10)\n"
+            "  -l  measure latency on the daemon's " EMU_LATENCY_DEVICE " device\n"
+            "  -p  report wakeups and CPU time of the daemon with this pid\n"
+            "  -W  with -p or a daemon command: idle, then %d Hz accelerometer, -t seconds each\n",
+            progName, EMU_LOADED_RATE_HZ);
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    P U B L I C     F U N C T I O N S
+\*-------------------------------------------------------------------------------------------------*/
+
+/****************************************************************************************************
+ * @fn      main
+ *          Application entry point
+ *
+ ***************************************************************************************************/
+int main(int argc, char** argv)
+{
+    const char* dir = EMU_DEFAULT_DIR;
+    unsigned int durationSec = 10;
+    bool measureLatency = false;
+    bool wakeupBenchmark = false;
+    pthread_t latencyThread;
+    char path[256];
+    int option;
+
+    while ((option = getopt(argc, argv, "d:n:a:m:g:k:b:t:lp:Wh")) != -1) {
+        switch (option) {
+        case 'd': dir = optarg; break;
+        case 'n': _numCpus = strtoul(optarg, NULL, 0); break;
+        case 'a': _sensors[0].rateHz = strtoul(optarg, NULL, 0); break;
+        case 'm': _sensors[1].rateHz = strtoul(optarg, NULL, 0); break;
+        case 'g': _sensors[2].rateHz = strtoul(optarg, NULL, 0); break;
+        case 'k': _tickUsec = strtoul(optarg, NULL, 0); break;
+        case 'b': _batch = strtoul(optarg, NULL, 0); break;
+        case 't': durationSec = strtoul(optarg, NULL, 0); break;
+        case 'l': measureLatency = true; break;
+        case 'p': _daemonPid = strtol(optarg, NULL, 0); break;
+        case 'W': wakeupBenchmark = true; break;
+        default:
+            _usage(argv[0]);
+            return (option == 'h') ? 0 : -1;
+        }
+    }
+
+    if ((_numCpus < 1) || (_numCpus > EMU_MAX_CPUS) || (_tickUsec == 0) || (_batch == 0) ||
+        (wakeupBenchmark && (((_daemonPid <= 0) && (optind == argc)) || (durationSec == 0)))) {
+        _usage(argv[0]);
+        return -1;
+    }
+
+    mkdir(dir, 0755);
+    for (unsigned int cpu = 0; cpu < _numCpus; cpu++) {
+        if (_createCpuBuffer(dir, cpu) < 0) {
+            return -1;
+        }
+    }
+
+    //Opened read-write: never blocks waiting for the daemon and never sees EPIPE
+    snprintf(path, sizeof(path), "%s/" EMU_WAKEUP_NAME, dir);
+    unlink(path);
+    if ((mkfifo(path, 0666) < 0) || ((_wakeupFd = open(path, O_RDWR | O_NONBLOCK)) < 0)) {
+        fprintf(stderr, "Unable to create wakeup FIFO %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    if (optind < argc) {
+        _daemonPid = fork();
+        if (_daemonPid == 0) {
+            execvp(argv[optind], &argv[optind]);
+            fprintf(stderr, "Unable to start %s: %s\n", argv[optind], strerror(errno));
+            _exit(127);
+        }
+        if (_daemonPid < 0) {
+            fprintf(stderr, "Unable to start %s: %s\n", argv[optind], strerror(errno));
+            return -1;
+        }
+        sleep(EMU_DAEMON_SETTLE_SEC);
+    } else {
+        printf("relay emulator ready, start the daemon with:\n"
+               "  sensorhubd -r %s/" EMU_BUFFER_NAME " -w %s\n", dir, path);
+    }
+
+    if (measureLatency) {
+        printf("waiting for " EMU_LATENCY_DEVICE "...\n");
+        while (_running && ((_latencyFd = openInputEventDevice(EMU_LATENCY_DEVICE)) < 0)) {
+            sleep(1);
+        }
+        if ((_latencyFd >= 0) &&
+            (pthread_create(&latencyThread, NULL, _measureLatency, NULL) != 0)) {
+            fprintf(stderr, "Unable to start latency thread\n");
+            return -1;
+        }
+    }
+
+    //no SA_RESTART, so the signal also breaks the latency thread out of its read()
+    struct sigaction quitAction;
+    memset(&quitAction, 0, sizeof(quitAction));
+    quitAction.sa_handler = _onQuitSignal;
+    sigaction(SIGINT, &quitAction, NULL);
+    sigaction(SIGTERM, &quitAction, NULL);
+
+    double elapsedSec;
+
+    if (wakeupBenchmark) {
+        EmuDaemonLoad_t start, end;
+
+        printf("daemon %d wakeups and CPU time, %us per phase\n", (int)_daemonPid, durationSec);
+        for (int i = 0; i < EMU_NUM_SENSORS; i++) {
+            _sensors[i].rateHz = 0;
+        }
+        _readDaemonLoad(&start);
+        elapsedSec = _emulate(durationSec);
+        if (_readDaemonLoad(&end) < 0) {
+            fprintf(stderr, "daemon %d is gone\n", (int)_daemonPid);
+            return -1;
+        }
+        _reportDaemonLoad("idle", &start, &end, elapsedSec);
+
+        _sensors[0].rateHz = EMU_LOADED_RATE_HZ;
+        start = end;
+        elapsedSec = _emulate(durationSec);
+        _readDaemonLoad(&end);
+        _reportDaemonLoad("1kHz", &start, &end, elapsedSec);
+    } else {
+        EmuDaemonLoad_t start, end;
+
+        if (_daemonPid > 0) {
+            _readDaemonLoad(&start);
+        }
+        elapsedSec = _emulate(durationSec);
+        if ((_daemonPid > 0) && (_readDaemonLoad(&end) == 0)) {
+            _reportDaemonLoad("run", &start, &end, elapsedSec);
+        }
+    }
+
+
+    //give the daemon a moment to drain what is in flight before stopping the measurement
+    if (_latencyFd >= 0) {
+        usleep(100000);
+        _running = 0;
+        pthread_kill(latencyThread, SIGINT);
+        pthread_join(latencyThread, NULL);
+    }
+
+    printf("ran %.2fs\n", elapsedSec);
+    for (int i = 0; i < EMU_NUM_SENSORS; i++) {
+        printf("  %-6s %10llu nodes  %8.1f/s\n", _sensors[i].name,
+               (unsigned long long)_sensors[i].generated,
+               _sensors[i].generated / elapsedSec);
+    }
+    for (unsigned int cpu = 0; cpu < _numCpus; cpu++) {
+        _updateConsumed(&_cpuBuffers[cpu]);
+        printf("  cpu%-3u %10llu written, %llu consumed, %llu overruns\n", cpu,
+               (unsigned long long)_cpuBuffers[cpu].written,
+               (unsigned long long)_cpuBuffers[cpu].consumed,
+               (unsigned long long)_cpuBuffers[cpu].overruns);
+    }
+    if (_latency.frames) {
+        printf("  %s: %llu frames (%.1f/s), latency mean %.1fus max %.1fus\n",
+               EMU_LATENCY_DEVICE, (unsigned long long)_latency.frames,
+               _latency.frames / elapsedSec,
+               _latency.sumNs / (_latency.frames * 1000.0), _latency.maxNs / 1000.0);
+    }
+
+    if (optind < argc) {
+        kill(_daemonPid, SIGTERM);
+        waitpid(_daemonPid, NULL, 0);
+    }
+
+    return 0;
+}
+
+
+/*-------------------------------------------------------------------------------------------------*\
+ |    E N D   O F   F I L E
+\*-------------------------------------------------------------------------------------------------*/
@@ -22,6 +22,10 @@
  * Author: Aristeu Sergio Rozanski Filho <aris@cathedrallabs.org>
  *
  * Changes/Revisions:
+ *	0.5	(sensorhubd copy: UI_DEV_SETUP, UI_ABS_SETUP and UI_GET_VERSION only)
+ *		- add UI_DEV_SETUP ioctl
+ *		- add UI_ABS_SETUP ioctl
+ *		- add UI_GET_VERSION ioctl
  *	0.3	24/05/2006 (Anssi Hannula <anssi.hannulagmail.com>)
  *		- update ff support for the changes in kernel interface
  *		- add UINPUT_VERSION
@@ -34,7 +38,7 @@
 
 #include <linux/input.h>
 
-#define UINPUT_VERSION		3
+#define UINPUT_VERSION		5
 
 
 struct uinput_ff_upload {
@@ -132,5 +136,33 @@ struct uinput_user_dev {
 	int absfuzz[ABS_MAX + 1];
 	int absflat[ABS_MAX + 1];
 };
+
+/*
+ * UI_DEV_SETUP - Set device parameters for setup
+ *
+ * Replaces the write() of struct uinput_user_dev for the device identity; the absolute axes
+ * are set up with UI_ABS_SETUP. Issued before UI_DEV_CREATE.
+ */
+struct uinput_setup {
+	struct input_id id;
+	char name[UINPUT_MAX_NAME_SIZE];
+	__u32 ff_effects_max;
+};
+#define UI_DEV_SETUP		_IOW(UINPUT_IOCTL_BASE, 3, struct uinput_setup)
+
+/*
+ * UI_ABS_SETUP - Set absolute axis information for the device to setup
+ *
+ * The axis must also be enabled with UI_SET_ABSBIT.
+ */
+struct uinput_abs_setup {
+	__u16 code; /* axis code */
+	/* __u16 filler; */
+	struct input_absinfo absinfo;
+};
+#define UI_ABS_SETUP		_IOW(UINPUT_IOCTL_BASE, 4, struct uinput_abs_setup)
+
+/* UI_GET_VERSION - Return the UINPUT_VERSION of the running kernel, 5 or later */
+#define UI_GET_VERSION		_IOR(UINPUT_IOCTL_BASE, 45, unsigned int)
 #endif	/* __UINPUT_H_ */
 
@@ -25,6 +25,8 @@
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
 
 #include <linux/input.h>
 #include <linux/types.h>
@@ -48,6 +50,8 @@
 #define BUS_VIRTUAL 6
 #endif // BUS_VIRTUAL
 
+#define VSDM_WRITEV_MAX_FRAMES          64  /* frames of a backlog written per writev() */
+
 
 /*-------------------------------------------------------------------------------------------------*\
  |    P R I V A T E   T Y P E   D E F I N I T I O N S
@@ -84,6 +88,207 @@ void VirtualSensorDeviceManager::fatalErrorIf(bool condition, int code, const ch
 
 
 
+/****************************************************************************************************
+ * @fn      buildFrame
+ *          Fills in the axis, ABS_MISC (low 32 bits of time) and EV_SYN (high 32 bits of time)
+ *          events of one sample. Returns the number of events used
+ *
+ ***************************************************************************************************/
+int VirtualSensorDeviceManager::buildFrame(input_event* events, const int32_t data[],
+                                           const int64_t timeNanoSec, int numAxis) {
+    int i;
+
+    if (numAxis > VSDM_MAX_AXIS) {
+        LOG_Err("%s: %d axis requested, only %d published\n", __FUNCTION__, numAxis, VSDM_MAX_AXIS);
+        numAxis = VSDM_MAX_AXIS;
+    }
+
+    memset(events, 0, sizeof(input_event) * (numAxis + 2));
+
+    for (i = 0; i < numAxis; i++) {
+        events[i].type = EV_ABS;
+        events[i].code = ABS_X + i;
+        events[i].value = data[i];
+    }
+
+    events[i].type = EV_ABS;
+    events[i].code = ABS_MISC;
+    events[i].value = (uint32_t)(timeNanoSec & 0xFFFFFFFF);
+    i++;
+
+    events[i].type = EV_SYN;
+    events[i].value = (uint32_t)(timeNanoSec >> 32);
+    i++;
+
+    return i;
+}
+
+
+/****************************************************************************************************
+ * @fn      enqueue
+ *          Appends whole frames (each ending in EV_SYN) to a device's backlog, applying its
+ *          overflow policy: drop-oldest devices drop their oldest frame, never-drop ones refuse the
+ *          new frame at VSDM_NEVER_DROP_MAX_FRAMES. Called with _outputLock held
+ *
+ ***************************************************************************************************/
+void VirtualSensorDeviceManager::enqueue(int deviceFd, Device_t* pDevice,
+                                         const input_event* events, size_t numEvents) {
+    size_t start = 0;
+
+    for (size_t i = 0; i < numEvents; i++) {
+        if ((events[i].type != EV_SYN) && (i + 1 < numEvents)) {
+            continue;
+        }
+
+        Frame_t frame;
+        frame.numEvents = i + 1 - start;
+        if (frame.numEvents > VSDM_MAX_EVENTS_PER_FRAME) {
+            frame.numEvents = VSDM_MAX_EVENTS_PER_FRAME;
+        }
+        memcpy(frame.events, &events[start], frame.numEvents * sizeof(input_event));
+        start = i + 1;
+
+        if ((pDevice->policy == VSDM_DROP_OLDEST) &&
+            (pDevice->backlog.size() >= pDevice->maxFrames)) {
+            //a frame the device has seen part of must be completed, drop the one after it
+            if (pDevice->headWritten == 0) {
+                pDevice->backlog.pop_front();
+                pDevice->dropped++;
+            } else if (pDevice->backlog.size() > 1) {
+                pDevice->backlog.erase(pDevice->backlog.begin() + 1);
+                pDevice->dropped++;
+            }
+        } else if ((pDevice->policy == VSDM_NEVER_DROP) &&
+                   (pDevice->backlog.size() >= VSDM_NEVER_DROP_MAX_FRAMES)) {
+            pDevice->dropped++;
+            continue;
+        }
+        pDevice->backlog.push_back(frame);
+
+        if ((pDevice->policy == VSDM_NEVER_DROP) &&
+            (pDevice->backlog.size() == VSDM_NEVER_DROP_MAX_FRAMES)) {
+            LOG_Err("%s: uinput device %d holds %d unread frames, refusing new ones\n",
+                    __FUNCTION__, deviceFd, VSDM_NEVER_DROP_MAX_FRAMES);
+        }
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      drain
+ *          Writes a device's backlog until it is empty or the device would block, and keeps the
+ *          device on _writableFd exactly while a backlog remains. Called with _outputLock held
+ *
+ ***************************************************************************************************/
+void VirtualSensorDeviceManager::drain(int deviceFd, Device_t* pDevice) {
+    while (!pDevice->backlog.empty()) {
+        struct iovec iov[VSDM_WRITEV_MAX_FRAMES];
+        int count = 0;
+
+        for (std::deque<Frame_t>::iterator it = pDevice->backlog.begin();
+             (it != pDevice->backlog.end()) && (count < VSDM_WRITEV_MAX_FRAMES); ++it, ++count) {
+            const size_t skip = (count == 0) ? pDevice->headWritten : 0;
+
+            iov[count].iov_base = it->events + skip;
+            iov[count].iov_len = (it->numEvents - skip) * sizeof(input_event);
+        }
+
+        const ssize_t written = writev(deviceFd, iov, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN) {
+                LOG_Err("%s: uinput device %d: %s, dropping %u frames\n", __FUNCTION__, deviceFd,
+                        strerror(errno), (unsigned int)pDevice->backlog.size());
+                pDevice->dropped += pDevice->backlog.size();
+                pDevice->backlog.clear();
+                pDevice->headWritten = 0;
+            }
+            break;
+        }
+        if (written == 0) {
+            break;
+        }
+
+        size_t eventsWritten = written / sizeof(input_event);
+        while (eventsWritten > 0) {
+            const size_t remaining = pDevice->backlog.front().numEvents - pDevice->headWritten;
+
+            if (eventsWritten < remaining) {
+                pDevice->headWritten += eventsWritten;
+                break;
+            }
+            eventsWritten -= remaining;
+            pDevice->backlog.pop_front();
+            pDevice->headWritten = 0;
+        }
+    }
+
+    const bool wantWritable = !pDevice->backlog.empty();
+    if (wantWritable != pDevice->armed) {
+        struct epoll_event event;
+
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLOUT;
+        event.data.fd = deviceFd;
+        if (epoll_ctl(_writableFd, wantWritable ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, deviceFd,
+                      &event) == 0) {
+            pDevice->armed = wantWritable;
+        }
+    }
+}
+
+
+/****************************************************************************************************
+ * @fn      writeEvents
+ *          Writes an array of events to a uinput node with a single write(). Whatever the device
+ *          does not take right away is queued behind its backlog. Called with _outputLock held
+ *
+ ***************************************************************************************************/
+void VirtualSensorDeviceManager::writeEvents(int deviceFd, const input_event* events,
+                                             size_t numEvents) {
+    std::map<int, Device_t>::iterator it = _devices.find(deviceFd);
+    ssize_t written;
+
+    if (it == _devices.end()) {
+        LOG_Err("%s: %d is not a uinput device of ours\n", __FUNCTION__, deviceFd);
+        return;
+    }
+    Device_t* pDevice = &it->second;
+
+    if (!pDevice->backlog.empty()) {
+        enqueue(deviceFd, pDevice, events, numEvents);
+        drain(deviceFd, pDevice);
+        return;
+    }
+
+    do {
+        written = write(deviceFd, events, numEvents * sizeof(input_event));
+    } while ((written < 0) && (errno == EINTR));
+
+    if ((written < 0) && (errno != EAGAIN)) {
+        LOG_Err("%s: uinput device %d: %s\n", __FUNCTION__, deviceFd, strerror(errno));
+        for (size_t i = 0; i < numEvents; i++) {
+            pDevice->dropped += (events[i].type == EV_SYN);
+        }
+        return;
+    }
+
+    size_t eventsWritten = (written > 0) ? written / sizeof(input_event) : 0;
+    if (eventsWritten < numEvents) {
+        //the rest goes in the backlog from the start of the frame the device stopped in
+        size_t frameStart = eventsWritten;
+        while ((frameStart > 0) && (events[frameStart - 1].type != EV_SYN)) {
+            frameStart--;
+        }
+        enqueue(deviceFd, pDevice, &events[frameStart], numEvents - frameStart);
+        pDevice->headWritten = eventsWritten - frameStart;
+        drain(deviceFd, pDevice);
+    }
+}
+
+
 /*-------------------------------------------------------------------------------------------------*\
  |    P U B L I C     F U N C T I O N S
 \*-------------------------------------------------------------------------------------------------*/
@@ -96,6 +301,12 @@ void VirtualSensorDeviceManager::fatalErrorIf(bool condition, int code, const ch
 VirtualSensorDeviceManager::VirtualSensorDeviceManager( const int sleepus ):
     _sleepus(sleepus)
 {
+    pthread_mutex_init(&_outputLock, NULL);
+    _writableFd = epoll_create1(EPOLL_CLOEXEC);
+    if (_writableFd < 0) {
+        LOG_Err("%s: epoll_create1 failed: %s, uinput backlogs are not retried\n",
+                __FUNCTION__, strerror(errno));
+    }
 }
 
 /****************************************************************************************************
@@ -109,83 +320,165 @@ VirtualSensorDeviceManager::~VirtualSensorDeviceManager()
         ioctl(*it, UI_DEV_DESTROY);
         close(*it);
     }
+    if (_writableFd >= 0) {
+        close(_writableFd);
+    }
+    pthread_mutex_destroy(&_outputLock);
 }
 
 
 /****************************************************************************************************
- * @fn      createSensor
- *          Creates uinput node corresponding to the name
+ * @fn      setupDevice
+ *          Identity and axes of a device being created, through UI_DEV_SETUP and UI_ABS_SETUP
+ *          (uinput version 5 and later)
  *
  ***************************************************************************************************/
-int VirtualSensorDeviceManager::createSensor(const char* name, const char* physname,
-                                             int absMin, int absMax) {
-    int result =-1;
-    int status =-1;
+int VirtualSensorDeviceManager::setupDevice(int deviceFd, const char* name, int absMin,
+                                            int absMax, int numAxis) {
+    struct uinput_setup setup;
+    struct uinput_abs_setup absSetup;
+
+    for (int i = 0; i <= numAxis; i++) {
+        memset(&absSetup, 0, sizeof(absSetup));
+        //the axes, then ABS_MISC which carries the low half of the time stamp
+        absSetup.code = (i < numAxis) ? (ABS_X + i) : ABS_MISC;
+        absSetup.absinfo.minimum = (i < numAxis) ? absMin : INT_MIN;
+        absSetup.absinfo.maximum = (i < numAxis) ? absMax : INT_MAX;
+        if (ioctl(deviceFd, UI_ABS_SETUP, &absSetup) < 0) {
+            return -1;
+        }
+    }
+
+    memset(&setup, 0, sizeof(setup));
+    strncpy(setup.name, name, sizeof(setup.name) - 1);
+    setup.id.bustype = BUS_VIRTUAL;
+    setup.id.vendor = 0x0591;
+    setup.id.product = 0x1483;
+    setup.id.version = 1;
+
+    return ioctl(deviceFd, UI_DEV_SETUP, &setup);
+}
+
+
+/****************************************************************************************************
+ * @fn      setupLegacyDevice
+ *          Identity and axes of a device being created, through a write of uinput_user_dev for
+ *          kernels without UI_DEV_SETUP
+ *
+ ***************************************************************************************************/
+int VirtualSensorDeviceManager::setupLegacyDevice(int deviceFd, const char* name, int absMin,
+                                                  int absMax, int numAxis) {
     struct uinput_user_dev virtualSensorDev;
 
-    //struct uinput_user_dev virtualSensorDev;
     memset(&virtualSensorDev, 0, sizeof(struct uinput_user_dev));
-    result= open("/dev/uinput", O_WRONLY | O_NONBLOCK);
-    if (result < 0)
-        return -1;
-    strcpy(virtualSensorDev.name, name);
+    strncpy(virtualSensorDev.name, name, sizeof(virtualSensorDev.name) - 1);
 
     virtualSensorDev.id.bustype = BUS_VIRTUAL;
     virtualSensorDev.id.vendor = 0x0591;
     virtualSensorDev.id.product = 0x1483;
     virtualSensorDev.id.version = 1;
 
-    virtualSensorDev.absmin[ABS_X] = absMin;
-    virtualSensorDev.absmax[ABS_X] = absMax;
-    virtualSensorDev.absfuzz[ABS_X] = 0;
-    virtualSensorDev.absflat[ABS_X] = 0;
-    virtualSensorDev.absmin[ABS_Y] = absMin;
-    virtualSensorDev.absmax[ABS_Y] = absMax;
-    virtualSensorDev.absfuzz[ABS_Y] = 0;
-    virtualSensorDev.absflat[ABS_Y] = 0;
-    virtualSensorDev.absmin[ABS_Z] = absMin;
-    virtualSensorDev.absmax[ABS_Z] = absMax;
-    virtualSensorDev.absfuzz[ABS_Z] = 0;
-    virtualSensorDev.absflat[ABS_Z] = 0;
-
-    status= write(result, &virtualSensorDev, sizeof(struct uinput_user_dev));
-    fatalErrorIf(status != sizeof(struct uinput_user_dev), -1, "error setIup\n");
+    for (int i = 0; i < numAxis; i++) {
+        virtualSensorDev.absmin[ABS_X + i] = absMin;
+        virtualSensorDev.absmax[ABS_X + i] = absMax;
+    }
+    virtualSensorDev.absmin[ABS_MISC] = INT_MIN;
+    virtualSensorDev.absmax[ABS_MISC] = INT_MAX;
 
+    if (write(deviceFd, &virtualSensorDev, sizeof(struct uinput_user_dev)) !=
+        sizeof(struct uinput_user_dev)) {
+        return -1;
+    }
+    return 0;
+}
 
-    status= ioctl(result, UI_SET_EVBIT, EV_ABS);
-    fatalErrorIf(status < 0, -1, "error evbit abs\n");
 
-    status= ioctl(result, UI_SET_EVBIT, EV_REL);
-    fatalErrorIf(status < 0, -1, "error evbit rel\n");
+/****************************************************************************************************
+ * @fn      createSensor
+ *          Creates uinput node corresponding to the name. Only the event types and axes that
+ *          buildFrame() emits for numAxis are declared, so creation takes a handful of ioctls.
+ *          Returns the device fd, or -1 with nothing left open if any step failed
+ *
+ ***************************************************************************************************/
+int VirtualSensorDeviceManager::createSensor(const char* name, const char* physname,
+                                             int absMin, int absMax, int numAxis,
+                                             VsdmOverflowPolicy_t policy, size_t maxFrames) {
+    int result =-1;
+    int status =-1;
+    unsigned int version = 0;
+    const char* failedStep = NULL;
 
-    status= ioctl(result, UI_SET_EVBIT, EV_SYN);
-    fatalErrorIf(status < 0, -1, "error evbit syn\n");
+    if (numAxis > VSDM_MAX_AXIS) {
+        numAxis = VSDM_MAX_AXIS;
+    }
 
+    result= open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+    if (result < 0)
+        return -1;
 
-    for(int i = ABS_X; i <= ABS_MAX; i++) {
-        status= ioctl(result, UI_SET_ABSBIT, i);
-        fatalErrorIf(status < 0, -1, "error setabsbit %d\n");
+    //devices are also created lazily at runtime, so a failure is reported, not fatal
+    if (ioctl(result, UI_SET_EVBIT, EV_ABS) < 0) {
+        failedStep = "evbit abs";
+    } else if (ioctl(result, UI_SET_EVBIT, EV_SYN) < 0) {
+        failedStep = "evbit syn";
     }
-
-    for(int i = REL_X; i <= REL_MAX; i++) {
-        status= ioctl(result, UI_SET_RELBIT, i);
-        fatalErrorIf(status < 0, -1, "error setrelbit %d\n");
+    for (int i = 0; (failedStep == NULL) && (i < numAxis); i++) {
+        if (ioctl(result, UI_SET_ABSBIT, ABS_X + i) < 0) {
+            failedStep = "setabsbit";
+        }
+    }
+    if ((failedStep == NULL) && (ioctl(result, UI_SET_ABSBIT, ABS_MISC) < 0)) {
+        failedStep = "setabsbit misc";
     }
 
     //Set physical path name
-    status = ioctl(result, UI_SET_PHYS, physname);
-    fatalErrorIf(status < 0, -1, "error set phys\n");
+    if ((failedStep == NULL) && (ioctl(result, UI_SET_PHYS, physname) < 0)) {
+        failedStep = "set phys";
+    }
 
-    status= ioctl(result, UI_DEV_CREATE);
-    if (status < 0){
-        LOG_Err("Error on dev crate: %s", strerror(errno));
+    if (failedStep == NULL) {
+        if ((ioctl(result, UI_GET_VERSION, &version) == 0) && (version >= 5)) {
+            status = setupDevice(result, name, absMin, absMax, numAxis);
+        } else {
+            status = setupLegacyDevice(result, name, absMin, absMax, numAxis);
+        }
+        if (status < 0) {
+            failedStep = "setup";
+        } else if (ioctl(result, UI_DEV_CREATE) < 0) {
+            failedStep = "dev create";
+        }
     }
-    fatalErrorIf(status < 0, -1, "error create \n");
 
-    _deviceFds.push_back(result);
+    if (failedStep != NULL) {
+        LOG_Err("%s: %s: error %s: %s\n", __FUNCTION__, name, failedStep, strerror(errno));
+        close(result);
+        return -1;
+    }
 
-    return result;
+    return attachDevice(result, policy, maxFrames);
+}
 
+
+/****************************************************************************************************
+ * @fn      attachDevice
+ *          Takes an open, non-blocking node to publish to; createSensor() uses it for the uinput
+ *          nodes it creates, benchmarks for plain files and pipes. The manager closes it
+ *
+ ***************************************************************************************************/
+int VirtualSensorDeviceManager::attachDevice(int deviceFd, VsdmOverflowPolicy_t policy,
+                                             size_t maxFrames) {
+    //devices can be created while the publishing thread queues frames for the others
+    pthread_mutex_lock(&_outputLock);
+    _deviceFds.push_back(deviceFd);
+    Device_t& device = _devices[deviceFd];
+    device.policy = policy;
+    device.maxFrames = maxFrames;
+    device.headWritten = 0;
+    device.armed = false;
+    device.dropped = 0;
+    pthread_mutex_unlock(&_outputLock);
+
+    return deviceFd;
 }
 
 
@@ -195,10 +488,9 @@ int VirtualSensorDeviceManager::createSensor(const char* name, const char* physn
  *
  ***************************************************************************************************/
 void VirtualSensorDeviceManager::publish(int deviceFd, input_event event) {
-    int status;
-
-    status= write(deviceFd, &event, sizeof(event));
-    fatalErrorIf(status != sizeof(event), -1, "Error on send_event");
+    pthread_mutex_lock(&_outputLock);
+    writeEvents(deviceFd, &event, 1);
+    pthread_mutex_unlock(&_outputLock);
 }
 
 
@@ -209,74 +501,131 @@ void VirtualSensorDeviceManager::publish(int deviceFd, input_event event) {
  ***************************************************************************************************/
 void VirtualSensorDeviceManager::publish(int deviceFd, int* data,
                                          const unsigned int* const timeInMillis) {
-    struct input_event event;
-    int status;
+    struct input_event events[VSDM_MAX_EVENTS_PER_FRAME];
+    int numEvents = 0;
 
-    memset(&event, 0, sizeof(event));
-
-    event.type = EV_ABS;
+    memset(events, 0, sizeof(events));
 
     for (int i = 0; i < 3; i++) {
-        event.code = ABS_X + i;
-        event.value = data[i];
-        gettimeofday(&event.time, NULL);
-        status= write(deviceFd, &event, sizeof(event));
-        fatalErrorIf(status != sizeof(event), -1, "Error on send_event");
+        events[numEvents].type = EV_ABS;
+        events[numEvents].code = ABS_X + i;
+        events[numEvents].value = data[i];
+        gettimeofday(&events[numEvents].time, NULL);
+        numEvents++;
     }
 
     if (timeInMillis){
-        event.code = ABS_MISC;
-        memcpy(&event.value, timeInMillis, sizeof(event.value));//copying unsigned to signed here
-        status= write(deviceFd, &event, sizeof(event));
-        fatalErrorIf(status != sizeof(event), -1, "Error on send_event");
+        events[numEvents] = events[numEvents - 1];
+        events[numEvents].code = ABS_MISC;
+        memcpy(&events[numEvents].value, timeInMillis, sizeof(events[numEvents].value));//copying unsigned to signed here
+        numEvents++;
     }
 
-    memset(&event, 0, sizeof(event));
-    event.type = EV_SYN;
-    status= write(deviceFd, &event, sizeof(event));
-    fatalErrorIf(status != sizeof(event), -1, "Error on send_event");
+    events[numEvents].type = EV_SYN;
+    numEvents++;
 
-    return;
+    pthread_mutex_lock(&_outputLock);
+    writeEvents(deviceFd, events, numEvents);
+    pthread_mutex_unlock(&_outputLock);
 }
 
 
 /****************************************************************************************************
  * @fn      publish
- *          Publish events to the given uinput node file handle
+ *          Publish events to the given uinput node file handle. The whole frame (axes, ABS_MISC
+ *          and EV_SYN) goes out in a single write()
  *
  ***************************************************************************************************/
 void VirtualSensorDeviceManager::publish(int deviceFd, const int32_t data[],
                                          const int64_t timeNanoSec, int numAxis) {
-    struct input_event event;
-    int status;
-    int i;
+    struct input_event events[VSDM_MAX_EVENTS_PER_FRAME];
+    int numEvents;
+
+    numEvents = buildFrame(events, data, timeNanoSec, numAxis);
+    pthread_mutex_lock(&_outputLock);
+    writeEvents(deviceFd, events, numEvents);
+    pthread_mutex_unlock(&_outputLock);
+}
 
-    memset(&event, 0, sizeof(event));
 
-    event.type = EV_ABS;
-    for (i = 0; i < numAxis; i++) {
-        event.code = ABS_X + i;
-        event.value = data[i];
-        status= write(deviceFd, &event, sizeof(event));
-        fatalErrorIf(status != sizeof(event), -1, "Error on send_event");
+/****************************************************************************************************
+ * @fn      queue
+ *          Stage a frame for the given uinput node. Frames accumulate per device until flush() so
+ *          that a burst drained from one relay wakeup costs one write() per device
+ *
+ ***************************************************************************************************/
+void VirtualSensorDeviceManager::queue(int deviceFd, const int32_t data[],
+                                       const int64_t timeNanoSec, int numAxis) {
+    //the lookup races with createSensor() otherwise; the lock is uncontended in steady state
+    pthread_mutex_lock(&_outputLock);
+    std::map<int, Device_t>::iterator it = _devices.find(deviceFd);
+    if (it == _devices.end()) {
+        pthread_mutex_unlock(&_outputLock);
+        return;
+    }
+    std::vector<input_event>& pending = it->second.staged;
+    pthread_mutex_unlock(&_outputLock);
+
+    //staged is only touched by the flushing thread, and map nodes never move
+    const size_t used = pending.size();
+    pending.resize(used + VSDM_MAX_EVENTS_PER_FRAME);
+    pending.resize(used + buildFrame(&pending[used], data, timeNanoSec, numAxis));
+}
+
+
+/****************************************************************************************************
+ * @fn      flush
+ *          Write out all frames staged by queue()
+ *
+ ***************************************************************************************************/
+void VirtualSensorDeviceManager::flush() {
+    pthread_mutex_lock(&_outputLock);
+    for (std::map<int, Device_t>::iterator it = _devices.begin(); it != _devices.end(); ++it) {
+        std::vector<input_event>& staged = it->second.staged;
+
+        if (!staged.empty()) {
+            writeEvents(it->first, &staged[0], staged.size());
+            //clear() keeps the capacity so steady state bursts do not reallocate
+            staged.clear();
+        }
     }
+    pthread_mutex_unlock(&_outputLock);
+}
 
-    memset(&event, 0, sizeof(event));
 
-    event.type = EV_ABS;
-    event.code = ABS_MISC;
-    event.value = (uint32_t)(timeNanoSec & 0xFFFFFFFF);
-    status= write(deviceFd, &event, sizeof(event));
-    fatalErrorIf(status != sizeof(event), -1, "Error on send_event");
+/****************************************************************************************************
+ * @fn      retryWrites
+ *          Writes the backlogs of the devices that have one; called when getWritableFd() is
+ *          readable. May run on another thread than flush()
+ *
+ ***************************************************************************************************/
+void VirtualSensorDeviceManager::retryWrites() {
+    pthread_mutex_lock(&_outputLock);
+    for (std::map<int, Device_t>::iterator it = _devices.begin(); it != _devices.end(); ++it) {
+        if (it->second.armed) {
+            drain(it->first, &it->second);
+        }
+    }
+    pthread_mutex_unlock(&_outputLock);
+}
 
-    memset(&event, 0, sizeof(event));
 
-    event.type = EV_SYN;
-    event.value = (uint32_t)(timeNanoSec >> 32);
-    status= write(deviceFd, &event, sizeof(event));
-    fatalErrorIf(status != sizeof(event), -1, "Error on send_event");
+/****************************************************************************************************
+ * @fn      getDropped
+ *          Frames of a device lost to its overflow policy or to write errors
+ *
+ ***************************************************************************************************/
+uint64_t VirtualSensorDeviceManager::getDropped(int deviceFd) const {
+    uint64_t dropped = 0;
+
+    pthread_mutex_lock(&_outputLock);
+    std::map<int, Device_t>::const_iterator it = _devices.find(deviceFd);
+    if (it != _devices.end()) {
+        dropped = it->second.dropped;
+    }
+    pthread_mutex_unlock(&_outputLock);
 
-    return;
+    return dropped;
 }
 
 
@@ -22,38 +22,105 @@
  |    I N C L U D E   F I L E S
 \*-------------------------------------------------------------------------------------------------*/
 #include <stdint.h>
+#include <pthread.h>
 #include <vector>
+#include <deque>
+#include <map>
 #include <linux/input.h>
 
 
 /*-------------------------------------------------------------------------------------------------*\
  |    C O N S T A N T S   &   M A C R O S
 \*-------------------------------------------------------------------------------------------------*/
+/* Largest sample we publish (quaternion) plus the ABS_MISC and EV_SYN events of the frame */
+#define VSDM_MAX_AXIS                   4
+#define VSDM_MAX_EVENTS_PER_FRAME       (VSDM_MAX_AXIS + 2)
+/* Frames a drop-oldest device holds while its readers do not keep up, ~1 s at 200 Hz */
+#define VSDM_DEFAULT_MAX_FRAMES         256
+/* Hard cap of a never-drop device's queue, ~600 KB. Past it new frames are refused, for a reader
+   that stopped reading rather than for one that is slow */
+#define VSDM_NEVER_DROP_MAX_FRAMES      4096
 
 /*-------------------------------------------------------------------------------------------------*\
  |    T Y P E / C L A S S   D E F I N I T I O N S
 \*-------------------------------------------------------------------------------------------------*/
-//! manages the lifecycle of virtual sensor device file descriptors
+//! what a device does with new frames while its output queue is full
+typedef enum {
+    VSDM_DROP_OLDEST,       //!< continuous sensors: the newest samples are the useful ones
+    VSDM_NEVER_DROP,        //!< one-shot and on-change sensors: every event matters, up to
+                            //!< VSDM_NEVER_DROP_MAX_FRAMES queued
+} VsdmOverflowPolicy_t;
+
+//! manages the lifecycle of virtual sensor device file descriptors. Frames a device does not
+//! accept right away (EAGAIN) wait in its bounded output queue and are retried once the device
+//! is writable, see getWritableFd()
 class VirtualSensorDeviceManager
 {
 public:
     VirtualSensorDeviceManager( const int sleepus = 10000);
     ~VirtualSensorDeviceManager();
 
+    //! creates a device that reports numAxis axes (ABS_X onwards) plus the ABS_MISC time stamp.
+    //! May be called while other devices are being written. Returns -1 if it failed
     int createSensor(const char* name, const char* physname, int absMin =-2048,
-                     int absMax =2047);
+                     int absMax =2047, int numAxis = VSDM_MAX_AXIS,
+                     VsdmOverflowPolicy_t policy = VSDM_DROP_OLDEST,
+                     size_t maxFrames = VSDM_DEFAULT_MAX_FRAMES);
+    //! publishes to an already open node (file, pipe) instead of a uinput device it creates
+    int attachDevice(int deviceFd, VsdmOverflowPolicy_t policy = VSDM_DROP_OLDEST,
+                     size_t maxFrames = VSDM_DEFAULT_MAX_FRAMES);
     void publish(int deviceFd, input_event data);
     void publish(int deviceFd, int* data,
                  const unsigned int* const timeInMillis = 0);
     void publish(int deviceFd, const int32_t data[],
                  const int64_t time64, int numAxis=3);
 
+    //! stage a frame for deviceFd; nothing is written until flush()
+    void queue(int deviceFd, const int32_t data[],
+               const int64_t time64, int numAxis=3);
+    //! write all staged frames with one write() per device
+    void flush();
+
+    //! readable while a device with queued output has become writable; retryWrites() then
+    int getWritableFd() const { return _writableFd; }
+    void retryWrites();
+
+    //! frames dropped by a device's overflow policy, refused at its hard cap or lost to write
+    //! errors
+    uint64_t getDropped(int deviceFd) const;
+
 protected:
 
     void fatalErrorIf(bool condition, int code, const char* msg);
+    int buildFrame(input_event* events, const int32_t data[],
+                   const int64_t timeNanoSec, int numAxis);
+    void writeEvents(int deviceFd, const input_event* events, size_t numEvents);
+    int setupDevice(int deviceFd, const char* name, int absMin, int absMax, int numAxis);
+    int setupLegacyDevice(int deviceFd, const char* name, int absMin, int absMax, int numAxis);
 
 private:
+    typedef struct {
+        uint8_t numEvents;
+        input_event events[VSDM_MAX_EVENTS_PER_FRAME];
+    } Frame_t;
+
+    typedef struct {
+        VsdmOverflowPolicy_t policy;
+        size_t maxFrames;
+        std::vector<input_event> staged;    //!< queue() to flush(), flushing thread only
+        std::deque<Frame_t> backlog;        //!< frames the device has not accepted yet
+        size_t headWritten;                 //!< events of backlog.front() already written
+        bool armed;                         //!< waiting for EPOLLOUT on _writableFd
+        uint64_t dropped;
+    } Device_t;
+
+    void enqueue(int deviceFd, Device_t* pDevice, const input_event* events, size_t numEvents);
+    void drain(int deviceFd, Device_t* pDevice);
+
     std::vector<int> _deviceFds;
+    std::map<int, Device_t> _devices;       //!< devices are added under _outputLock
+    mutable pthread_mutex_t _outputLock;    //!< _devices; backlog, armed and dropped of each
+    int _writableFd;
     const int _sleepus;
 };
 